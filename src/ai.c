@@ -0,0 +1,138 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The CPU player. It is written for the right paddle; the left one
+ * plays on a mirrored field.
+ */
+
+#include <stddef.h>
+
+#include "ai.h"
+#include "bytes.h"
+
+#define MOVE_UP		-GAME_PADDLE_STEP
+#define MOVE_DOWN	GAME_PADDLE_STEP
+
+const AiParams ai_default = {
+	.rest_top = GAME_HEIGHT * 2/5,
+	.rest_bottom = GAME_HEIGHT * 3/5,
+	.engage_x = GAME_WIDTH * 2/3,
+	.fast_x = GAME_WIDTH * 3/5,
+	.fast_vx = 10,
+	.deadzone = 5,
+};
+
+const AiParam ai_param[AI_PARAMS_NO] = {
+	{ "rest_top", offsetof(AiParams, rest_top) },
+	{ "rest_bottom", offsetof(AiParams, rest_bottom) },
+	{ "engage_x", offsetof(AiParams, engage_x) },
+	{ "fast_x", offsetof(AiParams, fast_x) },
+	{ "fast_vx", offsetof(AiParams, fast_vx) },
+	{ "deadzone", offsetof(AiParams, deadzone) },
+};
+
+/* per thread: headless tools play different AIs side by side */
+static __thread const AiParams *use[2];
+
+void ai_use(const AiParams *left, const AiParams *right)
+{
+	use[0] = left;
+	use[1] = right;
+}
+
+const AiParams *ai_params(int p)
+{
+	return use[p] ? use[p] : &ai_default;
+}
+
+void ai_move(GameState *s, int p)
+{
+	ai_move_with(s, p, ai_params(p));
+}
+
+void ai_move_with(GameState *s, int p, const AiParams *a)
+{
+	u16 pbar, pbar_human;
+	s16 bx, by, px;
+	s8 vect_x, vect_y;
+
+	pbar = GAME_PADDLE_Y(s, p) + GAME_PADDLE_HEIGHT / 2;
+
+	if (s->phase != GAME_PLAYING) {
+		if (pbar < GAME_HEIGHT / 2)
+			game_paddle_move(s, p, MOVE_DOWN);
+		else if (pbar > GAME_HEIGHT / 2)
+			game_paddle_move(s, p, MOVE_UP);
+
+		return;
+	}
+
+	bx = s->ball.x;
+	by = s->ball.y;
+	vect_x = s->ball.vx;
+	vect_y = s->ball.vy;
+	px = GAME_PADDLE_X(1);
+
+	if (p == 0) {
+		bx = GAME_WIDTH - bx - GAME_BALL_SIZE;
+		vect_x = -vect_x;
+	}
+
+	if (vect_x < 0 && bx + GAME_BALL_SIZE <= a->engage_x) {
+		if (pbar <= a->rest_top)
+			game_paddle_move(s, p, MOVE_DOWN);
+		else if (pbar >= a->rest_bottom)
+			game_paddle_move(s, p, MOVE_UP);
+	}
+
+	if (vect_x > 0 && bx + GAME_BALL_SIZE + vect_x >= px) {
+		pbar_human = GAME_PADDLE_Y(s, !p) + GAME_PADDLE_HEIGHT / 2;
+		if (pbar_human > GAME_HEIGHT / 2)
+			game_paddle_move(s, p, MOVE_UP);
+		else
+			game_paddle_move(s, p, MOVE_DOWN);
+	}
+
+	if (vect_x < 0 && abs(vect_y) > vect_x && bx < a->engage_x)
+		return;
+
+	if ((vect_x < 0 && bx + GAME_BALL_SIZE / 2 <= a->engage_x) ||
+	    (vect_x < a->fast_vx && bx + GAME_BALL_SIZE / 2 <= a->fast_x))
+		return;
+
+	if (pbar + a->deadzone < by + GAME_BALL_SIZE / 2)
+		game_paddle_move(s, p, MOVE_DOWN);
+	else if (pbar - a->deadzone > by + GAME_BALL_SIZE / 2)
+		game_paddle_move(s, p, MOVE_UP);
+}
+
+void ai_pack(const AiParams *a, u8 *buf)
+{
+	int i;
+
+	for (i=0; i<AI_PARAMS_NO; ++i)
+		buf = put_le(buf, (u16)AI_PARAM(a, i), 2);
+}
+
+void ai_unpack(AiParams *a, const u8 *buf)
+{
+	int i;
+
+	for (i=0; i<AI_PARAMS_NO; ++i, buf+=2)
+		AI_PARAM(a, i) = (s16)get_le(buf, 2);
+}
@@ -0,0 +1,98 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef AI_H
+#define AI_H
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * What the CPU player does, as distances on the field; see ai.c. The
+ * right paddle's, the left one's being mirrored.
+ */
+typedef struct {
+	s16 rest_top;		/* the paddle's middle rests between these */
+	s16 rest_bottom;	/* ...while the ball goes away */
+	s16 engage_x;		/* the ball's middle is past this: follow it */
+	s16 fast_x;		/* ...or past this, if slower than fast_vx */
+	s16 fast_vx;
+	s16 deadzone;		/* off the ball's middle by more: move */
+} AiParams;
+
+#define AI_PARAMS_NO		6
+#define AI_PARAMS_LEN		(2 * AI_PARAMS_NO)	/* packed */
+
+/*
+ * Every parameter: its name in presets and where AiParams keeps it.
+ */
+typedef struct {
+	const char *name;
+	size_t      offset;
+} AiParam;
+
+extern const AiParam ai_param[AI_PARAMS_NO];
+
+/*
+ * Parameter `i' of the AiParams at `a'.
+ */
+#define AI_PARAM(A, I)	(*(s16 *)((u8 *)(A) + ai_param[I].offset))
+
+/*
+ * The parameters gnop always played with.
+ */
+extern const AiParams ai_default;
+
+/*
+ * Play paddle 0 with `left' and paddle 1 with `right' (NULL for
+ * ai_default) from now on in this thread.
+ */
+void ai_use (const AiParams *left, const AiParams *right);
+
+/*
+ * The parameters paddle `p' is played with in this thread.
+ */
+const AiParams *ai_params (int p);
+
+/*
+ * Let the CPU player move paddle `p' for the current tick.
+ */
+void ai_move (GameState *s, int p);
+
+/*
+ * Same with parameters `a'.
+ */
+void ai_move_with (GameState *s, int p, const AiParams *a);
+
+/*
+ * Read the preset `path', a line per parameter: its name and value, as
+ * written by ai_save(). Parameters left out keep their ai_default value.
+ */
+int  ai_load (const char *path, AiParams *a);
+
+/*
+ * Write `a' to the preset `path', after the comment line `note'.
+ */
+int  ai_save (const char *path, const AiParams *a, const char *note);
+
+/*
+ * Pack `a' into AI_PARAMS_LEN bytes, little-endian, and back.
+ */
+void ai_pack   (const AiParams *a, u8 *buf);
+void ai_unpack (AiParams *a, const u8 *buf);
+
+#endif /* !AI_H */
@@ -24,6 +24,9 @@
 
 #include "log.h"
 #include "audio.h"
+#include "mixer.h"
+#include "pak.h"
+#include "timeline.h"
 #include "engine.h"
 
 #define BOUNCE_FILE	"bounce.raw"
@@ -42,9 +45,11 @@
 
 static struct {
 	Mix_Chunk *chunk[AUDIO_SOUND_NO];
+	u8        *pcm[AUDIO_SOUND_NO];
 	u8	   vol;		/* [0-128] */
 	bool       inited;
 	bool       mute;
+	bool       mixer;	/* using our mixer instead of SDL_mixer */
 } audio;
 
 /*
@@ -64,9 +69,27 @@ INLINE static size_t get_file_size(FILE *stream)
 }
 
 /*
- * Load a sound.
+ * Hand `sz' bytes of raw samples over to the backend.
  */
-static int load_snd(AudioSound snd, const char *path)
+static int attach_snd(AudioSound snd, const u8 *buf, size_t sz)
+{
+	if (audio.mixer)
+		return mixer_load(snd, (const s16 *)buf, sz / sizeof(s16));
+
+	/* SDL_mixer does not write to quick-loaded samples */
+	audio.chunk[snd] = Mix_QuickLoad_RAW((u8 *)buf, sz);
+	if (!audio.chunk[snd]) {
+		log_err("could not load chunk: %s", SDL_GetError());
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Load a sound file.
+ */
+static int load_snd_file(AudioSound snd, const char *path)
 {
 	FILE *fp;
 	size_t sz;
@@ -85,52 +108,93 @@ static int load_snd(AudioSound snd, const char *path)
 	fread(buf, sz, 1, fp);
 	fclose(fp);
 
-	audio.chunk[snd] = Mix_QuickLoad_RAW(buf, sz);
-	if (!audio.chunk[snd]) {
-		log_err("could not load chunk: %s", SDL_GetError());
+	audio.pcm[snd] = buf;
+
+	return attach_snd(snd, buf, sz);
+}
+
+/*
+ * Load a sound, from the asset pack if one is open.
+ */
+static int load_snd(AudioSound snd, const char *datadir, const char *name)
+{
+	char path[PATH_MAX];
+	const u8 *data;
+	u32 sz;
+
+	data = pak_find(name, &sz);
+	if (data)
+		return attach_snd(snd, data, sz);
+
+	if (!join_path(datadir, name, path))
+		return -1;
+
+	return load_snd_file(snd, path);
+}
+
+/*
+ * Open the device through SDL_mixer.
+ */
+static int open_sdl_mixer(void)
+{
+	char buf[32];
+
+	if (Mix_OpenAudio(AUDIO_FREQ, AUDIO_FMT, AUDIO_CHANNELS, CHUNKSZ)) {
+		log_err("could not open audio: %s", Mix_GetError());
 		return -1;
 	}
 
-	audio.chunk[snd]->volume = VOLUME_START;
+	Mix_AllocateChannels(4);
+
+	SDL_AudioDriverName(buf, sizeof(buf));
+	log_info("driver audio: %s", buf);
 
 	return 0;
 }
 
+/*
+ * Apply current volume.
+ */
+static void set_volume(void)
+{
+	if (audio.mixer)
+		mixer_set_volume(audio.vol);
+	else
+		Mix_Volume(-1, audio.vol);
+}
+
 /*
  * Initialize audio subsystem.
  */
-int audio_init(const char *datadir)
+int audio_init(const char *datadir, u16 frames)
 {
-	char buf[PATH_MAX];
+	int span, retv;
 
 	if (audio.inited) {
 		log_warn("audio: subsystem seems already initialized");
 		return 1;
 	}
 
-	if (Mix_OpenAudio(AUDIO_FREQ, AUDIO_FMT, AUDIO_CHANNELS, CHUNKSZ)) {
-		log_err("could not open audio: %s", Mix_GetError());
-		return -1;
-	}
+	audio.mixer = frames != 0;
 
-	Mix_AllocateChannels(4);
+	span = timeline_begin("audio device");
+	retv = audio.mixer ? mixer_init(frames) : open_sdl_mixer();
+	timeline_end(span);
 
-	SDL_AudioDriverName(buf, sizeof(buf));
-	log_info("driver audio: %s", buf);
+	if (retv)
+		return -1;
 
 	audio.vol = VOLUME_START;
+	set_volume();
 
 	if (!datadir)
 		datadir = DATADIR;
 
-	join_path(datadir, BOUNCE_FILE, buf);
-	load_snd(AUDIO_BOUNCE, buf);
-	
-	join_path(datadir, SCORED_FILE, buf);
-	load_snd(AUDIO_SCORED, buf);
-
-	join_path(datadir, GAMEOVER_FILE, buf);
-	load_snd(AUDIO_GAMEOVER, buf);
+	span = timeline_begin("sound load");
+	load_snd(AUDIO_BOUNCE, datadir, BOUNCE_FILE);
+	load_snd(AUDIO_SCORED, datadir, SCORED_FILE);
+	load_snd(AUDIO_GAMEOVER, datadir, GAMEOVER_FILE);
+	timeline_end(span);
 
 	audio.inited = 1;
 
@@ -145,13 +209,18 @@ void audio_quit(void)
 	int i;
 
 	if (audio.inited) {
+		if (audio.mixer)
+			mixer_quit();
+		else
+			Mix_CloseAudio();
+
 		for (i=0; i<AUDIO_SOUND_NO; ++i) {
-			free(audio.chunk[i]->abuf);
-			Mix_FreeChunk(audio.chunk[i]);
+			if (audio.chunk[i])
+				Mix_FreeChunk(audio.chunk[i]);
+			free(audio.pcm[i]);
 		}
 
-		Mix_CloseAudio();
-		audio.inited = 0;
+		memset(&audio, 0, sizeof(audio));
 	}
 }
 
@@ -160,11 +229,21 @@ void audio_quit(void)
  */
 INLINE void audio_play(AudioSound snd)
 {
-	if (!audio.mute && snd < AUDIO_SOUND_NO)
+	if (audio.mixer)
+		mixer_play(snd);
+	else if (!audio.mute && snd < AUDIO_SOUND_NO && audio.chunk[snd])
 		if (Mix_PlayChannel(-1, audio.chunk[snd], 0) == -1)
 			log_err("Mix_PlayChannel: %s", Mix_GetError());
 }
 
+/*
+ * Mixer underruns so far, 0 without gnop's mixer.
+ */
+INLINE u32 audio_get_underruns(void)
+{
+	return audio.mixer ? mixer_get_underruns() : 0;
+}
+
 /*
  * Enable/disable mute.
  */
@@ -173,6 +252,9 @@ INLINE bool audio_toggle_mute(void)
 	log_info("audio mute: %s", 
 		 (audio.mute = !audio.mute) ? "off" : "on");
 
+	if (audio.mixer)
+		mixer_set_mute(audio.mute);
+
 	return audio.mute;
 }
 
@@ -181,12 +263,9 @@ INLINE bool audio_toggle_mute(void)
  */
 int audio_volume_up(void)
 {
-	int i;
-
 	if (audio.vol + VOLUME_STEP <= MIX_MAX_VOLUME) {
 		audio.vol += VOLUME_STEP;
-		for (i=0; i<AUDIO_SOUND_NO; ++i)
-			audio.chunk[i]->volume = audio.vol;
+		set_volume();
 	}
 
 /* 	log_debug("real: %d\t\tperc: %d",  */
@@ -200,12 +279,9 @@ int audio_volume_up(void)
  */
 int audio_volume_down(void)
 {
-	int i;
-
 	if (audio.vol - VOLUME_STEP >= 0) {
 		audio.vol -= VOLUME_STEP;
-		for (i=0; i<AUDIO_SOUND_NO; ++i)
-			audio.chunk[i]->volume = audio.vol;
+		set_volume();
 	}
 
 /* 	log_debug("real: %d\t\tperc: %d",  */
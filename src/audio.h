@@ -31,8 +31,11 @@ typedef void (*AudioCallback)(u8 volume, bool mute);
 
 /* 
  * Initialize audio subsystem.
+ *
+ * If `frames' is 0 sounds are played through SDL_mixer, otherwise through
+ * gnop's own mixer with a device buffer of `frames' samples (see mixer.h).
  */
-int audio_init (const char *datadir);
+int audio_init (const char *datadir, u16 frames);
 
 /*
  * Close audio subsystem.
@@ -44,6 +47,11 @@ void audio_quit (void);
  */
 void audio_play (AudioSound sound);
 
+/*
+ * Buffers gnop's mixer could not fill in time (0 with SDL_mixer).
+ */
+u32 audio_get_underruns (void);
+
 /*
  * Enable/disable mute.
  *
@@ -0,0 +1,599 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-bench: microbenchmarks for the sprite, text, physics and AI hot
+ * paths. Runs under SDL's dummy video driver (unless SDL_VIDEODRIVER is
+ * already set) and prints one tab-separated line per benchmark and color
+ * depth, so that runs of different builds can be compared with diff(1),
+ * join(1) or a spreadsheet.
+ */
+
+#define _SPRITE_CHILD
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <getopt.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "clock.h"
+#include "log.h"
+#include "engine.h"
+#include "video.h"
+
+#include "sprite_impl.h"
+#include "ai.h"
+#include "delta.h"
+#include "env.h"
+#include "game.h"
+#include "instant.h"
+#include "shmem.h"
+#include "text.h"
+
+#define VIDEO_WIDTH	512
+#define VIDEO_HEIGHT	400
+
+#define FONT_BASENAME	"DejaVuSans.ttf"
+
+#define DEFAULT_SAMPLES	200
+#define DEFAULT_WARMUP	20
+
+/* per-sample target, used to size the inner loop */
+#define SAMPLE_NS	(200 * NSEC_PER_USEC)
+
+#define DELTA_STATES	1024	/* consecutive states of a CPU match */
+
+#define SHMEM_NAME	"/gnop-bench"
+
+#define ENV_MATCHES	256	/* in the batch env_batch_step steps */
+
+#define RASTER_SIDE	84	/* frames of the raster bench */
+
+#define USAGE_FMT	\
+	"Usage: %s [OPTION]...\n"					\
+	"  -b, --bpp=BPP\t\t only run at BPP bits per pixel "		\
+	"(default: 8, 16, 32)\n"					\
+	"  -d, --datadir=DIR\t load the font from DIR (default: %s)\n"	\
+	"  -f, --filter=NAME\t only run benchmarks whose name "		\
+	"contains NAME\n"						\
+	"  -n, --samples=N\t samples per benchmark (default: %d)\n"	\
+	"  -w, --warmup=N\t discarded warm-up samples (default: %d)\n"	\
+	"  --help\t\t display this help and exit\n"
+
+static struct option long_options[] = {
+	{ "bpp", required_argument, NULL, 'b' },
+	{ "datadir", required_argument, NULL, 'd' },
+	{ "filter", required_argument, NULL, 'f' },
+	{ "samples", required_argument, NULL, 'n' },
+	{ "warmup", required_argument, NULL, 'w' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL },
+};
+
+typedef struct {
+	const char *name;
+	void      (*run)(u32 i);
+} Bench;
+
+static struct {
+	Sprite *small;
+	Sprite *large;
+	Text   *text;
+
+	GameState game;
+	u32       hash;		/* keeps game_hash() from being optimized out */
+
+	GameState played[DELTA_STATES];
+	u8        coded[DELTA_STATES][DELTA_MAX_LEN];
+
+	EnvBatch *env;
+	u8        actions[ENV_MATCHES];
+	float     obs[ENV_MATCHES * ENV_OBS_LEN];
+	float     rewards[ENV_MATCHES];
+	u8        dones[ENV_MATCHES];
+
+	Raster   *raster;
+	u8        frame[RASTER_SIDE * RASTER_SIDE];
+
+	ShmemRegion *shared;
+	pid_t     bot;		/* answering the shared states, or 0 */
+} obj;
+
+static void bench_blit_small(u32 i)
+{
+	sprite_set_xy(obj.small, i % (VIDEO_WIDTH - 14), i % (VIDEO_HEIGHT - 14));
+	sprite_blit(obj.small);
+}
+
+static void bench_blit_large(u32 i)
+{
+	sprite_blit(obj.large);
+}
+
+static void bench_fill_region(u32 i)
+{
+	sprite_fill_region(obj.large, i % (VIDEO_WIDTH - 4), 
+			   i % (VIDEO_HEIGHT - 6), 4, 6, 0xdedede);
+}
+
+static void bench_fill_pixel(u32 i)
+{
+	sprite_fill_pixel(obj.large, i % VIDEO_WIDTH, i % VIDEO_HEIGHT,
+			  0xdedede);
+}
+
+static void bench_text(u32 i)
+{
+	text_set_text(obj.text, "%u", i % 12);
+}
+
+/*
+ * Two CPU players, match after match.
+ */
+static void bench_game_step(u32 i)
+{
+	static const u8 input[2];
+
+	game_step(&obj.game, input);
+}
+
+/*
+ * The ball sweeps the whole field so that every branch is taken.
+ */
+static void bench_game_ball(u32 i)
+{
+	static const u8 input[2];
+
+	obj.game.phase = GAME_PLAYING;
+	obj.game.score[0] = obj.game.score[1] = 0;
+	obj.game.ball.x = i % VIDEO_WIDTH;
+	obj.game.ball.y = (i * 7) % VIDEO_HEIGHT;
+	game_step(&obj.game, input);
+}
+
+static void bench_ai_move(u32 i)
+{
+	obj.game.phase = GAME_PLAYING;
+	obj.game.ball.x = i % VIDEO_WIDTH;
+	obj.game.ball.y = (i * 7) % VIDEO_HEIGHT;
+	ai_move(&obj.game, 1);
+	obj.game.paddle[1].move = 0;
+}
+
+/*
+ * A save and a restore, as rollback does per resimulated frame.
+ */
+static void bench_game_save(u32 i)
+{
+	static GameSnapshot snap;
+
+	obj.game.tick = i;
+	game_save(&obj.game, &snap);
+	game_restore(&obj.game, &snap);
+}
+
+static void bench_game_hash(u32 i)
+{
+	obj.game.tick = i;
+	obj.hash ^= game_hash(&obj.game);
+}
+
+/*
+ * Each state against the one before, as a spectator stream sends them.
+ */
+static void bench_delta_encode(u32 i)
+{
+	u32 k = 1 + i % (DELTA_STATES - 1);
+
+	delta_encode(&obj.played[k - 1], &obj.played[k], obj.coded[k]);
+}
+
+static void bench_delta_decode(u32 i)
+{
+	u32 k = 1 + i % (DELTA_STATES - 1);
+
+	delta_decode(&obj.played[k - 1], obj.coded[k], DELTA_MAX_LEN,
+		     &obj.game);
+}
+
+static void bench_instant_push(u32 i)
+{
+	obj.game.ball.x = i % VIDEO_WIDTH;
+	instant_push(&obj.game, i & GAME_EVENT_WALL);
+}
+
+/*
+ * A step of ENV_MATCHES matches, each agent following the ball.
+ */
+static void bench_env_batch_step(u32 i)
+{
+	const float *o;
+	u32 k;
+
+	for (k=0; k<ENV_MATCHES; ++k) {
+		o = obj.obs + k * ENV_OBS_LEN;
+		obj.actions[k] = o[ENV_OBS_BALL_Y] * 2 - 1 < o[ENV_OBS_PADDLE] ?
+				 ENV_ACTION_UP : ENV_ACTION_DOWN;
+	}
+
+	env_batch_step(obj.env, obj.actions, obj.obs, obj.rewards, 
+		       obj.dones);
+}
+
+/*
+ * A frame of a match being played, scores and all.
+ */
+static void bench_raster_draw(u32 i)
+{
+	raster_draw(obj.raster, &obj.played[i % DELTA_STATES], obj.frame);
+}
+
+/*
+ * Share a state, and wait for the bot to answer it.
+ */
+static void bench_shmem_round_trip(u32 i)
+{
+	obj.game.tick = i + 1;
+	shmem_publish(&obj.game);
+
+	while (__atomic_load_n(&obj.shared->input, __ATOMIC_ACQUIRE) >> 32 
+	       != i + 1)
+		sched_yield();
+}
+
+static const Bench benches[] = {
+	{ "sprite_blit_14x14",    bench_blit_small },
+	{ "sprite_blit_512x400",  bench_blit_large },
+	{ "sprite_fill_region",   bench_fill_region },
+	{ "sprite_fill_pixel",    bench_fill_pixel },
+	{ "text_set_text",        bench_text },
+	{ "game_step",            bench_game_step },
+	{ "game_step_ball",       bench_game_ball },
+	{ "ai_move",              bench_ai_move },
+	{ "game_save_restore",    bench_game_save },
+	{ "game_hash",            bench_game_hash },
+	{ "delta_encode",         bench_delta_encode },
+	{ "delta_decode",         bench_delta_decode },
+	{ "instant_push",         bench_instant_push },
+	{ "env_batch_step_256",   bench_env_batch_step },
+	{ "raster_draw_84x84",    bench_raster_draw },
+	{ "shmem_round_trip",     bench_shmem_round_trip },
+};
+
+#define BENCH_NO	(sizeof(benches) / sizeof(*benches))
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Time `b' and print its result line.
+ */
+static void run_bench(const Bench *b, u8 bpp, int nsamples, int warmup)
+{
+	u64 *sample, t, sum;
+	u32 i, n, iters, k;
+	int s;
+
+	/* size the inner loop so that a sample lasts about SAMPLE_NS */
+	k = 0;
+	for (iters=1; iters<(1 << 20); iters*=2) {
+		t = clock_ns();
+		for (i=0; i<iters; ++i)
+			b->run(k++);
+		if (clock_ns() - t >= SAMPLE_NS)
+			break;
+	}
+
+	sample = malloc(nsamples * sizeof(*sample));
+
+	for (s=-warmup; s<nsamples; ++s) {
+		t = clock_ns();
+		for (n=0; n<iters; ++n)
+			b->run(k++);
+		t = clock_ns() - t;
+
+		if (s >= 0)
+			sample[s] = t;
+	}
+
+	qsort(sample, nsamples, sizeof(*sample), cmp_u64);
+
+	for (s=0, sum=0; s<nsamples; ++s)
+		sum += sample[s];
+
+	printf("%s\t%u\t%d\t%u\t%.1f\t%.1f\t%.1f\t%.1f\n", b->name, bpp, 
+	       nsamples, iters,
+	       (double)sample[nsamples / 2] / iters,
+	       (double)sample[(nsamples * 99 - 1) / 100] / iters,
+	       (double)sample[0] / iters,
+	       (double)sum / nsamples / iters);
+	fflush(stdout);
+
+	free(sample);
+}
+
+/*
+ * Play the states the delta benches code, and print what they cost
+ * against baselines `lag' ticks old (0: none).
+ */
+static void delta_setup(void)
+{
+	static const u8 input[2];
+	static const u32 lags[] = { 1, 4, 8, 30, 0 };
+	u8 buf[DELTA_MAX_LEN];
+	u32 i, k, len, max, total;
+
+	game_init(&obj.played[0], 0);
+	obj.played[0].cpu = 1 << 0 | 1 << 1;
+	for (k=1; k<DELTA_STATES; ++k) {
+		obj.played[k] = obj.played[k - 1];
+		game_step(&obj.played[k], input);
+	}
+
+	for (i=0; i<sizeof(lags) / sizeof(*lags); ++i) {
+		max = total = 0;
+		for (k=lags[i]; k<DELTA_STATES; ++k) {
+			len = delta_encode(lags[i] ? 
+					   &obj.played[k - lags[i]] : NULL,
+					   &obj.played[k], buf);
+			total += len;
+			if (len > max)
+				max = len;
+		}
+
+		k = DELTA_STATES - lags[i];
+		if (lags[i])
+			printf("# delta %u back: ", lags[i]);
+		else
+			printf("# delta alone: ");
+		printf("%.2f bytes mean, %u max, "
+		       "%.1fx under a %u-byte snapshot\n",
+		       (double)total / k, max, 
+		       (double)GAME_SNAPSHOT_LEN * k / total, 
+		       GAME_SNAPSHOT_LEN);
+	}
+}
+
+/*
+ * Start the bot process the shmem bench plays against, on the region
+ * the engine shares: it answers every state with the AI's keys, as soon
+ * as it sees it.
+ */
+static void start_bot(void)
+{
+	ShmemRegion *r;
+	GameState s;
+	u32 seq, last = 0;
+
+	obj.bot = fork();
+	if (obj.bot == -1)
+		obj.bot = 0;
+	if (obj.bot)
+		return;
+
+	r = shmem_attach(SHMEM_NAME);
+	if (!r)
+		_exit(1);
+
+	for (;;) {
+		seq = shmem_read(r, &s);
+		if (seq == last) {
+			sched_yield();
+			continue;
+		}
+		last = seq;
+
+		s.paddle[1].move = 0;
+		ai_move(&s, 1);
+		shmem_answer(r, s.tick, s.paddle[1].move < 0 ? GAME_INPUT_UP :
+			     s.paddle[1].move > 0 ? GAME_INPUT_DOWN : 0);
+	}
+}
+
+static void stop_bot(void)
+{
+	if (!obj.bot)
+		return;
+
+	kill(obj.bot, SIGTERM);
+	waitpid(obj.bot, NULL, 0);
+	obj.bot = 0;
+}
+
+static int run_depth(u8 bpp, const char *datadir, const char *filter,
+		     int nsamples, int warmup)
+{
+	EngineConfig cfg;
+	char path[PATH_MAX];
+	unsigned i;
+
+	memset(&cfg, 0, sizeof(cfg));
+#if HAVE_LIBSDL_MIXER
+	cfg.opts = ENGINE_OPTION_MUTE;
+#endif
+	cfg.datadir = datadir;
+	cfg.fg_color = ENGINE_FG_COLOR;
+	cfg.bg_color = ENGINE_BG_COLOR;
+	cfg.bpp = bpp;
+	if (!filter || strstr("shmem_round_trip", filter))
+		cfg.shmem = SHMEM_NAME;
+
+	if (engine_init(&cfg) != 0)
+		return -1;
+
+	if (video_get_bpp() != bpp) {
+		log_warn("bench: %u bpp not available", bpp);
+		engine_quit();
+		return -1;
+	}
+
+	obj.small = sprite_new(14, 14);
+	sprite_fill(obj.small, ENGINE_FG_COLOR);
+	sprite_set_accel(obj.small, ENGINE_FG_COLOR);
+
+	obj.large = sprite_new(VIDEO_WIDTH, VIDEO_HEIGHT);
+	sprite_fill(obj.large, ENGINE_BG_COLOR);
+
+	game_init(&obj.game, 0);
+	obj.game.cpu = 1 << 0 | 1 << 1;
+
+	if (cfg.shmem) {
+		obj.shared = shmem_attach(SHMEM_NAME);
+		if (obj.shared)
+			start_bot();
+	}
+
+	/* after the engine's font task is done with FreeType */
+	engine_bench_setup();
+
+	join_path(datadir ? datadir : DATADIR, FONT_BASENAME, path);
+	obj.text = text_new(path, 48, ENGINE_FG_COLOR);
+	if (obj.text)
+		text_set_text(obj.text, "0");
+
+	for (i=0; i<BENCH_NO; ++i) {
+		if (filter && !strstr(benches[i].name, filter))
+			continue;
+
+		if (benches[i].run == bench_text && !obj.text)
+			continue;
+
+		if (benches[i].run == bench_shmem_round_trip && !obj.bot)
+			continue;
+
+		run_bench(&benches[i], bpp, nsamples, warmup);
+	}
+
+	objects_free(obj.small, obj.large, NULL);
+	if (obj.text)
+		object_free(obj.text);
+
+	stop_bot();
+	if (obj.shared)
+		munmap(obj.shared, sizeof(*obj.shared));
+	obj.shared = NULL;
+
+	engine_quit();
+
+	return 0;
+}
+
+int main(int ac, char *av[])
+{
+	static const u8 all_depths[] = { 8, 16, 32 };
+	EnvConfig cfg = { 0 };
+	const char *datadir, *filter;
+	int c, nsamples, warmup, retv;
+	u8 depth[3];
+	unsigned i, ndepths;
+	long bpp;
+	char *p;
+
+	datadir = filter = NULL;
+	nsamples = DEFAULT_SAMPLES;
+	warmup = DEFAULT_WARMUP;
+	ndepths = 0;
+
+	while ((c = getopt_long(ac, av, "b:d:f:n:w:", 
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'b':
+			if (ndepths == sizeof(depth))
+				break;
+			bpp = strtol(optarg, &p, 10);
+			if (*p || (bpp != 8 && bpp != 16 && bpp != 32)) {
+				log_err("invalid color depth: %s", optarg);
+				return 1;
+			}
+			depth[ndepths++] = bpp;
+			break;
+
+		case 'd':
+			datadir = optarg;
+			break;
+
+		case 'f':
+			filter = optarg;
+			break;
+
+		case 'n':
+			nsamples = atoi(optarg);
+			if (nsamples < 1) {
+				log_err("invalid number of samples: %s", 
+					optarg);
+				return 1;
+			}
+			break;
+
+		case 'w':
+			warmup = atoi(optarg);
+			if (warmup < 0)
+				warmup = 0;
+			break;
+
+		case 'h':
+			printf(USAGE_FMT, *av, DATADIR, 
+			       DEFAULT_SAMPLES, DEFAULT_WARMUP);
+			return 0;
+
+		case '?':
+			printf("Try `%s --help' for more information\n", 
+			       av[0]);
+			return 1;
+		}
+	}
+
+	if (!ndepths) {
+		memcpy(depth, all_depths, sizeof(all_depths));
+		ndepths = sizeof(all_depths);
+	}
+
+	setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+	printf("# gnop-bench %s\n", VERSION);
+	printf("# name\tbpp\tsamples\titers\tmedian_ns\tp99_ns\t"
+	       "min_ns\tmean_ns\n");
+
+	delta_setup();
+
+	cfg.n = ENV_MATCHES;
+	obj.env = env_batch_new(&cfg);
+	env_batch_reset(obj.env, obj.obs);
+	obj.raster = raster_new(RASTER_SIDE, RASTER_SIDE, 
+				RASTER_SEPARATOR | RASTER_SCORES);
+
+	for (i=0, retv=0; i<ndepths; ++i)
+		if (run_depth(depth[i], datadir, filter, nsamples, warmup))
+			retv = 1;
+
+	env_batch_free(obj.env);
+	raster_free(obj.raster);
+
+	return retv;
+}
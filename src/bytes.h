@@ -0,0 +1,88 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BYTES_H
+#define BYTES_H
+
+#include "common.h"
+
+/*
+ * Integers in byte buffers, little-endian, as every file and packet of
+ * gnop's has them.
+ */
+
+/*
+ * Store the `n' low bytes of `v' at `p'; return the byte after them.
+ */
+static inline u8 *put_le(u8 *p, u64 v, int n)
+{
+	while (n--) {
+		*p++ = v;
+		v >>= 8;
+	}
+
+	return p;
+}
+
+/*
+ * The `n' byte integer at `p'.
+ */
+static inline u64 get_le(const u8 *p, int n)
+{
+	u64 v = 0;
+
+	while (n--)
+		v = v << 8 | p[n];
+
+	return v;
+}
+
+/*
+ * Same, advancing `*p' past it.
+ */
+static inline u64 take_le(const u8 **p, int n)
+{
+	u64 v = get_le(*p, n);
+
+	*p += n;
+
+	return v;
+}
+
+/*
+ * 8 bytes, spelled out so that compilers make single moves of them.
+ */
+static inline void store_le64(u8 *p, u64 v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+	p[4] = v >> 32;
+	p[5] = v >> 40;
+	p[6] = v >> 48;
+	p[7] = v >> 56;
+}
+
+static inline u64 load_le64(const u8 *p)
+{
+	return (u64)p[0] | (u64)p[1] << 8 | (u64)p[2] << 16 | 
+	       (u64)p[3] << 24 | (u64)p[4] << 32 | (u64)p[5] << 40 | 
+	       (u64)p[6] << 48 | (u64)p[7] << 56;
+}
+
+#endif /* !BYTES_H */
@@ -1,6 +1,6 @@
-/* $Id: ball.h 27 2009-08-28 21:03:48Z gallows $ 
+/* $Id$
  *
- * Copyright (c) 2008,2009 Sergio Perticone <g4ll0ws@gmail.com>
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
  *
  * Permission to use, copy, modify, and/or distribute this software for any
  * purpose with or without fee is hereby granted, provided that the above
@@ -15,41 +15,36 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-/*
- * Object Hierarchy:
- *
- *  Object
- *   +----Layer
- *         +----Sprite
- *               +----Ball (final)
- */
-
-#ifndef BALL_H
-#define BALL_H
+#ifndef CLOCK_H
+#define CLOCK_H
 
-#include "sprite.h"
+#include <time.h>
 
-#define BALL_SPEED	13
-#define BALL_WIDTH	14
-#define BALL_HEIGHT	BALL_WIDTH
+#include "common.h"
 
-typedef enum {
-	BALL_BOUNCE_H,
-	BALL_BOUNCE_V
-} BallBounce;
+#define NSEC_PER_SEC	1000000000ULL
+#define NSEC_PER_MSEC	1000000ULL
+#define NSEC_PER_USEC	1000ULL
 
-typedef enum {
-	BALL_PUSH_NONE =  0,
-	BALL_PUSH_DOWN = -1,
-	BALL_PUSH_UP   =  1,
-} BallPush;
+/*
+ * Monotonic time in nanoseconds (unrelated to the wall clock).
+ */
+static inline u64 clock_ns(void)
+{
+	struct timespec ts;
 
-typedef struct _Ball Ball;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-Ball  *ball_new     (u32 color);
-void   ball_start   (Ball *self);
-void   ball_bounce  (Ball *self, BallBounce bounce, BallPush push);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
 
-void   ball_get_vectors (const Ball *self, s8 *x, s8 *y);
+/*
+ * Same in microseconds, cut to 32 bits: for stamps echoed in packets,
+ * subtracted from one another with wrap-around.
+ */
+static inline u32 clock_us32(void)
+{
+	return clock_ns() / NSEC_PER_USEC;
+}
 
-#endif /* !BALL_H */
+#endif /* !CLOCK_H */
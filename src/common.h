@@ -22,27 +22,10 @@
 # include <config.h>
 #endif
 
-#if HAVE_STDBOOL_H
-# include <stdbool.h>
-#else
-# define NEED_BOOL
-#endif
-
-#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef uint8_t		u8;
-typedef uint16_t	u16;
-typedef uint32_t	u32;
-
-typedef int8_t		s8;
-typedef int16_t		s16;
-typedef int32_t		s32;
-
-#ifdef NEED_BOOL
-typedef unsigned char   bool;
-#endif
+#include "types.h"
 
 #ifndef __GNUC__
 # define __attribute__(X)	/* nothing */
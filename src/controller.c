@@ -0,0 +1,167 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "ai.h"
+#include "controller.h"
+#include "log.h"
+
+/*
+ * The computer player. It moves within game_step() when it plays
+ * (see GameState.cpu); here it tells its move as keys instead, a step
+ * copied off the state, so it sees the state before the tick's serve.
+ */
+typedef struct {
+	ControllerVT parent;
+	AiParams     params;
+} AiController;
+
+typedef struct {
+	ControllerVT parent;
+	s16          deadzone;
+} FollowController;
+
+static Controller *ai_controller_new     (const char *arg);
+static Controller *follow_controller_new (const char *arg);
+
+static const struct {
+	const char *name;
+	Controller *(*ctor) (const char *arg);	/* arg NULL without a `:' */
+} kinds[] = {
+	{ "ai", ai_controller_new },
+	{ "follow", follow_controller_new },
+};
+
+Controller *controller_new(const char *spec)
+{
+	const char *arg;
+	size_t len;
+	u32 i;
+
+	arg = strchr(spec, ':');
+	len = arg ? (size_t)(arg++ - spec) : strlen(spec);
+
+	for (i=0; i<sizeof(kinds)/sizeof(*kinds); ++i)
+		if (strlen(kinds[i].name) == len && 
+		    !strncmp(kinds[i].name, spec, len))
+			return kinds[i].ctor(arg);
+
+	log_err("controller: unknown `%s' (ai[:PRESET] or "
+		"follow[:DEADZONE])", spec);
+
+	return NULL;
+}
+
+u8 controller_keys(Controller *self, const GameState *s, int p)
+{
+	return CONTROLLER(self)->vtable.keys(self, s, p) & 
+		(GAME_INPUT_UP | GAME_INPUT_DOWN);
+}
+
+void controller_free(Controller *self)
+{
+	if (self) {
+		if (CONTROLLER(self)->vtable.dtor)
+			CONTROLLER(self)->vtable.dtor(self);
+		free(self);
+	}
+}
+
+static u8 ai_controller_keys(AiController *self, const GameState *s, int p)
+{
+	GameState t = *s;
+
+	ai_move_with(&t, p, &self->params);
+
+	if (t.paddle[p].move < 0)
+		return GAME_INPUT_UP;
+	if (t.paddle[p].move > 0)
+		return GAME_INPUT_DOWN;
+
+	return 0;
+}
+
+static Controller *ai_controller_new(const char *arg)
+{
+	char path[PATH_MAX];
+	AiController *self;
+
+	self = calloc(1, sizeof(AiController));
+	if (!self) {
+		log_err("controller: out of memory");
+		return NULL;
+	}
+
+	CONTROLLER(self)->vtable.keys = (pfKeys)ai_controller_keys;
+	self->params = ai_default;
+
+	if (arg) {
+		if (!strchr(arg, '/')) {
+			snprintf(path, sizeof(path), "%s/%s.ai", DATADIR, arg);
+			arg = path;
+		}
+
+		if (ai_load(arg, &self->params) != 0) {
+			free(self);
+			return NULL;
+		}
+	}
+
+	return self;
+}
+
+static u8 follow_controller_keys(FollowController *self, 
+				 const GameState *s, int p)
+{
+	s16 pbar = GAME_PADDLE_Y(s, p) + GAME_PADDLE_HEIGHT / 2;
+	s16 ball = s->ball.y + GAME_BALL_SIZE / 2;
+
+	if (pbar + self->deadzone < ball)
+		return GAME_INPUT_DOWN;
+	if (pbar - self->deadzone > ball)
+		return GAME_INPUT_UP;
+
+	return 0;
+}
+
+static Controller *follow_controller_new(const char *arg)
+{
+	FollowController *self;
+	long deadzone = GAME_PADDLE_STEP;
+	char *end;
+
+	if (arg) {
+		deadzone = strtol(arg, &end, 10);
+		if (*end || deadzone < 0 || deadzone > GAME_HEIGHT) {
+			log_err("controller: invalid deadzone: %s", arg);
+			return NULL;
+		}
+	}
+
+	self = calloc(1, sizeof(FollowController));
+	if (!self) {
+		log_err("controller: out of memory");
+		return NULL;
+	}
+
+	CONTROLLER(self)->vtable.keys = (pfKeys)follow_controller_keys;
+	self->deadzone = deadzone;
+
+	return self;
+}
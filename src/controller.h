@@ -0,0 +1,69 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Controllers: whatever plays a paddle, from the game state to the keys
+ * it holds. They follow object.h's scheme, a vtable first in every
+ * kind, and are named by a spec:
+ *
+ *	ai[:PRESET]		the computer player, with ai_default or the
+ *				parameters in PRESET (see ai.h): a file
+ *				if it has a `/', else PRESET.ai in DATADIR
+ *	follow[:DEADZONE]	keeps the paddle's middle on the ball's,
+ *				within DEADZONE (default: a step)
+ *
+ * A new kind is a struct with a ControllerVT first, a constructor
+ * taking the text after the `:', and an entry in controller.c's table.
+ * A controller is used by one thread at a time.
+ */
+
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include "common.h"
+#include "game.h"
+
+#define CONTROLLER(C)	((ControllerVT *)(C))
+
+typedef void Controller;
+
+typedef u8   (* pfKeys)     (Controller *, const GameState *, int);
+typedef void (* pfCtrlDtor) (Controller *);
+
+struct _ControllerVT {
+	/*< protected >*/
+	struct {
+		pfKeys     keys;
+		pfCtrlDtor dtor;
+	} vtable;
+};
+
+typedef struct _ControllerVT ControllerVT;
+
+/*
+ * Make the controller named by `spec', or log why not and return NULL.
+ */
+Controller *controller_new (const char *spec);
+
+/*
+ * The keys to hold for paddle `p' this tick: GAME_INPUT_UP, _DOWN or 0.
+ */
+u8   controller_keys (Controller *self, const GameState *s, int p);
+
+void controller_free (Controller *self);
+
+#endif /* !CONTROLLER_H */
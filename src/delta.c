@@ -0,0 +1,251 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "bytes.h"
+#include "delta.h"
+
+/* the generator steps by GOLDEN: a draw count times GOLDEN_INV */
+#define GOLDEN		0x9e3779b97f4a7c15ULL
+#define GOLDEN_INV	0xf1de83e19937733dULL
+
+#define GROUP_BITS	4
+#define GROUPS_MAX	(64 / GROUP_BITS)
+
+typedef struct {
+	u8  *p;
+	u64  acc;
+	int  n;			/* bits in acc */
+} Writer;
+
+typedef struct {
+	const u8 *p;		/* into a zero-padded copy */
+	const u8 *end;		/* of the code in the copy */
+	u64       acc;
+	int       n;
+	u32       used;		/* bits taken */
+	bool      bad;		/* a field longer than 64 bits */
+} Reader;
+
+static u64 zigzag(s64 v)
+{
+	return (u64)v << 1 ^ (u64)(v >> 63);
+}
+
+static s64 unzigzag(u64 v)
+{
+	return (s64)(v >> 1) ^ -(s64)(v & 1);
+}
+
+/*
+ * Append the low `bits' (up to 32) of `v'. Whole bytes are stored 8 at
+ * a time: the buffer must have room past the end of the code, which
+ * DELTA_MAX_LEN leaves.
+ */
+static void put_bits(Writer *w, u64 v, int bits)
+{
+	if (w->n + bits > 63) {
+		store_le64(w->p, w->acc);
+		w->p += w->n >> 3;
+		w->acc >>= w->n & ~7;
+		w->n &= 7;
+	}
+
+	w->acc |= v << w->n;
+	w->n += bits;
+}
+
+static void flush_bits(Writer *w)
+{
+	store_le64(w->p, w->acc);
+	w->p += (w->n + 7) >> 3;
+}
+
+/*
+ * Append `v' as its count of groups in unary, then the groups.
+ */
+static void put_field(Writer *w, u64 v)
+{
+	int bits, groups, len;
+
+	bits = v ? 64 - __builtin_clzll(v) : 0;
+	groups = (bits + GROUP_BITS - 1) / GROUP_BITS;
+	len = groups * (GROUP_BITS + 1) + 1;
+
+	/* all in one go up to 6 groups (24 bits) */
+	if (len <= 32) {
+		put_bits(w, v << (groups + 1) | ((1ULL << groups) - 1), len);
+		return;
+	}
+
+	put_bits(w, (1ULL << groups) - 1, groups + 1);
+	put_bits(w, v & 0xffffffff, bits = groups * GROUP_BITS < 32 ? 
+		 groups * GROUP_BITS : 32);
+	if (groups * GROUP_BITS > 32)
+		put_bits(w, v >> 32, groups * GROUP_BITS - 32);
+}
+
+/*
+ * Keep at least 56 bits in the reader.
+ */
+static inline INLINE void refill(Reader *r)
+{
+	r->acc |= load_le64(r->p) << r->n;
+	r->p += (63 - r->n) >> 3;
+	r->n |= 56;
+
+	/* past the end, keep reading the zeros after it */
+	if (r->p > r->end)
+		r->p = r->end;
+}
+
+static inline INLINE u64 take_bits(Reader *r, int bits)
+{
+	u64 v;
+
+	if (r->n < bits)
+		refill(r);
+
+	v = r->acc & ((1ULL << bits) - 1);
+	r->acc >>= bits;
+	r->n -= bits;
+	r->used += bits;
+
+	return v;
+}
+
+static inline INLINE u64 take_field(Reader *r)
+{
+	int groups, bits;
+	u64 v;
+
+	refill(r);
+	groups = ~r->acc ? __builtin_ctzll(~r->acc) : 64;
+	if (groups > GROUPS_MAX) {
+		r->bad = 1;
+		groups = GROUPS_MAX;
+	}
+
+	/* at least 39 bits are left after the count */
+	r->acc >>= groups + 1;
+	r->n -= groups + 1;
+	r->used += groups + 1;
+
+	bits = groups * GROUP_BITS;
+	if (bits <= 32)
+		return take_bits(r, bits);
+
+	v = take_bits(r, 32);
+	v |= take_bits(r, bits - 32) << 32;
+
+	return v;
+}
+
+/*
+ * Predictions of the fields that move on their own, `dt' ticks after
+ * `b'.
+ */
+#define IDLE(B)			((B)->phase != GAME_PLAYING && !(B)->paused)
+#define PRED_TIMER(B, DT)	((B)->timer - (IDLE(B) ? (DT) : 0))
+#define PRED_BALL(B, C, DT)	((B)->ball.C + ((B)->phase == GAME_PLAYING \
+				 && !(B)->paused ? (B)->ball.v##C * (DT) : 0))
+#define PRED_PADDLE(B, P, DT)	((B)->paddle[P].pos +			\
+				 (B)->paddle[P].last_move *		\
+				 GAME_PADDLE_STEP * (DT))
+
+/*
+ * Put or take field F of type T, predicted as PRED.
+ */
+#define PUT(T, F, PRED)		put_field(&w, zigzag((T)((F) - (PRED))))
+#define TAKE(T, F, PRED)	F = (PRED) + (T)unzigzag(take_field(&r))
+
+u32 delta_encode(const GameState *base, const GameState *s, u8 *buf)
+{
+	static const GameState zero;
+	const GameState *b = base ? base : &zero;
+	Writer w = { buf, 0, 0 };
+	s32 dt = s->tick - b->tick;
+	int p;
+
+	PUT(s32, s->tick, b->tick + 1);
+	put_field(&w, zigzag((s64)((s->rng - b->rng) * GOLDEN_INV)));
+	PUT(s32, s->match, b->match);
+	PUT(s16, s->timer, PRED_TIMER(b, dt));
+	PUT(s8, s->phase, b->phase);
+	PUT(s8, s->paused, b->paused);
+	PUT(s8, s->cpu, b->cpu);
+	PUT(s8, s->score[0], b->score[0]);
+	PUT(s8, s->score[1], b->score[1]);
+	PUT(s16, s->ball.x, PRED_BALL(b, x, dt));
+	PUT(s16, s->ball.y, PRED_BALL(b, y, dt));
+	PUT(s8, s->ball.vx, b->ball.vx);
+	PUT(s8, s->ball.vy, b->ball.vy);
+
+	for (p=0; p<2; ++p) {
+		PUT(s16, s->paddle[p].pos, PRED_PADDLE(b, p, dt));
+		PUT(s8, s->paddle[p].move, b->paddle[p].move);
+		PUT(s8, s->paddle[p].last_move, b->paddle[p].last_move);
+	}
+
+	flush_bits(&w);
+
+	return w.p - buf;
+}
+
+int delta_decode(const GameState *base, const u8 *buf, u32 len, 
+		 GameState *s)
+{
+	static const GameState zero;
+	const GameState *b = base ? base : &zero;
+	u8 copy[DELTA_MAX_LEN + 8];
+	Reader r = { copy, copy, 0, 0, 0, 0 };
+	s32 dt;
+	int p;
+
+	/* reads past the code find zeros, and fail below */
+	if (len > DELTA_MAX_LEN)
+		len = DELTA_MAX_LEN;
+	memcpy(copy, buf, len);
+	memset(copy + len, 0, 8);
+	r.end = copy + len;
+
+	TAKE(s32, s->tick, b->tick + 1);
+	dt = s->tick - b->tick;
+
+	s->rng = b->rng + (u64)unzigzag(take_field(&r)) * GOLDEN;
+	TAKE(s32, s->match, b->match);
+	TAKE(s16, s->timer, PRED_TIMER(b, dt));
+	TAKE(s8, s->phase, b->phase);
+	TAKE(s8, s->paused, b->paused);
+	TAKE(s8, s->cpu, b->cpu);
+	TAKE(s8, s->score[0], b->score[0]);
+	TAKE(s8, s->score[1], b->score[1]);
+	TAKE(s16, s->ball.x, PRED_BALL(b, x, dt));
+	TAKE(s16, s->ball.y, PRED_BALL(b, y, dt));
+	TAKE(s8, s->ball.vx, b->ball.vx);
+	TAKE(s8, s->ball.vy, b->ball.vy);
+
+	for (p=0; p<2; ++p) {
+		TAKE(s16, s->paddle[p].pos, PRED_PADDLE(b, p, dt));
+		TAKE(s8, s->paddle[p].move, b->paddle[p].move);
+		TAKE(s8, s->paddle[p].last_move, b->paddle[p].last_move);
+	}
+
+	if (r.bad || r.used > len * 8)
+		return -1;
+
+	return (r.used + 7) / 8;
+}
@@ -0,0 +1,53 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * Delta coding of game states against a baseline both ends have, for
+ * state streams.
+ *
+ * Each field is predicted from the baseline as if nothing happened but
+ * time: the tick moves on by one, the ball keeps its vector, paddles
+ * keep moving their last way, idle timers run down and the generator is
+ * drawn from zero times. What is left, zig-zag coded, is written as a
+ * unary count of 4-bit groups and the groups themselves: a field as
+ * predicted costs a single bit, a paddle step six. A tick of play
+ * against the one before it usually fits in 3 bytes.
+ */
+
+#define DELTA_MAX_LEN		96
+
+/*
+ * Code `s' against `base' (NULL: a zeroed state, for a state that must
+ * stand alone) into `buf', DELTA_MAX_LEN bytes at most. Return the
+ * bytes used.
+ */
+u32 delta_encode (const GameState *base, const GameState *s, u8 *buf);
+
+/*
+ * Decode into `s' the state coded in the `len' bytes at `buf' against
+ * `base'. Return the bytes used, or -1 if they are not a state.
+ */
+int delta_decode (const GameState *base, const u8 *buf, u32 len, 
+		  GameState *s);
+
+#endif /* !DELTA_H */
@@ -22,13 +22,15 @@
 #include <errno.h>
 #include <limits.h>
 #include <time.h>
+#include <unistd.h>
 
 #if HAVE_ALLOCA_H
 # include <alloca.h>
 #endif
 
+#include <SDL_thread.h>
 #include <SDL_timer.h>
-#include <SDL_events.h>
+#include <SDL_keysym.h>
 
 #if HAVE_LIBSDL_MIXER
 # include "audio.h"
@@ -38,160 +40,306 @@
 #endif
 
 #include "video.h"
-
-#include "ball.h"
-#include "paddle.h"
-#include "text.h"
+#include "input.h"
+#include "clock.h"
+#include "latency.h"
+#include "mem.h"
+#include "pak.h"
+#include "metrics.h"
+#include "net.h"
+#include "online.h"
+#include "perf.h"
+#include "shmem.h"
+#include "telemetry.h"
+#include "timeline.h"
+
+#include "ai.h"
+#include "game.h"
+#include "instant.h"
+#include "replay.h"
+#include "stream.h"
+#include "scene.h"
 
 #include "engine.h"
 
-#define VIDEO_WIDTH	512
-#define VIDEO_HEIGHT	400
-
-#define IDLE_MS		20
-
-#define TIME_PREGAME	500
-#define TIME_SCORED	800
-#define TIME_GAME_OVER	3000
-
-#define FONT_BASENAME	"DejaVuSans.ttf"
-#define FONT_SCORE_PTSZ	48
-#define FONT_WON_PTSZ	24
-
-#define PANEL_ALPHA	92
+#define VIDEO_WIDTH	GAME_WIDTH
+#define VIDEO_HEIGHT	GAME_HEIGHT
 
-#define SCORE_TXT_Y	16
-#define SCORE_LIMIT	10
-#define WON_TXT_Y	(VIDEO_HEIGHT - 64)
+#define SEEK_TICKS	(10000 / GAME_TICK_MS)
 
 /*
- * Place score text for player P.
+ * Account STMT to perf phase PHASE.
  */
-#define AUTO_SET_X_SCORE_TXT(P) do {					\
-	if (P == 0)							\
-		layer_set_x(gnop.score_txt[P], VIDEO_WIDTH / 3 +	\
-			    - layer_get_width(gnop.score_txt[P]) / 2);	\
-	else								\
-		layer_set_x(gnop.score_txt[P], VIDEO_WIDTH * 2/3 +	\
-			    - layer_get_width(gnop.score_txt[P]) / 2);	\
+#define PERF_PHASE(PHASE, STMT) do {					\
+	perf_begin(PHASE);						\
+	STMT;								\
+	perf_end(PHASE);						\
 } while (0)
 
 /*
- * Place won text for player P.
+ * A startup job run on its own thread. The main thread must not touch
+ * what it produces before task_join() reported it finished.
  */
-#define AUTO_SET_X_WON_TXT(P) do {					\
-	if (P == 0)							\
-		layer_set_x(gnop.won_txt, VIDEO_WIDTH / 4 +		\
-			    - layer_get_width(gnop.won_txt) / 2);	\
-	else								\
-		layer_set_x(gnop.won_txt, VIDEO_WIDTH * 3/4 +		\
-			    - layer_get_width(gnop.won_txt) / 2);	\
-} while (0)
-
-/*
- * Set engine status.
- */ 
-#define SET_STATE(STATE) do {						\
-	gnop.prev_state = gnop.state;					\
-	gnop.state = STATE;						\
-} while (0)
-
-
-/*
- * gnop states:
- */
-enum {
-	STATE_PREGAME,
-	STATE_INGAME,
-	STATE_GAMEOVER,
-	STATE_IDLE,
-};
+typedef struct {
+	int        (*fn)(void);
+	SDL_Thread  *thread;
+	int          retv;
+	int          done;
+} Task;
 
 /*
  * gnop's Engine variables:
  */
 static struct Engine {
-	u8    state, prev_state;
 	bool  running;
-	bool  first_run;
-	bool  paused;
 	bool  todraw_panel;
 	bool  have_audio;
+	bool  steady;	/* no allocation expected in current frame */
+	bool  shown;	/* first frame is on screen */
+	u8    loading;	/* startup tasks not joined yet */
 
 	bool  key_up_pressed;
 	bool  key_down_pressed;
+	bool  key_up_latched;	/* pressed since the previous tick */
+	bool  key_down_latched;
+
+	bool  recording;
+	bool  replaying;	/* inputs come from a recording */
+	bool  uncapped;		/* no delay between ticks */
+	bool  auto_replay;	/* show every rally again after its point */
+	bool  netplay;		/* the other paddle is played over UDP */
+	bool  online;		/* the game is stepped by a gnop-server */
+	bool  publishing;	/* states go to a spectator relay */
+	bool  watching;		/* states come from a spectator relay */
+	bool  sharing;		/* states go to shared memory */
+	u8    local;		/* paddle played on this side */
 
 	time_t  tstart;
+	u64     last_poll;	/* end of previous input poll (ns) */
 
-	u8   score[2];
-
-	Sprite *bg;
-	Sprite *panel;
-	Ball *ball;
-	Paddle *paddle[2];
-	Text *score_txt[2];
-	Text *won_txt;
-
-	s16     paddle_x[2];
-
-	/*
-	 * gnop.scored stores:
-	 *	0	no one scored
-	 *	1	player1 scored
-	 *	2	player2 scored
-	 */
-	u8	scored;
+	GameState game;
+	GameState view;		/* drawn during an instant replay */
+	AiParams  ai;		/* loaded with --ai */
+	Scene    *scene;
 
 	char *datadir;
+	u16   audio_frames;
+
+	Task      font_task;
+	TTF_Font *font[SCENE_FONT_NO];
+#if HAVE_LIBSDL_MIXER
+	Task      audio_task;
+#endif
 } gnop;
 
-static void init_sprites  (u32 fg_color, u32 bg_color);
-static void draw          (void);
-static void handle_input  (void);
-static void handle_ai     (void);
-static void handle_ball   (void);
-static void go_idle       (int ms);
+static int  load_ai       (const char *name, const char *datadir);
+static int  load_fonts    (void);
+#if HAVE_LIBSDL_MIXER
+static int  load_audio    (void);
+#endif
+static void task_start    (Task *task, int (*fn)(void));
+static void attach_assets (bool block);
+static void cancel_tasks  (void);
+static void begin_frame   (void);
+static int  step_game     (u8 input[2]);
+static int  watch_game    (void);
+static void record_confirmed (void);
+static void play_instant  (void);
+static void draw          (const GameState *g);
+static void handle_input  (u8 input[2]);
+static void seek          (int ticks);
+static void start_instant (bool rally, u8 slow);
+static void play_sounds   (u32 ev);
+static void handle_events (u32 ev);
 
 /*
  * Initialize gnop's engine.
  */
-int engine_init(u8 opts, const char *datadir, u32 fg_color, u32 bg_color)
+int engine_init(const EngineConfig *cfg)
 {
-	if (video_init() != 0)
-		return -1;
+	char path[PATH_MAX];
+	u32 opts = cfg->opts;
+	int span;
 
-	video_set_title("gnop");
-	video_toggle_cursor();
+	if (opts & ENGINE_OPTION_STARTUP)
+		timeline_init();
+
+	game_init(&gnop.game, clock_ns());
 
-	if (video_set_mode(VIDEO_WIDTH, VIDEO_HEIGHT, 0) != 0) {
-		video_quit();
+	if (cfg->ai && load_ai(cfg->ai, cfg->datadir) != 0)
 		return -1;
+
+	if (cfg->host || cfg->join) {
+		net_condition(cfg->net_delay, cfg->net_jitter, cfg->net_loss);
+		if (net_open(cfg->join ? cfg->join : cfg->host, 
+			     cfg->join != NULL, &gnop.game) != 0)
+			return -1;
+		gnop.netplay = 1;
+		gnop.local = net_local_player();
+	}
+
+	if (cfg->server) {
+		if (online_open(cfg->server, &gnop.game) != 0)
+			goto out_net;
+		gnop.online = 1;
+		gnop.local = online_local_player();
 	}
 
+	if (cfg->watch) {
+		if (stream_watch_open(cfg->watch, 
+				      opts & ENGINE_OPTION_WATCH_UDP) != 0)
+			goto out_online;
+		gnop.watching = 1;
+	}
+
+	if (cfg->relay) {
+		if (stream_publish_open(cfg->relay) != 0)
+			goto out_stream;
+		gnop.publishing = 1;
+	}
+
+	/* a recording starts from its own first state */
+	if (cfg->play) {
+		if (replay_play_open(cfg->play, &gnop.game) != 0)
+			goto out_stream;
+
+		if (cfg->seek && replay_seek(&gnop.game, cfg->seek) != 0) {
+			log_err("replay: `%s' ends before tick %u", 
+				cfg->play, cfg->seek);
+			goto out_replay;
+		}
+		gnop.replaying = 1;
+	}
+
+	if (cfg->record) {
+		if (replay_record_open(cfg->record, &gnop.game) != 0)
+			goto out_replay;
+		gnop.recording = 1;
+	}
+
+	gnop.uncapped = (opts & ENGINE_OPTION_UNCAPPED) != 0;
+	gnop.auto_replay = (opts & ENGINE_OPTION_AUTO_REPLAY) != 0;
+	instant_reset();
+
+	if (cfg->telemetry && telemetry_open(cfg->telemetry) != 0)
+		goto out_replay;
+
+	if (cfg->metrics && metrics_init(cfg->metrics) != 0)
+		goto out_telemetry;
+
+	if (cfg->shmem) {
+		if (shmem_open(cfg->shmem) != 0)
+			goto out_metrics;
+		gnop.sharing = 1;
+
+		/* the recording would miss the bot taking the AI's place */
+		if (gnop.recording)
+			log_warn("shmem: no bot plays while recording");
+	}
+
+	if (opts & (ENGINE_OPTION_MEM_STATS | ENGINE_OPTION_MEM_CHECK))
+		mem_init(opts & ENGINE_OPTION_MEM_CHECK);
+
+	span = timeline_begin("video init");
+	if (video_init() != 0)
+		goto out_shmem;
+	timeline_end(span);
+
+	gnop.datadir = strdup(cfg->datadir ? cfg->datadir : DATADIR);
+	gnop.audio_frames = cfg->audio_frames;
+
+	/* without a pack, assets are read from loose files in datadir */
+	snprintf(path, sizeof(path), "%s/%s", gnop.datadir, PAK_BASENAME);
+	if (access(path, R_OK) == 0)
+		pak_open(path);
+
 	ttf_init();
 
+	/*
+	 * Fonts and sounds load while the window comes up, and attach to
+	 * the game when ready. Audio must wait for video_init():
+	 * SDL_InitSubSystem() is not thread-safe.
+	 */
+	task_start(&gnop.font_task, load_fonts);
+#if HAVE_LIBSDL_MIXER
+	if (!(opts & ENGINE_OPTION_MUTE))
+		task_start(&gnop.audio_task, load_audio);
+#endif
+
+	video_set_title("gnop");
+	video_toggle_cursor();
+
+	span = timeline_begin("video mode");
+	if (video_set_mode(VIDEO_WIDTH, VIDEO_HEIGHT, cfg->bpp) != 0)
+		goto out_assets;
+	timeline_end(span);
+
 	if (opts & ENGINE_OPTION_FS)
 		video_toggle_fullscreen();
 
-	if (video_get_bpp() != 8) {
-		gnop.panel = sprite_new(VIDEO_WIDTH, VIDEO_HEIGHT);
-		sprite_set_alpha(gnop.panel, PANEL_ALPHA);
-	}
+	input_init();
+
+	span = timeline_begin("sprites");
+	gnop.scene = scene_new(cfg->fg_color, cfg->bg_color);
+	timeline_end(span);
+
+	if (opts & ENGINE_OPTION_PERF)
+		perf_init();
 
-	gnop.datadir = datadir ? strdup(datadir) : strdup(DATADIR);
-	init_sprites(fg_color, bg_color);
+	if (opts & ENGINE_OPTION_LATENCY)
+		latency_init();
 
+	return 0;
+
+	/* undo in reverse order */
+out_assets:
+	cancel_tasks();
 #if HAVE_LIBSDL_MIXER
-	if (!(opts & ENGINE_OPTION_MUTE)) {
-		audio_init(gnop.datadir);
-		gnop.have_audio = 1;
-	}
+	if (gnop.have_audio)
+		audio_quit();
+	gnop.have_audio = 0;
 #endif
+	pak_close();
+	ttf_quit();
+	free(gnop.datadir);
+	video_quit();
+out_shmem:
+	shmem_close();
+out_metrics:
+	metrics_quit();
+out_telemetry:
+	telemetry_close();
+out_replay:
+	replay_close();
+out_stream:
+	stream_close();
+out_online:
+	online_close();
+out_net:
+	net_close();
+
+	return -1;
+}
 
-	time(&gnop.tstart);
+/*
+ * Play the AI with preset `name': a file if it has a `/', else
+ * NAME.ai in `datadir'.
+ */
+static int load_ai(const char *name, const char *datadir)
+{
+	char file[PATH_MAX], path[PATH_MAX];
+
+	if (!strchr(name, '/')) {
+		snprintf(file, sizeof(file), "%s.ai", name);
+		if (!join_path(datadir ? datadir : DATADIR, file, path))
+			return -1;
+		name = path;
+	}
+
+	if (ai_load(name, &gnop.ai) != 0)
+		return -1;
 
-	SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, 
-			    SDL_DEFAULT_REPEAT_INTERVAL);
+	ai_use(&gnop.ai, &gnop.ai);
 
 	return 0;
 }
@@ -207,7 +355,7 @@ void engine_quit(void)
 	time(&ticks);
 	ticks -= gnop.tstart;
 
-	if (ticks) {
+	if (gnop.tstart && ticks) {
 		printf("\nAddicted to gnop for ");
 		t60 = div(ticks, 60);
 		if (t60.quot > 0) {
@@ -222,18 +370,41 @@ void engine_quit(void)
 			       ticks, ticks == 1 ? "" : "s");
 	}
 
-	objects_free(gnop.bg, gnop.ball, gnop.score_txt[0], gnop.score_txt[1],
-		     gnop.won_txt, gnop.paddle[0], gnop.paddle[1], gnop.panel,
-		     NULL);
+	cancel_tasks();
+	shmem_close();
+	metrics_quit();
+	telemetry_close();
+	replay_close();
+	stream_close();
+	online_close();
+	net_close();
+	gnop.recording = gnop.replaying = gnop.netplay = 0;
+	gnop.online = 0;
+	gnop.publishing = gnop.watching = gnop.sharing = 0;
+	gnop.local = 0;
+
+	perf_quit();
+	latency_quit();
+	timeline_quit();
+
+	scene_free(gnop.scene);
+	gnop.scene = NULL;
 
 	free(gnop.datadir);
+	gnop.tstart = 0;
+	gnop.shown = 0;
 
 #if HAVE_LIBSDL_MIXER
 	if (gnop.have_audio)
 		audio_quit();
+	gnop.have_audio = 0;
 #endif
 	ttf_quit();
+	pak_close();
+	input_quit();
 	video_quit();
+
+	mem_quit();
 }
 
 /*
@@ -241,7 +412,8 @@ void engine_quit(void)
  */
 int engine_loop(void)
 {
-	int p;
+	u8 input[2];
+	int n, retv;
 
 	if (gnop.running) {
 		log_warn("main loop is already runnning");
@@ -249,72 +421,181 @@ int engine_loop(void)
 	}
 
 	gnop.running = 1;
-	gnop.first_run = 1;
-	gnop.state = STATE_PREGAME;
-	srand(time(NULL));
+	time(&gnop.tstart);
+	retv = 0;
 
 	do {
-		if (gnop.state == STATE_PREGAME) {
-			if (gnop.first_run) {
-				gnop.first_run = 0;
-			}
-			else {  /* reset scores and paddles position */
-				gnop.score[0] = gnop.score[1] = 0;
-				text_set_text(gnop.score_txt[0], "0");
-				text_set_text(gnop.score_txt[1], "0");
-				AUTO_SET_X_SCORE_TXT(0);
-				AUTO_SET_X_SCORE_TXT(1);
-				paddle_reset_pos(gnop.paddle[0]);
-				paddle_reset_pos(gnop.paddle[1]);
+		begin_frame();
+		/* startup tasks allocate behind the frame's back */
+		gnop.steady = gnop.game.phase == GAME_PLAYING && !gnop.loading;
+
+		PERF_PHASE(PERF_PHASE_INPUT, handle_input(input));
+
+		if (instant_playing()) {
+			play_instant();
+		} else {
+			n = step_game(input);
+			if (n <= 0) {
+				retv = n < 0;
+				break;
 			}
+		}
+
+		mem_frame_end(gnop.steady);
+
+		if (!gnop.uncapped)
+			SDL_Delay(GAME_TICK_MS);
+	} while (gnop.running);
+
+	gnop.running = 0;
 
- 			go_idle(TIME_PREGAME);
-			SET_STATE(STATE_INGAME);
+	return retv;
+}
 
-			ball_start(gnop.ball);
+/*
+ * Play a tick of the game with `input' and draw it. Return 0 at the end
+ * of the recording played or once the netplay peer, or the server, is
+ * gone, or -1 if the recording diverged.
+ */
+static int step_game(u8 input[2])
+{
+	u32 ev;
+	int n;
+
+	if (gnop.watching)
+		return watch_game();
+
+	if (gnop.netplay) {
+		PERF_PHASE(PERF_PHASE_GAME, 
+			   n = net_step(&gnop.game, input[0], &ev));
+		if (n <= 0) {
+			latency_drop();
+			return n == 0;	/* waiting for the peer: go on */
 		}
-		else if (gnop.scored) {
-			/* someone scored (player gnop.scored-1) */
-			p = gnop.scored - 1;
-			text_set_text(gnop.score_txt[p], 
-				      "%d", gnop.score[p]);
-
-			AUTO_SET_X_SCORE_TXT(p);
-
-			if (gnop.score[p] >= SCORE_LIMIT &&
-			    gnop.score[p] > gnop.score[!p] + 1) {
-				/* it was a match ball.. */
-				SET_STATE(STATE_GAMEOVER);
-				AUTO_SET_X_WON_TXT(p);
-
-				log_info("Player %d won: %d - %d",
-					 gnop.score[0] > gnop.score[1] ? 1 : 2,
-					 gnop.score[0], gnop.score[1]);
-				PLAY_SND(AUDIO_GAMEOVER);
-
-				go_idle(TIME_GAME_OVER);
-				SET_STATE(STATE_PREGAME);
-			}
-			else {
-				go_idle(TIME_SCORED);
-				ball_start(gnop.ball);
+
+		record_confirmed();
+	} else if (gnop.online) {
+		PERF_PHASE(PERF_PHASE_GAME, 
+			   n = online_step(&gnop.game, input[0], &ev));
+		if (n <= 0) {
+			latency_drop();
+			return n == 0;	/* no state yet: go on */
+		}
+
+		if (gnop.publishing && stream_publish(&gnop.game) != 0)
+			gnop.publishing = 0;
+	} else {
+		if (gnop.replaying) {
+			n = replay_next(input);
+			if (n <= 0) {
+				if (n == 0)
+					log_info("replay: played %u ticks",
+						 gnop.game.tick);
+				return n;
 			}
+		}
+
+		if (gnop.sharing && !gnop.replaying && !gnop.recording)
+			shmem_bot(&gnop.game, input);
 
-			gnop.scored = 0;
+		PERF_PHASE(PERF_PHASE_GAME, 
+			   ev = game_step(&gnop.game, input));
+
+		if (gnop.recording)
+			replay_record(input, &gnop.game);
+		if (gnop.publishing && stream_publish(&gnop.game) != 0)
+			gnop.publishing = 0;
+
+		if (gnop.replaying && !replay_check(&gnop.game)) {
+			log_err("replay: diverged at tick %u", 
+				gnop.game.tick);
+			return -1;
 		}
+	}
+
+	if (!gnop.replaying && gnop.game.paddle[gnop.local].last_move &&
+	    !gnop.game.paused)
+		latency_mark(LATENCY_MOVED);
+	else
+		latency_drop();
 
-		handle_input();
- 		handle_ai();
+	if (gnop.sharing)
+		shmem_publish(&gnop.game);
 
-		if (gnop.state == STATE_INGAME)
-			handle_ball();
+	instant_push(&gnop.game, ev);
 
-		draw();
+	handle_events(ev);
+	draw(&gnop.game);
 
-		SDL_Delay(IDLE_MS);
-	} while (gnop.running);
-    
-	return 0;
+	return 1;
+}
+
+/*
+ * Record, and publish, the netplay ticks which can't be rolled back
+ * anymore: only those are sure to be played the same way again.
+ */
+static void record_confirmed(void)
+{
+	GameState s;
+	u8 input[2];
+
+	while (net_next_confirmed(input, &s)) {
+		if (gnop.recording)
+			replay_record(input, &s);
+		if (gnop.publishing && stream_publish(&s) != 0)
+			gnop.publishing = 0;
+	}
+}
+
+/*
+ * Show the state the relay streams, as it comes. Return 0 once the
+ * relay is gone.
+ */
+static int watch_game(void)
+{
+	GameState was = gnop.view;
+	int n;
+
+	latency_drop();
+
+	n = stream_watch(&gnop.view);
+	if (n <= 0)
+		return n == 0;	/* buffering: go on */
+
+	if (gnop.sharing)
+		shmem_publish(&gnop.view);
+
+	if (gnop.view.paused != was.paused)
+		gnop.todraw_panel = gnop.view.paused;
+	if (gnop.view.score[0] != was.score[0] || 
+	    gnop.view.score[1] != was.score[1])
+		gnop.steady = 0;	/* scores are rendered again */
+
+	draw(&gnop.view);
+
+	return 1;
+}
+
+/*
+ * Show the next frame of the instant replay, while the game waits.
+ */
+static void play_instant(void)
+{
+	u32 ev;
+
+	gnop.steady = 0;	/* scores may be rendered again */
+	latency_drop();
+
+	if (instant_next(&gnop.view, &ev)) {
+		play_sounds(ev);
+		draw(&gnop.view);
+		return;
+	}
+
+	/* back to the game, as it was left */
+	scene_show_replay(gnop.scene, 0);
+	gnop.todraw_panel = gnop.game.paused;
+	draw(&gnop.game);
 }
 
 /*
@@ -348,98 +629,246 @@ char *join_path(const char *a, const char *b, char *buf)
 }
 
 /*
- * Create and initialize some gnop's sprites.
+ * Wait for the assets still loading, for gnop-bench.
  */
-static void init_sprites(u32 fg_color, u32 bg_color)
+void engine_bench_setup(void)
 {
-	char path[PATH_MAX];
-	s16 i;
+	attach_assets(1);
+}
 
-	gnop.bg = sprite_new(VIDEO_WIDTH, VIDEO_HEIGHT);
-  	sprite_fill(gnop.bg, bg_color);
-	sprite_set_accel(gnop.bg, bg_color);
+/*
+ * Startup task: parse the fonts.
+ */
+static int load_fonts(void)
+{
+	int span, retv;
 
-	for (i=13; i<VIDEO_HEIGHT; ++i) { /* separator */
-		if (!(i % 13))
-			sprite_fill_region(gnop.bg, VIDEO_WIDTH / 2 - 2, 
-					   i-4, 4, 6, fg_color);
+	span = timeline_begin("font parse");
+	retv = scene_open_fonts(gnop.datadir, gnop.font);
+	timeline_end(span);
+
+	return retv;
+}
 
-		/* I know, too many magic numbers... */
+/*
+ * Build the score and "won" texts once the fonts are parsed. Without
+ * fonts the game goes on with no scores shown.
+ */
+static void attach_fonts(void)
+{
+	if (gnop.font_task.retv != 0) {
+		scene_close_fonts(gnop.font);
+		return;
 	}
 
-	gnop.ball = ball_new(fg_color);
-
-	gnop.paddle[0] = paddle_new(fg_color, PADDLE_POS_LEFT);
-	gnop.paddle[1] = paddle_new(fg_color, PADDLE_POS_RIGHT);
-	gnop.paddle_x[0] = layer_get_x(gnop.paddle[0]);
-	gnop.paddle_x[1] = layer_get_x(gnop.paddle[1]);
-	
-	join_path(gnop.datadir, FONT_BASENAME, path);
-
-	gnop.score_txt[0] = text_new(path, FONT_SCORE_PTSZ, fg_color);
-	gnop.score_txt[1] = text_new(path, FONT_SCORE_PTSZ, fg_color);
-	text_set_text(gnop.score_txt[0], "0");
-	text_set_text(gnop.score_txt[1], "0");
-	layer_set_y(gnop.score_txt[0], SCORE_TXT_Y);
-	layer_set_y(gnop.score_txt[1], SCORE_TXT_Y);
-	AUTO_SET_X_SCORE_TXT(0);
-	AUTO_SET_X_SCORE_TXT(1);
-
-	gnop.won_txt = text_new(path, FONT_WON_PTSZ, fg_color);
-	text_set_text(gnop.won_txt, "won");
-	layer_set_y(gnop.won_txt,  WON_TXT_Y);
+	scene_set_fonts(gnop.scene, gnop.font);
+	memset(gnop.font, 0, sizeof(gnop.font));	/* owned by the scene */
+
+	gnop.steady = 0;	/* rendering texts allocates */
+	timeline_mark("scores attached");
 }
 
+#if HAVE_LIBSDL_MIXER
 /*
- * Performs sprites blit then update screen.
+ * Startup task: open the audio device and load the sounds.
  */
-static void draw(void)
+static int load_audio(void)
 {
-	if (gnop.paused && !gnop.todraw_panel)
-		return;
+	return audio_init(gnop.datadir, gnop.audio_frames);
+}
+#endif
 
-	objects_blit(gnop.bg, gnop.score_txt[0], gnop.score_txt[1],
-		     gnop.paddle[0], gnop.paddle[1], NULL);
+static int task_run(void *arg)
+{
+	Task *task = arg;
 
-	if (gnop.state != STATE_IDLE)
-		object_blit(gnop.ball);
+	task->retv = task->fn();
+	__atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
 
-	if (gnop.state == STATE_IDLE && gnop.prev_state == STATE_GAMEOVER)
-		object_blit(gnop.won_txt);
+	return 0;
+}
 
-	if (gnop.paused) {
-		object_blit(gnop.panel);
-		gnop.todraw_panel = 0;
+/*
+ * Run `fn' on a new thread, or right away if none can be created.
+ */
+static void task_start(Task *task, int (*fn)(void))
+{
+	task->fn = fn;
+	task->done = 0;
+	++gnop.loading;
+
+	task->thread = SDL_CreateThread(task_run, task);
+	if (!task->thread) {
+		log_warn("could not start task: %s", SDL_GetError());
+		task_run(task);
 	}
+}
+
+/*
+ * Return 1 if `task' has finished since the last call; with `block' set,
+ * wait for it.
+ */
+static bool task_join(Task *task, bool block)
+{
+	if (!task->fn)
+		return 0;
+
+	if (!block && !__atomic_load_n(&task->done, __ATOMIC_ACQUIRE))
+		return 0;
+
+	if (task->thread)
+		SDL_WaitThread(task->thread, NULL);
+
+	task->thread = NULL;
+	task->fn = NULL;
+	--gnop.loading;
+
+	return 1;
+}
+
+/*
+ * Attach the results of finished startup tasks.
+ */
+static void attach_assets(bool block)
+{
+	if (task_join(&gnop.font_task, block))
+		attach_fonts();
+
+#if HAVE_LIBSDL_MIXER
+	if (task_join(&gnop.audio_task, block)) {
+		gnop.have_audio = gnop.audio_task.retv == 0;
+		timeline_mark("sounds attached");
+	}
+#endif
+}
+
+/*
+ * Wait for the startup tasks, dropping the fonts they parsed.
+ */
+static void cancel_tasks(void)
+{
+	if (task_join(&gnop.font_task, 1))
+		scene_close_fonts(gnop.font);
+
+#if HAVE_LIBSDL_MIXER
+	if (task_join(&gnop.audio_task, 1))
+		gnop.have_audio = gnop.audio_task.retv == 0;
+#endif
+}
+
+/*
+ * Start a frame of either loop.
+ */
+static void begin_frame(void)
+{
+	mem_frame_begin();
+
+	metrics_frame();
+	metrics_set(METRIC_SURFACE_BYTES, mem_get_surface_bytes());
+#if HAVE_LIBSDL_MIXER
+	if (gnop.have_audio)
+		metrics_set(METRIC_AUDIO_UNDERRUNS, audio_get_underruns());
+#endif
+}
+
+/*
+ * Performs sprites blit of state `g' then update screen.
+ */
+static void draw(const GameState *g)
+{
+	if (gnop.loading)
+		attach_assets(0);
+
+	if (g->paused && !gnop.todraw_panel)
+		return;
+
+	latency_mark(LATENCY_RENDER);
+	perf_begin(PERF_PHASE_BLIT);
+
+	scene_draw(gnop.scene, g);
+	gnop.todraw_panel = 0;
+
+	perf_end(PERF_PHASE_BLIT);
+
+	latency_mark(LATENCY_FLIP);
+	PERF_PHASE(PERF_PHASE_FLIP, video_flip());
+	latency_mark(LATENCY_SHOWN);
 
-	video_flip();
+	if (!gnop.shown) {
+		gnop.shown = 1;
+		timeline_mark("first frame");
+	}
 }
 
 /*
- * Handle user input.
+ * Handle user input, and fill `input' with the game keys held for this
+ * tick.
  */
-static void handle_input(void)
+static void handle_input(u8 input[2])
 {
-	SDL_Event event;
-	
-	while (SDL_PollEvent(&event)) {
-		switch (event.type) {
-		case SDL_KEYDOWN:
-			switch (event.key.keysym.sym) {
+	InputEvent ev;
+	u64 arrival;
+	bool up, down;
+
+	input[0] = input[1] = 0;
+
+	/*
+	 * Without an event thread, events are only timestamped when the 
+	 * game thread pumps them: the earliest they could have arrived is
+	 * right after the previous poll.
+	 */
+	if (!gnop.last_poll)
+		gnop.last_poll = clock_ns();
+
+	input_pump();
+
+	while (input_pop(&ev)) {
+		arrival = input_threaded() ? ev.time : gnop.last_poll;
+
+		switch (ev.type) {
+		case INPUT_KEY_DOWN:
+			if (ev.key != SDLK_UP && ev.key != SDLK_DOWN)
+				gnop.steady = 0;
+
+			if (ev.key == SDLK_r || ev.key == SDLK_s) {
+				if (instant_playing())
+					instant_stop();
+				else
+					start_instant(0, ev.key == SDLK_s ?
+						      INSTANT_SLOW : 1);
+				break;
+			}
+
+			/* a recording, or the relay, brings the game keys */
+			if (gnop.replaying || gnop.watching) {
+				if (gnop.replaying && (ev.key == SDLK_LEFT || 
+						       ev.key == SDLK_RIGHT))
+					seek(ev.key == SDLK_LEFT ? -SEEK_TICKS
+								 : SEEK_TICKS);
+				if (ev.key == SDLK_UP || ev.key == SDLK_DOWN ||
+				    ev.key == SDLK_F2 || ev.key == SDLK_p)
+					break;
+			}
+
+			switch (ev.key) {
 			case SDLK_ESCAPE:
 				gnop.running = 0;
 				break;
 
 			case SDLK_UP:
+				latency_input(arrival, input_threaded());
 				gnop.key_up_pressed = 1;
+				gnop.key_up_latched = 1;
 				break;
 
 			case SDLK_DOWN:
+				latency_input(arrival, input_threaded());
 				gnop.key_down_pressed = 1;
+				gnop.key_down_latched = 1;
 				break;
 
 			case SDLK_F2:
-				gnop.state = STATE_PREGAME;
+				input[0] |= GAME_INPUT_RESTART;
 				log_info("match restarted");
 				break;
 
@@ -452,9 +881,7 @@ static void handle_input(void)
 				break;
 #endif
 			case SDLK_p:
-				gnop.paused = !gnop.paused;
-				if (gnop.paused)
-					gnop.todraw_panel = 1;
+				input[0] ^= GAME_INPUT_PAUSE;
 				break;
 #if HAVE_LIBSDL_MIXER
 			case SDLK_9:
@@ -468,8 +895,8 @@ static void handle_input(void)
 			}
 			break;
 
-		case SDL_KEYUP:
-			switch (event.key.keysym.sym) {
+		case INPUT_KEY_UP:
+			switch (ev.key) {
 			case SDLK_UP:
 				gnop.key_up_pressed = 0;
 				break;
@@ -480,176 +907,120 @@ static void handle_input(void)
 			}
 			break;
 
-		case SDL_QUIT:
+		case INPUT_QUIT:
 			gnop.running = 0;
 			return;
 		}
 	}
 
-	if (gnop.key_up_pressed)
-		paddle_move(gnop.paddle[0], PADDLE_MOVE_UP);
-	else if (gnop.key_down_pressed)
-		paddle_move(gnop.paddle[0], PADDLE_MOVE_DOWN);
+	gnop.last_poll = clock_ns();
+
+	/*
+	 * Key state is applied once per tick; a key pressed and released
+	 * within the same tick still counts as held for that tick.
+	 */
+	up = gnop.key_up_pressed || gnop.key_up_latched;
+	down = gnop.key_down_pressed || gnop.key_down_latched;
+	gnop.key_up_latched = gnop.key_down_latched = 0;
+
+	if (up)
+		input[0] |= GAME_INPUT_UP;
+	else if (down)
+		input[0] |= GAME_INPUT_DOWN;
 }
 
 /*
- * Handle CPU player.
+ * Jump `ticks' back or forth in the recording being played.
  */
-static void handle_ai(void)
+static void seek(int ticks)
 {
-	u16 pbar, pbar_human;
-	s16 bx, by;
-	s8 vect_x, vect_y;
-
-	pbar = layer_get_y(gnop.paddle[1]) + PADDLE_HEIGHT / 2;
+	u32 tick = gnop.game.tick;
 
-	ball_get_vectors(gnop.ball, &vect_x, &vect_y);
-	bx = layer_get_x(gnop.ball);
-	by = layer_get_y(gnop.ball);
+	tick = ticks < 0 && tick < (u32)-ticks ? 0 : tick + ticks;
+	if (replay_seek(&gnop.game, tick) != 0)
+		gnop.running = 0;	/* at the end anyway */
 
-	if (gnop.state == STATE_IDLE || gnop.state == STATE_PREGAME) {
-		if (pbar < VIDEO_HEIGHT / 2)
-			paddle_move(gnop.paddle[1], PADDLE_MOVE_DOWN);
-		else if (pbar > VIDEO_HEIGHT / 2)
-			paddle_move(gnop.paddle[1], PADDLE_MOVE_UP);
-
-		return;
-	}
-	
-	if (vect_x < 0 && bx + BALL_WIDTH <= VIDEO_WIDTH * 2/3) {
-		if (pbar <= VIDEO_HEIGHT * 2/5)
-			paddle_move(gnop.paddle[1], PADDLE_MOVE_DOWN);
-		else if (pbar >= VIDEO_HEIGHT * 3/5)
-			paddle_move(gnop.paddle[1], PADDLE_MOVE_UP);
-		
-		if (gnop.state == STATE_PREGAME)
-			return;
-	}
-
-	if (vect_x > 0 && bx + BALL_WIDTH + vect_x >= gnop.paddle_x[1]) {
-		pbar_human = layer_get_y(gnop.paddle[0]) + PADDLE_HEIGHT / 2;
-		if (pbar_human > VIDEO_HEIGHT / 2)
-			paddle_move(gnop.paddle[1], PADDLE_MOVE_UP);
-		else
-			paddle_move(gnop.paddle[1], PADDLE_MOVE_DOWN);
-	}
+	/* what was kept leads somewhere else now */
+	instant_reset();
+	scene_show_replay(gnop.scene, 0);
+}
 
-	if (vect_x < 0 && abs(vect_y) > vect_x && bx < VIDEO_WIDTH * 2/3)
+/*
+ * Show the last rally, or the last INSTANT_SECONDS, again. With `slow'
+ * set each frame is shown for that many ticks.
+ */
+static void start_instant(bool rally, u8 slow)
+{
+	/* the peer, the server or the relay would not wait */
+	if (gnop.netplay || gnop.online || gnop.watching || 
+	    !instant_start(rally, slow))
 		return;
 
-	if ((vect_x < 0 && bx + BALL_WIDTH / 2 <= VIDEO_WIDTH * 2/3) ||
-	    (vect_x < 10 && bx + BALL_WIDTH / 2 <= VIDEO_WIDTH * 3/5))
-		return;
-	
-	if (pbar + 5 < by + BALL_HEIGHT / 2)
-		paddle_move(gnop.paddle[1], PADDLE_MOVE_DOWN);
-	else if (pbar - 5 > by + BALL_HEIGHT / 2)
-		paddle_move(gnop.paddle[1], PADDLE_MOVE_UP);
+	gnop.view = gnop.game;
+	scene_show_replay(gnop.scene, 1);
 }
 
 /*
- * Handle ball activities.
+ * Play the sounds of events `ev'.
  */
-static void handle_ball(void)
+static void play_sounds(u32 ev)
 {
-	s16 x, y;
-	s8 vect_x, lm;
-	int i, j, p;
-	bool hit;
-
-	x = layer_get_x(gnop.ball);
-	y = layer_get_y(gnop.ball);
-
-	p = -1;
-	if (x + BALL_WIDTH < 0) 
-		p = 1; /* player1 scored */
-	else if (x >= VIDEO_WIDTH)
-		p = 0; /* player0 scored */
-
-	if (p > -1) { /* update score */
-		++gnop.score[p];
-		gnop.scored = p+1;
-		PLAY_SND(AUDIO_SCORED);
-		return;
-	}
-
-	/* Check for bouncing against horizontal walls:  */
-	if (y <= 0 || y + BALL_HEIGHT >= VIDEO_HEIGHT) {
-		ball_bounce(gnop.ball, BALL_BOUNCE_V, 0);
+	if (ev & (GAME_EVENT_WALL | GAME_EVENT_HIT_1 | GAME_EVENT_HIT_2))
 		PLAY_SND(AUDIO_BOUNCE);
 
-		/* fix ball position: */
-		if (y < 0)
-			layer_set_y(gnop.ball, 0);
-		else if (y + BALL_HEIGHT > VIDEO_HEIGHT)
-			layer_set_y(gnop.ball, VIDEO_HEIGHT - BALL_HEIGHT);
-
-		return;
-	}
-
-	if (x <= gnop.paddle_x[0] + PADDLE_WIDTH)
-		p = 0; /* player0 could have hit the ball */
-	else if (x + BALL_WIDTH >= gnop.paddle_x[1])
-		p = 1; /* player1 could have hit the ball */
-	else
-		return;
-
-	ball_get_vectors(gnop.ball, &vect_x, NULL);
-	if ((!p && vect_x > 0) || (p && vect_x < 0))
-		return;
+	if (ev & (GAME_EVENT_POINT_1 | GAME_EVENT_POINT_2))
+		PLAY_SND(AUDIO_SCORED);
 
-	/* Check for paddle-ball collisions: */
-	for (i=0, hit=0; i<BALL_WIDTH && !hit; ++i) {
-		for (j=0; j<BALL_HEIGHT && !hit; ++j) {
-			if (layer_own(gnop.paddle[p], x+i, y+j)) {
-				/*
-				 * Player(p) hit the ball, now we have to fix
-				 * ball position then perform bouncing.
-				 */
-
-				if (p) {
-					layer_set_x(gnop.ball, 
-						    gnop.paddle_x[1] +
-						    - BALL_WIDTH);
-				}
-				else {
-					layer_set_x(gnop.ball,
-						    gnop.paddle_x[0] + 
-						    PADDLE_WIDTH);
-				}
-
-				lm = paddle_last_move(gnop.paddle[p]);
-				ball_bounce(gnop.ball, BALL_BOUNCE_H, lm);
-				PLAY_SND(AUDIO_BOUNCE);
-				hit = 1;
-			}
-		}
-	}
+	if (ev & GAME_EVENT_WON)
+		PLAY_SND(AUDIO_GAMEOVER);
 }
 
 /*
- * Set the game in idle mode for `ms' milliseconds.
+ * React to what happened in the last game step.
  */
-static void go_idle(int ms)
+static void handle_events(u32 ev)
 {
-	u32 ticks;
+	const GameState *g = &gnop.game;
+	int p;
 
-	gnop.prev_state = gnop.state;
-	gnop.state = STATE_IDLE;
+	if (ev & GAME_EVENT_PAUSE) {
+		gnop.todraw_panel = g->paused;
+		gnop.steady = 0;
+	}
+
+	if (ev & GAME_EVENT_MATCH) {
+		telemetry_rally_end(g->tick, 0);	/* restarted in one */
+		metrics_add(METRIC_MATCHES_STARTED, 1);
+		gnop.steady = 0;	/* scores are rendered again */
+	}
+
+	if (ev & GAME_EVENT_SERVE)
+		telemetry_rally_start(g->match, g->tick);
 
-	ticks = SDL_GetTicks();
-	while (ticks + ms > SDL_GetTicks() && gnop.running) {
-		handle_input();
+	play_sounds(ev);
 
-		if (gnop.prev_state != STATE_GAMEOVER)
-			handle_ai();
+	for (p=0; p<2; ++p) {
+		if (ev & (GAME_EVENT_HIT_1 << p))
+			telemetry_hit(p+1, g->ball.vx, g->ball.vy);
+
+		if (ev & (GAME_EVENT_POINT_1 << p)) {
+			telemetry_rally_end(g->tick, p+1);
+			metrics_add(p ? METRIC_POINTS_P2 : METRIC_POINTS_P1, 1);
+
+			/* re-rendering the score: not a steady frame */
+			gnop.steady = 0;
+		}
+	}
 
-		draw();
+	if (ev & GAME_EVENT_WON) {
+		p = g->score[1] > g->score[0];
 
-		SDL_Delay(IDLE_MS);
+		metrics_add(METRIC_MATCHES_FINISHED, 1);
+		log_info("Player %d won: %d - %d", p+1, 
+			 g->score[0], g->score[1]);
 	}
 
-	gnop.state ^= gnop.prev_state;
-	gnop.prev_state ^= gnop.state;
-	gnop.state ^= gnop.prev_state;
+	if (ev & (GAME_EVENT_POINT_1 | GAME_EVENT_POINT_2) && 
+	    gnop.auto_replay)
+		start_instant(1, INSTANT_SLOW);
 }
@@ -29,18 +29,52 @@ enum EngineOptions {
 #if HAVE_LIBSDL_MIXER
 	ENGINE_OPTION_MUTE=	1 << 1,
 #endif
+	ENGINE_OPTION_PERF=	1 << 2,
+	ENGINE_OPTION_MEM_STATS=	1 << 3,
+	ENGINE_OPTION_MEM_CHECK=	1 << 4,
+	ENGINE_OPTION_LATENCY=	1 << 5,
+	ENGINE_OPTION_STARTUP=	1 << 6,
+	ENGINE_OPTION_UNCAPPED=	1 << 7,	/* don't wait between ticks */
+	ENGINE_OPTION_AUTO_REPLAY=	1 << 8,	/* replay rallies after points */
+	ENGINE_OPTION_WATCH_UDP=	1 << 9,	/* watch over UDP */
 };
 
+/*
+ * Engine settings, filled by the caller of engine_init().
+ */
+typedef struct {
+	u32         opts;	/* or-ed EngineOptions or 0 */
+	const char *datadir;	/* NULL: default data directory */
+	u32         fg_color;
+	u32         bg_color;
+	u8          bpp;	/* 0: use the display's depth */
+	u16         audio_frames; /* 0: SDL_mixer, else low-latency mixer */
+	const char *telemetry;	/* NULL, or CSV file recording rallies */
+	const char *metrics;	/* NULL, or port/socket serving metrics */
+	const char *shmem;	/* NULL, or shared memory object to share in */
+	const char *ai;		/* NULL, or AI preset: a file, or a name */
+	const char *record;	/* NULL, or file recording the game */
+	const char *play;	/* NULL, or recording to play back */
+	u32         seek;	/* tick to start playing back from */
+	const char *host;	/* NULL, or UDP port to host netplay on */
+	const char *join;	/* NULL, or HOST:PORT of the netplay host */
+	u16         net_delay;	/* added to every packet sent (ms) */
+	u16         net_jitter;	/* added or taken from net_delay (ms) */
+	u8          net_loss;	/* packets dropped (%) */
+	const char *server;	/* NULL, or HOST:PORT of a gnop-server */
+	const char *relay;	/* NULL, or HOST:PORT of a relay to stream to */
+	const char *watch;	/* NULL, or HOST:PORT of a relay to watch */
+} EngineConfig;
+
 /*
  * Initialize gnop's engine.
  *
- * `opts' should be or-ed EngineOptions or 0.
- *  If `datadir' is a NULL pointer, default directory will be used (whose was
- *  definited at compilation time).
+ *  If `cfg->datadir' is a NULL pointer, default directory will be used
+ *  (whose was definited at compilation time).
  *  engine_init() will return 0 if the engine was initialized correctly;
  *  otherwise, on error, the functino will return -1.
  */
-int  engine_init (u8 opts, const char *datadir, u32 fg_color, u32 bg_color);
+int  engine_init (const EngineConfig *cfg);
 
 /*
  * Quit gnop's engine.
@@ -49,6 +83,11 @@ void engine_quit (void);
 
 /*
  * Gnop main loop.
+ *
+ *  When playing a recording back, engine_loop() returns at its end: 0 if
+ *  every tick led to the recorded state, 1 otherwise. In netplay it
+ *  returns 0 once the peer is gone, playing online once the server is,
+ *  and when watching once the relay is.
  */
 int  engine_loop (void);
 
@@ -65,4 +104,10 @@ int  engine_loop (void);
  */
 char *join_path(const char *a, const char *b, char *buf);
 
+/*
+ * Hook for gnop-bench, not used by the game itself: wait for the assets
+ * an initialized engine is still loading.
+ */
+void engine_bench_setup (void);
+
 #endif /* !ENGINE_H */
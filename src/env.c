@@ -0,0 +1,187 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "env.h"
+#include "game.h"
+
+struct EnvBatch {
+	EnvConfig  cfg;
+	GameState *game;
+	u8        *last;	/* action held at the latest tick */
+	u32       *ticks;	/* into the episode */
+	u64        rng;
+	u64        episodes;
+};
+
+static const u8 keys[ENV_ACTIONS] = {
+	[ENV_ACTION_UP] = GAME_INPUT_UP,
+	[ENV_ACTION_DOWN] = GAME_INPUT_DOWN,
+};
+
+/*
+ * splitmix64, for seeds and sticky actions.
+ */
+static u64 next_rand(EnvBatch *b)
+{
+	u64 z = (b->rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+/*
+ * Play the ticks before the ball is in play with no keys held.
+ */
+static void skip_idle(GameState *s)
+{
+	static const u8 none[2];
+
+	while (s->phase != GAME_PLAYING)
+		game_step(s, none);
+}
+
+static void start(EnvBatch *b, u32 i)
+{
+	game_init(&b->game[i], next_rand(b));
+	b->last[i] = ENV_ACTION_NONE;
+	b->ticks[i] = 0;
+
+	if (b->cfg.skip_idle)
+		skip_idle(&b->game[i]);
+}
+
+static void observe(const GameState *s, float *obs)
+{
+	obs[ENV_OBS_BALL_X] = (float)s->ball.x / 
+			      (GAME_WIDTH - GAME_BALL_SIZE);
+	obs[ENV_OBS_BALL_Y] = (float)s->ball.y / 
+			      (GAME_HEIGHT - GAME_BALL_SIZE);
+	obs[ENV_OBS_BALL_VX] = (float)s->ball.vx / GAME_BALL_SPEED;
+	obs[ENV_OBS_BALL_VY] = (float)s->ball.vy / GAME_BALL_SPEED;
+	obs[ENV_OBS_PADDLE] = (float)s->paddle[0].pos / GAME_PADDLE_LIMIT;
+	obs[ENV_OBS_OPPONENT] = (float)s->paddle[1].pos / GAME_PADDLE_LIMIT;
+	obs[ENV_OBS_PLAYING] = s->phase == GAME_PLAYING;
+}
+
+EnvBatch *env_batch_new(const EnvConfig *cfg)
+{
+	EnvBatch *b;
+
+	if (!cfg->n)
+		return NULL;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+
+	b->cfg = *cfg;
+	if (!b->cfg.repeat)
+		b->cfg.repeat = 1;
+	b->rng = cfg->seed;
+
+	b->game = malloc(cfg->n * sizeof(*b->game));
+	b->last = malloc(cfg->n * sizeof(*b->last));
+	b->ticks = malloc(cfg->n * sizeof(*b->ticks));
+	if (!b->game || !b->last || !b->ticks) {
+		env_batch_free(b);
+		return NULL;
+	}
+
+	return b;
+}
+
+void env_batch_free(EnvBatch *b)
+{
+	if (!b)
+		return;
+
+	free(b->game);
+	free(b->last);
+	free(b->ticks);
+	free(b);
+}
+
+void env_batch_reset(EnvBatch *b, float *obs)
+{
+	u32 i;
+
+	for (i=0; i<b->cfg.n; ++i) {
+		start(b, i);
+		observe(&b->game[i], obs + i * ENV_OBS_LEN);
+	}
+}
+
+void env_batch_step(EnvBatch *b, const u8 *actions, float *obs, 
+		    float *rewards, u8 *dones)
+{
+	const EnvConfig *cfg = &b->cfg;
+	GameState *s;
+	u8 input[2] = { 0, 0 }, action, done;
+	float reward;
+	u32 i, t, ev;
+
+	for (i=0; i<cfg->n; ++i) {
+		s = &b->game[i];
+		action = actions[i] < ENV_ACTIONS ? actions[i] 
+						  : ENV_ACTION_NONE;
+		reward = 0;
+		done = 0;
+
+		for (t=0; t<cfg->repeat && !done; ++t) {
+			if (!cfg->sticky || next_rand(b) % 100 >= cfg->sticky)
+				b->last[i] = action;
+			input[0] = keys[b->last[i]];
+
+			ev = game_step(s, input);
+			if (ev & GAME_EVENT_POINT_1)
+				reward += 1;
+			if (ev & GAME_EVENT_POINT_2)
+				reward -= 1;
+			if (ev & GAME_EVENT_WON)
+				done |= ENV_DONE_OVER;
+
+			if (++b->ticks[i] == cfg->max_ticks)
+				done |= ENV_DONE_TRUNCATED;
+		}
+
+		if (done) {
+			++b->episodes;
+			start(b, i);
+		} else if (cfg->skip_idle) {
+			skip_idle(s);
+		}
+
+		observe(s, obs + i * ENV_OBS_LEN);
+		rewards[i] = reward;
+		dones[i] = done;
+	}
+}
+
+void env_batch_pixels(const EnvBatch *b, const Raster *r, u8 *pixels, 
+		      u32 threads)
+{
+	raster_batch(r, b->game, b->cfg.n, pixels, threads);
+}
+
+u64 env_batch_episodes(const EnvBatch *b)
+{
+	return b->episodes;
+}
@@ -0,0 +1,112 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ENV_H
+#define ENV_H
+
+#include "raster.h"
+
+/*
+ * Batches of independent matches, stepped in lockstep for training
+ * agents: the agent plays the left paddle of every match, the AI the
+ * right one. Built into libgnop-env.a; a batch has no global state, so
+ * threads may each step their own.
+ *
+ * Every call writes its results into the caller's contiguous arrays,
+ * one entry (or ENV_OBS_LEN floats) per match, and allocates nothing.
+ */
+
+/*
+ * What the agent sees of its match. Speeds and paddles are in [-1, 1].
+ * The ball's position is in [0, 1] but for a step's worth past either
+ * end as the ball meets a wall or leaves the field.
+ */
+enum {
+	ENV_OBS_BALL_X,		/* 0 at the left edge, 1 at the right */
+	ENV_OBS_BALL_Y,		/* 0 at the top, 1 at the bottom */
+	ENV_OBS_BALL_VX,	/* per tick, over GAME_BALL_SPEED */
+	ENV_OBS_BALL_VY,
+	ENV_OBS_PADDLE,		/* the agent's, from its middle: -1 up */
+	ENV_OBS_OPPONENT,
+	ENV_OBS_PLAYING,	/* 1 while the ball is in play, else 0 */
+	ENV_OBS_LEN
+};
+
+/*
+ * Actions.
+ */
+enum {
+	ENV_ACTION_NONE,
+	ENV_ACTION_UP,
+	ENV_ACTION_DOWN,
+	ENV_ACTIONS
+};
+
+/*
+ * `dones' flags: how an episode, a match, ended.
+ */
+enum {
+	ENV_DONE_OVER=		1 << 0,		/* someone won */
+	ENV_DONE_TRUNCATED=	1 << 1,		/* `max_ticks' was reached */
+};
+
+typedef struct {
+	u32  n;			/* matches */
+	u64  seed;
+	u32  repeat;		/* ticks an action is held for: frame skip */
+	u8   sticky;		/* % of ticks the previous action is kept */
+	u32  max_ticks;		/* per episode, 0 for no limit */
+	bool skip_idle;		/* play pauses between points at once */
+} EnvConfig;
+
+typedef struct EnvBatch EnvBatch;
+
+/*
+ * Create a batch of `cfg->n' matches. Return NULL on error.
+ */
+EnvBatch *env_batch_new (const EnvConfig *cfg);
+
+void      env_batch_free (EnvBatch *b);
+
+/*
+ * Start a new episode in every match, and write what each shows into
+ * `obs' (n * ENV_OBS_LEN).
+ */
+void      env_batch_reset (EnvBatch *b, float *obs);
+
+/*
+ * Play `actions[i]' in match `i' for `repeat' ticks. Write what each
+ * shows then into `obs', the points won (+1) and lost (-1) meanwhile
+ * into `rewards', and into `dones' whether the episode ended. An ended
+ * episode starts over at once: `obs' shows the new one.
+ */
+void      env_batch_step (EnvBatch *b, const u8 *actions, float *obs, 
+			   float *rewards, u8 *dones);
+
+/*
+ * Draw what every match shows now into frames of `r' at `pixels', one
+ * after the other, with up to `threads' threads; see raster_batch().
+ */
+void      env_batch_pixels (const EnvBatch *b, const Raster *r, 
+			    u8 *pixels, u32 threads);
+
+/*
+ * Episodes ended since the batch was created.
+ */
+u64       env_batch_episodes (const EnvBatch *b);
+
+#endif /* !ENV_H */
@@ -0,0 +1,349 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The rules of gnop, stepped one tick at a time.
+ *
+ * Positions and speeds are integers and the random numbers come from a
+ * generator kept in the state, so a step only depends on the state and
+ * on the inputs. Keep it that way: recorded games are replayed and
+ * checked against their hashes.
+ */
+
+#include "ai.h"
+#include "bytes.h"
+#include "game.h"
+
+#define BALL_X0		(GAME_WIDTH / 2 - GAME_BALL_SIZE / 2)
+#define BALL_Y0		(GAME_HEIGHT / 2 - GAME_BALL_SIZE / 2)
+
+/*
+ * Horizontal speed for a vertical speed of `i', so that the ball keeps
+ * GAME_BALL_SPEED: (s8)sqrt(GAME_BALL_SPEED^2 - i^2).
+ */
+static const s8 speed_x[GAME_BALL_SPEED] = {
+	13, 12, 12, 12, 12, 12, 11, 10, 10, 9, 8, 6, 5,
+};
+
+/*
+ * splitmix64.
+ */
+u32 game_rand(GameState *s)
+{
+	u64 z = (s->rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return (z ^ (z >> 31)) >> 32;
+}
+
+void game_init(GameState *s, u64 seed)
+{
+	memset(s, 0, sizeof(*s));
+	s->rng = seed;
+	s->cpu = 1 << 1;
+	s->phase = GAME_OVER;
+	s->timer = 1;
+}
+
+bool game_paddle_move(GameState *s, int p, s8 way)
+{
+	if (abs(s->paddle[p].pos + way) < GAME_PADDLE_LIMIT) {
+		s->paddle[p].move = way;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void start_match(GameState *s)
+{
+	++s->match;
+	s->score[0] = s->score[1] = 0;
+	s->paddle[0].pos = s->paddle[1].pos = 0;
+	s->phase = GAME_PREGAME;
+	s->timer = GAME_PREGAME_TICKS;
+}
+
+static void serve(GameState *s)
+{
+	GameBall *b = &s->ball;
+
+	b->x = BALL_X0;
+	b->y = BALL_Y0;
+
+	b->vy = game_rand(s) % 3;
+	b->vx = speed_x[b->vy];
+
+	if (game_rand(s) % 2 == 0)
+		b->vy *= -1;
+
+	if (game_rand(s) % 2 == 0)
+		b->vx *= -1;
+
+	s->phase = GAME_PLAYING;
+}
+
+/*
+ * Reverse the ball's vertical (`vertical' set) or horizontal speed,
+ * then let a moving paddle (`push' -1 or 1) deflect it by up to two.
+ */
+static void bounce(GameBall *b, bool vertical, int push)
+{
+	int i, vx;
+
+	if (vertical)
+		b->vy *= -1;
+	else
+		b->vx *= -1;
+
+	vx = b->vx;
+
+	for (i=0; i<2; ++i)
+		if (push < 0 && b->vy - 1 > -GAME_BALL_SPEED)
+			b->vy -= 1;
+		else if (push > 0 && b->vy + 1 < GAME_BALL_SPEED)
+			b->vy += 1;
+		else
+			return;
+
+	b->vx = speed_x[abs(b->vy)];
+
+	if (vx < 0)
+		b->vx *= -1;
+}
+
+/*
+ * Score for player `p'.
+ */
+static u32 point(GameState *s, int p)
+{
+	u32 ev = p ? GAME_EVENT_POINT_2 : GAME_EVENT_POINT_1;
+
+	++s->score[p];
+
+	if (s->score[p] >= GAME_SCORE_LIMIT &&
+	    s->score[p] > s->score[!p] + 1) {
+		s->phase = GAME_OVER;
+		s->timer = GAME_OVER_TICKS;
+		return ev | GAME_EVENT_WON;
+	}
+
+	s->phase = GAME_SCORED;
+	s->timer = GAME_SCORED_TICKS;
+
+	return ev;
+}
+
+static u32 ball_step(GameState *s)
+{
+	GameBall *b = &s->ball;
+	s16 px, py;
+	int p;
+
+	if (b->x + GAME_BALL_SIZE < 0)
+		return point(s, 1);
+	else if (b->x >= GAME_WIDTH)
+		return point(s, 0);
+
+	/* horizontal walls: */
+	if (b->y <= 0 || b->y + GAME_BALL_SIZE >= GAME_HEIGHT) {
+		bounce(b, 1, 0);
+
+		if (b->y < 0)
+			b->y = 0;
+		else if (b->y + GAME_BALL_SIZE > GAME_HEIGHT)
+			b->y = GAME_HEIGHT - GAME_BALL_SIZE;
+
+		return GAME_EVENT_WALL;
+	}
+
+	if (b->x <= GAME_PADDLE_X(0) + GAME_PADDLE_WIDTH)
+		p = 0;
+	else if (b->x + GAME_BALL_SIZE >= GAME_PADDLE_X(1))
+		p = 1;
+	else
+		return 0;
+
+	if ((!p && b->vx > 0) || (p && b->vx < 0))
+		return 0;
+
+	/* paddles own their right and bottom edges too */
+	px = GAME_PADDLE_X(p);
+	py = GAME_PADDLE_Y(s, p);
+	if (b->x > px + GAME_PADDLE_WIDTH || b->x + GAME_BALL_SIZE - 1 < px ||
+	    b->y > py + GAME_PADDLE_HEIGHT || b->y + GAME_BALL_SIZE - 1 < py)
+		return 0;
+
+	b->x = p ? px - GAME_BALL_SIZE : px + GAME_PADDLE_WIDTH;
+	bounce(b, 0, s->paddle[p].last_move);
+
+	return p ? GAME_EVENT_HIT_2 : GAME_EVENT_HIT_1;
+}
+
+u32 game_step(GameState *s, const u8 input[2])
+{
+	u8 any = input[0] | input[1];
+	u32 ev = 0;
+	int p;
+
+	++s->tick;
+
+	if (any & GAME_INPUT_PAUSE) {
+		s->paused = !s->paused;
+		ev |= GAME_EVENT_PAUSE;
+	}
+
+	if (s->paused)
+		return ev;
+
+	if (any & GAME_INPUT_RESTART) {
+		start_match(s);
+		ev |= GAME_EVENT_MATCH;
+	}
+	else if (s->phase != GAME_PLAYING && --s->timer == 0) {
+		if (s->phase == GAME_OVER) {
+			start_match(s);
+			ev |= GAME_EVENT_MATCH;
+		}
+		else {
+			serve(s);
+			ev |= GAME_EVENT_SERVE;
+		}
+	}
+
+	for (p=0; p<2; ++p) {
+		if (s->cpu & (1 << p)) {
+			/* the winner gets to celebrate */
+			if (s->phase != GAME_OVER)
+				ai_move(s, p);
+		}
+		else if (input[p] & GAME_INPUT_UP)
+			game_paddle_move(s, p, -GAME_PADDLE_STEP);
+		else if (input[p] & GAME_INPUT_DOWN)
+			game_paddle_move(s, p, GAME_PADDLE_STEP);
+	}
+
+	if (s->phase == GAME_PLAYING)
+		ev |= ball_step(s);
+
+	for (p=0; p<2; ++p) {
+		GamePaddle *pd = &s->paddle[p];
+
+		if (pd->move) {
+			pd->pos += pd->move;
+			pd->last_move = pd->move > 0 ? 1 : -1;
+			pd->move = 0;
+		}
+		else {
+			pd->last_move = 0;
+		}
+	}
+
+	if (s->phase == GAME_PLAYING) {
+		s->ball.x += s->ball.vx;
+		s->ball.y += s->ball.vy;
+	}
+
+	return ev;
+}
+
+void game_save(const GameState *s, GameSnapshot *snap)
+{
+	u8 *p = snap->data;
+	int i;
+
+	p = put_le(p, s->rng, 8);
+	p = put_le(p, s->tick, 4);
+	p = put_le(p, s->match, 4);
+	p = put_le(p, s->timer, 2);
+	*p++ = s->phase;
+	*p++ = s->paused;
+	*p++ = s->cpu;
+	*p++ = s->score[0];
+	*p++ = s->score[1];
+	p = put_le(p, (u16)s->ball.x, 2);
+	p = put_le(p, (u16)s->ball.y, 2);
+	*p++ = s->ball.vx;
+	*p++ = s->ball.vy;
+
+	for (i=0; i<2; ++i) {
+		p = put_le(p, (u16)s->paddle[i].pos, 2);
+		*p++ = s->paddle[i].move;
+		*p++ = s->paddle[i].last_move;
+	}
+}
+
+void game_restore(GameState *s, const GameSnapshot *snap)
+{
+	const u8 *p = snap->data;
+	int i;
+
+	s->rng = take_le(&p, 8);
+	s->tick = take_le(&p, 4);
+	s->match = take_le(&p, 4);
+	s->timer = take_le(&p, 2);
+	s->phase = *p++;
+	s->paused = *p++;
+	s->cpu = *p++;
+	s->score[0] = *p++;
+	s->score[1] = *p++;
+	s->ball.x = (s16)take_le(&p, 2);
+	s->ball.y = (s16)take_le(&p, 2);
+	s->ball.vx = (s8)*p++;
+	s->ball.vy = (s8)*p++;
+
+	for (i=0; i<2; ++i) {
+		s->paddle[i].pos = (s16)take_le(&p, 2);
+		s->paddle[i].move = (s8)*p++;
+		s->paddle[i].last_move = (s8)*p++;
+	}
+}
+
+#define HASH_MUL	0x9e3779b97f4a7c15ull
+
+#define HASH_MIX(H, V) do {						\
+	H = ((H) ^ (V)) * HASH_MUL;					\
+	H ^= H >> 32;							\
+} while (0)
+
+/*
+ * Multiply-xorshift over the snapshot read as little-endian words: five
+ * multiplies, where hashing it byte by byte would take 37.
+ */
+u32 game_snapshot_hash(const GameSnapshot *snap)
+{
+	const u8 *p = snap->data;
+	u64 h = GAME_SNAPSHOT_LEN;
+	int i;
+
+	for (i=0; i<GAME_SNAPSHOT_LEN / 8; ++i)
+		HASH_MIX(h, take_le(&p, 8));
+	HASH_MIX(h, take_le(&p, GAME_SNAPSHOT_LEN % 8));
+
+	return h;
+}
+
+u32 game_hash(const GameState *s)
+{
+	GameSnapshot snap;
+
+	game_save(s, &snap);
+
+	return game_snapshot_hash(&snap);
+}
@@ -0,0 +1,171 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The game itself: a plain state struct and a fixed-tick step function,
+ * free of SDL and of wall time. Given the same seed and inputs, every
+ * run steps through the same states.
+ */
+
+#ifndef GAME_H
+#define GAME_H
+
+#include "types.h"
+
+#define GAME_WIDTH		512
+#define GAME_HEIGHT		400
+
+#define GAME_BALL_SIZE		14
+#define GAME_BALL_SPEED		13
+
+#define GAME_PADDLE_WIDTH	14
+#define GAME_PADDLE_HEIGHT	72
+#define GAME_PADDLE_DISTANCE	32	/* from the field's side */
+#define GAME_PADDLE_STEP	7
+#define GAME_PADDLE_LIMIT	(GAME_HEIGHT / 2 - GAME_PADDLE_HEIGHT / 2)
+
+#define GAME_SCORE_LIMIT	10
+
+/*
+ * The game runs at a tick every GAME_TICK_MS; pauses between points
+ * and matches are counted in ticks.
+ */
+#define GAME_TICK_MS		20
+#define GAME_PREGAME_TICKS	(500 / GAME_TICK_MS)
+#define GAME_SCORED_TICKS	(800 / GAME_TICK_MS)
+#define GAME_OVER_TICKS		(3000 / GAME_TICK_MS)
+
+typedef enum {
+	GAME_PREGAME,		/* before the first serve of a match */
+	GAME_PLAYING,
+	GAME_SCORED,		/* before the next serve */
+	GAME_OVER,		/* before the next match */
+} GamePhase;
+
+/*
+ * A player's input for one tick.
+ */
+enum {
+	GAME_INPUT_UP=		1 << 0,
+	GAME_INPUT_DOWN=	1 << 1,
+	GAME_INPUT_RESTART=	1 << 2,		/* start a new match */
+	GAME_INPUT_PAUSE=	1 << 3,		/* toggle pause */
+};
+
+/*
+ * What happened during a step.
+ */
+enum {
+	GAME_EVENT_MATCH=	1 << 0,		/* a match began */
+	GAME_EVENT_SERVE=	1 << 1,		/* a rally began */
+	GAME_EVENT_WALL=	1 << 2,		/* the ball bounced on a wall */
+	GAME_EVENT_HIT_1=	1 << 3,		/* ...on player 1's paddle */
+	GAME_EVENT_HIT_2=	1 << 4,
+	GAME_EVENT_POINT_1=	1 << 5,		/* player 1 scored */
+	GAME_EVENT_POINT_2=	1 << 6,
+	GAME_EVENT_WON=		1 << 7,		/* ...and won the match */
+	GAME_EVENT_PAUSE=	1 << 8,		/* pause toggled */
+};
+
+typedef struct {
+	s16 x, y;		/* top-left corner */
+	s8  vx, vy;
+} GameBall;
+
+typedef struct {
+	s16 pos;		/* offset from the field's middle */
+	s8  move;		/* accepted this tick, applied at its end */
+	s8  last_move;		/* -1, 0 or 1: pushes the ball on hits */
+} GamePaddle;
+
+typedef struct {
+	u64        rng;
+	u32        tick;
+	u32        match;	/* matches begun */
+	u16        timer;	/* ticks left in an idle phase */
+	u8         phase;	/* GamePhase */
+	bool       paused;
+	u8         cpu;		/* bit p set: the AI plays paddle p */
+	u8         score[2];
+	GameBall   ball;
+	GamePaddle paddle[2];
+} GameState;
+
+/*
+ * A GameState packed into GAME_SNAPSHOT_LEN bytes, little-endian and
+ * free of padding: the same on every host, so it can be compared,
+ * hashed, written to a file or sent over the network as is.
+ *
+ *	rng:u64 tick:u32 match:u32 timer:u16 phase:u8 paused:u8 cpu:u8
+ *	score:u8[2] ball.x:s16 ball.y:s16 ball.vx:s8 ball.vy:s8
+ *	{ pos:s16 move:s8 last_move:s8 }[2]
+ */
+#define GAME_SNAPSHOT_LEN	37
+
+typedef struct {
+	u8 data[GAME_SNAPSHOT_LEN];
+} GameSnapshot;
+
+/*
+ * Set `s' up for a game seeded by `seed', with the AI playing the right
+ * paddle. The first step begins the first match.
+ */
+void game_init (GameState *s, u64 seed);
+
+/*
+ * Advance `s' by one tick and return the or-ed GAME_EVENT_* that
+ * happened. `input[p]' is ignored if the AI plays paddle `p'.
+ */
+u32  game_step (GameState *s, const u8 input[2]);
+
+/*
+ * Hash of everything that determines the following steps.
+ */
+u32  game_hash (const GameState *s);
+
+/*
+ * Pack `s' into `snap', and back. Both take a few nanoseconds.
+ */
+void game_save    (const GameState *s, GameSnapshot *snap);
+void game_restore (GameState *s, const GameSnapshot *snap);
+
+/*
+ * game_hash() of the state saved in `snap'.
+ */
+u32  game_snapshot_hash (const GameSnapshot *snap);
+
+/*
+ * Ask paddle `p' to move by `way' (+/-GAME_PADDLE_STEP) at the end of
+ * the tick. Return 0 if that would cross the field's edge.
+ */
+bool game_paddle_move (GameState *s, int p, s8 way);
+
+/*
+ * Uniform random number from the game's own generator.
+ */
+u32  game_rand (GameState *s);
+
+/*
+ * Top-left corner of paddle `p'.
+ */
+#define GAME_PADDLE_X(P)						\
+	((P) ? GAME_WIDTH - GAME_PADDLE_DISTANCE - GAME_PADDLE_WIDTH	\
+	     : GAME_PADDLE_DISTANCE)
+#define GAME_PADDLE_Y(S, P)						\
+	((S)->paddle[P].pos + GAME_HEIGHT / 2 - GAME_PADDLE_HEIGHT / 2)
+
+#endif /* !GAME_H */
@@ -0,0 +1,155 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <SDL.h>
+
+#include "clock.h"
+#include "log.h"
+#include "video.h"
+#include "input.h"
+
+#define QUEUE_SZ	256	/* power of two */
+#define QUEUE_MASK	(QUEUE_SZ - 1)
+
+/*
+ * Single-producer single-consumer queue: the event filter (running on
+ * SDL's event thread) is the only writer of `tail', the game thread the 
+ * only writer of `head'.
+ */
+static struct {
+	bool        inited;
+	bool        threaded;
+
+	InputEvent  ring[QUEUE_SZ];
+	u32         head;
+	u32         tail;
+	u32         dropped;
+} input;
+
+static void push(u8 type, u16 key)
+{
+	u32 tail, head;
+
+	tail = input.tail;
+	head = __atomic_load_n(&input.head, __ATOMIC_ACQUIRE);
+
+	if (tail - head == QUEUE_SZ) {
+		input.dropped++;
+		return;
+	}
+
+	input.ring[tail & QUEUE_MASK].time = clock_ns();
+	input.ring[tail & QUEUE_MASK].key = key;
+	input.ring[tail & QUEUE_MASK].type = type;
+
+	__atomic_store_n(&input.tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * SDL event filter: queue what the engine needs, drop everything.
+ */
+static int filter(const SDL_Event *ev)
+{
+	switch (ev->type) {
+	case SDL_KEYDOWN:
+		push(INPUT_KEY_DOWN, ev->key.keysym.sym);
+		break;
+
+	case SDL_KEYUP:
+		push(INPUT_KEY_UP, ev->key.keysym.sym);
+		break;
+
+	case SDL_QUIT:
+		push(INPUT_QUIT, 0);
+		break;
+	}
+
+	return 0;
+}
+
+int input_init(void)
+{
+	static const u8 ignored[] = {
+		SDL_ACTIVEEVENT, SDL_MOUSEMOTION, SDL_MOUSEBUTTONDOWN,
+		SDL_MOUSEBUTTONUP, SDL_JOYAXISMOTION, SDL_JOYBALLMOTION,
+		SDL_JOYHATMOTION, SDL_JOYBUTTONDOWN, SDL_JOYBUTTONUP,
+		SDL_SYSWMEVENT, SDL_VIDEORESIZE, SDL_VIDEOEXPOSE,
+	};
+	unsigned i;
+
+	if (input.inited) {
+		log_warn("input seems already initialized");
+		return 0;
+	}
+
+	for (i=0; i<sizeof(ignored); ++i)
+		SDL_EventState(ignored[i], SDL_IGNORE);
+
+	input.threaded = video_has_event_thread();
+	input.head = input.tail = input.dropped = 0;
+
+	SDL_SetEventFilter(filter);
+
+	log_info("input: collected on %s thread", 
+		 input.threaded ? "a dedicated" : "the game");
+
+	input.inited = 1;
+
+	return 0;
+}
+
+void input_quit(void)
+{
+	if (!input.inited)
+		return;
+
+	SDL_SetEventFilter(NULL);
+
+	if (input.dropped)
+		log_warn("input: %u events dropped (queue full)", 
+			 input.dropped);
+
+	input.inited = 0;
+}
+
+INLINE bool input_threaded(void)
+{
+	return input.threaded;
+}
+
+INLINE void input_pump(void)
+{
+	if (!input.threaded)
+		SDL_PumpEvents();
+}
+
+bool input_pop(InputEvent *ev)
+{
+	u32 head, tail;
+
+	head = input.head;
+	tail = __atomic_load_n(&input.tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return 0;
+
+	*ev = input.ring[head & QUEUE_MASK];
+
+	__atomic_store_n(&input.head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
@@ -0,0 +1,62 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "common.h"
+
+typedef enum {
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+	INPUT_QUIT,
+} InputType;
+
+typedef struct {
+	u64 time;	/* arrival, clock_ns() */
+	u16 key;	/* SDLKey */
+	u8  type;	/* InputType */
+} InputEvent;
+
+/*
+ * Start collecting input.
+ *
+ * Keyboard and quit events are timestamped as SDL delivers them and queued
+ * for input_pop(); every other event is discarded at the source. When SDL
+ * runs its own event thread (see video_init()), collection happens there,
+ * otherwise it happens within input_pump() on the calling thread.
+ */
+int  input_init (void);
+void input_quit (void);
+
+/*
+ * Tell whether events are collected on a dedicated thread (hence whether
+ * their timestamps are true arrival times).
+ */
+bool input_threaded (void);
+
+/*
+ * Collect pending events when there is no event thread.
+ */
+void input_pump (void);
+
+/*
+ * Dequeue the oldest event. Returns 0 if the queue is empty.
+ */
+bool input_pop (InputEvent *ev);
+
+#endif /* !INPUT_H */
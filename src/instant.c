@@ -0,0 +1,130 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "instant.h"
+
+/*
+ * Events worth showing again.
+ */
+#define KEPT_EVENTS	(GAME_EVENT_SERVE | GAME_EVENT_WALL |		\
+			 GAME_EVENT_HIT_1 | GAME_EVENT_HIT_2 |		\
+			 GAME_EVENT_POINT_1 | GAME_EVENT_POINT_2 |	\
+			 GAME_EVENT_WON)
+
+typedef struct {
+	s16 ball_x, ball_y;
+	s16 pos[2];
+	u8  score[2];
+	u8  phase;
+	u16 ev;
+} Frame;
+
+static struct {
+	Frame ring[INSTANT_TICKS];
+	u32   head;		/* frames ever pushed */
+	u32   rally;		/* head at the last serve */
+
+	bool  playing;
+	u32   at;		/* next frame shown */
+	u8    slow;
+	u8    held;		/* times the current frame was shown */
+} inst;
+
+void instant_push(const GameState *s, u32 ev)
+{
+	Frame *f;
+
+	if (s->paused)
+		return;
+
+	if (ev & GAME_EVENT_SERVE)
+		inst.rally = inst.head;
+
+	f = &inst.ring[inst.head++ % INSTANT_TICKS];
+	f->ball_x = s->ball.x;
+	f->ball_y = s->ball.y;
+	f->pos[0] = s->paddle[0].pos;
+	f->pos[1] = s->paddle[1].pos;
+	f->score[0] = s->score[0];
+	f->score[1] = s->score[1];
+	f->phase = s->phase;
+	f->ev = ev & KEPT_EVENTS;
+}
+
+void instant_reset(void)
+{
+	inst.head = inst.rally = 0;
+	inst.playing = 0;
+}
+
+bool instant_start(bool rally, u8 slow)
+{
+	u32 first;
+
+	first = inst.head > INSTANT_TICKS ? inst.head - INSTANT_TICKS : 0;
+	if (rally && inst.rally > first)
+		first = inst.rally;
+
+	if (first == inst.head)
+		return 0;
+
+	inst.playing = 1;
+	inst.at = first;
+	inst.slow = slow ? slow : 1;
+	inst.held = 0;
+
+	return 1;
+}
+
+void instant_stop(void)
+{
+	inst.playing = 0;
+}
+
+bool instant_playing(void)
+{
+	return inst.playing;
+}
+
+bool instant_next(GameState *view, u32 *ev)
+{
+	const Frame *f;
+
+	if (!inst.playing)
+		return 0;
+
+	f = &inst.ring[inst.at % INSTANT_TICKS];
+	view->ball.x = f->ball_x;
+	view->ball.y = f->ball_y;
+	view->paddle[0].pos = f->pos[0];
+	view->paddle[1].pos = f->pos[1];
+	view->score[0] = f->score[0];
+	view->score[1] = f->score[1];
+	view->phase = f->phase;
+	view->paused = 0;
+
+	/* sounds go with the first showing only */
+	*ev = inst.held ? 0 : f->ev;
+
+	if (++inst.held == inst.slow) {
+		inst.held = 0;
+		if (++inst.at == inst.head)
+			inst.playing = 0;
+	}
+
+	return 1;
+}
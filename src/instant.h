@@ -0,0 +1,65 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INSTANT_H
+#define INSTANT_H
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * Instant replay: the last INSTANT_SECONDS of play, kept tick by tick in
+ * a fixed ring of what is drawn (ball, paddles, scores and phase) and of
+ * the events that made a sound. Pushing a tick copies a few bytes and
+ * never allocates.
+ */
+
+#define INSTANT_SECONDS		10
+#define INSTANT_TICKS		(INSTANT_SECONDS * 1000 / GAME_TICK_MS)
+
+#define INSTANT_SLOW		3	/* ticks a frame is shown in slow motion */
+
+/*
+ * Keep the state `s' reached by a step and the events `ev' it returned.
+ * Paused ticks are left out.
+ */
+void instant_push (const GameState *s, u32 ev);
+
+/*
+ * Forget everything pushed, e.g. when the game jumped.
+ */
+void instant_reset (void);
+
+/*
+ * Start playing back the last rally, or with `rally' unset the whole
+ * ring, showing each tick for `slow' ticks. Return 0 if there is nothing
+ * to play.
+ */
+bool instant_start (bool rally, u8 slow);
+
+void instant_stop (void);
+
+bool instant_playing (void);
+
+/*
+ * Make `view' the next frame to show, and set `ev' to the events to play
+ * with it. Only what the scene draws is changed. Return 0 once every
+ * frame was shown.
+ */
+bool instant_next (GameState *view, u32 *ev);
+
+#endif /* !INSTANT_H */
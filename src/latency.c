@@ -0,0 +1,213 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "clock.h"
+#include "log.h"
+#include "latency.h"
+
+#define PENDING_MAX	16
+#define SAMPLES_MAX	4096	/* most recent traces kept */
+#define STALE_NS	NSEC_PER_SEC
+
+#define STAGE_NO	(LATENCY_POINT_NO - 1)
+#define TOTAL		STAGE_NO
+
+static const char *stage_name[STAGE_NO + 1] = {
+	"queue", "update", "wait", "render", "flip", "total",
+};
+
+typedef struct {
+	u64 t[LATENCY_POINT_NO];
+	u8  reached;	/* last point stamped */
+} Trace;
+
+static struct {
+	bool  enabled;
+	bool  inexact;
+
+	Trace pending[PENDING_MAX];
+	int   npending;
+
+	/* per-stage durations (ns) of completed traces, plus the total */
+	u32   sample[STAGE_NO + 1][SAMPLES_MAX];
+	u64   ntraces;
+	u64   dropped;
+} lat;
+
+void latency_init(void)
+{
+	memset(&lat, 0, sizeof(lat));
+	lat.enabled = 1;
+}
+
+void latency_input(u64 arrival, bool exact)
+{
+	Trace *t;
+
+	if (!lat.enabled)
+		return;
+
+	if (lat.npending == PENDING_MAX) {
+		lat.dropped++;
+		return;
+	}
+
+	if (!exact)
+		lat.inexact = 1;
+
+	t = &lat.pending[lat.npending++];
+	t->t[LATENCY_ARRIVED] = arrival;
+	t->t[LATENCY_POLLED] = clock_ns();
+	t->reached = LATENCY_POLLED;
+}
+
+/*
+ * Store the stage durations of a completed trace.
+ */
+static void record(const Trace *t)
+{
+	u32 i, slot;
+
+	slot = lat.ntraces++ % SAMPLES_MAX;
+
+	for (i=0; i<STAGE_NO; ++i)
+		lat.sample[i][slot] = t->t[i+1] - t->t[i];
+
+	lat.sample[TOTAL][slot] = t->t[LATENCY_SHOWN] - t->t[LATENCY_ARRIVED];
+}
+
+void latency_mark(LatencyPoint point)
+{
+	Trace *t;
+	u64 now;
+	int i;
+
+	if (!lat.enabled || !lat.npending)
+		return;
+
+	now = clock_ns();
+
+	for (i=0; i<lat.npending; ++i) {
+		if (lat.pending[i].reached != point - 1)
+			continue;
+
+		lat.pending[i].t[point] = now;
+		lat.pending[i].reached = point;
+	}
+
+	if (point != LATENCY_SHOWN)
+		return;
+
+	/* retire completed and stale traces */
+	for (i=0; i<lat.npending; ) {
+		t = &lat.pending[i];
+
+		if (t->reached == LATENCY_SHOWN) 
+			record(t);
+		else if (now - t->t[LATENCY_POLLED] > STALE_NS)
+			lat.dropped++;
+		else {
+			++i;
+			continue;
+		}
+
+		*t = lat.pending[--lat.npending];
+	}
+}
+
+void latency_drop(void)
+{
+	int i;
+
+	for (i=0; i<lat.npending; ) {
+		if (lat.pending[i].reached < LATENCY_MOVED) {
+			lat.dropped++;
+			lat.pending[i] = lat.pending[--lat.npending];
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+#define MS(NS)	((double)(NS) / NSEC_PER_MSEC)
+
+/*
+ * Print the report.
+ */
+void latency_quit(void)
+{
+	u32 sorted[SAMPLES_MAX];
+	double mean[STAGE_NO + 1];
+	u64 sum;
+	u32 n, j;
+	int i, top;
+
+	if (!lat.enabled)
+		return;
+
+	lat.enabled = 0;
+
+	printf("\ninput-to-photon latency: %llu traces, %llu dropped\n",
+	       (unsigned long long)lat.ntraces,
+	       (unsigned long long)lat.dropped);
+
+	n = lat.ntraces < SAMPLES_MAX ? lat.ntraces : SAMPLES_MAX;
+	if (!n) {
+		putchar('\n');
+		return;
+	}
+
+	printf("%-7s %9s %9s %9s %9s %9s   (ms)\n",
+	       "stage", "mean", "p50", "p90", "p99", "max");
+
+	for (i=0; i<=STAGE_NO; ++i) {
+		memcpy(sorted, lat.sample[i], n * sizeof(*sorted));
+		qsort(sorted, n, sizeof(*sorted), cmp_u32);
+
+		for (j=0, sum=0; j<n; ++j)
+			sum += sorted[j];
+		mean[i] = (double)sum / n;
+
+		printf("%-7s %9.3f %9.3f %9.3f %9.3f %9.3f\n", stage_name[i],
+		       MS(mean[i]), MS(sorted[n / 2]), MS(sorted[n * 9 / 10]),
+		       MS(sorted[(n * 99 - 1) / 100]), MS(sorted[n - 1]));
+	}
+
+	for (i=1, top=0; i<STAGE_NO; ++i)
+		if (mean[i] > mean[top])
+			top = i;
+
+	printf("dominant stage: %s (%.0f%% of mean latency)\n",
+	       stage_name[top], mean[TOTAL] ? 100 * mean[top] / mean[TOTAL] 
+	       : 0.0);
+
+	if (lat.inexact)
+		printf("note: arrival times were not available, `queue' is "
+		       "an upper bound\n");
+
+	putchar('\n');
+}
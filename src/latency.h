@@ -0,0 +1,61 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "common.h"
+
+/*
+ * Points of the input-to-photon pipeline, in order.
+ */
+typedef enum {
+	LATENCY_ARRIVED,	/* input event arrived */
+	LATENCY_POLLED,		/* the engine saw it */
+	LATENCY_MOVED,		/* the paddle move it causes was accepted */
+	LATENCY_RENDER,		/* drawing of the frame showing it began */
+	LATENCY_FLIP,		/* ...and was handed to video_flip() */
+	LATENCY_SHOWN,		/* video_flip() returned */
+	LATENCY_POINT_NO,
+} LatencyPoint;
+
+/*
+ * Enable tracing. latency_quit() prints the report on stdout.
+ */
+void latency_init (void);
+void latency_quit (void);
+
+/*
+ * Start tracing an input event which arrived at `arrival' (clock_ns()
+ * time) and was just polled. If `exact' is false, `arrival' is only an
+ * upper bound for the time the event waited in the queue.
+ */
+void latency_input (u64 arrival, bool exact);
+
+/*
+ * Stamp `point' on every pending trace that reached the previous point.
+ * Stamping LATENCY_SHOWN completes them.
+ */
+void latency_mark (LatencyPoint point);
+
+/*
+ * Discard pending traces which did not reach LATENCY_MOVED (e.g. the
+ * paddle was already at its limit).
+ */
+void latency_drop (void);
+
+#endif /* !LATENCY_H */
@@ -15,81 +15,648 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
+#include "clock.h"
 #include "log.h"
 
-#define DO_LOG(TYPE)							\
-	va_list ap;							\
-	va_start(ap, fmt);						\
-	do_log(TYPE, fmt, ap);						\
-	va_end(ap)
-
-enum log_types {
-	LOG_ERROR,
-	LOG_WARNING,
-	LOG_FIXME,
-	LOG_DEBUG,
-	LOG_INFO,
+#define RING_NO		16	/* threads logging at the same time */
+#define RING_SLOTS	128	/* power of two */
+#define ARG_MAX		8	/* raw arguments per record */
+#define STR_BYTES	168	/* copied string arguments per record */
+#define MSG_MAX		512	/* formatted message */
+#define OUT_BYTES	8192	/* written to stderr at once */
+
+#define SITE_NO		32	/* rate limited call sites per thread */
+#define LOG_BURST	8	/* messages per call site per window */
+#define WINDOW_NS	NSEC_PER_SEC
+#define IDLE_NS		(10 * NSEC_PER_MSEC)
+
+#define DIGITS		"0123456789"
+
+/*
+ * Argument types, from the conversion specifications.
+ */
+enum {
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_PTRDIFF,
+	ARG_INTMAX,
+	ARG_DOUBLE,
+	ARG_PTR,
+	ARG_STR,
+};
+
+typedef union {
+	int          i;
+	long         l;
+	long long    ll;
+	size_t       z;
+	ptrdiff_t    t;
+	intmax_t     j;
+	double       d;
+	const void  *p;
+	u32          str;	/* offset in Record.str */
+} Arg;
+
+/*
+ * A message waiting to be formatted (256 bytes).
+ */
+typedef struct {
+	u64          time;
+	const char  *fmt;	/* NULL: `str' holds the formatted message */
+	u32          suppressed; /* messages this call site dropped before */
+	u8           level;
+	Arg          arg[ARG_MAX];
+	char         str[STR_BYTES];
+} Record;
+
+typedef struct {
+	const char  *fmt;
+	u64          window;	/* start of the current window */
+	u32          count;
+	u32          suppressed;
+} Site;
+
+/*
+ * Single producer (the owner thread), single consumer (the logging
+ * thread).
+ */
+typedef struct {
+	Record  slot[RING_SLOTS];
+	u32     head;		/* advanced by the logging thread */
+	u32     tail;		/* advanced by the owner */
+	int     owned;		/* 0: free for the next thread */
+	Site    site[SITE_NO];	/* touched by the owner only */
+} Ring;
+
+static const char *prefix[] = {
+	" [ERROR] ", " [WARNING] ", " [**] ", " [FIXME] ", " [DEBUG] ",
 };
 
-static void do_log(int type, const char *fmt, va_list ap)
+static struct {
+	int            level;
+	bool           running;
+	bool           stop;
+	bool           have_key;
+	pthread_t      thread;
+	pthread_key_t  key;	/* thread's Ring */
+
+	Ring           ring[RING_NO];
+	u64            dropped;	/* lost to full rings */
+	u32            drains;	/* drain() calls completed */
+
+	char           out[OUT_BYTES];
+	u32            outlen;
+} lg = { .level = LOG_DEBUG };
+
+static void sleep_ns(u64 ns)
 {
-	const char *prefix;
+	struct timespec ts;
 
-	switch (type) {
-	case LOG_WARNING:
-		prefix = " [WARNING] ";
+	ts.tv_sec = ns / NSEC_PER_SEC;
+	ts.tv_nsec = ns % NSEC_PER_SEC;
+	nanosleep(&ts, NULL);
+}
+
+/*
+ * Parse the conversion specification after a `%' (not "%%"). Return a
+ * pointer past it, or NULL if log records can't carry its argument.
+ */
+static const char *parse_spec(const char *p, int *nstar, int *type)
+{
+	int len = ARG_INT;
+
+	*nstar = 0;
+
+	p += strspn(p, "-+ #0'");
+	if (*p == '*') {
+		++*nstar;
+		++p;
+	}
+	else
+		p += strspn(p, DIGITS);
+
+	if (*p == '.') {
+		if (*++p == '*') {
+			++*nstar;
+			++p;
+		}
+		else
+			p += strspn(p, DIGITS);
+	}
+
+	switch (*p) {
+	case 'h':
+		p += p[1] == 'h' ? 2 : 1;
 		break;
 
-	case LOG_ERROR:
-		prefix = " [ERROR] ";
+	case 'l':
+		if (p[1] == 'l') {
+			len = ARG_LLONG;
+			++p;
+		}
+		else
+			len = ARG_LONG;
+		++p;
 		break;
-		
-	case LOG_FIXME:
-		prefix = " [FIXME] ";
+
+	case 'z':
+		len = ARG_SIZE;
+		++p;
 		break;
 
-	case LOG_DEBUG:
-		prefix = " [DEBUG] ";
+	case 't':
+		len = ARG_PTRDIFF;
+		++p;
 		break;
 
-	case LOG_INFO:
-		prefix = " [**] ";
+	case 'j':
+		len = ARG_INTMAX;
+		++p;
 		break;
+	}
+
+	switch (*p) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		*type = len;
+		break;
+
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		if (len != ARG_INT && len != ARG_LONG)
+			return NULL;
+		*type = ARG_DOUBLE;
+		break;
+
+	case 'c':
+	case 'p':
+	case 's':
+		if (len != ARG_INT)	/* wide characters */
+			return NULL;
+		*type = *p == 'p' ? ARG_PTR : *p == 's' ? ARG_STR : ARG_INT;
+		break;
+
+	default:		/* %n, %m, long double... */
+		return NULL;
+	}
+
+	return p + 1;
+}
+
+/*
+ * Copy the arguments of `fmt' into `rec'; strings are copied (and
+ * truncated) since they may not outlive the call.
+ */
+static int capture(Record *rec, const char *fmt, va_list ap)
+{
+	const char *p, *s;
+	u32 off = 0, len;
+	int n = 0, nstar, type;
+
+	for (p = fmt; (p = strchr(p, '%')); ) {
+		if (p[1] == '%') {
+			p += 2;
+			continue;
+		}
+
+		p = parse_spec(p + 1, &nstar, &type);
+		if (!p || n + nstar >= ARG_MAX)
+			return -1;
+
+		while (nstar--)
+			rec->arg[n++].i = va_arg(ap, int);
+
+		switch (type) {
+		case ARG_INT:
+			rec->arg[n].i = va_arg(ap, int);
+			break;
+
+		case ARG_LONG:
+			rec->arg[n].l = va_arg(ap, long);
+			break;
+
+		case ARG_LLONG:
+			rec->arg[n].ll = va_arg(ap, long long);
+			break;
+
+		case ARG_SIZE:
+			rec->arg[n].z = va_arg(ap, size_t);
+			break;
+
+		case ARG_PTRDIFF:
+			rec->arg[n].t = va_arg(ap, ptrdiff_t);
+			break;
+
+		case ARG_INTMAX:
+			rec->arg[n].j = va_arg(ap, intmax_t);
+			break;
+
+		case ARG_DOUBLE:
+			rec->arg[n].d = va_arg(ap, double);
+			break;
+
+		case ARG_PTR:
+			rec->arg[n].p = va_arg(ap, void *);
+			break;
+
+		case ARG_STR:
+			if (off == STR_BYTES)
+				return -1;
+
+			s = va_arg(ap, const char *);
+			if (!s)
+				s = "(null)";
+
+			len = strlen(s);
+			if (len > STR_BYTES - off - 1)
+				len = STR_BYTES - off - 1;
+
+			memcpy(rec->str + off, s, len);
+			rec->str[off + len] = '\0';
+			rec->arg[n].str = off;
+			off += len + 1;
+			break;
+		}
+
+		++n;
+	}
+
+	rec->fmt = fmt;
+
+	return 0;
+}
+
+#define PRINT_ARG(V)							\
+	(nstar == 0 ? snprintf(buf, size, spec, V) :			\
+	 nstar == 1 ? snprintf(buf, size, spec, st[0], V) :		\
+		      snprintf(buf, size, spec, st[0], st[1], V))
+
+static int print_arg(char *buf, int size, const char *spec, int type,
+		     int nstar, const int *st, const Arg *a, const char *str)
+{
+	switch (type) {
+	case ARG_INT:		return PRINT_ARG(a->i);
+	case ARG_LONG:		return PRINT_ARG(a->l);
+	case ARG_LLONG:		return PRINT_ARG(a->ll);
+	case ARG_SIZE:		return PRINT_ARG(a->z);
+	case ARG_PTRDIFF:	return PRINT_ARG(a->t);
+	case ARG_INTMAX:	return PRINT_ARG(a->j);
+	case ARG_DOUBLE:	return PRINT_ARG(a->d);
+	case ARG_PTR:		return PRINT_ARG(a->p);
+	case ARG_STR:		return PRINT_ARG(str + a->str);
+	}
+
+	return 0;
+}
+
+/*
+ * Format `rec' in `buf'; capture() already validated its format.
+ */
+static int format_record(const Record *rec, char *buf, int size)
+{
+	char spec[32];
+	const char *p, *end;
+	int len = 0, n = 0, nstar, type, st[2], i;
+
+	if (!rec->fmt)
+		return snprintf(buf, size, "%s", rec->str);
+
+	for (p = rec->fmt; *p && len < size - 1; p = end) {
+		if (*p != '%' || p[1] == '%') {
+			buf[len++] = *p;
+			end = p + 1 + (*p == '%');
+			continue;
+		}
+
+		end = parse_spec(p + 1, &nstar, &type);
+		if (end - p >= (int)sizeof(spec))
+			break;
+
+		memcpy(spec, p, end - p);
+		spec[end - p] = '\0';
+
+		for (i=0; i<nstar; ++i)
+			st[i] = rec->arg[n++].i;
+
+		len += print_arg(buf + len, size - len, spec, type, nstar, st,
+				 &rec->arg[n++], rec->str);
+	}
+
+	if (len > size - 1)
+		len = size - 1;
+	buf[len] = '\0';
+
+	return len;
+}
+
+static void flush_out(void)
+{
+	fwrite(lg.out, 1, lg.outlen, stderr);
+	lg.outlen = 0;
+}
+
+/*
+ * Append to the output buffer, as much as fits.
+ */
+static CHECK_FMT void out_printf(const char *fmt, ...)
+{
+	size_t room = OUT_BYTES - 1 - lg.outlen;
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(lg.out + lg.outlen, room + 1, fmt, ap);
+	va_end(ap);
+
+	if (n > 0)
+		lg.outlen += (size_t)n < room ? (size_t)n : room;
+}
+
+static void write_record(const Record *rec)
+{
+	char msg[MSG_MAX];
+
+	if (lg.outlen + MSG_MAX + 64 > OUT_BYTES)
+		flush_out();
+
+	format_record(rec, msg, sizeof(msg));
+
+	out_printf("%s%s", prefix[rec->level], msg);
+
+	if (rec->suppressed)
+		out_printf(" (%u similar messages suppressed)", 
+			   rec->suppressed);
+
+	lg.out[lg.outlen++] = '\n';
+}
+
+/*
+ * Write out every pending record, oldest first across threads. Return
+ * the number of records written.
+ */
+static int drain(void)
+{
+	const Record *rec, *oldest;
+	Ring *ring, *from = NULL;
+	u64 dropped;
+	u32 tail;
+	int i, n;
+
+	for (n=0; ; ++n) {
+		oldest = NULL;
+
+		for (i=0; i<RING_NO; ++i) {
+			ring = &lg.ring[i];
+			tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+			if (ring->head == tail)
+				continue;
+
+			rec = &ring->slot[ring->head & (RING_SLOTS - 1)];
+			if (!oldest || rec->time < oldest->time) {
+				oldest = rec;
+				from = ring;
+			}
+		}
+
+		if (!oldest)
+			break;
+
+		write_record(oldest);
+		__atomic_store_n(&from->head, from->head + 1, 
+				 __ATOMIC_RELEASE);
+	}
+
+	dropped = __atomic_exchange_n(&lg.dropped, 0, __ATOMIC_RELAXED);
+	if (dropped) {
+		if (lg.outlen + 64 > OUT_BYTES)
+			flush_out();
+		out_printf("%slog: %llu messages dropped\n", 
+			   prefix[LOG_WARNING], (unsigned long long)dropped);
+	}
+
+	if (lg.outlen)
+		flush_out();
+
+	return n;
+}
+
+static void *log_thread(void *unused)
+{
+	int n;
+
+	while (!__atomic_load_n(&lg.stop, __ATOMIC_ACQUIRE)) {
+		n = drain();
+		__atomic_fetch_add(&lg.drains, 1, __ATOMIC_RELEASE);
+
+		if (!n)
+			sleep_ns(IDLE_NS);
+	}
+
+	drain();
+
+	return NULL;
+}
+
+static void release_ring(void *ring)
+{
+	__atomic_store_n(&((Ring *)ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Return the calling thread's ring, claiming a free one on first use.
+ */
+static Ring *get_ring(void)
+{
+	Ring *ring;
+	int i, unowned;
+
+	ring = pthread_getspecific(lg.key);
+	if (ring)
+		return ring;
+
+	for (i=0; i<RING_NO; ++i) {
+		ring = &lg.ring[i];
+		unowned = 0;
+
+		if (__atomic_compare_exchange_n(&ring->owned, &unowned, 1, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED)) {
+			memset(ring->site, 0, sizeof(ring->site));
+			pthread_setspecific(lg.key, ring);
+			return ring;
+		}
+	}
+
+	return NULL;
+}
+
+static void push(Ring *ring, int level, const char *fmt, va_list ap)
+{
+	Record *rec;
+	Site *site;
+	va_list aq;
+	u32 tail, suppressed = 0;
+	u64 now;
+
+	now = clock_ns();
+
+	site = &ring->site[((uintptr_t)fmt >> 3) % SITE_NO];
+	if (site->fmt != fmt || now - site->window >= WINDOW_NS) {
+		if (site->fmt == fmt)
+			suppressed = site->suppressed;
+
+		site->fmt = fmt;
+		site->window = now;
+		site->count = 0;
+		site->suppressed = 0;
+	}
+
+	if (++site->count > LOG_BURST) {
+		++site->suppressed;
+		return;
+	}
 
-	default:
-		prefix = NULL;
+	tail = ring->tail;
+	if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == 
+	    RING_SLOTS) {
+		__atomic_fetch_add(&lg.dropped, 1, __ATOMIC_RELAXED);
+		return;
 	}
 
-	fprintf(stderr, prefix);
-	vfprintf(stderr, fmt, ap);
-	fputc('\n', stderr);
+	rec = &ring->slot[tail & (RING_SLOTS - 1)];
+	rec->time = now;
+	rec->level = level;
+	rec->suppressed = suppressed;
+
+	va_copy(aq, ap);
+	if (capture(rec, fmt, aq) != 0) {
+		/* not representable: format it here */
+		rec->fmt = NULL;
+		vsnprintf(rec->str, STR_BYTES, fmt, ap);
+	}
+	va_end(aq);
+
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
 }
 
-void log_err(const char *fmt, ...)
+void log_write(LogLevel level, const char *fmt, ...)
 {
-	DO_LOG(LOG_ERROR);
+	va_list ap;
+	Ring *ring = NULL;
+
+	if ((int)level > __atomic_load_n(&lg.level, __ATOMIC_RELAXED))
+		return;
+
+	va_start(ap, fmt);
+
+	if (__atomic_load_n(&lg.running, __ATOMIC_ACQUIRE))
+		ring = get_ring();
+
+	if (ring)
+		push(ring, level, fmt, ap);
+	else {
+		flockfile(stderr);
+		fputs(prefix[level], stderr);
+		vfprintf(stderr, fmt, ap);
+		fputc('\n', stderr);
+		funlockfile(stderr);
+	}
+
+	va_end(ap);
 }
 
-void log_warn(const char *fmt, ...)
+int log_init(void)
 {
-	DO_LOG(LOG_WARNING);
+	if (lg.running)
+		return 1;
+
+	if (!lg.have_key) {
+		if (pthread_key_create(&lg.key, release_ring) != 0)
+			return -1;
+		lg.have_key = 1;
+	}
+
+	lg.stop = 0;
+	if (pthread_create(&lg.thread, NULL, log_thread, NULL) != 0)
+		return -1;
+
+	__atomic_store_n(&lg.running, 1, __ATOMIC_RELEASE);
+
+	return 0;
 }
 
-void log_fixme(const char *fmt, ...)
+void log_quit(void)
 {
-	DO_LOG(LOG_FIXME);
+	if (!lg.running)
+		return;
+
+	/* later messages are written by their callers */
+	__atomic_store_n(&lg.running, 0, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&lg.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(lg.thread, NULL);
+
+	/* a push that saw `running' just before may have landed since */
+	drain();
 }
 
-void log_debug(const char *fmt, ...)
+void log_flush(void)
 {
-	DO_LOG(LOG_DEBUG);
+	u32 drains;
+	int i;
+
+	if (!__atomic_load_n(&lg.running, __ATOMIC_ACQUIRE))
+		return;
+
+	for (i=0; i<RING_NO; ++i)
+		while (__atomic_load_n(&lg.ring[i].head, __ATOMIC_ACQUIRE) !=
+		       __atomic_load_n(&lg.ring[i].tail, __ATOMIC_ACQUIRE))
+			sleep_ns(NSEC_PER_MSEC);
+
+	/* the last records may still sit in the output buffer */
+	drains = __atomic_load_n(&lg.drains, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(&lg.drains, __ATOMIC_ACQUIRE) == drains)
+		sleep_ns(NSEC_PER_MSEC);
 }
 
-void log_info(const char *fmt, ...)
+void log_set_level(LogLevel level)
 {
-	DO_LOG(LOG_INFO);
+	__atomic_store_n(&lg.level, level, __ATOMIC_RELAXED);
+}
+
+int log_set_level_name(const char *name)
+{
+	int level = log_parse_level(name);
+
+	if (level < 0) {
+		log_err("invalid log level: %s", name);
+		return -1;
+	}
+
+	log_set_level(level);
+
+	return 0;
+}
+
+int log_parse_level(const char *name)
+{
+	static const char *names[] = {
+		"error", "warning", "info", "fixme", "debug",
+	};
+	int i;
+
+	for (i=0; i<=LOG_DEBUG; ++i)
+		if (!strcmp(name, names[i]))
+			return i;
+
+	return -1;
 }
@@ -20,10 +20,78 @@
 
 #include "common.h"
 
-CHECK_FMT void  log_err    (const char *fmt, ...);
-CHECK_FMT void  log_warn   (const char *fmt, ...);
-CHECK_FMT void  log_fixme  (const char *fmt, ...);
-CHECK_FMT void  log_debug  (const char *fmt, ...);
-CHECK_FMT void  log_info   (const char *fmt, ...);
+/*
+ * Log levels, from the most to the least important.
+ */
+typedef enum {
+	LOG_ERROR,
+	LOG_WARNING,
+	LOG_INFO,
+	LOG_FIXME,
+	LOG_DEBUG,
+} LogLevel;
+
+/*
+ * Calls above LOG_LEVEL_MAX are compiled out (configure --with-log-level).
+ */
+#ifndef LOG_LEVEL_MAX
+# define LOG_LEVEL_MAX	LOG_DEBUG
+#endif
+
+#define log_at(LEVEL, ...) do {						\
+	if ((LEVEL) <= LOG_LEVEL_MAX)					\
+		log_write(LEVEL, __VA_ARGS__);				\
+} while (0)
+
+#define log_err(...)	log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...)	log_at(LOG_WARNING, __VA_ARGS__)
+#define log_info(...)	log_at(LOG_INFO, __VA_ARGS__)
+#define log_fixme(...)	log_at(LOG_FIXME, __VA_ARGS__)
+#define log_debug(...)	log_at(LOG_DEBUG, __VA_ARGS__)
+
+/*
+ * Start the logging thread. Until log_init() and after log_quit(),
+ * messages are written synchronously by the caller.
+ *
+ * Once started, log_write() only copies the format pointer and the raw
+ * arguments (strings included) into a ring owned by the calling thread;
+ * the logging thread formats and writes them to stderr. Each call site
+ * may log 8 messages per second per thread; the others are counted and
+ * reported with the next one let through.
+ */
+int  log_init  (void);
+void log_quit  (void);
+
+/*
+ * Wait until every message logged so far is written, e.g. before
+ * abort(3).
+ */
+void log_flush (void);
+
+/*
+ * Drop messages less important than `level' (default: LOG_DEBUG).
+ */
+void log_set_level (LogLevel level);
+
+/*
+ * Parse a level name ("error", "warning", "info", "fixme", "debug");
+ * returns -1 if `name' is unknown.
+ */
+int  log_parse_level (const char *name);
+
+/*
+ * log_set_level() by name, for --log-level: logs and returns -1 if
+ * `name' is unknown.
+ */
+int  log_set_level_name (const char *name);
+
+/*
+ * --log-level's lines in the programs' usage texts.
+ */
+#define LOG_LEVEL_USAGE							\
+	"  --log-level=LEVEL\t log up to LEVEL: error, warning, info,\n"\
+	"                   \t fixme or debug (default: debug)\n"
+
+CHECK_FMT2 void log_write (LogLevel level, const char *fmt, ...);
 
 #endif /* !LOG_H */
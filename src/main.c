@@ -25,6 +25,10 @@
 #include "log.h"
 #include "engine.h"
 
+#if HAVE_LIBSDL_MIXER
+# include "mixer.h"
+#endif
+
 #define USAGE_FMT	\
 	"gnop (%s)\n\n"							\
 	"Usage: %s [OPTION]...\n"					\
@@ -32,16 +36,82 @@
 	"  -c, --fg-color=COLOR\t set foreground color\n"		\
 	"  -C, --bg-color=COLOR\t set background color\n"		\
 	"  -f, --fullscreen\t enable fullscreen mode\n"			\
+	"  --bpp=BPP\t\t force color depth (8, 16 or 32)\n"		\
 	"  --display=DISPLAY\t X display to use\n"			\
 	"\nMisc Options:\n"						\
 	"  -d, --datadir=DIR\t load game data from DIR\n"		\
 	"                   \t (default: %s)\n"				\
 	"  -m, --mute\t\t disable sounds\n"				\
-	"  --help\t\t display this help and exit\n\n"
+	LOG_LEVEL_USAGE							\
+	"  --audio-buffer=N\t mix sounds in gnop with a buffer of N\n"	\
+	"                  \t frames (128-4096, default: use SDL_mixer)\n"\
+	"  --telemetry=FILE\t record every rally to the CSV FILE\n"	\
+	"  --metrics=ADDR\t serve Prometheus metrics on the loopback\n"	\
+	"                \t TCP port ADDR, or Unix socket ADDR if it\n"	\
+	"                \t contains a `/'\n"				\
+	"  --shm=NAME\t\t share the game live in the shared memory\n"	\
+	"            \t\t object NAME, and let a bot play there\n"	\
+	"  --record=FILE\t record the game's seed and inputs to FILE\n"	\
+	"  --play=FILE\t\t play back the game recorded in FILE\n"	\
+	"  --seek=TICK\t\t with --play, start from TICK\n"		\
+	"  --uncapped\t\t with --play, don't wait between ticks\n"	\
+	"  --auto-replay\t\t show every rally again after its point\n"	\
+	"  --ai=PRESET\t\t play the computer with PRESET: easy, hard,\n"\
+	"             \t\t or the file a gnop-tune run wrote\n"		\
+	"  --help\t\t display this help and exit\n"			\
+	"\nNetplay Options:\n"						\
+	"  --host=PORT\t\t wait for a second player on UDP PORT\n"	\
+	"  --join=HOST:PORT\t play against the player hosting at\n"	\
+	"                  \t HOST:PORT\n"				\
+	"  --net-delay=MS\t delay every packet sent by MS\n"		\
+	"  --net-jitter=MS\t vary the delay by up to MS\n"		\
+	"  --net-loss=PERCENT\t drop PERCENT of the packets sent\n"	\
+	"  --server=HOST:PORT\t play a match hosted by the gnop-server\n"\
+	"                    \t at HOST:PORT\n"				\
+	"\nSpectator Options:\n"					\
+	"  --relay=HOST:PORT\t stream the game to the gnop-relay at\n"	\
+	"                   \t HOST:PORT\n"				\
+	"  --watch=HOST:PORT\t watch the game streamed by the gnop-relay\n"\
+	"                   \t at HOST:PORT\n"				\
+	"  --watch-udp\t\t with --watch, watch over UDP\n"		\
+	"\nDebug Options:\n"						\
+	"  --perf-stats\t\t print per-phase timings and hardware\n"	\
+	"              \t\t counters on exit\n"				\
+	"  --mem-stats\t\t print allocation and surface memory\n"	\
+	"             \t\t accounting on exit\n"			\
+	"  --mem-check\t\t abort if an in-game frame allocates\n"	\
+	"  --trace-latency\t report input-to-photon latency on exit\n"	\
+	"  --startup-timeline\t report where startup time went on exit\n\n"
 
 enum {
 	OPT_DISPLAY,
+	OPT_BPP,
+	OPT_AUDIO_BUFFER,
 	OPT_HELP,
+	OPT_LOG_LEVEL,
+	OPT_TELEMETRY,
+	OPT_METRICS,
+	OPT_SHM,
+	OPT_RECORD,
+	OPT_PLAY,
+	OPT_SEEK,
+	OPT_UNCAPPED,
+	OPT_AUTO_REPLAY,
+	OPT_AI,
+	OPT_HOST,
+	OPT_JOIN,
+	OPT_NET_DELAY,
+	OPT_NET_JITTER,
+	OPT_NET_LOSS,
+	OPT_SERVER,
+	OPT_RELAY,
+	OPT_WATCH,
+	OPT_WATCH_UDP,
+	OPT_PERF_STATS,
+	OPT_MEM_STATS,
+	OPT_MEM_CHECK,
+	OPT_TRACE_LATENCY,
+	OPT_STARTUP_TIMELINE,
 };
 
 static struct option long_options[] = {
@@ -51,23 +121,47 @@ static struct option long_options[] = {
 	{ "datadir", required_argument, NULL, 'd' },
 #if HAVE_LIBSDL_MIXER
 	{ "mute", no_argument, NULL, 'm' },
+	{ "audio-buffer", required_argument, NULL, OPT_AUDIO_BUFFER },
 #endif
 	{ "display", required_argument, NULL, OPT_DISPLAY },
+	{ "bpp", required_argument, NULL, OPT_BPP },
 	{ "help", no_argument, NULL, OPT_HELP },
+	{ "log-level", required_argument, NULL, OPT_LOG_LEVEL },
+	{ "telemetry", required_argument, NULL, OPT_TELEMETRY },
+	{ "metrics", required_argument, NULL, OPT_METRICS },
+	{ "shm", required_argument, NULL, OPT_SHM },
+	{ "record", required_argument, NULL, OPT_RECORD },
+	{ "play", required_argument, NULL, OPT_PLAY },
+	{ "seek", required_argument, NULL, OPT_SEEK },
+	{ "uncapped", no_argument, NULL, OPT_UNCAPPED },
+	{ "auto-replay", no_argument, NULL, OPT_AUTO_REPLAY },
+	{ "ai", required_argument, NULL, OPT_AI },
+	{ "host", required_argument, NULL, OPT_HOST },
+	{ "join", required_argument, NULL, OPT_JOIN },
+	{ "net-delay", required_argument, NULL, OPT_NET_DELAY },
+	{ "net-jitter", required_argument, NULL, OPT_NET_JITTER },
+	{ "net-loss", required_argument, NULL, OPT_NET_LOSS },
+	{ "server", required_argument, NULL, OPT_SERVER },
+	{ "relay", required_argument, NULL, OPT_RELAY },
+	{ "watch", required_argument, NULL, OPT_WATCH },
+	{ "watch-udp", no_argument, NULL, OPT_WATCH_UDP },
+	{ "perf-stats", no_argument, NULL, OPT_PERF_STATS },
+	{ "mem-stats", no_argument, NULL, OPT_MEM_STATS },
+	{ "mem-check", no_argument, NULL, OPT_MEM_CHECK },
+	{ "trace-latency", no_argument, NULL, OPT_TRACE_LATENCY },
+	{ "startup-timeline", no_argument, NULL, OPT_STARTUP_TIMELINE },
 	{ NULL },
 };
 
 int main(int ac, char *av[])
 {
-	int c;
-	char *p, *datadir;
-	u32 fg, bg;
-	u8 opts;
+	EngineConfig cfg;
+	char *p;
+	int c, n, retv;
 
-	datadir = NULL;
-	opts = 0;
-	fg = ENGINE_FG_COLOR;
-	bg = ENGINE_BG_COLOR;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.fg_color = ENGINE_FG_COLOR;
+	cfg.bg_color = ENGINE_BG_COLOR;
 
 	for (;;) {
 		c = getopt_long(ac, av, "c:C:fd:"
@@ -87,8 +181,127 @@ int main(int ac, char *av[])
  			setenv("DISPLAY", optarg, 1);
 			break;
 
+		case OPT_BPP:
+			cfg.bpp = strtol(optarg, &p, 10);
+			if (*p || (cfg.bpp != 8 && cfg.bpp != 16 && 
+				   cfg.bpp != 32)) {
+				log_err("invalid color depth: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_LOG_LEVEL:
+			if (log_set_level_name(optarg) != 0)
+				return 1;
+			break;
+
+		case OPT_TELEMETRY:
+			cfg.telemetry = optarg;
+			break;
+
+		case OPT_METRICS:
+			cfg.metrics = optarg;
+			break;
+
+		case OPT_SHM:
+			cfg.shmem = optarg;
+			break;
+
+		case OPT_RECORD:
+			cfg.record = optarg;
+			break;
+
+		case OPT_PLAY:
+			cfg.play = optarg;
+			break;
+
+		case OPT_SEEK:
+			cfg.seek = strtoul(optarg, &p, 10);
+			if (*p) {
+				log_err("invalid tick: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_UNCAPPED:
+			cfg.opts |= ENGINE_OPTION_UNCAPPED;
+			break;
+
+		case OPT_AUTO_REPLAY:
+			cfg.opts |= ENGINE_OPTION_AUTO_REPLAY;
+			break;
+
+		case OPT_AI:
+			cfg.ai = optarg;
+			break;
+
+		case OPT_HOST:
+			cfg.host = optarg;
+			break;
+
+		case OPT_JOIN:
+			cfg.join = optarg;
+			break;
+
+		case OPT_NET_DELAY:
+		case OPT_NET_JITTER:
+			n = strtol(optarg, &p, 10);
+			if (*p || n < 0 || n > 5000) {
+				log_err("invalid delay: %s (0-5000 ms)", 
+					optarg);
+				return 1;
+			}
+			*(c == OPT_NET_DELAY ? &cfg.net_delay 
+					     : &cfg.net_jitter) = n;
+			break;
+
+		case OPT_NET_LOSS:
+			n = strtol(optarg, &p, 10);
+			if (*p || n < 0 || n > 100) {
+				log_err("invalid loss: %s (0-100 %%)", optarg);
+				return 1;
+			}
+			cfg.net_loss = n;
+			break;
+
+		case OPT_SERVER:
+			cfg.server = optarg;
+			break;
+
+		case OPT_RELAY:
+			cfg.relay = optarg;
+			break;
+
+		case OPT_WATCH:
+			cfg.watch = optarg;
+			break;
+
+		case OPT_WATCH_UDP:
+			cfg.opts |= ENGINE_OPTION_WATCH_UDP;
+			break;
+
+		case OPT_PERF_STATS:
+			cfg.opts |= ENGINE_OPTION_PERF;
+			break;
+
+		case OPT_MEM_STATS:
+			cfg.opts |= ENGINE_OPTION_MEM_STATS;
+			break;
+
+		case OPT_MEM_CHECK:
+			cfg.opts |= ENGINE_OPTION_MEM_CHECK;
+			break;
+
+		case OPT_TRACE_LATENCY:
+			cfg.opts |= ENGINE_OPTION_LATENCY;
+			break;
+
+		case OPT_STARTUP_TIMELINE:
+			cfg.opts |= ENGINE_OPTION_STARTUP;
+			break;
+
 		case 'c':
-			fg = strtol(optarg, &p, 16);
+			cfg.fg_color = strtol(optarg, &p, 16);
 			if (*p) {
 				log_err("invalid fg color: %s", optarg);
 				return 1;
@@ -96,7 +309,7 @@ int main(int ac, char *av[])
 			break;
 
 		case 'C':
-			bg = strtol(optarg, &p, 16);
+			cfg.bg_color = strtol(optarg, &p, 16);
 			if (*p) {
 				log_err("invalid bg color: %s", optarg);
 				return 1;
@@ -104,15 +317,28 @@ int main(int ac, char *av[])
 			break;
 
 		case 'f':
-			opts |= ENGINE_OPTION_FS;
+			cfg.opts |= ENGINE_OPTION_FS;
 			break;
 
 		case 'd':
-			datadir = optarg;
+			cfg.datadir = optarg;
 			break;
 #if HAVE_LIBSDL_MIXER
 		case 'm':
-			opts |= ENGINE_OPTION_MUTE;
+			cfg.opts |= ENGINE_OPTION_MUTE;
+			break;
+
+		case OPT_AUDIO_BUFFER:
+			cfg.audio_frames = strtol(optarg, &p, 10);
+			if (*p || cfg.audio_frames < MIXER_MIN_FRAMES ||
+			    cfg.audio_frames > MIXER_MAX_FRAMES ||
+			    (cfg.audio_frames & (cfg.audio_frames - 1))) {
+				log_err("invalid audio buffer size: %s "
+					"(a power of two between %d and %d)",
+					optarg, MIXER_MIN_FRAMES, 
+					MIXER_MAX_FRAMES);
+				return 1;
+			}
 			break;
 #endif
 		case '?':
@@ -122,11 +348,58 @@ int main(int ac, char *av[])
 		}
 	}
 
-	if (engine_init(opts, datadir, fg, bg) != 0)
+	if (cfg.record && cfg.play) {
+		log_err("--record and --play are mutually exclusive");
+		return 1;
+	}
+
+	if ((cfg.seek || (cfg.opts & ENGINE_OPTION_UNCAPPED)) && !cfg.play) {
+		log_err("--seek and --uncapped need --play");
+		return 1;
+	}
+
+	if ((cfg.host && cfg.join) || ((cfg.host || cfg.join) && cfg.play)) {
+		log_err("--host, --join and --play are mutually exclusive");
+		return 1;
+	}
+
+	if ((cfg.net_delay || cfg.net_jitter || cfg.net_loss) && 
+	    !cfg.host && !cfg.join) {
+		log_err("--net-delay, --net-jitter and --net-loss need "
+			"--host or --join");
+		return 1;
+	}
+
+	if (cfg.server && (cfg.host || cfg.join || cfg.play || 
+			   cfg.record)) {
+		log_err("--server can't go with --host, --join, --play or "
+			"--record");
+		return 1;
+	}
+
+	if (cfg.watch && (cfg.server || cfg.host || cfg.join || cfg.play ||
+			  cfg.record || cfg.relay)) {
+		log_err("--watch can't go with --server, --host, --join, "
+			"--play, --record or --relay");
+		return 1;
+	}
+
+	if ((cfg.opts & ENGINE_OPTION_WATCH_UDP) && !cfg.watch) {
+		log_err("--watch-udp needs --watch");
 		return 1;
+	}
 
-	engine_loop();
+	log_init();
+
+	if (engine_init(&cfg) != 0) {
+		log_quit();
+		return 1;
+	}
+
+	retv = engine_loop();
 	engine_quit();
 
-	return 0;
+	log_quit();
+
+	return retv != 0;
 }
@@ -0,0 +1,281 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+
+#if ENABLE_MEM_DEBUG && defined(__GLIBC__)
+# include <errno.h>
+# include <malloc.h>
+# define HAVE_ALLOC_HOOK 1
+#endif
+
+#include "log.h"
+#include "mem.h"
+
+#define ATOMIC_ADD(VAR, N)	__atomic_fetch_add(&(VAR), N, __ATOMIC_RELAXED)
+#define ATOMIC_GET(VAR)		__atomic_load_n(&(VAR), __ATOMIC_RELAXED)
+
+static struct {
+	bool  enabled;
+	bool  check;
+
+	/* heap (updated by the allocator hook, from any thread) */
+	u64   allocs;
+	u64   frees;
+	s64   heap_bytes;
+	s64   heap_peak;
+
+	/* SDL surfaces (from any thread) */
+	s64   surface_bytes;
+	s64   surface_peak;
+
+	/* frames */
+	u64   frames;
+	u64   steady_frames;
+	u64   allocating_frames;
+	u64   max_frame_allocs;
+} mem;
+
+/*
+ * Allocations made by this thread. Frames only answer for the main
+ * thread's: the log drain, the telemetry writer and the metrics server
+ * allocate on their own schedule.
+ */
+static __thread u64 thread_allocs;
+static u64 frame_start_allocs;
+
+#if HAVE_ALLOC_HOOK
+
+/*
+ * Counting allocator hook: replaces the libc entry points for the whole
+ * process (SDL and its dependencies included).
+ */
+
+extern void *__libc_malloc   (size_t sz);
+extern void *__libc_calloc   (size_t n, size_t sz);
+extern void *__libc_realloc  (void *p, size_t sz);
+extern void *__libc_memalign (size_t align, size_t sz);
+extern void  __libc_free     (void *p);
+
+static void count_alloc(void *p)
+{
+	s64 sz, b, peak;
+
+	sz = malloc_usable_size(p);
+
+	ATOMIC_ADD(mem.allocs, 1);
+	++thread_allocs;
+	b = ATOMIC_ADD(mem.heap_bytes, sz) + sz;
+
+	/* racy, but good enough for a peak */
+	peak = ATOMIC_GET(mem.heap_peak);
+	if (b > peak)
+		__atomic_store_n(&mem.heap_peak, b, __ATOMIC_RELAXED);
+}
+
+static void count_free(void *p)
+{
+	ATOMIC_ADD(mem.frees, 1);
+	ATOMIC_ADD(mem.heap_bytes, -(s64)malloc_usable_size(p));
+}
+
+void *malloc(size_t sz)
+{
+	void *p = __libc_malloc(sz);
+
+	if (p)
+		count_alloc(p);
+
+	return p;
+}
+
+void *calloc(size_t n, size_t sz)
+{
+	void *p = __libc_calloc(n, sz);
+
+	if (p)
+		count_alloc(p);
+
+	return p;
+}
+
+void *realloc(void *old, size_t sz)
+{
+	void *p;
+
+	if (old)
+		count_free(old);
+
+	p = __libc_realloc(old, sz);
+	if (p)
+		count_alloc(p);
+	else if (old && sz)	/* failed: `old' is still there */
+		count_alloc(old);
+
+	return p;
+}
+
+void *memalign(size_t align, size_t sz)
+{
+	void *p = __libc_memalign(align, sz);
+
+	if (p)
+		count_alloc(p);
+
+	return p;
+}
+
+void *aligned_alloc(size_t align, size_t sz)
+{
+	return memalign(align, sz);
+}
+
+int posix_memalign(void **pp, size_t align, size_t sz)
+{
+	void *p;
+
+	if (align % sizeof(void *) || (align & (align - 1)))
+		return EINVAL;
+
+	p = memalign(align, sz);
+	if (!p)
+		return ENOMEM;
+
+	*pp = p;
+
+	return 0;
+}
+
+void free(void *p)
+{
+	if (p) {
+		count_free(p);
+		__libc_free(p);
+	}
+}
+
+#endif /* HAVE_ALLOC_HOOK */
+
+/*
+ * Enable allocation accounting.
+ */
+void mem_init(bool check)
+{
+#if !HAVE_ALLOC_HOOK
+	log_warn("mem: allocator hook not compiled in "
+		 "(configure with --enable-mem-debug): tracking surfaces only");
+#endif
+
+	mem.enabled = 1;
+	mem.check = check;
+}
+
+/*
+ * Print the accounting summary.
+ */
+void mem_quit(void)
+{
+	if (!mem.enabled)
+		return;
+
+	printf("\n");
+
+#if HAVE_ALLOC_HOOK
+	printf("heap:     %llu allocations, %llu frees, "
+	       "peak %lld bytes, %lld bytes live\n",
+	       (unsigned long long)mem.allocs, (unsigned long long)mem.frees,
+	       (long long)mem.heap_peak, (long long)mem.heap_bytes);
+
+	printf("frames:   %llu total, %llu steady, %llu allocating "
+	       "(at most %llu allocations per frame)\n",
+	       (unsigned long long)mem.frames,
+	       (unsigned long long)mem.steady_frames,
+	       (unsigned long long)mem.allocating_frames,
+	       (unsigned long long)mem.max_frame_allocs);
+#endif
+
+	printf("surfaces: peak %lld bytes, %lld bytes live\n\n",
+	       (long long)mem.surface_peak, (long long)mem.surface_bytes);
+
+	mem.enabled = 0;
+}
+
+/*
+ * Mark the beginning of a frame.
+ */
+void mem_frame_begin(void)
+{
+	if (mem.enabled)
+		frame_start_allocs = thread_allocs;
+}
+
+/*
+ * Mark the end of a frame.
+ */
+void mem_frame_end(bool steady)
+{
+	u64 n;
+
+	if (!mem.enabled)
+		return;
+
+	n = thread_allocs - frame_start_allocs;
+
+	mem.frames++;
+	if (steady)
+		mem.steady_frames++;
+
+	if (!n)
+		return;
+
+	mem.allocating_frames++;
+	if (n > mem.max_frame_allocs)
+		mem.max_frame_allocs = n;
+
+	if (steady && mem.check) {
+		log_err("mem: %llu allocation%s in steady-state frame %llu",
+			(unsigned long long)n, n == 1 ? "" : "s",
+			(unsigned long long)mem.frames);
+		log_flush();
+		abort();
+	}
+}
+
+s64 mem_get_surface_bytes(void)
+{
+	return ATOMIC_GET(mem.surface_bytes);
+}
+
+/*
+ * Account surface pixel memory, from any thread: gnop-render's workers
+ * make surfaces too.
+ */
+void mem_surface_track(s64 bytes)
+{
+	s64 b, peak;
+
+	b = ATOMIC_ADD(mem.surface_bytes, bytes) + bytes;
+
+	/* racy, but good enough for a peak */
+	peak = ATOMIC_GET(mem.surface_peak);
+	if (b > peak)
+		__atomic_store_n(&mem.surface_peak, b, __ATOMIC_RELAXED);
+}
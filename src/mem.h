@@ -0,0 +1,53 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MEM_H
+#define MEM_H
+
+#include "common.h"
+
+/*
+ * Enable allocation accounting.
+ *
+ * If `check' is true, mem_frame_end() will abort the program as soon as a
+ * steady-state frame performs any heap allocation.
+ * Heap figures are only available if gnop was configured with
+ * --enable-mem-debug; surface figures are always collected.
+ */
+void mem_init (bool check);
+
+/*
+ * Print the accounting summary on stdout.
+ */
+void mem_quit (void);
+
+/*
+ * Delimit a frame, from the thread that runs it: only its allocations
+ * count. `steady' tells whether the frame was expected not to allocate
+ * at all.
+ */
+void mem_frame_begin (void);
+void mem_frame_end   (bool steady);
+
+/*
+ * Account `bytes' of pixel memory held by SDL surfaces (negative when
+ * surfaces are released).
+ */
+void mem_surface_track (s64 bytes);
+s64  mem_get_surface_bytes (void);
+
+#endif /* !MEM_H */
@@ -0,0 +1,444 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include "clock.h"
+#include "log.h"
+#include "metrics.h"
+
+#define BACKLOG		4
+#define REQUEST_MAX	1024
+#define BODY_MAX	8192
+#define IO_TIMEOUT_SEC	1
+
+#define ATOMIC_ADD(VAR, N)	__atomic_fetch_add(&(VAR), N, __ATOMIC_RELAXED)
+#define ATOMIC_GET(VAR)		__atomic_load_n(&(VAR), __ATOMIC_RELAXED)
+
+/* frame time histogram bounds (ms) */
+static const u32 bucket_ms[] = { 5, 10, 15, 20, 25, 30, 40, 50, 100, 250 };
+
+#define BUCKET_NO	(sizeof(bucket_ms) / sizeof(*bucket_ms))
+
+static const struct {
+	const char *name;
+	const char *help;
+	const char *type;
+	const char *labels;
+} desc[METRIC_NO] = {
+	{ "gnop_frames_total", "Frames run.", "counter", "" },
+	{ "gnop_matches_started_total", "Matches started.", "counter", "" },
+	{ "gnop_matches_finished_total", "Matches played to the end.",
+	  "counter", "" },
+	{ "gnop_points_total", "Points scored.", "counter",
+	  "{player=\"1\"}" },
+	{ "gnop_points_total", "Points scored.", "counter", 
+	  "{player=\"2\"}" },
+	{ "gnop_audio_underruns_total", 
+	  "Audio buffers the mixer could not fill in time.", "counter", "" },
+	{ "gnop_surface_bytes", "Pixel memory held by SDL surfaces.", 
+	  "gauge", "" },
+	{ "gnop_net_rollbacks_total", 
+	  "Netplay mispredictions rolled back.", "counter", "" },
+	{ "gnop_net_resimulated_ticks_total", 
+	  "Ticks stepped again after a rollback.", "counter", "" },
+};
+
+static struct {
+	bool       enabled;
+
+	/* written by the engine */
+	u64        value[METRIC_NO];
+	u64        bucket[BUCKET_NO + 1];	/* the last one: +Inf */
+	u64        frame_ns;			/* histogram sum */
+	u64        last_frame;
+
+	/* metrics thread */
+	pthread_t  thread;
+	int        fd;
+	int        wake[2];
+	char      *path;	/* Unix socket to remove on quit */
+	double     fps;
+	u64        fps_frames;
+	u64        fps_time;
+	char       req[REQUEST_MAX];
+	char       body[BODY_MAX];
+} met;
+
+void metrics_add(Metric m, u64 n)
+{
+	if (met.enabled)
+		ATOMIC_ADD(met.value[m], n);
+}
+
+void metrics_set(Metric m, u64 v)
+{
+	if (met.enabled)
+		__atomic_store_n(&met.value[m], v, __ATOMIC_RELAXED);
+}
+
+void metrics_frame(void)
+{
+	u64 now, dt;
+	u32 i;
+
+	if (!met.enabled)
+		return;
+
+	now = clock_ns();
+	ATOMIC_ADD(met.value[METRIC_FRAMES], 1);
+
+	if (met.last_frame) {
+		dt = now - met.last_frame;
+		for (i=0; i<BUCKET_NO && dt > bucket_ms[i] * NSEC_PER_MSEC; ++i)
+			;
+
+		ATOMIC_ADD(met.bucket[i], 1);
+		ATOMIC_ADD(met.frame_ns, dt);
+	}
+
+	met.last_frame = now;
+}
+
+/*
+ * Frames per second over the last second or so.
+ */
+static void sample_fps(void)
+{
+	u64 now, frames;
+
+	now = clock_ns();
+	if (now - met.fps_time < NSEC_PER_SEC)
+		return;
+
+	frames = ATOMIC_GET(met.value[METRIC_FRAMES]);
+	met.fps = (double)(frames - met.fps_frames) * NSEC_PER_SEC / 
+		(now - met.fps_time);
+	met.fps_frames = frames;
+	met.fps_time = now;
+}
+
+/*
+ * From /proc/self/statm, without stdio: fopen() allocates.
+ */
+static u64 resident_bytes(void)
+{
+	unsigned long size, rss;
+	char buf[128];
+	ssize_t n;
+	int fd;
+
+	fd = open("/proc/self/statm", O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+
+	if (sscanf(buf, "%lu %lu", &size, &rss) != 2)
+		return 0;
+
+	return (u64)rss * sysconf(_SC_PAGESIZE);
+}
+
+#define APPEND(...) do {						\
+	len += snprintf(met.body + len, BODY_MAX - len, __VA_ARGS__);	\
+	if (len >= BODY_MAX)						\
+		len = BODY_MAX - 1;					\
+} while (0)
+
+static int render(void)
+{
+	u64 count, sum;
+	int len = 0, i;
+
+	for (i=0; i<METRIC_NO; ++i) {
+		if (!i || strcmp(desc[i].name, desc[i - 1].name))
+			APPEND("# HELP %s %s\n# TYPE %s %s\n", desc[i].name,
+			       desc[i].help, desc[i].name, desc[i].type);
+
+		APPEND("%s%s %llu\n", desc[i].name, desc[i].labels,
+		       (unsigned long long)ATOMIC_GET(met.value[i]));
+	}
+
+	APPEND("# HELP gnop_fps Frames per second.\n"
+	       "# TYPE gnop_fps gauge\n"
+	       "gnop_fps %.2f\n", met.fps);
+
+	APPEND("# HELP gnop_frame_seconds Time between frames.\n"
+	       "# TYPE gnop_frame_seconds histogram\n");
+
+	for (i=0, count=0; i<=(int)BUCKET_NO; ++i) {
+		count += ATOMIC_GET(met.bucket[i]);
+		if (i < (int)BUCKET_NO)
+			APPEND("gnop_frame_seconds_bucket{le=\"%g\"} %llu\n",
+			       bucket_ms[i] / 1000.0, 
+			       (unsigned long long)count);
+		else
+			APPEND("gnop_frame_seconds_bucket{le=\"+Inf\"} %llu\n",
+			       (unsigned long long)count);
+	}
+
+	sum = ATOMIC_GET(met.frame_ns);
+	APPEND("gnop_frame_seconds_sum %.6f\n"
+	       "gnop_frame_seconds_count %llu\n", 
+	       (double)sum / NSEC_PER_SEC, (unsigned long long)count);
+
+	APPEND("# HELP gnop_resident_bytes Resident set size.\n"
+	       "# TYPE gnop_resident_bytes gauge\n"
+	       "gnop_resident_bytes %llu\n", 
+	       (unsigned long long)resident_bytes());
+
+	return len;
+}
+
+static int send_all(int fd, const char *buf, int len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Answer one HTTP request, then close the connection.
+ */
+static void serve(int fd)
+{
+	struct timeval tv = { IO_TIMEOUT_SEC, 0 };
+	char head[160];
+	const char *status = "200 OK";
+	int len = 0, body;
+	ssize_t n;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* the request line is all we look at */
+	while (len < REQUEST_MAX - 1) {
+		n = recv(fd, met.req + len, REQUEST_MAX - 1 - len, 0);
+		if (n <= 0)
+			break;
+		len += n;
+		met.req[len] = '\0';
+		if (strstr(met.req, "\r\n\r\n") || strstr(met.req, "\n\n"))
+			break;
+	}
+	met.req[len] = '\0';
+
+	if (strncmp(met.req, "GET ", 4))
+		status = "405 Method Not Allowed";
+	else if (strncmp(met.req + 4, "/metrics ", 9) && 
+		 strncmp(met.req + 4, "/ ", 2))
+		status = "404 Not Found";
+
+	body = *status == '2' ? render() : 0;
+
+	len = snprintf(head, sizeof(head), "HTTP/1.0 %s\r\n"
+		       "Content-Type: text/plain; version=0.0.4\r\n"
+		       "Content-Length: %d\r\n"
+		       "Connection: close\r\n\r\n", status, body);
+
+	if (send_all(fd, head, len) == 0)
+		send_all(fd, met.body, body);
+
+	close(fd);
+}
+
+static void *metrics_thread(void *unused)
+{
+	struct pollfd pfd[2];
+	int fd;
+
+	pfd[0].fd = met.fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = met.wake[0];
+	pfd[1].events = POLLIN;
+
+	met.fps_time = clock_ns();
+
+	for (;;) {
+		if (poll(pfd, 2, 1000) == -1 && errno != EINTR)
+			break;
+
+		sample_fps();
+
+		if (pfd[1].revents)
+			break;
+
+		if (pfd[0].revents & POLLIN) {
+			fd = accept(met.fd, NULL, NULL);
+			if (fd != -1)
+				serve(fd);
+		}
+	}
+
+	return NULL;
+}
+
+static int listen_unix(const char *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(sun.sun_path)) {
+		log_err("metrics: socket path too long: %s", path);
+		return -1;
+	}
+
+	/* a socket left by a previous run */
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	met.path = strdup(path);
+
+	return fd;
+}
+
+static int listen_tcp(const char *port)
+{
+	struct sockaddr_in sin;
+	char *end;
+	long n;
+	int fd, on = 1;
+
+	n = strtol(port, &end, 10);
+	if (*end || n < 1 || n > 65535) {
+		log_err("metrics: invalid port: %s", port);
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(n);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int metrics_init(const char *addr)
+{
+	if (met.enabled) {
+		log_warn("metrics: already serving");
+		return 1;
+	}
+
+	memset(&met, 0, sizeof(met));
+
+	met.fd = strchr(addr, '/') ? listen_unix(addr) : listen_tcp(addr);
+	if (met.fd == -1 || listen(met.fd, BACKLOG) == -1) {
+		log_err("metrics: could not listen on %s: %s", addr,
+			strerror(errno));
+		goto fail;
+	}
+
+	/* a client gone before accept() must not block the thread */
+	fcntl(met.fd, F_SETFL, O_NONBLOCK);
+
+	if (pipe(met.wake) == -1)
+		goto fail;
+
+	met.enabled = 1;
+
+	if (pthread_create(&met.thread, NULL, metrics_thread, NULL) != 0) {
+		met.enabled = 0;
+		close(met.wake[0]);
+		close(met.wake[1]);
+		goto fail;
+	}
+
+	log_info("metrics: serving on %s", addr);
+
+	return 0;
+
+fail:
+	if (met.fd != -1)
+		close(met.fd);
+	if (met.path)
+		unlink(met.path);
+	free(met.path);
+	met.path = NULL;
+
+	return -1;
+}
+
+void metrics_quit(void)
+{
+	if (!met.enabled)
+		return;
+
+	met.enabled = 0;
+
+	if (write(met.wake[1], "", 1) != 1)
+		log_warn("metrics: could not wake thread: %s", strerror(errno));
+	pthread_join(met.thread, NULL);
+
+	close(met.wake[0]);
+	close(met.wake[1]);
+	close(met.fd);
+
+	if (met.path)
+		unlink(met.path);
+	free(met.path);
+	met.path = NULL;
+}
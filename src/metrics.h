@@ -0,0 +1,57 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+typedef enum {
+	METRIC_FRAMES,			/* counter */
+	METRIC_MATCHES_STARTED,		/* counter */
+	METRIC_MATCHES_FINISHED,	/* counter */
+	METRIC_POINTS_P1,		/* counter */
+	METRIC_POINTS_P2,		/* counter */
+	METRIC_AUDIO_UNDERRUNS,		/* counter, set from the mixer's */
+	METRIC_SURFACE_BYTES,		/* gauge */
+	METRIC_ROLLBACKS,		/* counter */
+	METRIC_RESIMULATED_TICKS,	/* counter */
+	METRIC_NO,
+} Metric;
+
+/*
+ * Serve the metrics in the Prometheus text format from a thread
+ * listening on `addr': a TCP port on the loopback interface, or the
+ * path of a Unix socket if `addr' contains a `/'.
+ */
+int  metrics_init (const char *addr);
+void metrics_quit (void);
+
+/*
+ * Update a metric. Relaxed atomics: cheap, never blocking, and no-ops
+ * unless metrics are served.
+ */
+void metrics_add (Metric m, u64 n);
+void metrics_set (Metric m, u64 v);
+
+/*
+ * Count a frame and put the time since the previous one in the frame
+ * time histogram. Main thread only.
+ */
+void metrics_frame (void);
+
+#endif /* !METRICS_H */
@@ -0,0 +1,335 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <SDL.h>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "clock.h"
+#include "log.h"
+#include "mixer.h"
+
+#define VOICES_NO	8
+#define QUEUE_SZ	64	/* power of two */
+#define QUEUE_MASK	(QUEUE_SZ - 1)
+
+#define ATOMIC_GET(VAR)		__atomic_load_n(&(VAR), __ATOMIC_ACQUIRE)
+#define ATOMIC_SET(VAR, X)	__atomic_store_n(&(VAR), X, __ATOMIC_RELEASE)
+
+enum {
+	CMD_PLAY,
+	CMD_VOLUME,
+	CMD_MUTE,
+};
+
+typedef struct {
+	u8 type;
+	u8 arg;
+} Command;
+
+typedef struct {
+	const s16 *pcm;
+	u32        len;
+} Sound;
+
+typedef struct {
+	const Sound *snd;	/* NULL if the voice is free */
+	u32          pos;
+} Voice;
+
+static struct {
+	bool     inited;
+	u16      frames;
+	u64      period_ns;
+	Sound    sound[MIXER_SOUND_NO];
+
+	/* game thread -> audio thread */
+	Command  queue[QUEUE_SZ];
+	u32      head;
+	u32      tail;
+	u32      dropped;
+
+	/*< owned by the audio thread >*/
+	Voice    voice[VOICES_NO];
+	u8       volume;
+	bool     mute;
+	u64      last_cb;
+	u64      callbacks;
+	u64      max_cb_ns;
+	u32      underruns;
+} mixer;
+
+/*
+ * Mix kernel: dst[i] += src[i] * volume / 128, with saturation.
+ */
+void mixer_mix(s16 *dst, const s16 *src, u32 n, u8 volume)
+{
+	u32 i = 0;
+	s32 x;
+
+#if defined(__SSE2__)
+	const __m128i v = _mm_set1_epi16(volume);
+	__m128i s, d, lo, hi;
+
+	for (; i+8 <= n; i+=8) {
+		s = _mm_loadu_si128((const __m128i *)(src + i));
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+		/* 16x16 -> 32-bit products, scaled back and packed */
+		lo = _mm_mullo_epi16(s, v);
+		hi = _mm_mulhi_epi16(s, v);
+		s = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 7),
+			_mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 7));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epi16(d, s));
+	}
+#endif
+
+	for (; i<n; ++i) {
+		x = dst[i] + ((src[i] * volume) >> 7);
+		dst[i] = x > 32767 ? 32767 : x < -32768 ? -32768 : x;
+	}
+}
+
+static void start_voice(int id)
+{
+	Voice *v, *oldest;
+	int i;
+
+	if (id < 0 || id >= MIXER_SOUND_NO || !mixer.sound[id].pcm)
+		return;
+
+	/* take a free voice, or steal the one which played the longest */
+	for (i=0, oldest=mixer.voice; i<VOICES_NO; ++i) {
+		v = &mixer.voice[i];
+		if (!v->snd)
+			break;
+		if (v->pos > oldest->pos)
+			oldest = v;
+	}
+
+	if (i == VOICES_NO)
+		v = oldest;
+
+	v->snd = &mixer.sound[id];
+	v->pos = 0;
+}
+
+static void run_commands(void)
+{
+	u32 head, tail;
+	Command *cmd;
+
+	head = mixer.head;
+	tail = ATOMIC_GET(mixer.tail);
+
+	for (; head != tail; ++head) {
+		cmd = &mixer.queue[head & QUEUE_MASK];
+
+		switch (cmd->type) {
+		case CMD_PLAY:
+			start_voice(cmd->arg);
+			break;
+
+		case CMD_VOLUME:
+			mixer.volume = cmd->arg;
+			break;
+
+		case CMD_MUTE:
+			mixer.mute = cmd->arg;
+			break;
+		}
+	}
+
+	ATOMIC_SET(mixer.head, head);
+}
+
+/*
+ * SDL audio callback (audio thread).
+ */
+static void fill(void *data, Uint8 *stream, int len)
+{
+	s16 *out = (s16 *)stream;
+	u32 n, k;
+	u64 now;
+	Voice *v;
+	int i;
+
+	now = clock_ns();
+
+	/* a late callback means the device ran out of samples */
+	if (mixer.last_cb && now - mixer.last_cb > 2 * mixer.period_ns)
+		__atomic_store_n(&mixer.underruns, mixer.underruns + 1,
+				 __ATOMIC_RELAXED);
+	mixer.last_cb = now;
+	mixer.callbacks++;
+
+	run_commands();
+
+	n = len / sizeof(*out);
+	memset(stream, 0, len);
+
+	for (i=0; i<VOICES_NO; ++i) {
+		v = &mixer.voice[i];
+		if (!v->snd)
+			continue;
+
+		k = v->snd->len - v->pos;
+		if (k > n)
+			k = n;
+
+		if (!mixer.mute && mixer.volume)
+			mixer_mix(out, v->snd->pcm + v->pos, k, mixer.volume);
+
+		v->pos += k;
+		if (v->pos >= v->snd->len)
+			v->snd = NULL;
+	}
+
+	now = clock_ns() - now;
+	if (now > mixer.max_cb_ns)
+		mixer.max_cb_ns = now;
+}
+
+int mixer_init(u16 frames)
+{
+	SDL_AudioSpec spec;
+	char buf[32];
+
+	if (mixer.inited) {
+		log_warn("mixer: seems already initialized");
+		return 1;
+	}
+
+	if (frames < MIXER_MIN_FRAMES || frames > MIXER_MAX_FRAMES ||
+	    (frames & (frames - 1))) {
+		log_err("mixer: invalid buffer size: %u frames", frames);
+		return -1;
+	}
+
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+		log_err("could not initialize audio subsystem: %s", 
+			SDL_GetError());
+		return -1;
+	}
+
+	memset(&mixer, 0, sizeof(mixer));
+
+	spec.freq = MIXER_FREQ;
+	spec.format = AUDIO_S16SYS;
+	spec.channels = 1;
+	spec.samples = frames;
+	spec.callback = fill;
+	spec.userdata = NULL;
+
+	/* no `obtained' spec: SDL converts to the device format for us */
+	if (SDL_OpenAudio(&spec, NULL) != 0) {
+		log_err("could not open audio: %s", SDL_GetError());
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+		return -1;
+	}
+
+	SDL_AudioDriverName(buf, sizeof(buf));
+	log_info("driver audio: %s (mixer, %u frames, %.1f ms)", buf, 
+		 frames, 1000.0 * frames / MIXER_FREQ);
+
+	mixer.frames = frames;
+	mixer.period_ns = (u64)frames * NSEC_PER_SEC / MIXER_FREQ;
+	mixer.volume = MIXER_MAX_VOLUME;
+	mixer.inited = 1;
+
+	SDL_PauseAudio(0);
+
+	return 0;
+}
+
+void mixer_quit(void)
+{
+	if (!mixer.inited)
+		return;
+
+	SDL_CloseAudio();
+	SDL_QuitSubSystem(SDL_INIT_AUDIO);
+
+	log_info("mixer: %llu buffers, %u underruns, max callback %.1f us%s",
+		 (unsigned long long)mixer.callbacks, mixer.underruns,
+		 (double)mixer.max_cb_ns / NSEC_PER_USEC,
+		 mixer.dropped ? " (commands were dropped)" : "");
+
+	mixer.inited = 0;
+}
+
+int mixer_load(int id, const s16 *pcm, u32 nsamples)
+{
+	if (id < 0 || id >= MIXER_SOUND_NO)
+		return -1;
+
+	SDL_LockAudio();
+	mixer.sound[id].pcm = pcm;
+	mixer.sound[id].len = nsamples;
+	SDL_UnlockAudio();
+
+	return 0;
+}
+
+/*
+ * Enqueue a command for the audio thread.
+ */
+static void push(u8 type, u8 arg)
+{
+	u32 head, tail;
+
+	if (!mixer.inited)
+		return;
+
+	tail = mixer.tail;
+	head = ATOMIC_GET(mixer.head);
+
+	if (tail - head == QUEUE_SZ) {
+		mixer.dropped++;
+		return;
+	}
+
+	mixer.queue[tail & QUEUE_MASK].type = type;
+	mixer.queue[tail & QUEUE_MASK].arg = arg;
+
+	ATOMIC_SET(mixer.tail, tail + 1);
+}
+
+INLINE void mixer_play(int id)
+{
+	push(CMD_PLAY, id);
+}
+
+INLINE void mixer_set_volume(u8 volume)
+{
+	push(CMD_VOLUME, volume > MIXER_MAX_VOLUME ? 
+	     MIXER_MAX_VOLUME : volume);
+}
+
+INLINE void mixer_set_mute(bool mute)
+{
+	push(CMD_MUTE, mute);
+}
+
+INLINE u32 mixer_get_underruns(void)
+{
+	return __atomic_load_n(&mixer.underruns, __ATOMIC_RELAXED);
+}
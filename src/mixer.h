@@ -0,0 +1,63 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "common.h"
+
+#define MIXER_FREQ		44100
+#define MIXER_MAX_VOLUME	128
+#define MIXER_SOUND_NO		8
+
+#define MIXER_MIN_FRAMES	128
+#define MIXER_MAX_FRAMES	4096
+
+/*
+ * Low-latency mixer owning the SDL audio callback (signed 16-bit mono).
+ *
+ * `frames' is the device buffer size: a power of two between
+ * MIXER_MIN_FRAMES and MIXER_MAX_FRAMES.
+ */
+int  mixer_init (u16 frames);
+void mixer_quit (void);
+
+/*
+ * Register sound `id' (< MIXER_SOUND_NO). `pcm' is not copied and must
+ * stay valid until mixer_quit().
+ */
+int  mixer_load (int id, const s16 *pcm, u32 nsamples);
+
+/*
+ * Commands: these only enqueue a request for the audio thread, hence 
+ * never block.
+ */
+void mixer_play       (int id);
+void mixer_set_volume (u8 volume);	/* [0-128] */
+void mixer_set_mute   (bool mute);
+
+/*
+ * Number of device buffers which were likely not delivered in time.
+ */
+u32  mixer_get_underruns (void);
+
+/*
+ * Mix kernel: dst[i] += src[i] * volume / 128, with saturation.
+ */
+void mixer_mix (s16 *dst, const s16 *src, u32 n, u8 volume);
+
+#endif /* !MIXER_H */
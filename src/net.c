@@ -0,0 +1,728 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "bytes.h"
+#include "clock.h"
+#include "delta.h"
+#include "log.h"
+#include "metrics.h"
+#include "net.h"
+
+#define MAGIC_LEN	(sizeof(NET_MAGIC) - 1)
+#define HELLO_LEN	(1 + MAGIC_LEN)
+#define WELCOME_LEN	(1 + MAGIC_LEN + 8)
+#define INPUT_HDR_LEN	29
+#define SEND_MAX	64	/* inputs per packet */
+#define PACKET_MAX	(INPUT_HDR_LEN + SEND_MAX + DELTA_MAX_LEN)
+
+#define HISTORY		128	/* ticks of inputs and snapshots kept */
+#define STATES		32	/* states sent, and received, kept */
+
+#define CONNECT_MS	60000
+#define HELLO_MS	250
+#define TIMEOUT_MS	5000
+
+#define SYNC_INTERVAL	10	/* ticks between two waits to slow down */
+
+#define QUEUE_LEN	256	/* packets held by the conditioner */
+
+#define NO_TICK		((u32)-1)
+#define PREDICTED(I)	((I) & (GAME_INPUT_UP | GAME_INPUT_DOWN))
+
+typedef struct {
+	u64 due;		/* ns */
+	u8  len;
+	u8  data[PACKET_MAX];
+} Delayed;
+
+static struct {
+	int   fd;
+	u64   seed;		/* sent again if the welcome was lost */
+	int   local;		/* paddle played here */
+	int   remote;
+
+	u8           input[2][HISTORY];	/* by tick, indexed by paddle */
+	GameSnapshot saved[HISTORY];	/* state before each tick */
+
+	u32   tick;		/* next tick to play */
+	u32   confirmed;	/* remote inputs received, in order */
+	u32   acked;		/* local inputs the peer received */
+	u32   wrong;		/* first tick mispredicted, or NO_TICK */
+	u32   recorded;		/* ticks handed out as confirmed */
+	u8    last_remote;
+
+	u32   remote_tick;	/* peer's next tick, when it last sent */
+	s8    remote_adv;	/* peer's advantage on us */
+	u32   synced;		/* tick of the last wait to slow down */
+
+	GameState sent[STATES];	/* by tick, as coded to the peer */
+	GameState peer[STATES];	/* by tick, as decoded */
+	u32   state_acked;	/* latest of `sent' the peer decoded */
+	u32   peer_state;	/* latest of `peer' */
+	u32   check_tick;	/* of `peer', until ours is confirmed */
+
+	u64   start;
+	u64   last_recv;
+	u32   echo;		/* peer's last stamp */
+	u64   echo_at;
+	u32   rtt_ms;
+
+	u32   rollbacks;
+	u32   resimulated;
+	u32   max_rollback;
+	u32   waits;
+
+	/* conditioner */
+	u16     delay_ms, jitter_ms;
+	u8      loss;
+	u64     rng;
+	Delayed queue[QUEUE_LEN];
+	u32     queued;
+} net = { -1 };
+
+static u32 now_ms(void)
+{
+	return (clock_ns() - net.start) / NSEC_PER_MSEC;
+}
+
+/*
+ * xorshift64, for the conditioner only: the game has its own.
+ */
+static u32 cond_rand(void)
+{
+	net.rng ^= net.rng << 13;
+	net.rng ^= net.rng >> 7;
+	net.rng ^= net.rng << 17;
+
+	return net.rng >> 32;
+}
+
+static void send_now(const u8 *buf, u32 len)
+{
+	if (send(net.fd, buf, len, 0) == -1 && errno != EAGAIN &&
+	    errno != ECONNREFUSED)
+		log_warn("net: could not send: %s", strerror(errno));
+}
+
+/*
+ * Send the packets whose delay is over.
+ */
+static void flush_queue(void)
+{
+	u64 now = clock_ns();
+	u32 i = 0;
+
+	while (i < net.queued) {
+		if (net.queue[i].due > now) {
+			++i;
+			continue;
+		}
+
+		send_now(net.queue[i].data, net.queue[i].len);
+		net.queue[i] = net.queue[--net.queued];
+	}
+}
+
+static void send_packet(const u8 *buf, u32 len)
+{
+	Delayed *d;
+	s64 delay;
+
+	if (!net.delay_ms && !net.jitter_ms && !net.loss) {
+		send_now(buf, len);
+		return;
+	}
+
+	if (cond_rand() % 100 < net.loss || net.queued == QUEUE_LEN)
+		return;
+
+	delay = net.delay_ms;
+	if (net.jitter_ms)
+		delay += (s64)(cond_rand() % (2*net.jitter_ms + 1)) - 
+			net.jitter_ms;
+
+	d = &net.queue[net.queued++];
+	d->due = clock_ns() + (delay > 0 ? delay : 0) * NSEC_PER_MSEC;
+	d->len = len;
+	memcpy(d->data, buf, len);
+}
+
+/*
+ * Tell the peer about every input it has not acknowledged, and about
+ * the state at the last tick confirmed here.
+ */
+static void send_inputs(const GameState *s)
+{
+	u8 buf[PACKET_MAX], *p;
+	const GameState *base;
+	GameState check;
+	u32 count, i, c, now, a;
+	s32 adv;
+
+	count = net.tick - net.acked;
+	if (count > SEND_MAX)
+		count = SEND_MAX;
+
+	c = net.confirmed < net.tick ? net.confirmed : net.tick;
+	if (c < net.tick)
+		game_restore(&check, &net.saved[c % HISTORY]);
+	else
+		check = *s;
+
+	adv = (s32)(net.tick - net.remote_tick);
+	adv = adv > 127 ? 127 : adv < -128 ? -128 : adv;
+	now = now_ms();
+
+	p = buf;
+	*p++ = 'I';
+	p = put_le(p, net.acked, 4);
+	*p++ = count;
+	p = put_le(p, net.confirmed, 4);
+	*p++ = (s8)adv;
+	p = put_le(p, now, 4);
+	p = put_le(p, net.echo, 4);
+	p = put_le(p, net.echo_at ? now - net.echo_at : 0, 2);
+	p = put_le(p, net.peer_state, 4);
+
+	/* code the state against the last one the peer has */
+	a = net.state_acked;
+	base = a != NO_TICK && net.sent[a % STATES].tick == a ?
+		&net.sent[a % STATES] : NULL;
+	p = put_le(p, base ? a : NO_TICK, 4);
+
+	for (i=0; i<count; ++i)
+		*p++ = net.input[net.local][(net.acked + i) % HISTORY];
+
+	p += delta_encode(base, &check, p);
+	net.sent[c % STATES] = check;
+
+	send_packet(buf, p - buf);
+}
+
+/*
+ * Decode the peer's state at `buf', coded against its state at tick
+ * `base', and keep it to be checked.
+ */
+static void take_state(const u8 *buf, u32 len, u32 base)
+{
+	const GameState *b = NULL;
+	GameState st;
+
+	if (base != NO_TICK) {
+		b = &net.peer[base % STATES];
+		if (b->tick != base)
+			return;		/* gone: wait for an ack of a newer */
+	}
+
+	if (delta_decode(b, buf, len, &st) != (int)len)
+		return;
+
+	net.peer[st.tick % STATES] = st;
+	if (net.peer_state == NO_TICK || st.tick > net.peer_state)
+		net.peer_state = net.check_tick = st.tick;
+}
+
+/*
+ * Take the remote inputs and state of an input packet; note the first
+ * tick that was played with a wrong guess.
+ */
+static void take_inputs(const u8 *buf, u32 len)
+{
+	u32 first, count, ack, t, i, stamp, echo, held;
+	u8 in;
+
+	first = get_le(buf + 1, 4);
+	count = buf[5];
+	if (len <= INPUT_HDR_LEN + count)
+		return;
+
+	ack = get_le(buf + 6, 4);
+	if (ack > net.acked && ack <= net.tick)
+		net.acked = ack;
+
+	if (first + count > net.remote_tick) {
+		net.remote_tick = first + count;
+		net.remote_adv = (s8)buf[10];
+	}
+
+	stamp = get_le(buf + 11, 4);
+	echo = get_le(buf + 15, 4);
+	held = get_le(buf + 19, 2);
+	if (stamp >= net.echo) {
+		net.echo = stamp;
+		net.echo_at = now_ms();
+	}
+	if (echo && now_ms() >= echo + held) {
+		t = now_ms() - echo - held;
+		net.rtt_ms = net.rtt_ms ? (net.rtt_ms * 7 + t) / 8 : t;
+	}
+
+	t = get_le(buf + 21, 4);
+	if (t != NO_TICK && (net.state_acked == NO_TICK ||
+			     t > net.state_acked))
+		net.state_acked = t;
+
+	take_state(buf + INPUT_HDR_LEN + count, len - INPUT_HDR_LEN - count,
+		   get_le(buf + 25, 4));
+
+	for (i=0; i<count; ++i) {
+		t = first + i;
+		if (t < net.confirmed)
+			continue;
+		if (t > net.confirmed || t >= net.tick + NET_MAX_ROLLBACK)
+			break;
+
+		in = buf[INPUT_HDR_LEN + i];
+		if (t < net.tick && net.input[net.remote][t % HISTORY] != in &&
+		    t < net.wrong)
+			net.wrong = t;
+
+		net.input[net.remote][t % HISTORY] = in;
+		net.last_remote = in;
+		++net.confirmed;
+	}
+}
+
+/*
+ * Read what the peer sent. Return -1 if it left.
+ */
+static int receive(void)
+{
+	u8 buf[PACKET_MAX + 1];
+	ssize_t n;
+
+	while ((n = recv(net.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		net.last_recv = clock_ns();
+
+		switch (buf[0]) {
+		case 'I':
+			if (n >= INPUT_HDR_LEN)
+				take_inputs(buf, n);
+			break;
+
+		case 'H':
+			/* our welcome was lost */
+			buf[0] = 'W';
+			put_le(buf + HELLO_LEN, net.seed, 8);
+			send_now(buf, WELCOME_LEN);
+			break;
+
+		case 'Q':
+			log_info("net: peer left");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Restore the state before the first mispredicted tick and play again
+ * up to the present, with the inputs now known.
+ */
+static void rollback(GameState *s)
+{
+	u8 in[2];
+	u32 t, n;
+
+	n = net.tick - net.wrong;
+	game_restore(s, &net.saved[net.wrong % HISTORY]);
+
+	for (t=net.wrong; t<net.tick; ++t) {
+		if (t >= net.confirmed)
+			net.input[net.remote][t % HISTORY] = 
+				PREDICTED(net.last_remote);
+
+		in[net.local] = net.input[net.local][t % HISTORY];
+		in[net.remote] = net.input[net.remote][t % HISTORY];
+
+		game_save(s, &net.saved[t % HISTORY]);
+		game_step(s, in);
+	}
+
+	++net.rollbacks;
+	net.resimulated += n;
+	if (n > net.max_rollback)
+		net.max_rollback = n;
+	metrics_add(METRIC_ROLLBACKS, 1);
+	metrics_add(METRIC_RESIMULATED_TICKS, n);
+
+	net.wrong = NO_TICK;
+}
+
+/*
+ * Compare the peer's state with ours at that tick, once we are sure of
+ * it. On a desync, the host's state wins: return 1 if the one we had
+ * here must be played again from there.
+ */
+static bool check_sync(GameState *s)
+{
+	GameSnapshot ours, theirs;
+	u32 c = net.check_tick, i;
+
+	if (c == NO_TICK || c > net.confirmed || c > net.tick ||
+	    c + HISTORY <= net.tick || net.peer[c % STATES].tick != c)
+		return 0;
+
+	net.check_tick = NO_TICK;
+
+	if (c < net.tick)
+		ours = net.saved[c % HISTORY];
+	else
+		game_save(s, &ours);
+	game_save(&net.peer[c % STATES], &theirs);
+
+	if (!memcmp(&ours, &theirs, sizeof(ours)))
+		return 0;
+
+	if (net.local == 0) {
+		log_warn("net: desync at tick %u", c);
+		return 0;
+	}
+
+	log_warn("net: desync at tick %u, taking the host's state", c);
+
+	if (c == net.tick) {
+		*s = net.peer[c % STATES];
+		return 0;
+	}
+
+	net.saved[c % HISTORY] = theirs;
+	if (c < net.wrong)
+		net.wrong = c;
+
+	/* the host may hold our old states as baselines */
+	for (i=0; i<STATES; ++i)
+		net.sent[i].tick = NO_TICK;
+	net.state_acked = NO_TICK;
+
+	return 1;
+}
+
+/*
+ * Return 1 if stepping now would predict too far, overflow what a
+ * packet can carry, or keep us ahead of the peer.
+ */
+static bool must_wait(void)
+{
+	s32 ahead;
+
+	if (net.tick - net.confirmed >= NET_MAX_ROLLBACK ||
+	    net.tick - net.acked >= SEND_MAX)
+		return 1;
+
+	/* both sides see their lead; half the difference is the real one */
+	ahead = ((s32)(net.tick - net.remote_tick) - net.remote_adv) / 2;
+	if (ahead >= 2 && net.tick - net.synced >= SYNC_INTERVAL) {
+		net.synced = net.tick;
+		return 1;
+	}
+
+	return 0;
+}
+
+int net_step(GameState *s, u8 input, u32 *ev)
+{
+	u8 in[2];
+	u32 t;
+
+	flush_queue();
+
+	if (receive() != 0)
+		return -1;
+
+	if (clock_ns() - net.last_recv > TIMEOUT_MS * NSEC_PER_MSEC) {
+		log_err("net: peer timed out");
+		return -1;
+	}
+
+	if (net.wrong < net.tick)
+		rollback(s);
+	if (check_sync(s))
+		rollback(s);
+
+	if (must_wait()) {
+		++net.waits;
+		send_inputs(s);
+		return 0;
+	}
+
+	t = net.tick;
+	net.input[net.local][t % HISTORY] = input;
+	if (t >= net.confirmed)
+		net.input[net.remote][t % HISTORY] = 
+			PREDICTED(net.last_remote);
+
+	in[net.local] = input;
+	in[net.remote] = net.input[net.remote][t % HISTORY];
+
+	game_save(s, &net.saved[t % HISTORY]);
+	*ev = game_step(s, in);
+	++net.tick;
+
+	send_inputs(s);
+
+	return 1;
+}
+
+bool net_next_confirmed(u8 input[2], GameState *s)
+{
+	u32 t = net.recorded;
+
+	/* the state after `t' is the one saved before `t + 1' */
+	if (t >= net.confirmed || t + 1 >= net.tick)
+		return 0;
+
+	input[0] = net.input[0][t % HISTORY];
+	input[1] = net.input[1][t % HISTORY];
+	game_restore(s, &net.saved[(t + 1) % HISTORY]);
+	++net.recorded;
+
+	return 1;
+}
+
+int net_local_player(void)
+{
+	return net.local;
+}
+
+void net_condition(u16 delay_ms, u16 jitter_ms, u8 loss)
+{
+	net.delay_ms = delay_ms;
+	net.jitter_ms = jitter_ms;
+	net.loss = loss;
+	net.rng = clock_ns() | 1;
+}
+
+void net_raise_nofile(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+int net_resolve(const char *addr, bool join, struct sockaddr_in *sin)
+{
+	struct addrinfo hints, *res;
+	const char *port;
+	char host[256];
+	int err;
+
+	port = strrchr(addr, ':');
+	if (join && (!port || port == addr || 
+		     (size_t)(port - addr) >= sizeof(host))) {
+		log_err("net: expected HOST:PORT, got `%s'", addr);
+		return -1;
+	}
+
+	if (join) {
+		memcpy(host, addr, port - addr);
+		host[port - addr] = '\0';
+		++port;
+	} else {
+		port = port ? port + 1 : addr;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = join ? 0 : AI_PASSIVE;
+
+	err = getaddrinfo(join ? host : NULL, port, &hints, &res);
+	if (err) {
+		log_err("net: %s: %s", addr, gai_strerror(err));
+		return -1;
+	}
+
+	memcpy(sin, res->ai_addr, sizeof(*sin));
+	freeaddrinfo(res);
+
+	return 0;
+}
+
+/*
+ * Wait up to `ms' for a packet.
+ */
+static ssize_t wait_packet(u8 *buf, size_t len, int ms, 
+			   struct sockaddr_in *from)
+{
+	struct pollfd pfd = { net.fd, POLLIN, 0 };
+	socklen_t fromlen = sizeof(*from);
+
+	if (poll(&pfd, 1, ms) <= 0)
+		return 0;
+
+	return recvfrom(net.fd, buf, len, 0, (struct sockaddr *)from, 
+			&fromlen);
+}
+
+/*
+ * Host: wait for a hello, and welcome its sender with the seed.
+ */
+static int accept_peer(u64 seed)
+{
+	struct sockaddr_in from;
+	u8 buf[PACKET_MAX];
+	ssize_t n;
+	u64 end;
+
+	end = clock_ns() + CONNECT_MS * NSEC_PER_MSEC;
+
+	while (clock_ns() < end) {
+		n = wait_packet(buf, sizeof(buf), HELLO_MS, &from);
+		if (n != HELLO_LEN || buf[0] != 'H' || 
+		    memcmp(buf + 1, NET_MAGIC, MAGIC_LEN))
+			continue;
+
+		if (connect(net.fd, (struct sockaddr *)&from, 
+			    sizeof(from)) == -1)
+			return -1;
+
+		buf[0] = 'W';
+		put_le(buf + HELLO_LEN, seed, 8);
+		send_now(buf, WELCOME_LEN);
+
+		return 0;
+	}
+
+	errno = ETIMEDOUT;
+	return -1;
+}
+
+/*
+ * Peer: say hello until welcomed, and take the seed.
+ */
+static int join_host(u64 *seed)
+{
+	struct sockaddr_in from;
+	u8 buf[PACKET_MAX];
+	ssize_t n;
+	u64 end;
+
+	end = clock_ns() + CONNECT_MS * NSEC_PER_MSEC;
+
+	while (clock_ns() < end) {
+		buf[0] = 'H';
+		memcpy(buf + 1, NET_MAGIC, MAGIC_LEN);
+		send_now(buf, HELLO_LEN);
+
+		n = wait_packet(buf, sizeof(buf), HELLO_MS, &from);
+		if (n == WELCOME_LEN && buf[0] == 'W' &&
+		    !memcmp(buf + 1, NET_MAGIC, MAGIC_LEN)) {
+			*seed = get_le(buf + HELLO_LEN, 8);
+			return 0;
+		}
+	}
+
+	errno = ETIMEDOUT;
+	return -1;
+}
+
+int net_open(const char *addr, bool join, GameState *s)
+{
+	struct sockaddr_in sin;
+	u64 seed;
+	u32 i;
+	int retv;
+
+	if (net.fd != -1) {
+		log_warn("net: already connected");
+		return 1;
+	}
+
+	if (net_resolve(addr, join, &sin) != 0)
+		return -1;
+
+	net.fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (net.fd == -1) {
+		log_err("net: could not create socket: %s", strerror(errno));
+		return -1;
+	}
+
+	if (join) {
+		retv = connect(net.fd, (struct sockaddr *)&sin, sizeof(sin));
+		if (retv == 0) {
+			log_info("net: joining %s", addr);
+			retv = join_host(&seed);
+		}
+	} else {
+		retv = bind(net.fd, (struct sockaddr *)&sin, sizeof(sin));
+		if (retv == 0) {
+			log_info("net: waiting for a peer on port %u", 
+				 ntohs(sin.sin_port));
+			seed = clock_ns();
+			retv = accept_peer(seed);
+		}
+	}
+
+	if (retv != 0) {
+		log_err("net: could not connect: %s", strerror(errno));
+		close(net.fd);
+		net.fd = -1;
+		return -1;
+	}
+
+	game_init(s, seed);
+	s->cpu = 0;
+
+	net.seed = seed;
+	net.local = join;
+	net.remote = !join;
+	net.tick = s->tick;
+	net.confirmed = net.acked = net.recorded = net.remote_tick = s->tick;
+	net.synced = s->tick;
+	net.wrong = net.check_tick = NO_TICK;
+	net.state_acked = net.peer_state = NO_TICK;
+	for (i=0; i<STATES; ++i)
+		net.sent[i].tick = net.peer[i].tick = NO_TICK;
+	net.start = net.last_recv = clock_ns();
+
+	log_info("net: connected, playing player %d", net.local + 1);
+
+	return 0;
+}
+
+void net_close(void)
+{
+	int i;
+
+	if (net.fd == -1)
+		return;
+
+	for (i=0; i<3; ++i)
+		send_now((const u8 *)"Q", 1);
+
+	close(net.fd);
+	net.fd = -1;
+
+	log_info("net: %u ticks, %u rollbacks re-simulating %u ticks "
+		 "(%.1f each, %u at most), %u waits, rtt %u ms",
+		 net.tick, net.rollbacks, net.resimulated, net.rollbacks ? 
+		 (double)net.resimulated / net.rollbacks : 0.0, 
+		 net.max_rollback, net.waits, net.rtt_ms);
+}
@@ -0,0 +1,107 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NET_H
+#define NET_H
+
+#include <netinet/in.h>
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * Two-player netplay over UDP, with rollback.
+ *
+ * Each side steps the game as soon as its own player's input is known,
+ * predicting that the remote player keeps the keys held at the last
+ * tick heard of. When the remote input for a past tick turns out to
+ * differ, the game is restored to the snapshot taken before that tick
+ * and stepped again up to the present. A side waits instead of stepping
+ * when it would predict more than NET_MAX_ROLLBACK ticks, or when it
+ * runs ahead of the other.
+ *
+ * Every packet carries all the local inputs the peer has not
+ * acknowledged yet, so a lost packet is made up for by the next one.
+ *
+ *	hello:	'H' "GNOPNET2"
+ *	welcome:'W' "GNOPNET2" seed:u64
+ *	input:	'I' first:u32 count:u8 ack:u32 advantage:s8 stamp:u32
+ *		echo:u32 held:u16 state_ack:u32 base:u32
+ *		input:u8[count] state
+ *	bye:	'Q'
+ *
+ * `ack' is how many of the peer's inputs were received; `stamp', `echo'
+ * and `held' measure the round trip. `state' is the sender's latest
+ * confirmed state, delta coded against its state at tick `base': the
+ * latest the peer acknowledged in `state_ack', or none. The states are
+ * compared to catch desyncs, which the joiner mends by taking the host's.
+ */
+
+#define NET_MAGIC		"GNOPNET2"
+
+#define NET_MAX_ROLLBACK	30	/* ticks predicted at most: 600 ms */
+
+/*
+ * Wait on UDP port `addr' for a peer, or with `join' set, join the game
+ * hosted at `addr' (HOST:PORT). Set `s' up for the game both will play:
+ * the host plays the left paddle, no paddle is left to the AI.
+ */
+int  net_open (const char *addr, bool join, GameState *s);
+
+/*
+ * Split HOST:PORT (or PORT alone, with `join' unset, to listen on)
+ * and resolve it.
+ */
+int  net_resolve (const char *addr, bool join, struct sockaddr_in *sin);
+
+/*
+ * Raise the limit on open files as far as allowed, for the servers
+ * keeping a socket per peer.
+ */
+void net_raise_nofile (void);
+
+/*
+ * Say goodbye and report how much was rolled back.
+ */
+void net_close (void);
+
+/*
+ * Delay every packet sent by `delay_ms', give or take up to `jitter_ms',
+ * and drop `loss' percent of them, to try netplay on the loopback.
+ */
+void net_condition (u16 delay_ms, u16 jitter_ms, u8 loss);
+
+/*
+ * Paddle played on this side.
+ */
+int  net_local_player (void);
+
+/*
+ * Exchange inputs and step `s' with the local player's `input', rolling
+ * back first if a prediction was wrong. Return 1 and set `ev' to the
+ * step's events if a tick was played, 0 if waiting for the peer, or -1
+ * once the peer is gone.
+ */
+int  net_step (GameState *s, u8 input, u32 *ev);
+
+/*
+ * Get the next tick which can't be rolled back anymore: the inputs of
+ * both players, and the state `s' they led to. Return 0 if none is left.
+ */
+bool net_next_confirmed (u8 input[2], GameState *s);
+
+#endif /* !NET_H */
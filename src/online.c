@@ -0,0 +1,263 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Client of gnop-server: nothing is predicted, the game shown is the
+ * server's, a round trip behind the keys.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "bytes.h"
+#include "clock.h"
+#include "log.h"
+#include "net.h"
+#include "online.h"
+#include "server.h"
+
+#define CONNECT_MS	10000
+
+static struct {
+	int   fd;
+	u32   id;
+	int   local;		/* paddle played here */
+
+	GameState states[SERVER_STATES];	/* by tick, as bases */
+	u32   acked;		/* newest tick received */
+
+	u64   last_recv;
+	u32   received, lost;
+	u32   rtt_us;		/* smoothed */
+} online = {
+	.fd = -1,
+};
+
+static int welcomed(void)
+{
+	struct pollfd pfd;
+	u8 buf[SERVER_PACKET_MAX];
+	u64 end;
+	ssize_t n;
+
+	pfd.fd = online.fd;
+	pfd.events = POLLIN;
+	end = clock_ns() + CONNECT_MS * NSEC_PER_MSEC;
+
+	while (clock_ns() < end) {
+		buf[0] = 'H';
+		memcpy(buf + 1, SERVER_MAGIC, SERVER_MAGIC_LEN);
+		send(online.fd, buf, SERVER_HELLO_LEN, 0);
+
+		if (poll(&pfd, 1, SERVER_HELLO_MS) <= 0)
+			continue;
+
+		n = recv(online.fd, buf, sizeof(buf), 0);
+		if (n == SERVER_WELCOME_LEN && buf[0] == 'W' && 
+		    !memcmp(buf + 1, SERVER_MAGIC, SERVER_MAGIC_LEN)) {
+			online.id = get_le(buf + SERVER_HELLO_LEN, 4);
+			online.local = buf[SERVER_HELLO_LEN + 4] & 1;
+			return 0;
+		}
+	}
+
+	errno = ETIMEDOUT;
+	return -1;
+}
+
+int online_open(const char *addr, GameState *s)
+{
+	struct sockaddr_in sin;
+	u32 i;
+
+	if (online.fd != -1) {
+		log_warn("online: already connected");
+		return 1;
+	}
+
+	if (net_resolve(addr, 1, &sin) != 0)
+		return -1;
+
+	online.fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (online.fd == -1) {
+		log_err("online: could not create socket: %s", 
+			strerror(errno));
+		return -1;
+	}
+
+	log_info("online: asking %s for a match", addr);
+	if (connect(online.fd, (struct sockaddr *)&sin, sizeof(sin)) != 0 ||
+	    welcomed() != 0) {
+		log_err("online: could not connect: %s", strerror(errno));
+		close(online.fd);
+		online.fd = -1;
+		return -1;
+	}
+
+	/* until the first state comes */
+	game_init(s, 0);
+	s->cpu = 1 << !online.local;
+
+	for (i=0; i<SERVER_STATES; ++i)
+		online.states[i].tick = SERVER_NO_TICK;
+	online.acked = SERVER_NO_TICK;
+	online.received = online.lost = online.rtt_us = 0;
+	online.last_recv = clock_ns();
+
+	log_info("online: seated, playing player %d", online.local + 1);
+
+	return 0;
+}
+
+void online_close(void)
+{
+	u8 buf[5];
+	int i;
+
+	if (online.fd == -1)
+		return;
+
+	buf[0] = 'Q';
+	put_le(buf + 1, online.id, 4);
+	for (i=0; i<3; ++i)
+		send(online.fd, buf, sizeof(buf), 0);
+
+	close(online.fd);
+	online.fd = -1;
+
+	log_info("online: %u states received, %u lost, rtt %u ms", 
+		 online.received, online.lost, 
+		 (online.rtt_us + 500) / 1000);
+}
+
+int online_local_player(void)
+{
+	return online.local;
+}
+
+/*
+ * Decode state packet `buf' of `len' bytes into `s', and the events of
+ * its step into `*ev'. Return 0 if it is not newer than what was
+ * received, or -1 if it can't be decoded.
+ */
+static int take_state(const u8 *buf, u32 len, GameState *s, u32 *ev)
+{
+	const GameState *base = NULL;
+	u32 bt, echo, rtt;
+
+	bt = get_le(buf + 5, 4);
+	if (bt != SERVER_NO_TICK) {
+		base = &online.states[bt % SERVER_STATES];
+		if (base->tick != bt)
+			return -1;
+	}
+
+	if (delta_decode(base, buf + SERVER_STATE_HDR_LEN, 
+			 len - SERVER_STATE_HDR_LEN, s) < 0)
+		return -1;
+
+	if (online.acked != SERVER_NO_TICK && s->tick <= online.acked)
+		return 0;
+
+	if (online.acked != SERVER_NO_TICK)
+		online.lost += s->tick - online.acked - 1;
+	online.acked = s->tick;
+	online.states[s->tick % SERVER_STATES] = *s;
+	++online.received;
+	*ev = get_le(buf + 9, 2);
+
+	echo = get_le(buf + 1, 4);
+	if (echo) {
+		rtt = clock_us32() - echo;
+		online.rtt_us = online.rtt_us ? 
+			(online.rtt_us * 7 + rtt) / 8 : rtt;
+	}
+
+	return 1;
+}
+
+/*
+ * What happened between states `a' and `b' that shows in them: what
+ * the scores and panels need, even if the states between were lost.
+ * Hits and bounces only come with the steps' events.
+ */
+static u32 events(const GameState *a, const GameState *b)
+{
+	u32 ev = 0;
+	int p;
+
+	if (b->match != a->match)
+		return GAME_EVENT_MATCH;
+
+	if (b->paused != a->paused)
+		ev |= GAME_EVENT_PAUSE;
+	if (b->phase == GAME_PLAYING && a->phase != GAME_PLAYING)
+		ev |= GAME_EVENT_SERVE;
+
+	for (p=0; p<2; ++p)
+		if (b->score[p] > a->score[p])
+			ev |= GAME_EVENT_POINT_1 << p;
+	if (b->phase == GAME_OVER && a->phase != GAME_OVER)
+		ev |= GAME_EVENT_WON;
+
+	return ev;
+}
+
+int online_step(GameState *s, u8 input, u32 *ev)
+{
+	u8 buf[SERVER_PACKET_MAX], *p = buf;
+	GameState got, was = *s;
+	u32 got_ev, stepped = 0;
+	bool fresh = 0;
+	ssize_t n;
+
+	*p++ = 'I';
+	p = put_le(p, online.id, 4);
+	*p++ = input & (GAME_INPUT_UP | GAME_INPUT_DOWN);
+	p = put_le(p, online.acked, 4);
+	p = put_le(p, clock_us32() | 1, 4);
+	send(online.fd, buf, p - buf, 0);
+
+	while ((n = recv(online.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		if (buf[0] != 'S' || n <= SERVER_STATE_HDR_LEN)
+			continue;
+
+		online.last_recv = clock_ns();
+		if (take_state(buf, n, &got, &got_ev) == 1) {
+			*s = got;
+			stepped |= got_ev;
+			fresh = 1;
+		}
+	}
+
+	if (!fresh) {
+		if (clock_ns() - online.last_recv > 
+		    SERVER_TIMEOUT_MS * NSEC_PER_MSEC) {
+			log_err("online: the server is gone");
+			return -1;
+		}
+		return 0;
+	}
+
+	*ev = online.received > 1 ? events(&was, s) | stepped 
+				  : GAME_EVENT_MATCH;
+
+	return 1;
+}
@@ -0,0 +1,54 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ONLINE_H
+#define ONLINE_H
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * Playing a match hosted by gnop-server (see server.h): the server
+ * steps the game, this side sends the keys held and shows the states
+ * it gets back.
+ */
+
+/*
+ * Ask the server at `addr' (HOST:PORT) for a seat, and set `s' up for
+ * the match.
+ */
+int  online_open (const char *addr, GameState *s);
+
+/*
+ * Say goodbye and report how the match went.
+ */
+void online_close (void);
+
+/*
+ * Paddle played on this side.
+ */
+int  online_local_player (void);
+
+/*
+ * Send the keys of `input' held, and take the states received. Return 1
+ * and set `s' to the newest, and `ev' to what happened since the
+ * previous one, if one came; 0 if none did, or -1 once the server is
+ * gone.
+ */
+int  online_step (GameState *s, u8 input, u32 *ev);
+
+#endif /* !ONLINE_H */
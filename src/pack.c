@@ -0,0 +1,164 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-pack: build the asset pack loaded by gnop at startup.
+ *
+ * Usage: gnop-pack [-d DIR] OUTPUT FILE...
+ *
+ * Each FILE (read from DIR, if given) is stored under its base name.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "log.h"
+#include "pak.h"
+
+/*
+ * Read the whole file at `path'.
+ */
+static u8 *slurp(const char *path, u32 *size)
+{
+	FILE *fp;
+	long sz;
+	u8 *buf;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		log_err("could not open `%s': %s", path, strerror(errno));
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	sz = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	buf = malloc(sz ? sz : 1);
+	if (fread(buf, 1, sz, fp) != (size_t)sz) {
+		log_err("could not read `%s'", path);
+		free(buf);
+		buf = NULL;
+	}
+
+	fclose(fp);
+	*size = sz;
+
+	return buf;
+}
+
+int main(int ac, char *av[])
+{
+	static const u8 zero[PAK_ALIGN];
+	char path[PATH_MAX];
+	const char *dir, *name;
+	u8 hdr[sizeof(PakHeader)], *ent, **blob;
+	u32 *size, offset, pad;
+	FILE *out;
+	int c, i, n;
+
+	dir = NULL;
+	while ((c = getopt(ac, av, "d:")) != -1) {
+		if (c == 'd') {
+			dir = optarg;
+		}
+		else {
+			fprintf(stderr, "Usage: %s [-d DIR] OUTPUT FILE...\n",
+				*av);
+			return 1;
+		}
+	}
+
+	if (ac - optind < 2) {
+		fprintf(stderr, "Usage: %s [-d DIR] OUTPUT FILE...\n", *av);
+		return 1;
+	}
+
+	n = ac - optind - 1;
+	blob = calloc(n, sizeof(*blob));
+	size = calloc(n, sizeof(*size));
+	ent = calloc(n, sizeof(PakEntry));
+
+	offset = sizeof(PakHeader) + n * sizeof(PakEntry);
+
+	for (i=0; i<n; ++i) {
+		name = av[optind + 1 + i];
+
+		if (dir)
+			snprintf(path, sizeof(path), "%s/%s", dir, name);
+		else
+			snprintf(path, sizeof(path), "%s", name);
+
+		if (!(blob[i] = slurp(path, &size[i])))
+			return 1;
+
+		if (strrchr(name, '/'))
+			name = strrchr(name, '/') + 1;
+
+		if (strlen(name) >= PAK_NAME_MAX) {
+			log_err("asset name too long: %s", name);
+			return 1;
+		}
+
+		offset = (offset + PAK_ALIGN - 1) & ~(PAK_ALIGN - 1);
+
+		strcpy((char *)ent + i * sizeof(PakEntry), name);
+		put_le(ent + i * sizeof(PakEntry) + PAK_NAME_MAX, offset, 4);
+		put_le(ent + i * sizeof(PakEntry) + PAK_NAME_MAX + 4, size[i], 
+		       4);
+
+		offset += size[i];
+	}
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, PAK_MAGIC, 8);
+	put_le(hdr + 8, n, 4);
+
+	out = fopen(av[optind], "wb");
+	if (!out) {
+		log_err("could not create `%s': %s", av[optind], 
+			strerror(errno));
+		return 1;
+	}
+
+	fwrite(hdr, sizeof(hdr), 1, out);
+	fwrite(ent, sizeof(PakEntry), n, out);
+
+	for (i=0; i<n; ++i) {
+		pad = -ftell(out) & (PAK_ALIGN - 1);
+		fwrite(zero, 1, pad, out);
+		fwrite(blob[i], 1, size[i], out);
+		free(blob[i]);
+	}
+
+	/* both: a failed fwrite() leaves only the error flag */
+	if (ferror(out) | fclose(out)) {
+		log_err("could not write `%s': %s", av[optind], 
+			strerror(errno));
+		unlink(av[optind]);
+		return 1;
+	}
+
+	free(blob);
+	free(size);
+	free(ent);
+
+	return 0;
+}
@@ -1,57 +0,0 @@
-/* $Id: paddle.h 27 2009-08-28 21:03:48Z gallows $
- *
- * Copyright (c) 2008,2009 Sergio Perticone <g4ll0ws@gmail.com>
- *
- * Permission to use, copy, modify, and/or distribute this software for any
- * purpose with or without fee is hereby granted, provided that the above
- * copyright notice and this permission notice appear in all copies.
- *
- * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
- * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
- * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
- * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
- * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
- * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
- * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
- */
-
-
-/*
- * Object Hierarchy:
- *
- *  Object
- *   +----Layer
- *         +----Sprite
- *	         +----Paddle (final)
- */
-
-#ifndef PADDLE_H
-#define PADDLE_H
-
-#include "sprite.h"
-
-#define PADDLE(OBJ)	((Paddle *)(OBJ))
-
-#define PADDLE_DISTANCE	32
-#define PADDLE_WIDTH	14
-#define PADDLE_HEIGHT	72
-
-typedef struct _Paddle Paddle;
-
-typedef enum  {
-	PADDLE_POS_LEFT,
-	PADDLE_POS_RIGHT
-} PaddleType;
-
-typedef enum {
-	PADDLE_MOVE_UP =	-7,
-	PADDLE_MOVE_DOWN =	+7,
-} PaddleMove;
-
-Paddle *paddle_new       (u32 color, PaddleType pos);
-bool    paddle_move      (Paddle *self, PaddleMove way);
-s8      paddle_last_move (const Paddle *self);
-void    paddle_reset_pos (Paddle *self);
-
-#endif /* !PADDLE_H */
-
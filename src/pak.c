@@ -0,0 +1,124 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bytes.h"
+#include "log.h"
+#include "pak.h"
+
+static struct {
+	const u8       *map;
+	size_t          len;
+	const PakEntry *index;
+	u32             count;
+} pak;
+
+static u32 le32(u32 x)
+{
+	return get_le((const u8 *)&x, 4);
+}
+
+/*
+ * Map the pack at `path'.
+ */
+int pak_open(const char *path)
+{
+	const PakHeader *hdr;
+	struct stat st;
+	void *map;
+	u32 i, count;
+	int fd;
+
+	if (pak.map) {
+		log_warn("pak: a pack is already open");
+		return 0;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -errno;
+
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return -errno;
+
+	hdr = map;
+	count = le32(hdr->count);
+
+	if (memcmp(hdr->magic, PAK_MAGIC, sizeof(hdr->magic)) ||
+	    sizeof(*hdr) + (u64)count * sizeof(PakEntry) > (u64)st.st_size) {
+		log_err("pak: %s: not a gnop pack", path);
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	pak.map = map;
+	pak.len = st.st_size;
+	pak.index = (const PakEntry *)(hdr + 1);
+	pak.count = count;
+
+	for (i=0; i<count; ++i) {
+		if ((u64)le32(pak.index[i].offset) + 
+		    le32(pak.index[i].size) > pak.len ||
+		    !memchr(pak.index[i].name, 0, PAK_NAME_MAX)) {
+			log_err("pak: %s: corrupted index", path);
+			pak_close();
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void pak_close(void)
+{
+	if (pak.map)
+		munmap((void *)pak.map, pak.len);
+
+	memset(&pak, 0, sizeof(pak));
+}
+
+/*
+ * Look up asset `name'.
+ */
+const void *pak_find(const char *name, u32 *size)
+{
+	u32 i;
+
+	for (i=0; i<pak.count; ++i) {
+		if (!strcmp(pak.index[i].name, name)) {
+			if (size)
+				*size = le32(pak.index[i].size);
+
+			return pak.map + le32(pak.index[i].offset);
+		}
+	}
+
+	return NULL;
+}
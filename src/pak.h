@@ -0,0 +1,64 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PAK_H
+#define PAK_H
+
+#include "common.h"
+
+/*
+ * gnop asset pack, as written by gnop-pack(1):
+ *
+ *	header		PakHeader
+ *	index		PakEntry[count]
+ *	blobs		each one aligned to PAK_ALIGN bytes
+ *
+ * All integers are little-endian.
+ */
+
+#define PAK_BASENAME	"gnop.pak"
+#define PAK_MAGIC	"GNOPPAK1"
+#define PAK_ALIGN	64
+#define PAK_NAME_MAX	56
+
+typedef struct {
+	char magic[8];
+	u32  count;
+	u32  reserved;
+} PakHeader;
+
+typedef struct {
+	char name[PAK_NAME_MAX];	/* NUL-terminated */
+	u32  offset;			/* from the beginning of the file */
+	u32  size;
+} PakEntry;
+
+/*
+ * Map the pack at `path'. Returns 0 on success, otherwise -errno (or -1
+ * if the file is not a valid pack).
+ */
+int  pak_open  (const char *path);
+void pak_close (void);
+
+/*
+ * Look up asset `name'. Returns a pointer into the mapping (valid until
+ * pak_close()) and stores its size in `size', or returns NULL if there is
+ * no open pack or no such asset.
+ */
+const void *pak_find (const char *name, u32 *size);
+
+#endif /* !PAK_H */
@@ -0,0 +1,289 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if HAVE_LINUX_PERF_EVENT_H
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+#include "clock.h"
+#include "log.h"
+#include "perf.h"
+
+enum {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_NO,
+};
+
+static const char *phase_name[PERF_PHASE_NO] = {
+	"input", "game", "blit", "flip",
+};
+
+static struct {
+	bool   enabled;
+	bool   multiplexed;
+
+	/*
+	 * perf.fd[COUNTER_CYCLES] is the group leader; counters the kernel
+	 * refused have fd -1. perf.slot[] maps each open counter to its
+	 * position in the group read.
+	 */
+	int    fd[COUNTER_NO];
+	int    slot[COUNTER_NO];
+	int    nr;
+
+	u64    start_ns[PERF_PHASE_NO];
+	u64    start[PERF_PHASE_NO][COUNTER_NO];
+
+	struct {
+		u64 calls;
+		u64 ns;
+		u64 count[COUNTER_NO];
+	} phase[PERF_PHASE_NO];
+} perf;
+
+#if HAVE_LINUX_PERF_EVENT_H
+
+static const u64 counter_config[COUNTER_NO] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int open_counter(u64 config, int group_fd)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = group_fd == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP |
+			   PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/*
+ * Read the whole counter group into `count'.
+ */
+static void read_counters(u64 *count)
+{
+	u64 buf[3 + COUNTER_NO];
+	int i;
+
+	if (read(perf.fd[COUNTER_CYCLES], buf, sizeof(buf)) <= 0)
+		return;
+
+	/* buf: nr, time_enabled, time_running, values... */
+	if (buf[2] < buf[1])
+		perf.multiplexed = 1;
+
+	for (i=0; i<COUNTER_NO; ++i)
+		if (perf.fd[i] != -1)
+			count[i] = buf[3 + perf.slot[i]];
+}
+
+static int open_counters(void)
+{
+	int i, leader;
+
+	for (i=0; i<COUNTER_NO; ++i)
+		perf.fd[i] = -1;
+
+	leader = open_counter(counter_config[COUNTER_CYCLES], -1);
+	if (leader == -1)
+		return -errno;
+
+	perf.fd[COUNTER_CYCLES] = leader;
+	perf.slot[COUNTER_CYCLES] = perf.nr++;
+
+	for (i=COUNTER_CYCLES+1; i<COUNTER_NO; ++i) {
+		perf.fd[i] = open_counter(counter_config[i], leader);
+		if (perf.fd[i] != -1)
+			perf.slot[i] = perf.nr++;
+	}
+
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+	return 0;
+}
+
+static void close_counters(void)
+{
+	int i;
+
+	for (i=COUNTER_NO-1; i>=0; --i)
+		if (perf.fd[i] != -1)
+			close(perf.fd[i]);
+}
+
+#else /* !HAVE_LINUX_PERF_EVENT_H */
+
+# define read_counters(COUNT)	/* nothing */
+# define close_counters()	/* nothing */
+
+static int open_counters(void)
+{
+	int i;
+
+	for (i=0; i<COUNTER_NO; ++i)
+		perf.fd[i] = -1;
+
+	return -ENOSYS;
+}
+
+#endif /* HAVE_LINUX_PERF_EVENT_H */
+
+/*
+ * Start collecting per-phase statistics.
+ */
+int perf_init(void)
+{
+	int retv;
+
+	if (perf.enabled) {
+		log_warn("perf: statistics seem already enabled");
+		return 0;
+	}
+
+	perf.enabled = 1;
+
+	retv = open_counters();
+	if (retv) {
+		log_warn("perf: hardware counters unavailable (%s): "
+			 "collecting wall time only", strerror(-retv));
+		return 1;
+	}
+
+	if (perf.nr < COUNTER_NO)
+		log_warn("perf: only %d of %d hardware counters available",
+			 perf.nr, COUNTER_NO);
+
+	return 0;
+}
+
+/*
+ * Mark the beginning of given phase.
+ */
+void perf_begin(PerfPhase phase)
+{
+	if (!perf.enabled)
+		return;
+
+	read_counters(perf.start[phase]);
+	perf.start_ns[phase] = clock_ns();
+}
+
+/*
+ * Mark the end of given phase.
+ */
+void perf_end(PerfPhase phase)
+{
+	u64 now, count[COUNTER_NO];
+	int i;
+
+	if (!perf.enabled)
+		return;
+
+	now = clock_ns();
+	read_counters(count);
+
+	perf.phase[phase].calls++;
+	perf.phase[phase].ns += now - perf.start_ns[phase];
+
+	for (i=0; i<COUNTER_NO; ++i)
+		if (perf.fd[i] != -1)
+			perf.phase[phase].count[i] += 
+				count[i] - perf.start[phase][i];
+}
+
+/*
+ * Print a per-call average of counter `c' for phase `p'.
+ */
+static void print_counter(int p, int c)
+{
+	if (perf.fd[c] == -1 || !perf.phase[p].calls)
+		printf(" %12s", "-");
+	else
+		printf(" %12llu", (unsigned long long)
+		       (perf.phase[p].count[c] / perf.phase[p].calls));
+}
+
+/*
+ * Print the summary table and release the counters.
+ */
+void perf_quit(void)
+{
+	u64 ins, cyc;
+	int i;
+
+	if (!perf.enabled)
+		return;
+
+	printf("\n%-6s %10s %10s %12s %12s %6s %12s %12s\n",
+	       "phase", "calls", "us/call", "cycles", "instructions",
+	       "IPC", "cache-miss", "branch-miss");
+
+	for (i=0; i<PERF_PHASE_NO; ++i) {
+		printf("%-6s %10llu %10.1f", phase_name[i],
+		       (unsigned long long)perf.phase[i].calls,
+		       perf.phase[i].calls ? (double)perf.phase[i].ns /
+		       perf.phase[i].calls / NSEC_PER_USEC : 0.0);
+
+		print_counter(i, COUNTER_CYCLES);
+		print_counter(i, COUNTER_INSTRUCTIONS);
+
+		cyc = perf.phase[i].count[COUNTER_CYCLES];
+		ins = perf.phase[i].count[COUNTER_INSTRUCTIONS];
+		if (perf.fd[COUNTER_INSTRUCTIONS] != -1 && cyc)
+			printf(" %6.2f", (double)ins / cyc);
+		else
+			printf(" %6s", "-");
+
+		print_counter(i, COUNTER_CACHE_MISSES);
+		print_counter(i, COUNTER_BRANCH_MISSES);
+		putchar('\n');
+	}
+
+	if (perf.multiplexed)
+		printf("(counters were multiplexed: figures are estimates)\n");
+
+	putchar('\n');
+
+	close_counters();
+	memset(&perf, 0, sizeof(perf));
+}
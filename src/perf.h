@@ -0,0 +1,54 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include "common.h"
+
+typedef enum {
+	PERF_PHASE_INPUT,
+	PERF_PHASE_GAME,
+	PERF_PHASE_BLIT,
+	PERF_PHASE_FLIP,
+	PERF_PHASE_NO,
+} PerfPhase;
+
+/*
+ * Start collecting per-phase statistics.
+ *
+ * Hardware counters (cycles, instructions, cache and branch misses) are
+ * read through perf_event_open(2) where available. If the kernel refuses
+ * them, perf_init() will return 1 and only wall time will be collected;
+ * otherwise 0 will be returned.
+ */
+int  perf_init (void);
+
+/*
+ * Print the summary table on stdout and release the counters.
+ */
+void perf_quit (void);
+
+/*
+ * Mark phase boundaries. Calls to perf_begin() and perf_end() for the
+ * same phase must not be nested. Both do nothing until perf_init() is
+ * called.
+ */
+void perf_begin (PerfPhase phase);
+void perf_end   (PerfPhase phase);
+
+#endif /* !PERF_H */
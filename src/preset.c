@@ -0,0 +1,95 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * AI presets on disk. Apart from ai.c so that libgnop-env.a, which has
+ * the AI but no files to read, leaves out the logger.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "ai.h"
+#include "log.h"
+
+int ai_load(const char *path, AiParams *a)
+{
+	char line[128], name[64];
+	int i, v, n = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		log_err("ai: `%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	*a = ai_default;
+
+	while (fgets(line, sizeof(line), f)) {
+		++n;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (sscanf(line, "%63s %d", name, &v) != 2)
+			goto bad;
+
+		for (i=0; i<AI_PARAMS_NO; ++i)
+			if (!strcmp(name, ai_param[i].name))
+				break;
+		if (i == AI_PARAMS_NO || v < -GAME_WIDTH || v > GAME_WIDTH)
+			goto bad;
+
+		AI_PARAM(a, i) = v;
+	}
+
+	fclose(f);
+
+	return 0;
+
+bad:
+	log_err("ai: `%s', line %d: expected a parameter and its value",
+		path, n);
+	fclose(f);
+
+	return -1;
+}
+
+int ai_save(const char *path, const AiParams *a, const char *note)
+{
+	FILE *f;
+	int i;
+
+	f = fopen(path, "w");
+	if (!f) {
+		log_err("ai: `%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(f, "# gnop AI preset\n");
+	if (note)
+		fprintf(f, "# %s\n", note);
+	for (i=0; i<AI_PARAMS_NO; ++i)
+		fprintf(f, "%s %d\n", ai_param[i].name, AI_PARAM(a, i));
+
+	if (fclose(f) != 0) {
+		log_err("ai: `%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
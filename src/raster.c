@@ -0,0 +1,312 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raster.h"
+
+#define SCORE_Y		16	/* where the scene puts them */
+#define DIGIT_CELL_W	8	/* a font pixel, on the field */
+#define DIGIT_CELL_H	7
+#define DIGIT_W		(3 * DIGIT_CELL_W)
+#define DIGIT_GAP	DIGIT_CELL_W
+
+#define FIX		256	/* subpixels per pixel */
+
+#define MIN(A, B)	((A) < (B) ? (A) : (B))
+#define MAX(A, B)	((A) > (B) ? (A) : (B))
+
+typedef struct {
+	const Raster    *r;
+	const GameState *s;
+	u32              n;
+	u8              *pixels;
+} Slice;
+
+/*
+ * The threads of raster_batch(), started as a batch first needs them
+ * and kept until raster_free(): starting them anew for every batch
+ * would cost more than drawing small frames.
+ */
+typedef struct {
+	pthread_mutex_t batch;		/* one raster_batch() at a time */
+	pthread_mutex_t lock;
+	pthread_cond_t  go, done;
+	pthread_t       thread[RASTER_MAX_THREADS - 1];
+	u32             nthreads;
+	bool            quit;
+
+	Slice           slice[RASTER_MAX_THREADS];
+	u32             nslices;
+	u32             next;		/* slice to take next */
+	u32             pending;	/* slices not drawn yet */
+} Pool;
+
+struct Raster {
+	u16   width, height;
+	u8    flags;
+	u8   *empty;		/* the field with nothing on it */
+	Pool *pool;
+};
+
+/*
+ * 3x5 digits, a row per 3 low bits, the top row first.
+ */
+static const u16 font[10] = {
+	07557, 02627, 07147, 07171, 05711, 07471, 07475, 07111, 07575, 07571,
+};
+
+/*
+ * Fill the `w' x `h' rectangle at `x', `y' on the field, clipped to it,
+ * into `pixels'.
+ */
+static void fill(const Raster *r, u8 *pixels, s32 x, s32 y, s32 w, s32 h)
+{
+	u16 cov[RASTER_MAX_SIDE];
+	u32 x0, x1, y0, y1, px, px0, px1, py, py0, py1, cy, v;
+	u8 *row;
+
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	w = MIN(w, GAME_WIDTH - x);
+	h = MIN(h, GAME_HEIGHT - y);
+	if (w <= 0 || h <= 0)
+		return;
+
+	/* in subpixels of the frame */
+	x0 = (u32)x * r->width * FIX / GAME_WIDTH;
+	x1 = (u32)(x + w) * r->width * FIX / GAME_WIDTH;
+	y0 = (u32)y * r->height * FIX / GAME_HEIGHT;
+	y1 = (u32)(y + h) * r->height * FIX / GAME_HEIGHT;
+
+	px0 = x0 / FIX;
+	px1 = (x1 + FIX - 1) / FIX;
+	py0 = y0 / FIX;
+	py1 = (y1 + FIX - 1) / FIX;
+
+	for (px=px0; px<px1; ++px)
+		cov[px - px0] = MIN(x1, (px + 1) * FIX) - MAX(x0, px * FIX);
+
+	for (py=py0; py<py1; ++py) {
+		cy = MIN(y1, (py + 1) * FIX) - MAX(y0, py * FIX);
+		row = pixels + py * r->width + px0;
+
+		/* one pass over the span: the compiler vectorises it */
+		for (px=0; px<px1 - px0; ++px) {
+			v = cov[px] * cy * 255 / (FIX * FIX);
+			row[px] = MAX(row[px], v);
+		}
+	}
+}
+
+static void draw_digit(const Raster *r, u8 *pixels, s32 x, u8 d)
+{
+	int i;
+
+	for (i=0; i<15; ++i)
+		if (font[d] & (1 << (14 - i)))
+			fill(r, pixels, x + i % 3 * DIGIT_CELL_W,
+			     SCORE_Y + i / 3 * DIGIT_CELL_H, 
+			     DIGIT_CELL_W, DIGIT_CELL_H);
+}
+
+/*
+ * Score `n' of player `p', centered on its half like the scene's.
+ */
+static void draw_score(const Raster *r, u8 *pixels, int p, u8 n)
+{
+	s32 x, w;
+
+	w = n >= 10 ? 2 * DIGIT_W + DIGIT_GAP : DIGIT_W;
+	x = GAME_WIDTH * (p+1) / 3 - w / 2;
+
+	if (n >= 10) {
+		draw_digit(r, pixels, x, n / 10 % 10);
+		x += DIGIT_W + DIGIT_GAP;
+	}
+	draw_digit(r, pixels, x, n % 10);
+}
+
+Raster *raster_new(u16 width, u16 height, u8 flags)
+{
+	Raster *r;
+	s32 y;
+
+	if (!width || !height || width > RASTER_MAX_SIDE || 
+	    height > RASTER_MAX_SIDE)
+		return NULL;
+
+	r = malloc(sizeof(*r));
+	if (!r)
+		return NULL;
+
+	r->width = width;
+	r->height = height;
+	r->flags = flags;
+	r->empty = calloc(width, height);
+	r->pool = calloc(1, sizeof(*r->pool));
+	if (!r->empty || !r->pool) {
+		free(r->empty);
+		free(r->pool);
+		free(r);
+		return NULL;
+	}
+
+	pthread_mutex_init(&r->pool->batch, NULL);
+	pthread_mutex_init(&r->pool->lock, NULL);
+	pthread_cond_init(&r->pool->go, NULL);
+	pthread_cond_init(&r->pool->done, NULL);
+
+	/* the scene's dashes */
+	if (flags & RASTER_SEPARATOR)
+		for (y=13; y<GAME_HEIGHT; y+=13)
+			fill(r, r->empty, GAME_WIDTH / 2 - 2, y - 4, 4, 6);
+
+	return r;
+}
+
+void raster_free(Raster *r)
+{
+	Pool *p;
+	u32 i;
+
+	if (!r)
+		return;
+
+	p = r->pool;
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->go);
+	pthread_mutex_unlock(&p->lock);
+
+	for (i=0; i<p->nthreads; ++i)
+		pthread_join(p->thread[i], NULL);
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->go);
+	pthread_mutex_destroy(&p->lock);
+	pthread_mutex_destroy(&p->batch);
+	free(p);
+	free(r->empty);
+	free(r);
+}
+
+void raster_draw(const Raster *r, const GameState *s, u8 *pixels)
+{
+	int p;
+
+	memcpy(pixels, r->empty, (u32)r->width * r->height);
+
+	if (r->flags & RASTER_SCORES)
+		for (p=0; p<2; ++p)
+			draw_score(r, pixels, p, s->score[p]);
+
+	for (p=0; p<2; ++p)
+		fill(r, pixels, GAME_PADDLE_X(p), GAME_PADDLE_Y(s, p),
+		     GAME_PADDLE_WIDTH, GAME_PADDLE_HEIGHT);
+
+	if (s->phase == GAME_PLAYING)
+		fill(r, pixels, s->ball.x, s->ball.y, GAME_BALL_SIZE, 
+		     GAME_BALL_SIZE);
+}
+
+static void draw_slice(const Slice *sl)
+{
+	u32 size = (u32)sl->r->width * sl->r->height, i;
+
+	for (i=0; i<sl->n; ++i)
+		raster_draw(sl->r, &sl->s[i], sl->pixels + (size_t)i * size);
+}
+
+/*
+ * Draw the slices left of the current batch, then wait for another.
+ * Under the lock.
+ */
+static void take_slices(Pool *p)
+{
+	u32 i;
+
+	while (p->next < p->nslices) {
+		i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		draw_slice(&p->slice[i]);
+		pthread_mutex_lock(&p->lock);
+
+		if (--p->pending == 0)
+			pthread_cond_signal(&p->done);
+	}
+}
+
+static void *work(void *arg)
+{
+	Pool *p = arg;
+
+	pthread_mutex_lock(&p->lock);
+	while (!p->quit) {
+		take_slices(p);
+		pthread_cond_wait(&p->go, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+void raster_batch(const Raster *r, const GameState *s, u32 n, 
+		  u8 *pixels, u32 threads)
+{
+	Pool *p = r->pool;
+	u32 size = (u32)r->width * r->height, i, first, k;
+
+	threads = MAX(1, MIN(MIN(threads, n), RASTER_MAX_THREADS));
+
+	pthread_mutex_lock(&p->batch);
+
+	/* this thread draws too: if none can be started, it draws all */
+	while (p->nthreads < threads - 1 &&
+	       pthread_create(&p->thread[p->nthreads], NULL, work, p) == 0)
+		++p->nthreads;
+
+	pthread_mutex_lock(&p->lock);
+
+	for (i=0, first=0; i<threads; ++i, first+=k) {
+		k = n / threads + (i < n % threads);
+		p->slice[i].r = r;
+		p->slice[i].s = s + first;
+		p->slice[i].n = k;
+		p->slice[i].pixels = pixels + (size_t)first * size;
+	}
+	p->nslices = p->pending = threads;
+	p->next = 0;
+
+	if (threads > 1)
+		pthread_cond_broadcast(&p->go);
+
+	take_slices(p);
+	while (p->pending)
+		pthread_cond_wait(&p->done, &p->lock);
+
+	pthread_mutex_unlock(&p->lock);
+	pthread_mutex_unlock(&p->batch);
+}
@@ -0,0 +1,67 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "game.h"
+
+/*
+ * A software rasteriser drawing game states straight into small
+ * grayscale frames, for agents that learn from pixels: one byte per
+ * pixel, 0 for the background and 255 for the paddles and the ball,
+ * rows packed one after the other. Edges are antialiased by how much of
+ * each pixel they cover, so that moves smaller than a pixel still show.
+ *
+ * Nothing goes through SDL: a Raster is the frame size, its options and
+ * the empty field drawn once, which every frame starts as a copy of.
+ */
+
+#define RASTER_MAX_SIDE		4096
+#define RASTER_MAX_THREADS	64
+
+enum {
+	RASTER_SEPARATOR=	1 << 0,		/* the dashed middle line */
+	RASTER_SCORES=		1 << 1,
+};
+
+typedef struct Raster Raster;
+
+/*
+ * Make a Raster of `width' x `height' pixel frames, drawing what the
+ * RASTER_* `flags' ask for besides the paddles and the ball. Return
+ * NULL if the size is out of 1..RASTER_MAX_SIDE, or on error.
+ */
+Raster *raster_new (u16 width, u16 height, u8 flags);
+
+void    raster_free (Raster *r);
+
+/*
+ * Draw state `s' into the width * height bytes at `pixels'.
+ */
+void    raster_draw (const Raster *r, const GameState *s, u8 *pixels);
+
+/*
+ * Draw the `n' states at `s' into as many frames at `pixels', one after
+ * the other, sharing them out among up to `threads' threads. The
+ * threads are started by the first batch that needs them and kept
+ * until raster_free(); batches on the same Raster take turns.
+ */
+void    raster_batch (const Raster *r, const GameState *s, u32 n, 
+		      u8 *pixels, u32 threads);
+
+#endif /* !RASTER_H */
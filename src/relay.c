@@ -0,0 +1,1018 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-relay: fan the states a game publishes out to its spectators.
+ *
+ * A single thread waits on epoll for the game, for spectators on TCP and
+ * for datagrams on UDP. Each state in is coded once for each kind of
+ * stream (see relay.h) and queued to every TCP spectator, whose socket
+ * is written as far as it takes without blocking; UDP spectators get
+ * theirs through sendmmsg() in batches. A spectator too slow to drain
+ * its queue loses states, and starts over from a keyframe.
+ *
+ * To try it all on one machine, gnop-relay can also play a CPU match
+ * into a relay (--feed), and watch it there with many spectators at
+ * once (--load), reporting how late states reach them.
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "bytes.h"
+#include "clock.h"
+#include "log.h"
+#include "net.h"
+#include "relay.h"
+#include "stream.h"
+
+#define DEFAULT_PORT	"7788"
+
+#define QUEUE_MAX	2048	/* bytes queued to a TCP spectator */
+#define SOURCE_MAX	4096
+#define EVENTS_MAX	256
+#define BATCH		64	/* datagrams per sendmmsg() */
+#define REPORT_MS	10000
+
+#define TICK_NS		(GAME_TICK_MS * NSEC_PER_MSEC)
+
+#define STAMPS		256	/* ticks published, by tick */
+#define BUCKET_NS	(10 * NSEC_PER_USEC)
+#define BUCKETS		10000	/* up to 100 ms */
+#define NO_TICK		((u32)-1)
+
+#define USAGE_FMT	\
+	"Usage: %s [OPTION]...\n"					\
+	"   or: %s --feed [--load=N [--udp]] HOST:PORT\n"		\
+	"Relay the states of a game to its spectators.\n\n"		\
+	"  -p, --port=PORT\t listen on TCP and UDP PORT (default: %s)\n"\
+	"  --feed\t\t play a CPU match into the relay at HOST:PORT\n"	\
+	"  --load=N\t\t ...and watch it there with N spectators,\n"	\
+	"          \t\t reporting how late states reach them\n"		\
+	"  --udp\t\t\t with --load, watch over UDP\n"			\
+	"  -t, --time=SECONDS\t with --feed, stop after SECONDS\n"	\
+	LOG_LEVEL_USAGE							\
+	"  --help\t\t display this help and exit\n"
+
+enum {
+	OPT_FEED = 256,
+	OPT_LOAD,
+	OPT_UDP,
+	OPT_LOG_LEVEL,
+};
+
+static struct option long_options[] = {
+	{ "port", required_argument, NULL, 'p' },
+	{ "feed", no_argument, NULL, OPT_FEED },
+	{ "load", required_argument, NULL, OPT_LOAD },
+	{ "udp", no_argument, NULL, OPT_UDP },
+	{ "time", required_argument, NULL, 't' },
+	{ "log-level", required_argument, NULL, OPT_LOG_LEVEL },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL },
+};
+
+enum {
+	CONN_NEW,		/* hello not read yet */
+	CONN_SOURCE,
+	CONN_VIEWER,
+	CONN_DEAD,		/* freed once the events at hand are done */
+};
+
+/*
+ * A TCP connection.
+ */
+typedef struct Conn {
+	int   fd;
+	u8    role;
+	bool  lagging;		/* states dropped: a keyframe once drained */
+	bool  writing;		/* waiting for room in the socket */
+	u8    got;		/* hello bytes read */
+	u8    hello[RELAY_HELLO_LEN];
+	u32   idx;		/* in relay.viewers */
+	u32   len;		/* queued */
+	struct Conn *next;	/* dead */
+	u8    queue[QUEUE_MAX];
+} Conn;
+
+/*
+ * A UDP spectator.
+ */
+typedef struct {
+	struct sockaddr_in addr;
+	u64   seen;		/* last hello (ns) */
+	bool  keyed;		/* was sent the current key */
+} Peer;
+
+static struct {
+	int    ep;
+	int    tcp, udp;	/* listening */
+	volatile sig_atomic_t quit;
+
+	Conn  *source;
+	u8     in[SOURCE_MAX];
+	u32    in_len;
+	StreamDecoder dec;	/* `dec.base' is the latest state */
+
+	Conn **viewers;
+	u32    nviewers, alloc;
+	Conn  *dead;
+
+	Peer  *peers;
+	u32    npeers, peers_alloc;
+	GameState key;		/* UDP keyframe */
+	bool   have_key;
+
+	u64    states, bytes, resyncs, udp_drops;
+	u64    report_at;
+} relay;
+
+/*
+ * A spectator of --load.
+ */
+typedef struct {
+	int   fd;
+	StreamDecoder dec;
+	u32   last;		/* tick */
+	u32   in_len;
+	u8    in[4 * RELAY_MSG_MAX];
+} Watcher;
+
+static struct {
+	Watcher *w;
+	u32    n;
+	bool   udp;
+
+	u32    stamp_tick[STAMPS];
+	u64    stamp[STAMPS];	/* when that tick was published */
+
+	u32    hist[BUCKETS];	/* publish to arrival, since last report */
+	u64    count, sum, max;
+	u64    lost, resyncs;
+} load;
+
+static void on_signal(int sig)
+{
+	relay.quit = 1;
+}
+
+/*
+ * Code state `s' as a message of `type' against `base' into `buf', and
+ * return its length.
+ */
+static u32 put_msg(u8 *buf, u8 type, const GameState *base, 
+		   const GameState *s)
+{
+	buf[0] = type;
+	buf[1] = delta_encode(base, s, buf + 2);
+
+	return 2 + buf[1];
+}
+
+static void watch_fd(int fd, u32 events, void *ptr, int op)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = ptr;
+	epoll_ctl(relay.ep, op, fd, &ev);
+}
+
+static void drop_conn(Conn *c)
+{
+	if (c->role == CONN_DEAD)
+		return;
+
+	if (c->role == CONN_VIEWER) {
+		relay.viewers[c->idx] = relay.viewers[--relay.nviewers];
+		relay.viewers[c->idx]->idx = c->idx;
+	} else if (c == relay.source) {
+		log_info("relay: the game left");
+		relay.source = NULL;
+	}
+
+	close(c->fd);
+	c->role = CONN_DEAD;
+	c->next = relay.dead;
+	relay.dead = c;
+}
+
+/*
+ * Queue the latest state whole to `c', to start it over.
+ */
+static void queue_key(Conn *c)
+{
+	c->len += put_msg(c->queue + c->len, 'K', NULL, &relay.dec.base);
+	c->lagging = 0;
+}
+
+/*
+ * Write as much of the queue of `c' as its socket takes. A lagging
+ * spectator that caught up starts over from the latest state.
+ */
+static void flush_conn(Conn *c)
+{
+	ssize_t n;
+
+	for (;;) {
+		while (c->len) {
+			n = send(c->fd, c->queue, c->len, MSG_NOSIGNAL);
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n == -1 && errno == EAGAIN)
+				break;
+			if (n == -1) {
+				drop_conn(c);
+				return;
+			}
+
+			relay.bytes += n;
+			c->len -= n;
+			memmove(c->queue, c->queue + n, c->len);
+		}
+
+		if (!c->lagging || c->len)
+			break;
+
+		++relay.resyncs;
+		queue_key(c);
+	}
+
+	if (c->writing != (c->len != 0)) {
+		c->writing = c->len != 0;
+		watch_fd(c->fd, EPOLLIN | (c->writing ? EPOLLOUT : 0), c,
+			 EPOLL_CTL_MOD);
+	}
+}
+
+/*
+ * Queue state message `msg' to every TCP spectator. Those whose queue
+ * is full lose it, and every state after it until they catch up.
+ */
+static void queue_state(const u8 *msg, u32 len)
+{
+	Conn *c;
+	u32 i;
+
+	for (i=0; i<relay.nviewers; ++i) {
+		c = relay.viewers[i];
+		if (c->lagging || c->len + len > QUEUE_MAX) {
+			c->lagging = 1;
+			continue;
+		}
+
+		memcpy(c->queue + c->len, msg, len);
+		c->len += len;
+	}
+}
+
+static void send_batch(struct mmsghdr *mm, u32 n)
+{
+	int sent;
+
+	sent = sendmmsg(relay.udp, mm, n, 0);
+	if (sent < 0)
+		sent = 0;
+
+	relay.udp_drops += n - sent;
+	while (sent--)
+		relay.bytes += mm[sent].msg_len;
+}
+
+/*
+ * Send datagram `msg' to every UDP spectator, and before it `key' to
+ * those which don't have it.
+ */
+static void send_datagrams(const u8 *msg, u32 len, const u8 *key, 
+			   u32 key_len)
+{
+	struct mmsghdr mm[BATCH];
+	struct iovec iov[BATCH];
+	const u8 *out[2];
+	u32 out_len[2];
+	u32 i, j, k, n = 0;
+	Peer *p;
+
+	memset(mm, 0, sizeof(mm));
+
+	for (i=0; i<relay.npeers; ++i) {
+		p = &relay.peers[i];
+
+		k = 0;
+		if (!p->keyed && msg != key) {
+			out[k] = key;
+			out_len[k++] = key_len;
+		}
+		out[k] = msg;
+		out_len[k++] = len;
+		p->keyed = 1;
+
+		if (n + k > BATCH) {
+			send_batch(mm, n);
+			n = 0;
+		}
+
+		for (j=0; j<k; ++j, ++n) {
+			iov[n].iov_base = (void *)out[j];
+			iov[n].iov_len = out_len[j];
+			mm[n].msg_hdr.msg_name = &p->addr;
+			mm[n].msg_hdr.msg_namelen = sizeof(p->addr);
+			mm[n].msg_hdr.msg_iov = &iov[n];
+			mm[n].msg_hdr.msg_iovlen = 1;
+		}
+	}
+
+	if (n)
+		send_batch(mm, n);
+}
+
+/*
+ * Fan state `s', which followed `prev' (NULL if none), out.
+ */
+static void fan_out(const GameState *prev, const GameState *s)
+{
+	u8 msg[RELAY_MSG_MAX], key[RELAY_MSG_MAX], *p;
+	u32 len, key_len, i;
+
+	++relay.states;
+
+	len = put_msg(msg, prev ? 'D' : 'K', prev, s);
+	queue_state(msg, len);
+
+	if (!relay.npeers)
+		return;
+
+	/* UDP: a new key every RELAY_KEY_TICKS, or when the game jumped */
+	if (!relay.have_key || s->tick < relay.key.tick ||
+	    s->tick - relay.key.tick >= RELAY_KEY_TICKS) {
+		relay.key = *s;
+		relay.have_key = 1;
+		for (i=0; i<relay.npeers; ++i)
+			relay.peers[i].keyed = 0;
+	}
+
+	key[0] = 'K';
+	key_len = 1 + delta_encode(NULL, &relay.key, key + 1);
+	if (s->tick == relay.key.tick) {
+		send_datagrams(key, key_len, key, key_len);
+		return;
+	}
+
+	p = msg;
+	*p++ = 'B';
+	p = put_le(p, relay.key.tick, 4);
+	p += delta_encode(&relay.key, s, p);
+	send_datagrams(msg, p - msg, key, key_len);
+}
+
+/*
+ * Take the states the game sent.
+ */
+static void read_source(Conn *c)
+{
+	GameState prev, s;
+	bool had;
+	u32 off, len;
+	ssize_t n;
+
+	for (;;) {
+		n = recv(c->fd, relay.in + relay.in_len, 
+			 SOURCE_MAX - relay.in_len, 0);
+		if (n == -1 && (errno == EAGAIN || errno == EINTR))
+			break;
+		if (n <= 0) {
+			drop_conn(c);
+			break;
+		}
+		relay.in_len += n;
+
+		for (off=0; relay.in_len - off >= 2; off += len) {
+			len = 2 + relay.in[off + 1];
+			if (relay.in_len - off < len)
+				break;
+
+			prev = relay.dec.base;
+			had = relay.dec.have_base;
+			if (stream_decode(&relay.dec, relay.in[off], 
+					  relay.in + off + 2, len - 2, 
+					  &s) != 1) {
+				log_warn("relay: bad state from the game");
+				drop_conn(c);
+				return;
+			}
+			fan_out(had ? &prev : NULL, &s);
+		}
+
+		relay.in_len -= off;
+		memmove(relay.in, relay.in + off, relay.in_len);
+	}
+
+	/* once for everything read; backwards, as drops swap the last in */
+	for (off=relay.nviewers; off-- > 0; )
+		if (!relay.viewers[off]->writing)
+			flush_conn(relay.viewers[off]);
+}
+
+/*
+ * Read the hello of a new connection.
+ */
+static void read_hello(Conn *c)
+{
+	Conn **viewers;
+	ssize_t n;
+	u32 alloc;
+
+	n = recv(c->fd, c->hello + c->got, RELAY_HELLO_LEN - c->got, 0);
+	if (n == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n <= 0) {
+		drop_conn(c);
+		return;
+	}
+
+	c->got += n;
+	if (c->got < RELAY_HELLO_LEN)
+		return;
+
+	if (memcmp(c->hello + 1, RELAY_MAGIC, RELAY_MAGIC_LEN) ||
+	    (c->hello[0] != 'S' && c->hello[0] != 'V')) {
+		drop_conn(c);
+		return;
+	}
+
+	if (c->hello[0] == 'S') {
+		if (relay.source) {
+			log_info("relay: a new game replaces the last one");
+			drop_conn(relay.source);
+		}
+		log_info("relay: the game is here");
+		c->role = CONN_SOURCE;
+		relay.source = c;
+		relay.in_len = 0;
+
+		/* its first state is whole: the stream goes on from ours */
+		return;
+	}
+
+	if (relay.nviewers == relay.alloc) {
+		alloc = relay.alloc ? relay.alloc * 2 : 64;
+		viewers = realloc(relay.viewers, alloc * sizeof(*viewers));
+		if (!viewers) {
+			log_warn("relay: out of memory: turning a viewer away");
+			drop_conn(c);
+			return;
+		}
+		relay.viewers = viewers;
+		relay.alloc = alloc;
+	}
+	c->role = CONN_VIEWER;
+	c->idx = relay.nviewers;
+	relay.viewers[relay.nviewers++] = c;
+
+	/* late: start from where the game is */
+	if (relay.dec.have_base) {
+		queue_key(c);
+		flush_conn(c);
+	}
+}
+
+static void read_conn(Conn *c, u32 events)
+{
+	u8 buf[256];
+	ssize_t n;
+
+	if (c->role == CONN_NEW)
+		read_hello(c);
+	else if (c->role == CONN_SOURCE)
+		read_source(c);
+	else if (c->role == CONN_VIEWER) {
+		/* nothing to hear: just notice it left */
+		if (events & EPOLLIN) {
+			n = recv(c->fd, buf, sizeof(buf), 0);
+			if (n == 0 || (n == -1 && errno != EAGAIN && 
+				       errno != EINTR))
+				drop_conn(c);
+		}
+
+		if (c->role == CONN_VIEWER && (events & EPOLLOUT))
+			flush_conn(c);
+	}
+}
+
+static void accept_conns(void)
+{
+	Conn *c;
+	int fd, one = 1;
+
+	while ((fd = accept4(relay.tcp, NULL, NULL, SOCK_NONBLOCK)) != -1) {
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		c = calloc(1, sizeof(*c));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->role = CONN_NEW;
+		watch_fd(fd, EPOLLIN, c, EPOLL_CTL_ADD);
+	}
+}
+
+static Peer *find_peer(const struct sockaddr_in *sin)
+{
+	u32 i;
+
+	for (i=0; i<relay.npeers; ++i)
+		if (relay.peers[i].addr.sin_port == sin->sin_port &&
+		    relay.peers[i].addr.sin_addr.s_addr == 
+		    sin->sin_addr.s_addr)
+			return &relay.peers[i];
+
+	return NULL;
+}
+
+static void read_datagrams(void)
+{
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	u8 buf[RELAY_HELLO_LEN + 1];
+	Peer *p, *peers;
+	ssize_t n;
+	u32 alloc;
+
+	for (;;) {
+		fromlen = sizeof(from);
+		n = recvfrom(relay.udp, buf, sizeof(buf), 0, 
+			     (struct sockaddr *)&from, &fromlen);
+		if (n == -1)
+			break;
+
+		p = find_peer(&from);
+		if (n == 1 && buf[0] == 'Q' && p) {
+			*p = relay.peers[--relay.npeers];
+			continue;
+		}
+
+		if (n != RELAY_HELLO_LEN || buf[0] != 'V' ||
+		    memcmp(buf + 1, RELAY_MAGIC, RELAY_MAGIC_LEN))
+			continue;
+
+		if (!p) {
+			if (relay.npeers == relay.peers_alloc) {
+				alloc = relay.peers_alloc ? 
+					relay.peers_alloc * 2 : 64;
+				peers = realloc(relay.peers, 
+						alloc * sizeof(*peers));
+				if (!peers)
+					continue;	/* it will say hello again */
+				relay.peers = peers;
+				relay.peers_alloc = alloc;
+			}
+			p = &relay.peers[relay.npeers++];
+			p->addr = from;
+			p->keyed = 0;
+		}
+		p->seen = clock_ns();
+	}
+}
+
+/*
+ * Forget the UDP spectators which stopped saying hello, and tell how
+ * it goes.
+ */
+static void housekeep(u64 now)
+{
+	static u64 bytes;
+	u32 i;
+
+	for (i=0; i<relay.npeers; )
+		if (now - relay.peers[i].seen > 
+		    RELAY_TIMEOUT_MS * NSEC_PER_MSEC)
+			relay.peers[i] = relay.peers[--relay.npeers];
+		else
+			++i;
+
+	if (now < relay.report_at)
+		return;
+
+	log_info("relay: %u TCP and %u UDP spectators, %lu states in, "
+		 "%.1f kB/s out, %lu resyncs, %lu datagrams dropped", 
+		 relay.nviewers, relay.npeers, (unsigned long)relay.states, 
+		 (relay.bytes - bytes) / (REPORT_MS / 1000.0) / 1000, 
+		 (unsigned long)relay.resyncs, 
+		 (unsigned long)relay.udp_drops);
+	bytes = relay.bytes;
+	relay.report_at = now + REPORT_MS * NSEC_PER_MSEC;
+}
+
+static int listen_on(const char *port)
+{
+	struct sockaddr_in sin;
+	int one = 1;
+
+	if (net_resolve(port, 0, &sin) != 0)
+		return -1;
+
+	relay.tcp = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	relay.udp = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (relay.tcp == -1 || relay.udp == -1)
+		goto fail;
+
+	setsockopt(relay.tcp, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(relay.tcp, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(relay.tcp, SOMAXCONN) == -1 ||
+	    bind(relay.udp, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		goto fail;
+
+	return 0;
+
+fail:
+	log_err("relay: port %s: %s", port, strerror(errno));
+	return -1;
+}
+
+static int run_relay(const char *port)
+{
+	struct epoll_event ev[EVENTS_MAX];
+	Conn *c;
+	int i, n;
+
+	relay.tcp = relay.udp = -1;
+	if (listen_on(port) != 0)
+		return -1;
+
+	relay.ep = epoll_create1(0);
+	watch_fd(relay.tcp, EPOLLIN, &relay.tcp, EPOLL_CTL_ADD);
+	watch_fd(relay.udp, EPOLLIN, &relay.udp, EPOLL_CTL_ADD);
+	relay.report_at = clock_ns() + REPORT_MS * NSEC_PER_MSEC;
+
+	log_info("relay: listening on port %s", port);
+
+	while (!relay.quit) {
+		n = epoll_wait(relay.ep, ev, EVENTS_MAX, 1000);
+
+		for (i=0; i<n; ++i) {
+			if (ev[i].data.ptr == &relay.tcp)
+				accept_conns();
+			else if (ev[i].data.ptr == &relay.udp)
+				read_datagrams();
+			else
+				read_conn(ev[i].data.ptr, ev[i].events);
+		}
+
+		while ((c = relay.dead)) {
+			relay.dead = c->next;
+			free(c);
+		}
+
+		housekeep(clock_ns());
+	}
+
+	relay.report_at = 0;
+	housekeep(clock_ns());
+
+	for (i=relay.nviewers; i--; )
+		close(relay.viewers[i]->fd);
+	close(relay.ep);
+	close(relay.tcp);
+	close(relay.udp);
+
+	return 0;
+}
+
+/*
+ * Connect `n' spectators to the relay at `addr'.
+ */
+static int open_watchers(const char *addr, u32 n, int ep)
+{
+	struct sockaddr_in sin;
+	u8 hello[RELAY_HELLO_LEN];
+	Watcher *w;
+	int one = 1;
+	u32 i;
+
+	if (net_resolve(addr, 1, &sin) != 0)
+		return -1;
+
+	load.w = calloc(n, sizeof(*load.w));
+	if (!load.w)
+		return -1;
+
+	hello[0] = 'V';
+	memcpy(hello + 1, RELAY_MAGIC, RELAY_MAGIC_LEN);
+
+	for (i=0; i<n; ++i) {
+		w = &load.w[i];
+		w->last = NO_TICK;
+		w->fd = socket(AF_INET, load.udp ? SOCK_DGRAM : SOCK_STREAM,
+			       0);
+		if (w->fd == -1 || 
+		    connect(w->fd, (struct sockaddr *)&sin, 
+			    sizeof(sin)) == -1) {
+			log_err("relay: spectator %u: %s", i, strerror(errno));
+			return -1;
+		}
+		++load.n;
+
+		if (!load.udp)
+			setsockopt(w->fd, IPPROTO_TCP, TCP_NODELAY, &one,
+				   sizeof(one));
+		fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) | O_NONBLOCK);
+		send(w->fd, hello, sizeof(hello), MSG_NOSIGNAL);
+		watch_fd(w->fd, EPOLLIN, w, EPOLL_CTL_ADD);
+	}
+
+	log_info("relay: %u spectators watching over %s", n, 
+		 load.udp ? "UDP" : "TCP");
+
+	return 0;
+}
+
+static void hello_watchers(void)
+{
+	u8 hello[RELAY_HELLO_LEN];
+	u32 i;
+
+	hello[0] = 'V';
+	memcpy(hello + 1, RELAY_MAGIC, RELAY_MAGIC_LEN);
+	for (i=0; i<load.n; ++i)
+		send(load.w[i].fd, hello, sizeof(hello), MSG_NOSIGNAL);
+}
+
+/*
+ * Account a state a spectator got.
+ */
+static void take_watched(Watcher *w, u8 type, const u8 *p, u32 len, 
+			 u64 now)
+{
+	GameState s;
+	u64 late;
+	bool had = w->dec.have_base;
+
+	if (stream_decode(&w->dec, type, p, len, &s) != 1) {
+		++load.lost;
+		return;
+	}
+
+	if (type == 'K' && had && !load.udp)
+		++load.resyncs;
+	if (w->last != NO_TICK && s.tick > w->last + 1)
+		load.lost += s.tick - w->last - 1;
+	if (w->last == NO_TICK || s.tick > w->last)
+		w->last = s.tick;
+
+	if (load.stamp_tick[s.tick % STAMPS] != s.tick)
+		return;
+
+	late = now - load.stamp[s.tick % STAMPS];
+	++load.hist[late / BUCKET_NS < BUCKETS ? late / BUCKET_NS 
+					       : BUCKETS - 1];
+	++load.count;
+	load.sum += late;
+	if (late > load.max)
+		load.max = late;
+}
+
+static void read_watcher(Watcher *w, u64 now)
+{
+	u8 buf[RELAY_MSG_MAX];
+	u32 off, len;
+	ssize_t n;
+
+	if (load.udp) {
+		while ((n = recv(w->fd, buf, sizeof(buf), 0)) > 0)
+			take_watched(w, buf[0], buf + 1, n - 1, now);
+		return;
+	}
+
+	while ((n = recv(w->fd, w->in + w->in_len, 
+			 sizeof(w->in) - w->in_len, 0)) > 0) {
+		w->in_len += n;
+
+		for (off=0; w->in_len - off >= 2; off += len) {
+			len = 2 + w->in[off + 1];
+			if (w->in_len - off < len)
+				break;
+			take_watched(w, w->in[off], w->in + off + 2, len - 2,
+				     now);
+		}
+
+		w->in_len -= off;
+		memmove(w->in, w->in + off, w->in_len);
+	}
+}
+
+/*
+ * Tell how late the states published in the last `secs' reached the
+ * spectators, and start over.
+ */
+static void report_load(double secs)
+{
+	u64 seen = 0, p50 = 0, p99 = 0;
+	u32 i;
+
+	for (i=0; i<BUCKETS; ++i) {
+		seen += load.hist[i];
+		if (!p50 && seen * 2 >= load.count)
+			p50 = i + 1;
+		if (!p99 && seen * 100 >= load.count * 99)
+			p99 = i + 1;
+	}
+
+	log_info("load: %.0f states/s to %u spectators, late by %.2f ms "
+		 "mean, %.2f p50, %.2f p99, %.2f max; %lu lost, %lu resyncs",
+		 load.count / secs, load.n, load.count ? 
+		 (double)load.sum / load.count / NSEC_PER_MSEC : 0.0, 
+		 (double)p50 * BUCKET_NS / NSEC_PER_MSEC,
+		 (double)p99 * BUCKET_NS / NSEC_PER_MSEC,
+		 (double)load.max / NSEC_PER_MSEC, 
+		 (unsigned long)load.lost, (unsigned long)load.resyncs);
+
+	memset(load.hist, 0, sizeof(load.hist));
+	load.count = load.sum = load.max = 0;
+}
+
+/*
+ * Play a CPU match in real time into the relay at `addr' for `secs'
+ * (0: until interrupted), watched there by `nwatchers' spectators.
+ */
+static int run_feed(const char *addr, u32 nwatchers, u32 secs)
+{
+	static const u8 input[2];
+	struct epoll_event ev[EVENTS_MAX];
+	GameState s;
+	u64 now, next, end, report, hello;
+	int i, n, ms, retv = -1;
+
+	relay.ep = epoll_create1(0);
+	if (nwatchers && open_watchers(addr, nwatchers, relay.ep) != 0)
+		goto out;
+
+	if (stream_publish_open(addr) != 0)
+		goto out;
+
+	game_init(&s, clock_ns());
+	s.cpu = 1 << 0 | 1 << 1;
+
+	now = next = clock_ns();
+	end = secs ? now + secs * NSEC_PER_SEC : 0;
+	report = hello = now + NSEC_PER_SEC;
+
+	while (!relay.quit && (!end || now < end)) {
+		if (now >= next) {
+			game_step(&s, input);
+			load.stamp_tick[s.tick % STAMPS] = s.tick;
+			load.stamp[s.tick % STAMPS] = clock_ns();
+			if (stream_publish(&s) != 0)
+				goto out;
+
+			/* don't make up for ticks lost to a stall */
+			next += TICK_NS;
+			if (next < now)
+				next = now + TICK_NS;
+		}
+
+		ms = (next - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC;
+		n = epoll_wait(relay.ep, ev, EVENTS_MAX, ms);
+
+		now = clock_ns();
+		for (i=0; i<n; ++i)
+			read_watcher(ev[i].data.ptr, now);
+
+		if (load.udp && now >= hello) {
+			hello_watchers();
+			hello = now + RELAY_HELLO_MS * NSEC_PER_MSEC;
+		}
+
+		if (nwatchers && now >= report) {
+			report_load(1.0 + (double)(now - report) / 
+				    NSEC_PER_SEC);
+			report = now + NSEC_PER_SEC;
+		}
+	}
+
+	log_info("relay: fed %u ticks", s.tick);
+	retv = 0;
+
+out:
+	stream_close();
+	while (load.n--) {
+		if (load.udp)
+			send(load.w[load.n].fd, "Q", 1, MSG_NOSIGNAL);
+		close(load.w[load.n].fd);
+	}
+	free(load.w);
+	close(relay.ep);
+
+	return retv;
+}
+
+int main(int ac, char *av[])
+{
+	const char *port = DEFAULT_PORT;
+	bool feed = 0;
+	u32 nwatchers = 0, secs = 0;
+	char *p;
+	int c, retv;
+
+	for (;;) {
+		c = getopt_long(ac, av, "p:t:", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			port = optarg;
+			break;
+
+		case OPT_FEED:
+			feed = 1;
+			break;
+
+		case OPT_LOAD:
+			nwatchers = strtoul(optarg, &p, 10);
+			if (*p || !nwatchers) {
+				log_err("invalid number of spectators: %s", 
+					optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_UDP:
+			load.udp = 1;
+			break;
+
+		case 't':
+			secs = strtoul(optarg, &p, 10);
+			if (*p) {
+				log_err("invalid time: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_LOG_LEVEL:
+			if (log_set_level_name(optarg) != 0)
+				return 1;
+			break;
+
+		case 'h':
+			printf(USAGE_FMT, *av, *av, DEFAULT_PORT);
+			return 0;
+
+		case '?':
+			printf("Try `%s --help' for more information\n", 
+			       av[0]);
+			return 1;
+		}
+	}
+
+	if (ac - optind != feed || ((nwatchers || load.udp || secs) && 
+				    !feed)) {
+		printf(USAGE_FMT, *av, *av, DEFAULT_PORT);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	net_raise_nofile();
+
+	log_init();
+
+	if (feed)
+		retv = run_feed(av[optind], nwatchers, secs);
+	else
+		retv = run_relay(port);
+
+	log_quit();
+
+	return retv != 0;
+}
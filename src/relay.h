@@ -0,0 +1,56 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "delta.h"
+
+/*
+ * Spectator streams: the game publishes its states to gnop-relay over
+ * TCP, and the relay fans them out to its spectators, over TCP or UDP.
+ *
+ * On TCP, both from the game and to spectators, states go as messages
+ * coded against the one before in the same stream:
+ *
+ *	hello:	'S' "GNOPRLY1" (the game) or 'V' "GNOPRLY1" (a spectator)
+ *	state:	type:u8 len:u8 state[len]
+ *
+ * A 'K' state is coded alone, a 'D' state against the previous one.
+ * Streams begin with a 'K', and so does the relay when a spectator fell
+ * so far behind that its queue overflowed.
+ *
+ * On UDP, each datagram stands alone. A spectator says hello, again
+ * every RELAY_HELLO_MS, and gets a 'K' every RELAY_KEY_TICKS and 'B'
+ * states in between, coded against that keyframe: a lost datagram only
+ * loses its own state.
+ *
+ *	hello:	'V' "GNOPRLY1"
+ *	bye:	'Q'
+ *	state:	'K' state | 'B' key:u32 state
+ */
+
+#define RELAY_MAGIC		"GNOPRLY1"
+#define RELAY_MAGIC_LEN		(sizeof(RELAY_MAGIC) - 1)
+#define RELAY_HELLO_LEN		(1 + RELAY_MAGIC_LEN)
+#define RELAY_MSG_MAX		(2 + 4 + DELTA_MAX_LEN)
+
+#define RELAY_KEY_TICKS		50	/* 1 s */
+#define RELAY_HELLO_MS		3000
+#define RELAY_TIMEOUT_MS	10000	/* without hello, UDP */
+
+#endif /* !RELAY_H */
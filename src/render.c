@@ -0,0 +1,696 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-render: render a recording to video frames, and its sounds to a
+ * WAV track, much faster than real time and without a display.
+ *
+ * The main thread plays the recording once, checking it and keeping the
+ * inputs and sounds of every tick, and the state at every keyframe. The
+ * game steps in well under a microsecond, so this is nothing next to
+ * drawing. Workers then take the keyframe-to-keyframe segments in turn
+ * and step them again, drawing every tick with the game's own Scene on
+ * their own offscreen canvas. Frames are written straight to their place
+ * in the output, so segments may finish in any order.
+ */
+
+#define _SPRITE_CHILD
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bytes.h"
+#include "clock.h"
+#include "log.h"
+#include "engine.h"
+#include "game.h"
+#include "pak.h"
+#include "replay.h"
+#include "scene.h"
+#include "video.h"
+
+#include "sprite_impl.h"
+
+#if HAVE_LIBSDL_MIXER
+# include "audio.h"
+# include "mixer.h"
+#endif
+
+#define Y4M_HEADER	"YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n"
+#define Y4M_FRAME	"FRAME\n"
+#define Y4M_FRAME_LEN	(sizeof(Y4M_FRAME) - 1)
+
+#define FPS		(1000 / GAME_TICK_MS)
+#define LUMA_LEN	(GAME_WIDTH * GAME_HEIGHT)
+#define CHROMA_LEN	(LUMA_LEN / 4)
+#define FRAME_LEN	(Y4M_FRAME_LEN + LUMA_LEN + 2 * CHROMA_LEN)
+
+#define WAV_VOLUME	104	/* the game's default */
+#define WAV_HEADER_LEN	44
+#define TICK_SAMPLES	(MIXER_FREQ / FPS)
+
+#if HAVE_LIBSDL_MIXER
+# define WAV_USAGE	"  -w, --wav=FILE\t mix the sounds into the WAV FILE\n"
+#else
+# define WAV_USAGE	""
+#endif
+
+#define USAGE_FMT	\
+	"Usage: %s [OPTION]... RECORDING OUTPUT\n"			\
+	"Render RECORDING to the YUV4MPEG2 file OUTPUT.\n\n"		\
+	"  -b, --bmp\t\t write OUTPUT/NNNNNN.bmp frames instead\n"	\
+	"  -s, --start=TICK\t first tick to render (default: 1)\n"	\
+	"  -e, --end=TICK\t last tick to render (default: the last)\n"	\
+	"  -j, --jobs=N\t\t render on N threads (default: one per CPU)\n"\
+	WAV_USAGE							\
+	"  -c, --fg-color=COLOR\t set foreground color\n"		\
+	"  -C, --bg-color=COLOR\t set background color\n"		\
+	"  -d, --datadir=DIR\t load game data from DIR (default: %s)\n"	\
+	"  --help\t\t display this help and exit\n"
+
+static struct option long_options[] = {
+	{ "bmp", no_argument, NULL, 'b' },
+	{ "start", required_argument, NULL, 's' },
+	{ "end", required_argument, NULL, 'e' },
+	{ "jobs", required_argument, NULL, 'j' },
+#if HAVE_LIBSDL_MIXER
+	{ "wav", required_argument, NULL, 'w' },
+#endif
+	{ "fg-color", required_argument, NULL, 'c' },
+	{ "bg-color", required_argument, NULL, 'C' },
+	{ "datadir", required_argument, NULL, 'd' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL },
+};
+
+/*
+ * Sounds started by a tick.
+ */
+enum {
+	SOUND_BOUNCE=	1 << 0,
+	SOUND_SCORED=	1 << 1,
+	SOUND_GAMEOVER=	1 << 2,
+};
+
+typedef struct {
+	pthread_t thread;
+	Scene    *scene;
+	Sprite   *canvas;
+	u8       *frame;	/* Y4M frame being written */
+	int       failed;
+} Worker;
+
+static struct {
+	const char *output;
+	bool        bmp;
+	int         fd;		/* Y4M output */
+	u64         header_len;
+
+	u32   first;		/* tick of the recording's first state */
+	u32   start, end;	/* ticks rendered */
+	u32   ticks;		/* in the recording */
+	u8   *input;		/* per tick: both inputs, one nibble each */
+	u8   *sound;		/* per tick: SOUND_* */
+	GameState *key;		/* state every REPLAY_KEYFRAME_TICKS */
+
+	u32   next;		/* segment to render next */
+	u32   last;		/* segment rendered last */
+} rnd;
+
+/*
+ * Play the recording once, keeping what the workers need.
+ */
+static int scan_recording(GameState *s)
+{
+	u32 ev, alloc;
+	u8 input[2];
+	int n;
+
+	rnd.first = s->tick;
+	rnd.ticks = alloc = 0;
+
+	for (;;) {
+		if (rnd.ticks == alloc) {
+			alloc = alloc ? alloc * 2 : 4096;
+			rnd.input = realloc(rnd.input, alloc);
+			rnd.sound = realloc(rnd.sound, alloc);
+			rnd.key = realloc(rnd.key, (alloc / 
+				REPLAY_KEYFRAME_TICKS + 1) * sizeof(*s));
+		}
+
+		if (rnd.ticks % REPLAY_KEYFRAME_TICKS == 0)
+			rnd.key[rnd.ticks / REPLAY_KEYFRAME_TICKS] = *s;
+
+		n = replay_next(input);
+		if (n <= 0)
+			return n;
+
+		ev = game_step(s, input);
+		if (!replay_check(s)) {
+			log_err("replay: diverged at tick %u", s->tick);
+			return -1;
+		}
+
+		rnd.input[rnd.ticks] = input[0] | input[1] << 4;
+		rnd.sound[rnd.ticks] = 
+		    (ev & (GAME_EVENT_WALL | GAME_EVENT_HIT_1 | 
+			   GAME_EVENT_HIT_2) ? SOUND_BOUNCE : 0) |
+		    (ev & (GAME_EVENT_POINT_1 | GAME_EVENT_POINT_2) ? 
+		     SOUND_SCORED : 0) |
+		    (ev & GAME_EVENT_WON ? SOUND_GAMEOVER : 0);
+		++rnd.ticks;
+	}
+}
+
+/*
+ * BT.601 studio swing.
+ */
+#define RGB_Y(R, G, B)	((( 66*(R) + 129*(G) +  25*(B) + 128) >> 8) + 16)
+#define RGB_U(R, G, B)	(((-38*(R) -  74*(G) + 112*(B) + 128) >> 8) + 128)
+#define RGB_V(R, G, B)	(((112*(R) -  94*(G) -  18*(B) + 128) >> 8) + 128)
+
+/*
+ * The pixel at (x, y), whatever the surface's depth.
+ */
+static u32 get_pixel(const SDL_Surface *src, int x, int y)
+{
+	const u8 *p = (const u8 *)src->pixels + y * src->pitch +
+		      x * src->format->BytesPerPixel;
+
+	switch (src->format->BytesPerPixel) {
+	case 1:
+		return *p;
+	case 2:
+		return *(const u16 *)p;
+	case 3:
+		if (SDL_BYTEORDER == SDL_BIG_ENDIAN)
+			return p[0] << 16 | p[1] << 8 | p[2];
+		return p[0] | p[1] << 8 | p[2] << 16;
+	default:
+		return *(const u32 *)p;
+	}
+}
+
+/*
+ * Convert the canvas to a Y4M 4:2:0 frame. 32 bpp canvases, the usual,
+ * are read through their masks; others through SDL_GetRGB().
+ */
+static void to_y4m(const SDL_Surface *src, u8 *dst)
+{
+	const SDL_PixelFormat *fmt = src->format;
+	u8 *y = dst + Y4M_FRAME_LEN;
+	u8 *u = y + LUMA_LEN;
+	u8 *v = u + CHROMA_LEN;
+	int i, j, di, dj, r, g, b, sr, sg, sb;
+	u8 r8, g8, b8;
+	u32 px;
+
+	memcpy(dst, Y4M_FRAME, Y4M_FRAME_LEN);
+
+	for (j=0; j<GAME_HEIGHT; j+=2) {
+		for (i=0; i<GAME_WIDTH; i+=2) {
+			sr = sg = sb = 0;
+
+			for (dj=0; dj<2; ++dj) {
+				for (di=0; di<2; ++di) {
+					px = get_pixel(src, i+di, j+dj);
+					if (fmt->BytesPerPixel == 4) {
+						r = (px & fmt->Rmask) >> 
+						    fmt->Rshift;
+						g = (px & fmt->Gmask) >> 
+						    fmt->Gshift;
+						b = (px & fmt->Bmask) >> 
+						    fmt->Bshift;
+					}
+					else {
+						SDL_GetRGB(px, fmt, &r8, &g8, 
+							   &b8);
+						r = r8;
+						g = g8;
+						b = b8;
+					}
+
+					y[(j+dj) * GAME_WIDTH + i+di] = 
+						RGB_Y(r, g, b);
+					sr += r;
+					sg += g;
+					sb += b;
+				}
+			}
+
+			sr /= 4;
+			sg /= 4;
+			sb /= 4;
+			*u++ = RGB_U(sr, sg, sb);
+			*v++ = RGB_V(sr, sg, sb);
+		}
+	}
+}
+
+static int write_frame(Worker *w, u32 frame)
+{
+	SDL_Surface *canvas = w->canvas->surface;
+	char path[PATH_MAX];
+	ssize_t n;
+	off_t off;
+
+	if (rnd.bmp) {
+		snprintf(path, sizeof(path), "%s/%06u.bmp", rnd.output, frame);
+		if (SDL_SaveBMP(canvas, path) != 0) {
+			log_err("could not write `%s': %s", path, 
+				SDL_GetError());
+			return -1;
+		}
+		return 0;
+	}
+
+	SDL_LockSurface(canvas);
+	to_y4m(canvas, w->frame);
+	SDL_UnlockSurface(canvas);
+
+	off = rnd.header_len + (u64)frame * FRAME_LEN;
+	n = pwrite(rnd.fd, w->frame, FRAME_LEN, off);
+	if (n != FRAME_LEN) {
+		log_err("could not write `%s': %s", rnd.output, 
+			n < 0 ? strerror(errno) : "short write");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Step and draw segment `k': the ticks after keyframe `k' up to the
+ * next one.
+ */
+static int render_segment(Worker *w, u32 k)
+{
+	GameState s = rnd.key[k];
+	u32 i, end;
+	u8 input[2];
+
+	i = k * REPLAY_KEYFRAME_TICKS;
+	end = i + REPLAY_KEYFRAME_TICKS;
+	if (end > rnd.end - rnd.first)
+		end = rnd.end - rnd.first;
+
+	for (; i<end; ++i) {
+		input[0] = rnd.input[i] & 0xf;
+		input[1] = rnd.input[i] >> 4;
+		game_step(&s, input);
+
+		if (s.tick < rnd.start)
+			continue;
+
+		scene_draw(w->scene, &s);
+		if (write_frame(w, s.tick - rnd.start) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void *work(void *arg)
+{
+	Worker *w = arg;
+	u32 k;
+
+	while ((k = __atomic_fetch_add(&rnd.next, 1, __ATOMIC_RELAXED)) 
+	       <= rnd.last) {
+		if (render_segment(w, k) != 0) {
+			w->failed = 1;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+#if HAVE_LIBSDL_MIXER
+static const char *const sound_files[] = {
+	"bounce.raw", "scored.raw", "gameover.raw",
+};
+
+/*
+ * Read a raw sound (signed 16-bit mono at MIXER_FREQ), from the pack if
+ * one is open.
+ */
+static s16 *load_sound(const char *datadir, const char *name, u32 *n)
+{
+	char path[PATH_MAX];
+	const void *data;
+	s16 *pcm;
+	FILE *fp;
+	long sz;
+
+	data = pak_find(name, n);
+	if (data) {
+		*n /= sizeof(s16);
+		pcm = malloc(*n * sizeof(s16));
+		memcpy(pcm, data, *n * sizeof(s16));
+		return pcm;
+	}
+
+	if (!join_path(datadir, name, path))
+		return NULL;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		log_err("could not open `%s': %s", path, strerror(errno));
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	sz = ftell(fp);
+	rewind(fp);
+
+	*n = sz / sizeof(s16);
+	pcm = malloc(*n * sizeof(s16));
+	*n = fread(pcm, sizeof(s16), *n, fp);
+	fclose(fp);
+
+	return pcm;
+}
+
+/*
+ * Mix the sounds of the rendered ticks into the WAV file `path'.
+ */
+static int write_wav(const char *path, const char *datadir)
+{
+	u8 hdr[WAV_HEADER_LEN], *p;
+	s16 *pcm[AUDIO_SOUND_NO], *track;
+	u32 len[AUDIO_SOUND_NO], n, i, at, bytes;
+	FILE *fp;
+	int k, retv;
+
+	for (k=0; k<AUDIO_SOUND_NO; ++k) {
+		pcm[k] = load_sound(datadir, sound_files[k], &len[k]);
+		if (!pcm[k])
+			len[k] = 0;
+	}
+
+	n = (rnd.end - rnd.start + 1) * TICK_SAMPLES;
+	track = calloc(n, sizeof(s16));
+
+	for (i=rnd.start; i<=rnd.end; ++i) {
+		at = (i - rnd.start) * TICK_SAMPLES;
+
+		for (k=0; k<AUDIO_SOUND_NO; ++k)
+			if (rnd.sound[i - rnd.first - 1] & (1 << k))
+				mixer_mix(track + at, pcm[k], n - at < len[k] ?
+					  n - at : len[k], WAV_VOLUME);
+	}
+
+	for (k=0; k<AUDIO_SOUND_NO; ++k)
+		free(pcm[k]);
+
+	bytes = n * sizeof(s16);
+
+	p = hdr;
+	memcpy(p, "RIFF", 4);
+	p = put_le(p + 4, 36 + bytes, 4);
+	memcpy(p, "WAVEfmt ", 8);
+	p = put_le(p + 8, 16, 4);
+	p = put_le(p, 1, 2);			/* PCM */
+	p = put_le(p, 1, 2);			/* mono */
+	p = put_le(p, MIXER_FREQ, 4);
+	p = put_le(p, MIXER_FREQ * sizeof(s16), 4);
+	p = put_le(p, sizeof(s16), 2);
+	p = put_le(p, 16, 2);
+	memcpy(p, "data", 4);
+	put_le(p + 4, bytes, 4);
+
+	/* samples are little-endian in a WAV file */
+	for (i=0; i<n; ++i)
+		put_le((u8 *)&track[i], (u16)track[i], 2);
+
+	retv = -1;
+	fp = fopen(path, "wb");
+	if (fp) {
+		fwrite(hdr, 1, sizeof(hdr), fp);
+		fwrite(track, sizeof(s16), n, fp);
+		retv = ferror(fp) | fclose(fp) ? -1 : 0;
+	}
+	if (retv != 0)
+		log_err("could not write `%s'", path);
+
+	free(track);
+
+	return retv;
+}
+#endif
+
+/*
+ * Render the segments covering the ticks asked for on `jobs' threads.
+ */
+static int render(int jobs, u32 fg_color, u32 bg_color, const char *datadir)
+{
+	TTF_Font *font[SCENE_FONT_NO];
+	Worker *w;
+	char hdr[64];
+	ssize_t n;
+	int i, retv;
+
+	if (!rnd.bmp) {
+		rnd.fd = open(rnd.output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (rnd.fd == -1) {
+			log_err("could not open `%s': %s", rnd.output, 
+				strerror(errno));
+			return -1;
+		}
+
+		rnd.header_len = snprintf(hdr, sizeof(hdr), Y4M_HEADER,
+					  GAME_WIDTH, GAME_HEIGHT, FPS);
+		n = write(rnd.fd, hdr, rnd.header_len);
+		if (n != (ssize_t)rnd.header_len) {
+			log_err("could not write `%s': %s", rnd.output, 
+				n < 0 ? strerror(errno) : "short write");
+			close(rnd.fd);
+			return -1;
+		}
+	}
+
+	rnd.next = (rnd.start - rnd.first - 1) / REPLAY_KEYFRAME_TICKS;
+	rnd.last = (rnd.end - rnd.first - 1) / REPLAY_KEYFRAME_TICKS;
+
+	/* sprites and fonts are made here: SDL_ttf is not thread-safe */
+	w = calloc(jobs, sizeof(*w));
+	for (i=0; i<jobs; ++i) {
+		w[i].canvas = sprite_new(GAME_WIDTH, GAME_HEIGHT);
+		w[i].scene = scene_new(fg_color, bg_color);
+		w[i].frame = malloc(FRAME_LEN);
+
+		if (scene_open_fonts(datadir, font) == 0)
+			scene_set_fonts(w[i].scene, font);
+		else
+			scene_close_fonts(font);
+
+		scene_set_target(w[i].scene, w[i].canvas);
+	}
+
+	for (i=0; i<jobs; ++i)
+		if (pthread_create(&w[i].thread, NULL, work, &w[i]) != 0) {
+			log_warn("could not start worker: rendering on %d", i);
+			w[i].thread = 0;
+			if (i == 0)
+				work(&w[i]);
+			break;
+		}
+
+	for (retv=0, i=0; i<jobs; ++i) {
+		if (w[i].thread)
+			pthread_join(w[i].thread, NULL);
+		if (w[i].failed)
+			retv = -1;
+
+		scene_free(w[i].scene);
+		object_free(w[i].canvas);
+		free(w[i].frame);
+	}
+
+	free(w);
+
+	if (!rnd.bmp && close(rnd.fd) != 0) {
+		log_err("could not write `%s': %s", rnd.output, 
+			strerror(errno));
+		retv = -1;
+	}
+
+	return retv;
+}
+
+int main(int ac, char *av[])
+{
+	char path[PATH_MAX];
+	const char *datadir, *wav;
+	u32 fg_color, bg_color, start, end;
+	GameState s;
+	int c, jobs, retv;
+	u64 t;
+	char *p;
+
+	datadir = wav = NULL;
+	fg_color = ENGINE_FG_COLOR;
+	bg_color = ENGINE_BG_COLOR;
+	start = 1;
+	end = 0;
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (;;) {
+		c = getopt_long(ac, av, "bs:e:j:c:C:d:"
+#if HAVE_LIBSDL_MIXER
+				"w:"
+#endif
+				, long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'b':
+			rnd.bmp = 1;
+			break;
+
+		case 's':
+		case 'e':
+			*(c == 's' ? &start : &end) = strtoul(optarg, &p, 10);
+			if (*p) {
+				log_err("invalid tick: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 'j':
+			jobs = strtol(optarg, &p, 10);
+			if (*p || jobs < 1) {
+				log_err("invalid number of jobs: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 'w':
+			wav = optarg;
+			break;
+
+		case 'c':
+		case 'C':
+			*(c == 'c' ? &fg_color : &bg_color) = 
+				strtol(optarg, &p, 16);
+			if (*p) {
+				log_err("invalid color: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 'd':
+			datadir = optarg;
+			break;
+
+		case 'h':
+			printf(USAGE_FMT, *av, DATADIR);
+			return 0;
+
+		case '?':
+			printf("Try `%s --help' for more information\n", 
+			       av[0]);
+			return 1;
+		}
+	}
+
+	if (ac - optind != 2) {
+		printf(USAGE_FMT, *av, DATADIR);
+		return 1;
+	}
+
+	if (jobs < 1)
+		jobs = 1;
+	if (!datadir)
+		datadir = DATADIR;
+	rnd.output = av[optind + 1];
+
+	setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+	log_init();
+	retv = 1;
+
+	if (replay_play_open(av[optind], &s) != 0)
+		goto out_log;
+
+	if (scan_recording(&s) != 0)
+		goto out_replay;
+
+	if (start <= rnd.first)
+		start = rnd.first + 1;
+	if (!end || end > rnd.first + rnd.ticks)
+		end = rnd.first + rnd.ticks;
+	if (start > end) {
+		log_err("nothing to render in ticks %u-%u", start, end);
+		goto out_replay;
+	}
+	rnd.start = start;
+	rnd.end = end;
+
+	if (video_init() != 0)
+		goto out_replay;
+	if (video_set_mode(GAME_WIDTH, GAME_HEIGHT, 32) != 0)
+		goto out_video;
+
+	snprintf(path, sizeof(path), "%s/%s", datadir, PAK_BASENAME);
+	if (access(path, R_OK) == 0)
+		pak_open(path);
+	ttf_init();
+
+	t = clock_ns();
+	if (render(jobs, fg_color, bg_color, datadir) != 0)
+		goto out_ttf;
+	t = clock_ns() - t;
+
+	log_info("rendered ticks %u-%u (%u frames) in %.2f s on %d "
+		 "threads: %.0f frames/s", start, end, end - start + 1,
+		 (double)t / NSEC_PER_SEC, jobs,
+		 (end - start + 1) / ((double)t / NSEC_PER_SEC));
+
+#if HAVE_LIBSDL_MIXER
+	if (wav && write_wav(wav, datadir) != 0)
+		goto out_ttf;
+#endif
+
+	retv = 0;
+
+out_ttf:
+	ttf_quit();
+	pak_close();
+out_video:
+	video_quit();
+out_replay:
+	replay_close();
+out_log:
+	free(rnd.input);
+	free(rnd.sound);
+	free(rnd.key);
+	log_quit();
+
+	return retv;
+}
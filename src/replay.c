@@ -0,0 +1,550 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bytes.h"
+#include "delta.h"
+#include "log.h"
+#include "replay.h"
+
+#define MAGIC_LEN	(sizeof(REPLAY_MAGIC) - 1)
+#define HEADER_LEN	(MAGIC_LEN + 2 + 2 * AI_PARAMS_LEN)
+#define TRAILER_LEN	(8 + MAGIC_LEN)
+#define CHUNK_HDR_LEN	(1 + 4)
+#define ENTRY_LEN	(4 + 8)
+#define VARINT_MAX	5
+
+#define INPUT_BYTE(I)	((I)[0] | (I)[1] << 4)
+
+/*
+ * Recording: the chunk being built is kept in memory and written whole.
+ */
+static struct {
+	FILE *fp;
+	u64   offset;		/* of the chunk being built */
+
+	GameState key;
+	u32   ticks;		/* recorded since the keyframe */
+	u32   total;
+	u8    input;		/* of the pending run */
+	u32   run;		/* ticks in the pending run */
+	u32   runs_len;
+	u8    runs[REPLAY_KEYFRAME_TICKS * (VARINT_MAX + 1)];
+	u8    check[REPLAY_KEYFRAME_TICKS * 4];
+
+	u8   *index;		/* keyframe entries, written on close */
+	u32   count, alloc;
+} wr;
+
+/*
+ * Playback from a mapping of the file.
+ */
+static struct {
+	int         fd;
+	const u8   *map;
+	size_t      len;
+	bool        sealed;	/* has its index: won't grow anymore */
+
+	const u8   *index;	/* into the map if sealed, else `scanned' */
+	u8         *scanned;
+	u32         count, alloc;
+	u64         scan_end;	/* where scanning for chunks resumes */
+
+	u32         chunk;	/* being played */
+	const u8   *runs, *runs_end;
+	const u8   *check;
+	u32         ticks;	/* left in the chunk */
+	u32         run;	/* left in the current run */
+	u8          input;
+	u32         last_check;
+	AiParams    ai[2];	/* recorded with */
+} rd = { -1 };
+
+static int put_varint(u8 *p, u32 v)
+{
+	int n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+
+	return n;
+}
+
+/*
+ * Decode a varint at `*p', not reading past `end'. Return -1 if it is
+ * malformed.
+ */
+static int take_varint(const u8 **p, const u8 *end, u32 *v)
+{
+	int i;
+
+	*v = 0;
+	for (i=0; i<VARINT_MAX && *p < end; ++i) {
+		*v |= (u32)(**p & 0x7f) << 7*i;
+		if (!(*(*p)++ & 0x80))
+			return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Append a keyframe entry to the index at `*index'.
+ */
+static void add_entry(u8 **index, u32 *count, u32 *alloc, u32 tick, u64 off)
+{
+	if (*count == *alloc) {
+		*alloc = *alloc ? *alloc * 2 : 64;
+		*index = realloc(*index, *alloc * ENTRY_LEN);
+	}
+
+	put_le(put_le(*index + *count * ENTRY_LEN, tick, 4), off, 8);
+	++*count;
+}
+
+static void put_run(void)
+{
+	wr.runs_len += put_varint(wr.runs + wr.runs_len, wr.run);
+	wr.runs[wr.runs_len++] = wr.input;
+	wr.run = 0;
+}
+
+static void start_chunk(const GameState *s)
+{
+	wr.key = *s;
+	wr.ticks = wr.run = wr.runs_len = 0;
+}
+
+/*
+ * Write the chunk being built and make it visible to readers.
+ */
+static void write_chunk(void)
+{
+	u8 hdr[CHUNK_HDR_LEN + 4 + DELTA_MAX_LEN + 2*VARINT_MAX], *p;
+	u32 len;
+
+	if (wr.run)
+		put_run();
+
+	p = hdr + CHUNK_HDR_LEN;
+	p = put_le(p, wr.key.tick, 4);
+	p += delta_encode(NULL, &wr.key, p);
+	p += put_varint(p, wr.ticks);
+	p += put_varint(p, wr.runs_len);
+
+	len = p - hdr - CHUNK_HDR_LEN + wr.runs_len + 4 * wr.ticks;
+	hdr[0] = 'K';
+	put_le(hdr + 1, len, 4);
+
+	fwrite(hdr, 1, p - hdr, wr.fp);
+	fwrite(wr.runs, 1, wr.runs_len, wr.fp);
+	fwrite(wr.check, 4, wr.ticks, wr.fp);
+	fflush(wr.fp);
+
+	add_entry(&wr.index, &wr.count, &wr.alloc, wr.key.tick, wr.offset);
+	wr.offset += CHUNK_HDR_LEN + len;
+}
+
+int replay_record_open(const char *path, const GameState *s)
+{
+	u8 hdr[HEADER_LEN];
+
+	wr.fp = fopen(path, "wb");
+	if (!wr.fp) {
+		log_err("replay: could not open `%s': %s", path,
+			strerror(errno));
+		return -1;
+	}
+
+	memcpy(hdr, REPLAY_MAGIC, MAGIC_LEN);
+	put_le(hdr + MAGIC_LEN, REPLAY_KEYFRAME_TICKS, 2);
+	ai_pack(ai_params(0), hdr + MAGIC_LEN + 2);
+	ai_pack(ai_params(1), hdr + MAGIC_LEN + 2 + AI_PARAMS_LEN);
+	fwrite(hdr, 1, sizeof(hdr), wr.fp);
+
+	wr.offset = HEADER_LEN;
+	wr.count = wr.total = 0;
+	start_chunk(s);
+
+	return 0;
+}
+
+void replay_record(const u8 input[2], const GameState *s)
+{
+	u8 in = INPUT_BYTE(input);
+
+	if (wr.run && in != wr.input)
+		put_run();
+
+	wr.input = in;
+	++wr.run;
+	put_le(wr.check + 4 * wr.ticks++, game_hash(s), 4);
+	++wr.total;
+
+	if (wr.ticks == REPLAY_KEYFRAME_TICKS) {
+		write_chunk();
+		start_chunk(s);
+	}
+}
+
+static void record_close(void)
+{
+	u8 buf[TRAILER_LEN];
+
+	/* the first keyframe is written even with no tick after it */
+	if (wr.ticks || !wr.count)
+		write_chunk();
+
+	buf[0] = 'I';
+	put_le(buf + 1, wr.count, 4);
+	fwrite(buf, 1, 5, wr.fp);
+	fwrite(wr.index, ENTRY_LEN, wr.count, wr.fp);
+
+	memcpy(put_le(buf, wr.offset, 8), REPLAY_INDEX_MAGIC, MAGIC_LEN);
+	fwrite(buf, 1, TRAILER_LEN, wr.fp);
+
+	if (ferror(wr.fp) | fclose(wr.fp))
+		log_err("replay: could not write the recording");
+	else
+		log_info("replay: recorded %u ticks", wr.total);
+
+	free(wr.index);
+	memset(&wr, 0, sizeof(wr));
+}
+
+/*
+ * Whether a whole chunk, its keyframe's tick included, starts at `off'
+ * and ends by `limit'.
+ */
+static bool chunk_fits(u64 off, u64 limit)
+{
+	u64 len;
+
+	if (off < HEADER_LEN || off + CHUNK_HDR_LEN + 4 > limit ||
+	    rd.map[off] != 'K')
+		return 0;
+
+	len = get_le(rd.map + off + 1, 4);
+
+	return len >= 4 && off + CHUNK_HDR_LEN + len <= limit;
+}
+
+/*
+ * Use the index at the end of a complete recording: return 1, or 0
+ * without one, or -1 if it is corrupt: out of place, or with an entry
+ * not pointing at a whole chunk of the tick it says.
+ */
+static int find_index(void)
+{
+	const u8 *end = rd.map + rd.len;
+	const u8 *e;
+	u64 off, chunk;
+	u32 count, i;
+
+	if (rd.len < HEADER_LEN + TRAILER_LEN ||
+	    memcmp(end - MAGIC_LEN, REPLAY_INDEX_MAGIC, MAGIC_LEN))
+		return 0;
+
+	off = get_le(end - TRAILER_LEN, 8);
+	if (off < HEADER_LEN || off + 5 > rd.len - TRAILER_LEN ||
+	    rd.map[off] != 'I')
+		return -1;
+
+	count = get_le(rd.map + off + 1, 4);
+	if (off + 5 + (u64)count * ENTRY_LEN != rd.len - TRAILER_LEN)
+		return -1;
+
+	for (i=0, e=rd.map + off + 5; i<count; ++i, e+=ENTRY_LEN) {
+		chunk = get_le(e + 4, 8);
+		if (!chunk_fits(chunk, off) ||
+		    get_le(rd.map + chunk + CHUNK_HDR_LEN, 4) != get_le(e, 4))
+			return -1;
+	}
+
+	rd.index = rd.map + off + 5;
+	rd.count = count;
+
+	return 1;
+}
+
+/*
+ * Index the complete chunks of a recording still being written (or cut
+ * short), from where the last scan stopped.
+ */
+static void scan_chunks(void)
+{
+	const u8 *p;
+	u64 len;
+
+	while (chunk_fits(rd.scan_end, rd.len)) {
+		p = rd.map + rd.scan_end;
+		len = get_le(p + 1, 4);
+
+		add_entry(&rd.scanned, &rd.count, &rd.alloc,
+			  get_le(p + CHUNK_HDR_LEN, 4), rd.scan_end);
+		rd.scan_end += CHUNK_HDR_LEN + len;
+	}
+
+	rd.index = rd.scanned;
+}
+
+/*
+ * Map the file again if it grew, and index its new chunks.
+ */
+static void refresh(void)
+{
+	struct stat st;
+	void *map;
+
+	if (rd.sealed || fstat(rd.fd, &st) != 0 || st.st_size <= rd.len)
+		return;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, rd.fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	munmap((void *)rd.map, rd.len);
+	rd.map = map;
+	rd.len = st.st_size;
+
+	scan_chunks();
+}
+
+static u64 entry_tick(u32 i)
+{
+	return get_le(rd.index + i * ENTRY_LEN, 4);
+}
+
+static const u8 *entry_chunk(u32 i)
+{
+	return rd.map + get_le(rd.index + i * ENTRY_LEN + 4, 8);
+}
+
+/*
+ * Start playing chunk `i'; set `s', if not NULL, to its keyframe.
+ */
+static int load_chunk(u32 i, GameState *s)
+{
+	const u8 *p, *end;
+	u32 ticks, runs_len;
+	GameState key;
+	int n;
+
+	p = entry_chunk(i);
+	end = p + CHUNK_HDR_LEN + get_le(p + 1, 4);
+	p += CHUNK_HDR_LEN + 4;
+
+	if (end > rd.map + rd.len || p > end)
+		goto corrupt;
+
+	n = delta_decode(NULL, p, end - p, &key);
+	if (n < 0 || key.tick != get_le(p - 4, 4))
+		goto corrupt;
+	if (s)
+		*s = key;
+	p += n;
+
+	if (take_varint(&p, end, &ticks) != 0 ||
+	    take_varint(&p, end, &runs_len) != 0 ||
+	    (u64)runs_len + 4 * (u64)ticks != (u64)(end - p))
+		goto corrupt;
+
+	rd.chunk = i;
+	rd.runs = p;
+	rd.runs_end = rd.check = p + runs_len;
+	rd.ticks = ticks;
+	rd.run = 0;
+
+	return 0;
+
+corrupt:
+	log_err("replay: corrupt chunk at tick %u", (u32)entry_tick(i));
+	return -1;
+}
+
+int replay_play_open(const char *path, GameState *s)
+{
+	struct stat st;
+	void *map;
+	int fd, sealed;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) != 0) {
+		log_err("replay: could not open `%s': %s", path,
+			strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	map = MAP_FAILED;
+	if (st.st_size >= HEADER_LEN)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (map == MAP_FAILED || memcmp(map, REPLAY_MAGIC, MAGIC_LEN) ||
+	    get_le((u8 *)map + MAGIC_LEN, 2) != REPLAY_KEYFRAME_TICKS) {
+		log_err("replay: `%s' is not a gnop recording", path);
+		if (map != MAP_FAILED)
+			munmap(map, st.st_size);
+		close(fd);
+		return -1;
+	}
+
+	rd.fd = fd;
+	rd.map = map;
+	rd.len = st.st_size;
+	rd.count = 0;
+
+	ai_unpack(&rd.ai[0], rd.map + MAGIC_LEN + 2);
+	ai_unpack(&rd.ai[1], rd.map + MAGIC_LEN + 2 + AI_PARAMS_LEN);
+	ai_use(&rd.ai[0], &rd.ai[1]);
+
+	sealed = find_index();
+	if (sealed < 0) {
+		log_err("replay: `%s' has a corrupt index", path);
+		replay_close();
+		return -1;
+	}
+
+	rd.sealed = sealed;
+	if (!rd.sealed) {
+		rd.scan_end = HEADER_LEN;
+		scan_chunks();
+	}
+
+	if (!rd.count || load_chunk(0, s) != 0) {
+		if (!rd.count)
+			log_err("replay: `%s' is empty", path);
+		replay_close();
+		return -1;
+	}
+
+	return 0;
+}
+
+int replay_next(u8 input[2])
+{
+	while (!rd.ticks) {
+		if (rd.chunk + 1 >= rd.count)
+			refresh();
+
+		if (rd.chunk + 1 >= rd.count)
+			return 0;
+
+		if (load_chunk(rd.chunk + 1, NULL) != 0)
+			return -1;
+	}
+
+	if (!rd.run) {
+		if (take_varint(&rd.runs, rd.runs_end, &rd.run) != 0 ||
+		    !rd.run || rd.runs == rd.runs_end) {
+			log_err("replay: corrupt inputs after tick %u",
+				(u32)entry_tick(rd.chunk));
+			return -1;
+		}
+		rd.input = *rd.runs++;
+	}
+
+	--rd.run;
+	--rd.ticks;
+	rd.last_check = get_le(rd.check, 4);
+	rd.check += 4;
+
+	input[0] = rd.input & 0xf;
+	input[1] = rd.input >> 4;
+
+	return 1;
+}
+
+bool replay_check(const GameState *s)
+{
+	GameSnapshot ours, theirs;
+	GameState key;
+	const u8 *p;
+	u32 len;
+
+	if (game_hash(s) != rd.last_check)
+		return 0;
+
+	if (rd.ticks || rd.chunk + 1 >= rd.count)
+		return 1;
+
+	/* the next keyframe is the state we should be in */
+	p = entry_chunk(rd.chunk + 1);
+	len = get_le(p + 1, 4);
+	if (len < 4 || p + CHUNK_HDR_LEN + len > rd.map + rd.len ||
+	    delta_decode(NULL, p + CHUNK_HDR_LEN + 4, len - 4, &key) < 0)
+		return 0;
+
+	game_save(s, &ours);
+	game_save(&key, &theirs);
+
+	return !memcmp(&ours, &theirs, sizeof(ours));
+}
+
+int replay_seek(GameState *s, u32 tick)
+{
+	u32 lo, hi, mid;
+	u8 input[2];
+	int n;
+
+	/* last keyframe at or before `tick' */
+	lo = 0;
+	hi = rd.count;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (entry_tick(mid) <= tick)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	if (load_chunk(lo, s) != 0)
+		return -1;
+
+	while (s->tick < tick) {
+		n = replay_next(input);
+		if (n <= 0)
+			return -1;
+		game_step(s, input);
+	}
+
+	return 0;
+}
+
+void replay_close(void)
+{
+	if (wr.fp)
+		record_close();
+
+	if (rd.map) {
+		munmap((void *)rd.map, rd.len);
+		close(rd.fd);
+		free(rd.scanned);
+		memset(&rd, 0, sizeof(rd));
+		rd.fd = -1;
+	}
+}
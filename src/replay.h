@@ -0,0 +1,94 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "ai.h"
+
+/*
+ * Game recordings: enough to play a game again with game_step(), and to
+ * jump anywhere in it.
+ *
+ * A recording is a run of chunks, each starting with a keyframe (the
+ * whole GameState, delta coded against nothing) and followed by the inputs
+ * of the next REPLAY_KEYFRAME_TICKS ticks. Inputs are run-length coded;
+ * every tick also gets a check, the game_hash() of the state it led
+ * to. Chunks are written whole, so a recording still being written
+ * can be read up to its last complete chunk. Closing it appends an
+ * index of the keyframes.
+ *
+ * File layout, little-endian, varints in LEB128:
+ *
+ *	"GNOPREC6" interval:u16 ai:u8[AI_PARAMS_LEN][2]
+ *	chunk:	'K' len:u32 tick:u32 state ticks:varint
+ *		runs_len:varint { count:varint input:u8 }... check:u32[ticks]
+ *	...
+ *	index:	'I' count:u32 { tick:u32 offset:u64 }...
+ *	offset_of_index:u64 "GNOPINDX"
+ *
+ * An input byte holds player 1's GAME_INPUT_* bits in the low nibble
+ * and player 2's in the high one. `ai' holds the ai_pack()ed parameters
+ * each paddle's AI played with, which playback plays with again.
+ */
+#define REPLAY_MAGIC		"GNOPREC6"
+#define REPLAY_INDEX_MAGIC	"GNOPINDX"
+
+#define REPLAY_KEYFRAME_TICKS	250	/* 5 s */
+
+/*
+ * Start recording a game from state `s'.
+ */
+int  replay_record_open (const char *path, const GameState *s);
+
+/*
+ * Append the tick which led to state `s' with `input'.
+ */
+void replay_record      (const u8 input[2], const GameState *s);
+
+/*
+ * Map the recording `path' for playback, set `s' to its first state
+ * and play the AI as it was recorded with.
+ */
+int  replay_play_open   (const char *path, GameState *s);
+
+/*
+ * Read the inputs of the next tick. Return 1 if there was one, 0 at the
+ * end of the recording and -1 if it is corrupt.
+ */
+int  replay_next        (u8 input[2]);
+
+/*
+ * Check state `s', stepped with the last inputs read, against the
+ * recording: return 0 if it differs. Keyframes are compared whole, the
+ * ticks between them by their hash.
+ */
+bool replay_check       (const GameState *s);
+
+/*
+ * Set `s' to the recorded state at `tick', from the closest keyframe
+ * before it; playback goes on from there. If the recording ends before
+ * `tick', `s' is left at its end and -1 is returned.
+ */
+int  replay_seek        (GameState *s, u32 tick);
+
+/*
+ * Close the recording, if any.
+ */
+void replay_close       (void);
+
+#endif /* !REPLAY_H */
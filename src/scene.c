@@ -0,0 +1,241 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <limits.h>
+
+#include "engine.h"
+#include "pak.h"
+#include "video.h"
+#include "scene.h"
+
+#define PANEL_ALPHA	92
+
+#define SCORE_TXT_Y	16
+#define WON_TXT_Y	(GAME_HEIGHT - 64)
+#define REPLAY_TXT_Y	(GAME_HEIGHT - 40)
+
+static const int font_ptsz[SCENE_FONT_NO] = { 48, 48, 24, 24 };
+
+struct _Scene {
+	Sprite *bg;
+	Sprite *panel;		/* NULL at 8 bpp */
+	Sprite *ball;
+	Sprite *paddle[2];
+	Text   *score_txt[2];	/* NULL without fonts */
+	Text   *won_txt;
+	Text   *replay_txt;
+
+	int     shown[2];	/* scores rendered in score_txt */
+	bool    replay;		/* mark frames as a replay */
+
+	u32     fg_color;
+	Sprite *target;		/* NULL: the screen */
+};
+
+/*
+ * Create a `w' x `h' sprite filled with `color'.
+ */
+static Sprite *new_block(u16 w, u16 h, u32 color)
+{
+	Sprite *self = sprite_new(w, h);
+
+	sprite_fill(self, color);
+	sprite_set_accel(self, color);
+
+	return self;
+}
+
+Scene *scene_new(u32 fg_color, u32 bg_color)
+{
+	Scene *self;
+	s16 i;
+	int p;
+
+	self = calloc(1, sizeof(Scene));
+	self->fg_color = fg_color;
+
+	self->bg = new_block(GAME_WIDTH, GAME_HEIGHT, bg_color);
+
+	for (i=13; i<GAME_HEIGHT; ++i) { /* separator */
+		if (!(i % 13))
+			sprite_fill_region(self->bg, GAME_WIDTH / 2 - 2, 
+					   i-4, 4, 6, fg_color);
+
+		/* I know, too many magic numbers... */
+	}
+
+	if (video_get_bpp() != 8) {
+		self->panel = sprite_new(GAME_WIDTH, GAME_HEIGHT);
+		sprite_set_alpha(self->panel, PANEL_ALPHA);
+	}
+
+	self->ball = new_block(GAME_BALL_SIZE, GAME_BALL_SIZE, fg_color);
+
+	for (p=0; p<2; ++p) {
+		self->paddle[p] = new_block(GAME_PADDLE_WIDTH, 
+					    GAME_PADDLE_HEIGHT, fg_color);
+		layer_set_x(self->paddle[p], GAME_PADDLE_X(p));
+	}
+
+	return self;
+}
+
+void scene_free(Scene *self)
+{
+	if (!self)
+		return;
+
+	objects_free(self->bg, self->ball, self->paddle[0], self->paddle[1],
+		     self->panel, NULL);
+
+	if (self->won_txt)
+		objects_free(self->score_txt[0], self->score_txt[1],
+			     self->won_txt, self->replay_txt, NULL);
+
+	free(self);
+}
+
+int scene_open_fonts(const char *datadir, TTF_Font *font[SCENE_FONT_NO])
+{
+	char path[PATH_MAX];
+	const void *data;
+	u32 size;
+	int i;
+
+	memset(font, 0, SCENE_FONT_NO * sizeof(*font));
+
+	data = pak_find(SCENE_FONT_BASENAME, &size);
+	if (!data && !join_path(datadir, SCENE_FONT_BASENAME, path))
+		return -1;
+
+	for (i=0; i<SCENE_FONT_NO; ++i) {
+		font[i] = data ? ttf_open_font_mem(data, size, font_ptsz[i])
+			       : ttf_open_font(path, font_ptsz[i]);
+		if (!font[i])
+			return -1;
+	}
+
+	return 0;
+}
+
+void scene_close_fonts(TTF_Font *font[SCENE_FONT_NO])
+{
+	int i;
+
+	for (i=0; i<SCENE_FONT_NO; ++i) {
+		if (font[i])
+			TTF_CloseFont(font[i]);
+		font[i] = NULL;
+	}
+}
+
+void scene_set_fonts(Scene *self, TTF_Font *font[SCENE_FONT_NO])
+{
+	u32 color = self->fg_color;
+	int p;
+
+	for (p=0; p<2; ++p) {
+		self->score_txt[p] = text_new_with_font(font[p], color);
+		layer_set_y(self->score_txt[p], SCORE_TXT_Y);
+		sprite_set_target(SPRITE(self->score_txt[p]), self->target);
+		self->shown[p] = -1;
+	}
+
+	self->won_txt = text_new_with_font(font[SCENE_FONT_WON], color);
+	text_set_text(self->won_txt, "won");
+	layer_set_y(self->won_txt, WON_TXT_Y);
+	sprite_set_target(SPRITE(self->won_txt), self->target);
+
+	self->replay_txt = text_new_with_font(font[SCENE_FONT_REPLAY], color);
+	text_set_text(self->replay_txt, "replay");
+	layer_set_xy(self->replay_txt, GAME_WIDTH / 2 - 
+		     layer_get_width(self->replay_txt) / 2, REPLAY_TXT_Y);
+	sprite_set_target(SPRITE(self->replay_txt), self->target);
+}
+
+void scene_set_target(Scene *self, Sprite *canvas)
+{
+	Sprite *sprites[] = {
+		self->bg, self->panel, self->ball, 
+		self->paddle[0], self->paddle[1],
+		SPRITE(self->score_txt[0]), SPRITE(self->score_txt[1]), 
+		SPRITE(self->won_txt), SPRITE(self->replay_txt),
+	};
+	unsigned i;
+
+	self->target = canvas;
+
+	for (i=0; i<sizeof(sprites) / sizeof(*sprites); ++i)
+		if (sprites[i])
+			sprite_set_target(sprites[i], canvas);
+}
+
+void scene_show_replay(Scene *self, bool on)
+{
+	self->replay = on;
+}
+
+/*
+ * Render the score of player `p' again if it changed, and center it on
+ * its half of the field.
+ */
+static void update_score(Scene *self, const GameState *s, int p)
+{
+	Text *txt = self->score_txt[p];
+
+	if (self->shown[p] == s->score[p])
+		return;
+
+	self->shown[p] = s->score[p];
+	text_set_text(txt, "%d", s->score[p]);
+	layer_set_x(txt, GAME_WIDTH * (p+1) / 3 - layer_get_width(txt) / 2);
+}
+
+void scene_draw(Scene *self, const GameState *s)
+{
+	int p;
+
+	object_blit(self->bg);
+
+	if (self->score_txt[0]) {
+		update_score(self, s, 0);
+		update_score(self, s, 1);
+		objects_blit(self->score_txt[0], self->score_txt[1], NULL);
+	}
+
+	layer_set_y(self->paddle[0], GAME_PADDLE_Y(s, 0));
+	layer_set_y(self->paddle[1], GAME_PADDLE_Y(s, 1));
+	objects_blit(self->paddle[0], self->paddle[1], NULL);
+
+	if (s->phase == GAME_PLAYING) {
+		layer_set_xy(self->ball, s->ball.x, s->ball.y);
+		object_blit(self->ball);
+	}
+
+	if (s->phase == GAME_OVER && self->won_txt) {
+		p = s->score[1] > s->score[0];
+		layer_set_x(self->won_txt, GAME_WIDTH * (2*p + 1) / 4 +
+			    - layer_get_width(self->won_txt) / 2);
+		object_blit(self->won_txt);
+	}
+
+	if (self->replay && self->replay_txt)
+		object_blit(self->replay_txt);
+
+	if (s->paused && self->panel)
+		object_blit(self->panel);
+}
@@ -0,0 +1,76 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "game.h"
+#include "text.h"
+
+/*
+ * What is drawn of a game: field, paddles, ball, scores, the winner, the
+ * pause panel and the replay mark. Texts are only shown once fonts are
+ * given.
+ */
+typedef struct _Scene Scene;
+
+#define SCENE_FONT_BASENAME	"DejaVuSans.ttf"
+
+enum {
+	SCENE_FONT_SCORE_1,
+	SCENE_FONT_SCORE_2,
+	SCENE_FONT_WON,
+	SCENE_FONT_REPLAY,
+	SCENE_FONT_NO,
+};
+
+/*
+ * Parse the scene's fonts from the pack if one is open, else from
+ * `datadir'. This creates no surface, so it can be done off the main
+ * thread. Return -1 if one is missing; the fonts parsed are left in
+ * `font' anyway.
+ */
+int    scene_open_fonts  (const char *datadir, 
+			  TTF_Font *font[SCENE_FONT_NO]);
+void   scene_close_fonts (TTF_Font *font[SCENE_FONT_NO]);
+
+Scene *scene_new       (u32 fg_color, u32 bg_color);
+void   scene_free      (Scene *self);
+
+/*
+ * Show scores and the winner with `font', as parsed by
+ * scene_open_fonts(). The fonts are taken.
+ */
+void   scene_set_fonts (Scene *self, TTF_Font *font[SCENE_FONT_NO]);
+
+/*
+ * Draw on `canvas' instead of the screen.
+ */
+void   scene_set_target (Scene *self, Sprite *canvas);
+
+/*
+ * Mark the frames drawn from now on as a replay, or stop.
+ */
+void   scene_show_replay (Scene *self, bool on);
+
+/*
+ * Blit state `s'. Scores are rendered again when they changed since the
+ * previous call.
+ */
+void   scene_draw      (Scene *self, const GameState *s);
+
+#endif /* !SCENE_H */
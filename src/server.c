@@ -0,0 +1,1074 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-server: host many matches at once, the game stepped here and
+ * played from gnop --server (see server.h).
+ *
+ * Matches are sharded across worker threads, one per CPU by default.
+ * Each worker binds its own UDP socket to the port with SO_REUSEPORT,
+ * so the kernel keeps every player on the same worker, and runs its
+ * own epoll loop over that socket and a timerfd ticking every
+ * GAME_TICK_MS. Nothing is shared between workers: a player is paired
+ * with one waiting on its own worker. Packets in are read, and states
+ * out sent, in batches with recvmmsg() and sendmmsg().
+ *
+ * Every REPORT_TICKS each worker reports how long its ticks took, how
+ * many overran GAME_TICK_MS, its CPU time, and how many matches it
+ * would fit at that cost.
+ *
+ * gnop-server --bots=N plays N bots against a server instead, driven by
+ * the AI, and reports how late the states answering their keys came.
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+
+#include "ai.h"
+#include "bytes.h"
+#include "clock.h"
+#include "log.h"
+#include "net.h"
+#include "server.h"
+
+#define DEFAULT_PORT	"7789"
+
+#define BATCH		64	/* packets per recvmmsg() or sendmmsg() */
+#define REPORT_TICKS	(10000 / GAME_TICK_MS)
+#define EXPIRE_TICKS	(1000 / GAME_TICK_MS)
+#define MAX_CLIENTS	65536	/* per worker: ids hold a 16-bit slot */
+#define SOCKET_BUF	(4 << 20)	/* a tick of keys comes in a burst */
+
+#define TICK_NS		(GAME_TICK_MS * NSEC_PER_MSEC)
+#define TIMEOUT_NS	(SERVER_TIMEOUT_MS * NSEC_PER_MSEC)
+#define KEYS		(GAME_INPUT_UP | GAME_INPUT_DOWN)
+
+#define BUCKET_NS	(10 * NSEC_PER_USEC)
+#define BUCKETS		10000	/* up to 100 ms */
+
+#define USAGE_FMT	\
+	"Usage: %s [OPTION]...\n"					\
+	"   or: %s --bots=N [OPTION]... HOST:PORT\n"			\
+	"Host matches for gnop --server, or play bots against a host.\n\n"\
+	"  -p, --port=PORT\t listen on UDP PORT (default: %s)\n"	\
+	"  -w, --workers=N\t run N worker threads (default: one per\n"	\
+	"                 \t CPU)\n"					\
+	"  --bots=N\t\t play N bots against the server at HOST:PORT\n"	\
+	"  -t, --time=SECONDS\t with --bots, stop after SECONDS\n"	\
+	LOG_LEVEL_USAGE							\
+	"  --help\t\t display this help and exit\n"
+
+enum {
+	OPT_BOTS = 256,
+	OPT_LOG_LEVEL,
+};
+
+static struct option long_options[] = {
+	{ "port", required_argument, NULL, 'p' },
+	{ "workers", required_argument, NULL, 'w' },
+	{ "bots", required_argument, NULL, OPT_BOTS },
+	{ "time", required_argument, NULL, 't' },
+	{ "log-level", required_argument, NULL, OPT_LOG_LEVEL },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL },
+};
+
+typedef struct {
+	struct sockaddr_in addr;
+	u16   cookie;		/* 0: free slot */
+	u8    side;
+	u8    input;		/* latest keys */
+	u32   match;
+	u32   acked;		/* latest state it decoded */
+	u32   echo;		/* its latest stamp */
+	u64   seen;
+} Client;
+
+typedef struct {
+	bool  used;
+	s32   client[2];	/* slot, or -1 for the AI */
+	s32   wait;		/* in Worker.waiting, or -1 */
+	u32   ev;		/* of the latest step */
+	GameState s;
+	GameState sent[SERVER_STATES];	/* by tick */
+} Match;
+
+/*
+ * A worker, with its share of the players and matches.
+ */
+typedef struct {
+	int   id;
+	int   fd, timer, ep;
+	pthread_t thread;
+	u64   rng;		/* for cookies and seeds */
+
+	Client *clients;
+	u32     nclients, clients_alloc;
+	u32    *free_clients;	/* slots */
+	u32     nfree_clients;
+
+	Match  *matches;
+	u32     nmatches, matches_alloc;
+	u32    *free_matches;
+	u32     nfree_matches;
+	u32    *waiting;	/* matches with one player */
+	u32     nwaiting, waiting_alloc;
+
+	struct mmsghdr mm[BATCH];
+	struct iovec   iov[BATCH];
+	struct sockaddr_in to[BATCH];
+	u8      out[BATCH][SERVER_PACKET_MAX];
+	u32     nout;
+
+	/* since the last report */
+	u64     ticks, overruns, work_ns, work_max;
+	u64     packets_in, packets_out;
+	u64     cpu_at, wall_at;
+} Worker;
+
+/*
+ * A bot of --bots.
+ */
+typedef struct {
+	int   fd;
+	bool  welcomed;
+	u32   id;
+	u8    side;
+	u32   acked;
+	GameState states[SERVER_STATES];	/* by tick */
+} Bot;
+
+static struct {
+	volatile sig_atomic_t quit;
+
+	Worker *workers;
+	int     nworkers;
+
+	Bot    *bots;
+	u32     nbots;
+	u32     hist[BUCKETS];	/* key to state, since the last report */
+	u64     count, sum, max, lost;
+} srv;
+
+static void on_signal(int sig)
+{
+	srv.quit = 1;
+}
+
+static u64 thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * xorshift64, for cookies and seeds.
+ */
+static u64 next_rand(Worker *w)
+{
+	w->rng ^= w->rng << 13;
+	w->rng ^= w->rng >> 7;
+	w->rng ^= w->rng << 17;
+
+	return w->rng;
+}
+
+static void send_batch(Worker *w)
+{
+	int sent;
+
+	if (!w->nout)
+		return;
+
+	sent = sendmmsg(w->fd, w->mm, w->nout, 0);
+	w->packets_out += sent > 0 ? sent : 0;
+	w->nout = 0;
+}
+
+/*
+ * Queue the `len' bytes at `w->out[w->nout]' to `to'.
+ */
+static void queue_packet(Worker *w, const struct sockaddr_in *to, u32 len)
+{
+	struct mmsghdr *m = &w->mm[w->nout];
+
+	w->to[w->nout] = *to;
+	w->iov[w->nout].iov_base = w->out[w->nout];
+	w->iov[w->nout].iov_len = len;
+	m->msg_hdr.msg_name = &w->to[w->nout];
+	m->msg_hdr.msg_namelen = sizeof(*to);
+	m->msg_hdr.msg_iov = &w->iov[w->nout];
+	m->msg_hdr.msg_iovlen = 1;
+
+	if (++w->nout == BATCH)
+		send_batch(w);
+}
+
+static void welcome(Worker *w, u32 slot)
+{
+	Client *c = &w->clients[slot];
+	u8 *p = w->out[w->nout];
+
+	*p++ = 'W';
+	memcpy(p, SERVER_MAGIC, SERVER_MAGIC_LEN);
+	p += SERVER_MAGIC_LEN;
+	p = put_le(p, slot | (u32)c->cookie << 16, 4);
+	*p++ = c->side;
+
+	queue_packet(w, &c->addr, SERVER_WELCOME_LEN);
+}
+
+/*
+ * Take a slot of `*array' (`*n' used, `*alloc' allocated) off the free
+ * list `*free_list', or a new one. Return -1 if none is left, or on
+ * error: the arrays are then left as they were.
+ */
+static s32 take_slot(void **array, size_t size, u32 *n, u32 *alloc, 
+		     u32 **free_list, u32 *nfree, u32 max)
+{
+	void *grown;
+	u32 want;
+
+	if (*nfree)
+		return (*free_list)[--*nfree];
+
+	if (*n == *alloc) {
+		if (*alloc >= max)
+			return -1;
+		want = *alloc ? *alloc * 2 : 64;
+
+		if (!(grown = realloc(*array, want * size)))
+			return -1;
+		*array = grown;
+
+		if (!(grown = realloc(*free_list, want * sizeof(**free_list))))
+			return -1;
+		*free_list = grown;
+		*alloc = want;
+	}
+
+	return (*n)++;
+}
+
+static s32 new_match(Worker *w)
+{
+	Match *m;
+	u32 *waiting, t;
+	s32 i;
+
+	i = take_slot((void **)&w->matches, sizeof(*w->matches), 
+		      &w->nmatches, &w->matches_alloc, &w->free_matches, 
+		      &w->nfree_matches, MAX_CLIENTS);
+	if (i < 0)
+		return -1;
+
+	/* room for every match to wait, so that wait_player() can't fail */
+	if (w->waiting_alloc < w->matches_alloc) {
+		waiting = realloc(w->waiting, 
+				  w->matches_alloc * sizeof(*waiting));
+		if (!waiting) {
+			w->matches[i].used = 0;
+			w->free_matches[w->nfree_matches++] = i;
+			return -1;
+		}
+		w->waiting = waiting;
+		w->waiting_alloc = w->matches_alloc;
+	}
+
+	m = &w->matches[i];
+	m->used = 1;
+	m->client[0] = m->client[1] = -1;
+	m->wait = -1;
+	game_init(&m->s, next_rand(w));
+	m->s.cpu = 1 << 0 | 1 << 1;
+	for (t=0; t<SERVER_STATES; ++t)
+		m->sent[t].tick = SERVER_NO_TICK;
+
+	return i;
+}
+
+/*
+ * Let the next player join match `i', which has one.
+ */
+static void wait_player(Worker *w, u32 i)
+{
+	if (w->matches[i].wait >= 0)
+		return;
+
+	w->matches[i].wait = w->nwaiting;
+	w->waiting[w->nwaiting++] = i;
+}
+
+static void stop_waiting(Worker *w, u32 i)
+{
+	s32 k = w->matches[i].wait;
+
+	if (k < 0)
+		return;
+
+	w->waiting[k] = w->waiting[--w->nwaiting];
+	w->matches[w->waiting[k]].wait = k;
+	w->matches[i].wait = -1;
+}
+
+static void free_match(Worker *w, u32 i)
+{
+	stop_waiting(w, i);
+	w->matches[i].used = 0;
+	w->free_matches[w->nfree_matches++] = i;
+}
+
+/*
+ * Seat a new player at `from': in a match waiting for one, the one
+ * left last, or in a new one against the AI.
+ */
+static void add_client(Worker *w, const struct sockaddr_in *from)
+{
+	Client *c;
+	Match *m;
+	s32 slot, i;
+
+	slot = take_slot((void **)&w->clients, sizeof(*w->clients), 
+			 &w->nclients, &w->clients_alloc, &w->free_clients,
+			 &w->nfree_clients, MAX_CLIENTS);
+	if (slot < 0)
+		return;
+
+	i = w->nwaiting ? (s32)w->waiting[w->nwaiting - 1] : new_match(w);
+	if (i < 0) {
+		w->free_clients[w->nfree_clients++] = slot;
+		return;
+	}
+	m = &w->matches[i];
+
+	c = &w->clients[slot];
+	c->addr = *from;
+	c->cookie = next_rand(w) | 1;
+	c->side = m->client[0] < 0 ? 0 : 1;
+	c->input = 0;
+	c->match = i;
+	c->acked = SERVER_NO_TICK;
+	c->echo = 0;
+	c->seen = clock_ns();
+
+	m->client[c->side] = slot;
+	m->s.cpu &= ~(1 << c->side);
+	if (m->client[!c->side] < 0)
+		wait_player(w, i);
+	else
+		stop_waiting(w, i);
+
+	welcome(w, slot);
+}
+
+static void drop_client(Worker *w, u32 slot)
+{
+	Client *c = &w->clients[slot];
+	Match *m = &w->matches[c->match];
+
+	m->client[c->side] = -1;
+	m->s.cpu |= 1 << c->side;
+	c->cookie = 0;
+	w->free_clients[w->nfree_clients++] = slot;
+
+	if (m->client[!c->side] < 0)
+		free_match(w, c->match);
+	else
+		wait_player(w, c->match);
+}
+
+static bool same_addr(const struct sockaddr_in *a, 
+		      const struct sockaddr_in *b)
+{
+	return a->sin_port == b->sin_port && 
+	       a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+/*
+ * Return the slot of the player `id' sending from `from', or -1.
+ */
+static s32 find_client(Worker *w, u32 id, const struct sockaddr_in *from)
+{
+	u32 slot = id & 0xffff;
+
+	if (slot >= w->nclients || w->clients[slot].cookie != id >> 16 ||
+	    !w->clients[slot].cookie || 
+	    !same_addr(&w->clients[slot].addr, from))
+		return -1;
+
+	return slot;
+}
+
+static void take_packet(Worker *w, const u8 *buf, u32 len, 
+			const struct sockaddr_in *from)
+{
+	Client *c;
+	s32 slot;
+	u32 i, ack;
+
+	switch (buf[0]) {
+	case 'H':
+		if (len != SERVER_HELLO_LEN || 
+		    memcmp(buf + 1, SERVER_MAGIC, SERVER_MAGIC_LEN))
+			return;
+
+		/* our welcome was lost: hellos are rare, a scan will do */
+		for (i=0; i<w->nclients; ++i)
+			if (w->clients[i].cookie && 
+			    same_addr(&w->clients[i].addr, from)) {
+				welcome(w, i);
+				return;
+			}
+
+		add_client(w, from);
+		break;
+
+	case 'I':
+		if (len != SERVER_INPUT_LEN)
+			return;
+		slot = find_client(w, get_le(buf + 1, 4), from);
+		if (slot < 0)
+			return;
+
+		c = &w->clients[slot];
+		c->input = buf[5] & KEYS;
+		ack = get_le(buf + 6, 4);
+		if (ack != SERVER_NO_TICK && 
+		    (c->acked == SERVER_NO_TICK || ack > c->acked))
+			c->acked = ack;
+		c->echo = get_le(buf + 10, 4);
+		c->seen = clock_ns();
+		break;
+
+	case 'Q':
+		if (len != 5)
+			return;
+		slot = find_client(w, get_le(buf + 1, 4), from);
+		if (slot >= 0)
+			drop_client(w, slot);
+		break;
+	}
+}
+
+static void receive(Worker *w)
+{
+	struct mmsghdr mm[BATCH];
+	struct iovec iov[BATCH];
+	struct sockaddr_in from[BATCH];
+	u8 buf[BATCH][SERVER_PACKET_MAX];
+	int i, n;
+
+	for (i=0; i<BATCH; ++i) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = sizeof(buf[i]);
+		memset(&mm[i].msg_hdr, 0, sizeof(mm[i].msg_hdr));
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		for (i=0; i<BATCH; ++i) {
+			mm[i].msg_hdr.msg_name = &from[i];
+			mm[i].msg_hdr.msg_namelen = sizeof(from[i]);
+		}
+
+		n = recvmmsg(w->fd, mm, BATCH, MSG_DONTWAIT, NULL);
+		for (i=0; i<n; ++i)
+			if (mm[i].msg_len)
+				take_packet(w, buf[i], mm[i].msg_len, 
+					    &from[i]);
+		if (n > 0)
+			w->packets_in += n;
+	} while (n == BATCH);
+
+	send_batch(w);
+}
+
+/*
+ * Send player `slot' the state of its match, against the latest it
+ * has.
+ */
+static void send_state(Worker *w, Match *m, u32 slot)
+{
+	Client *c = &w->clients[slot];
+	const GameState *base = NULL;
+	u8 *p = w->out[w->nout];
+	u32 a = c->acked;
+
+	if (a != SERVER_NO_TICK && m->sent[a % SERVER_STATES].tick == a)
+		base = &m->sent[a % SERVER_STATES];
+
+	*p++ = 'S';
+	p = put_le(p, c->echo, 4);
+	p = put_le(p, base ? a : SERVER_NO_TICK, 4);
+	p = put_le(p, m->ev, 2);
+	p += delta_encode(base, &m->s, p);
+
+	queue_packet(w, &c->addr, p - w->out[w->nout]);
+}
+
+/*
+ * Step every match, and send its players the state.
+ */
+static void tick(Worker *w)
+{
+	Match *m;
+	u8 input[2];
+	u32 i;
+	int p;
+
+	for (i=0; i<w->nmatches; ++i) {
+		m = &w->matches[i];
+		if (!m->used)
+			continue;
+
+		for (p=0; p<2; ++p)
+			input[p] = m->client[p] >= 0 ? 
+				w->clients[m->client[p]].input : 0;
+
+		m->ev = game_step(&m->s, input);
+		m->sent[m->s.tick % SERVER_STATES] = m->s;
+
+		for (p=0; p<2; ++p)
+			if (m->client[p] >= 0)
+				send_state(w, m, m->client[p]);
+	}
+
+	send_batch(w);
+}
+
+/*
+ * Drop the players not heard of for SERVER_TIMEOUT_MS.
+ */
+static void expire(Worker *w)
+{
+	u64 now = clock_ns();
+	u32 i;
+
+	for (i=0; i<w->nclients; ++i)
+		if (w->clients[i].cookie && 
+		    now - w->clients[i].seen > TIMEOUT_NS)
+			drop_client(w, i);
+}
+
+static void report(Worker *w)
+{
+	u64 cpu = thread_cpu_ns(), wall = clock_ns();
+	u32 i, matches = 0, players = 0;
+	double mean;
+
+	for (i=0; i<w->nmatches; ++i)
+		matches += w->matches[i].used;
+	players = w->nclients - w->nfree_clients;
+	mean = w->ticks ? (double)w->work_ns / w->ticks : 0;
+
+	log_info("server: worker %d: %u matches, %u players, ticks of "
+		 "%.3f ms mean, %.3f max, %lu overran; %.0f%% CPU, "
+		 "%lu packets in, %lu out; room for ~%.0f matches",
+		 w->id, matches, players, mean / NSEC_PER_MSEC, 
+		 (double)w->work_max / NSEC_PER_MSEC, 
+		 (unsigned long)w->overruns, 
+		 100.0 * (cpu - w->cpu_at) / (wall - w->wall_at),
+		 (unsigned long)w->packets_in, 
+		 (unsigned long)w->packets_out,
+		 matches && mean ? matches * TICK_NS / mean : 0.0);
+
+	w->ticks = w->overruns = w->work_ns = w->work_max = 0;
+	w->packets_in = w->packets_out = 0;
+	w->cpu_at = cpu;
+	w->wall_at = wall;
+}
+
+static void *worker_run(void *arg)
+{
+	Worker *w = arg;
+	struct epoll_event ev[2];
+	u64 expirations, t;
+	u64 count = 0;
+	int i, n;
+
+	w->cpu_at = thread_cpu_ns();
+	w->wall_at = clock_ns();
+
+	while (!srv.quit) {
+		n = epoll_wait(w->ep, ev, 2, 100);
+
+		for (i=0; i<n; ++i) {
+			if (ev[i].data.fd == w->fd) {
+				receive(w);
+				continue;
+			}
+
+			if (read(w->timer, &expirations, 8) != 8)
+				continue;
+
+			/* ticks missed are lost: catching up would be worse */
+			if (expirations > 1)
+				w->overruns += expirations - 1;
+
+			t = clock_ns();
+			tick(w);
+			t = clock_ns() - t;
+
+			++w->ticks;
+			w->work_ns += t;
+			if (t > w->work_max)
+				w->work_max = t;
+			if (t > TICK_NS)
+				++w->overruns;
+
+			if (++count % EXPIRE_TICKS == 0)
+				expire(w);
+			if (count % REPORT_TICKS == 0)
+				report(w);
+		}
+	}
+
+	report(w);
+
+	return NULL;
+}
+
+static void watch_fd(int ep, int fd)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int open_worker(Worker *w, const struct sockaddr_in *sin)
+{
+	struct itimerspec its;
+	int one = 1, size = SOCKET_BUF;
+
+	w->rng = clock_ns() * 2 + 1 + w->id;
+
+	w->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (w->fd == -1 ||
+	    setsockopt(w->fd, SOL_SOCKET, SO_REUSEPORT, &one, 
+		       sizeof(one)) == -1 ||
+	    bind(w->fd, (struct sockaddr *)sin, sizeof(*sin)) == -1)
+		return -1;
+
+	/* best effort: the system may hold it to less */
+	setsockopt(w->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(w->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+	w->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (w->timer == -1)
+		return -1;
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = TICK_NS;
+	its.it_value = its.it_interval;
+	timerfd_settime(w->timer, 0, &its, NULL);
+
+	w->ep = epoll_create1(0);
+	if (w->ep == -1)
+		return -1;
+	watch_fd(w->ep, w->fd);
+	watch_fd(w->ep, w->timer);
+
+	return 0;
+}
+
+static void close_worker(Worker *w)
+{
+	if (w->fd != -1)
+		close(w->fd);
+	if (w->timer != -1)
+		close(w->timer);
+	if (w->ep != -1)
+		close(w->ep);
+
+	free(w->clients);
+	free(w->free_clients);
+	free(w->matches);
+	free(w->free_matches);
+	free(w->waiting);
+}
+
+static int run_server(const char *port, int nworkers)
+{
+	struct sockaddr_in sin;
+	sigset_t all, old;
+	int i, started, retv = -1;
+
+	if (net_resolve(port, 0, &sin) != 0)
+		return -1;
+
+	srv.workers = calloc(nworkers, sizeof(*srv.workers));
+	srv.nworkers = nworkers;
+
+	for (i=0; i<nworkers; ++i) {
+		srv.workers[i].id = i;
+		srv.workers[i].fd = srv.workers[i].timer = 
+			srv.workers[i].ep = -1;
+	}
+
+	for (i=0; i<nworkers; ++i)
+		if (open_worker(&srv.workers[i], &sin) != 0) {
+			log_err("server: port %s: %s", port, strerror(errno));
+			goto out;
+		}
+
+	/* leave the signals to this thread, to wake it from pause() */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (started=0; started<nworkers; ++started)
+		if (pthread_create(&srv.workers[started].thread, NULL, 
+				   worker_run, &srv.workers[started]) != 0) {
+			log_err("server: could not start a worker");
+			srv.quit = 1;
+			break;
+		}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	log_info("server: hosting on UDP port %s with %d workers", port,
+		 nworkers);
+
+	while (!srv.quit)
+		pause();
+
+	for (i=0; i<started; ++i)
+		pthread_join(srv.workers[i].thread, NULL);
+	retv = started == nworkers ? 0 : -1;
+
+out:
+	for (i=0; i<nworkers; ++i)
+		close_worker(&srv.workers[i]);
+	free(srv.workers);
+
+	return retv;
+}
+
+/*
+ * The keys bot `b' presses in state `s': the ones the AI would.
+ */
+static u8 bot_keys(const Bot *b, const GameState *s)
+{
+	GameState t = *s;
+
+	t.paddle[b->side].move = 0;
+	ai_move(&t, b->side);
+
+	return t.paddle[b->side].move < 0 ? GAME_INPUT_UP : 
+	       t.paddle[b->side].move > 0 ? GAME_INPUT_DOWN : 0;
+}
+
+static void bot_send_input(Bot *b, u8 keys)
+{
+	u8 buf[SERVER_INPUT_LEN], *p = buf;
+
+	*p++ = 'I';
+	p = put_le(p, b->id, 4);
+	*p++ = keys;
+	p = put_le(p, b->acked, 4);
+	p = put_le(p, clock_us32() | 1, 4);
+
+	send(b->fd, buf, sizeof(buf), 0);
+}
+
+static void bot_hello(Bot *b)
+{
+	u8 buf[SERVER_HELLO_LEN];
+
+	buf[0] = 'H';
+	memcpy(buf + 1, SERVER_MAGIC, SERVER_MAGIC_LEN);
+	send(b->fd, buf, sizeof(buf), 0);
+}
+
+static void bot_take_state(Bot *b, const u8 *buf, u32 len)
+{
+	const GameState *base = NULL;
+	GameState s;
+	u64 late;
+	u32 bt;
+
+	bt = get_le(buf + 5, 4);
+	if (bt != SERVER_NO_TICK) {
+		base = &b->states[bt % SERVER_STATES];
+		if (base->tick != bt) {
+			++srv.lost;
+			return;
+		}
+	}
+
+	if (delta_decode(base, buf + SERVER_STATE_HDR_LEN, 
+			 len - SERVER_STATE_HDR_LEN, &s) < 0) {
+		++srv.lost;
+		return;
+	}
+
+	if (b->acked != SERVER_NO_TICK && s.tick <= b->acked)
+		return;
+	if (b->acked != SERVER_NO_TICK && s.tick > b->acked + 1)
+		srv.lost += s.tick - b->acked - 1;
+
+	b->states[s.tick % SERVER_STATES] = s;
+	b->acked = s.tick;
+
+	/* 0: no key of ours reached the server yet */
+	if (!get_le(buf + 1, 4))
+		goto reply;
+
+	late = (u32)(clock_us32() - get_le(buf + 1, 4)) * NSEC_PER_USEC;
+	++srv.hist[late / BUCKET_NS < BUCKETS ? late / BUCKET_NS 
+					      : BUCKETS - 1];
+	++srv.count;
+	srv.sum += late;
+	if (late > srv.max)
+		srv.max = late;
+
+reply:
+	bot_send_input(b, bot_keys(b, &s));
+}
+
+static void bot_read(Bot *b)
+{
+	u8 buf[SERVER_PACKET_MAX];
+	ssize_t n;
+
+	while ((n = recv(b->fd, buf, sizeof(buf), 0)) > 0) {
+		if (buf[0] == 'W' && n == SERVER_WELCOME_LEN &&
+		    !memcmp(buf + 1, SERVER_MAGIC, SERVER_MAGIC_LEN)) {
+			b->id = get_le(buf + SERVER_HELLO_LEN, 4);
+			b->side = buf[SERVER_HELLO_LEN + 4] & 1;
+			b->welcomed = 1;
+			bot_send_input(b, 0);
+		} else if (buf[0] == 'S' && n > SERVER_STATE_HDR_LEN && 
+			   b->welcomed) {
+			bot_take_state(b, buf, n);
+		}
+	}
+}
+
+/*
+ * Tell how late the states answering the bots' keys came in the last
+ * `secs', and start over.
+ */
+static void report_bots(double secs)
+{
+	u64 seen = 0, p50 = 0, p99 = 0;
+	u32 i, welcomed = 0;
+
+	for (i=0; i<BUCKETS && srv.count; ++i) {
+		seen += srv.hist[i];
+		if (!p50 && seen * 2 >= srv.count)
+			p50 = i + 1;
+		if (!p99 && seen * 100 >= srv.count * 99)
+			p99 = i + 1;
+	}
+	for (i=0; i<srv.nbots; ++i)
+		welcomed += srv.bots[i].welcomed;
+
+	log_info("bots: %u of %u playing, %.0f states/s, key to state "
+		 "%.2f ms mean, %.2f p50, %.2f p99, %.2f max; %lu lost",
+		 welcomed, srv.nbots, srv.count / secs, srv.count ? 
+		 (double)srv.sum / srv.count / NSEC_PER_MSEC : 0.0, 
+		 (double)p50 * BUCKET_NS / NSEC_PER_MSEC,
+		 (double)p99 * BUCKET_NS / NSEC_PER_MSEC,
+		 (double)srv.max / NSEC_PER_MSEC, (unsigned long)srv.lost);
+
+	memset(srv.hist, 0, sizeof(srv.hist));
+	srv.count = srv.sum = srv.max = srv.lost = 0;
+}
+
+/*
+ * Play `nbots' bots against the server at `addr' for `secs' (0: until
+ * interrupted).
+ */
+static int run_bots(const char *addr, u32 nbots, u32 secs)
+{
+	struct epoll_event ev[BATCH];
+	struct sockaddr_in sin;
+	struct epoll_event e;
+	u64 now, end, report, hello;
+	u8 bye[5];
+	int ep, i, n, retv = -1;
+
+	if (net_resolve(addr, 1, &sin) != 0)
+		return -1;
+
+	srv.bots = calloc(nbots, sizeof(*srv.bots));
+	ep = epoll_create1(0);
+
+	for (srv.nbots=0; srv.nbots<nbots; ++srv.nbots) {
+		Bot *b = &srv.bots[srv.nbots];
+
+		b->acked = SERVER_NO_TICK;
+		b->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+		if (b->fd == -1 || connect(b->fd, (struct sockaddr *)&sin, 
+					   sizeof(sin)) == -1) {
+			log_err("bots: %s: %s", addr, strerror(errno));
+			if (b->fd != -1)
+				close(b->fd);
+			goto out;
+		}
+
+		e.events = EPOLLIN;
+		e.data.ptr = b;
+		epoll_ctl(ep, EPOLL_CTL_ADD, b->fd, &e);
+		bot_hello(b);
+	}
+
+	log_info("bots: %u bots playing against %s", nbots, addr);
+
+	now = clock_ns();
+	end = secs ? now + secs * NSEC_PER_SEC : 0;
+	report = now + NSEC_PER_SEC;
+	hello = now + SERVER_HELLO_MS * NSEC_PER_MSEC;
+
+	while (!srv.quit && (!end || now < end)) {
+		n = epoll_wait(ep, ev, BATCH, 100);
+		for (i=0; i<n; ++i)
+			bot_read(ev[i].data.ptr);
+
+		now = clock_ns();
+		if (now >= hello) {
+			for (i=0; i<(int)srv.nbots; ++i)
+				if (!srv.bots[i].welcomed)
+					bot_hello(&srv.bots[i]);
+			hello = now + SERVER_HELLO_MS * NSEC_PER_MSEC;
+		}
+
+		if (now >= report) {
+			report_bots(1.0 + (double)(now - report) / 
+				    NSEC_PER_SEC);
+			report = now + NSEC_PER_SEC;
+		}
+	}
+
+	retv = 0;
+
+out:
+	while (srv.nbots--) {
+		if (srv.bots[srv.nbots].welcomed) {
+			bye[0] = 'Q';
+			put_le(bye + 1, srv.bots[srv.nbots].id, 4);
+			send(srv.bots[srv.nbots].fd, bye, sizeof(bye), 0);
+		}
+		close(srv.bots[srv.nbots].fd);
+	}
+	free(srv.bots);
+	close(ep);
+
+	return retv;
+}
+
+int main(int ac, char *av[])
+{
+	const char *port = DEFAULT_PORT;
+	u32 nbots = 0, secs = 0;
+	long nworkers;
+	char *p;
+	int c, retv;
+
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nworkers < 1)
+		nworkers = 1;
+
+	for (;;) {
+		c = getopt_long(ac, av, "p:w:t:", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			port = optarg;
+			break;
+
+		case 'w':
+			nworkers = strtol(optarg, &p, 10);
+			if (*p || nworkers < 1 || nworkers > 1024) {
+				log_err("invalid number of workers: %s", 
+					optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_BOTS:
+			nbots = strtoul(optarg, &p, 10);
+			if (*p || !nbots) {
+				log_err("invalid number of bots: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 't':
+			secs = strtoul(optarg, &p, 10);
+			if (*p) {
+				log_err("invalid time: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_LOG_LEVEL:
+			if (log_set_level_name(optarg) != 0)
+				return 1;
+			break;
+
+		case 'h':
+			printf(USAGE_FMT, *av, *av, DEFAULT_PORT);
+			return 0;
+
+		case '?':
+			printf("Try `%s --help' for more information\n", 
+			       av[0]);
+			return 1;
+		}
+	}
+
+	if (ac - optind != (nbots != 0) || (secs && !nbots)) {
+		printf(USAGE_FMT, *av, *av, DEFAULT_PORT);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	net_raise_nofile();
+
+	log_init();
+
+	if (nbots)
+		retv = run_bots(av[optind], nbots, secs);
+	else
+		retv = run_server(port, nworkers);
+
+	log_quit();
+
+	return retv != 0;
+}
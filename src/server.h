@@ -0,0 +1,58 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "delta.h"
+
+/*
+ * Matches played on a dedicated server (gnop-server), over UDP: the
+ * server steps the game, players only send their keys and draw the
+ * states sent back.
+ *
+ *	hello:	'H' "GNOPSRV2"
+ *	welcome:'W' "GNOPSRV2" id:u32 side:u8
+ *	input:	'I' id:u32 input:u8 ack:u32 stamp:u32
+ *	state:	'S' echo:u32 base:u32 events:u16 state
+ *	bye:	'Q' id:u32
+ *
+ * A player says hello until welcomed, then sends its keys every tick,
+ * with `ack' the latest tick of state it decoded and `stamp' its clock
+ * in microseconds. Each tick the server steps every match with the
+ * latest keys of its players, and sends each the new state coded
+ * against the one it acknowledged (`base', or SERVER_NO_TICK for none),
+ * with the last `stamp' it got from it and the GAME_EVENT_* of the
+ * step. Until a second player joins,
+ * and after one left, the AI plays the empty paddle.
+ */
+
+#define SERVER_MAGIC		"GNOPSRV2"
+#define SERVER_MAGIC_LEN	(sizeof(SERVER_MAGIC) - 1)
+#define SERVER_HELLO_LEN	(1 + SERVER_MAGIC_LEN)
+#define SERVER_WELCOME_LEN	(SERVER_HELLO_LEN + 4 + 1)
+#define SERVER_INPUT_LEN	(1 + 4 + 1 + 4 + 4)
+#define SERVER_STATE_HDR_LEN	(1 + 4 + 4 + 2)
+#define SERVER_PACKET_MAX	(SERVER_STATE_HDR_LEN + DELTA_MAX_LEN)
+
+#define SERVER_STATES		32	/* ticks of states kept as bases */
+#define SERVER_HELLO_MS		250
+#define SERVER_TIMEOUT_MS	5000
+
+#define SERVER_NO_TICK		((u32)-1)
+
+#endif /* !SERVER_H */
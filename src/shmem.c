@@ -0,0 +1,176 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "clock.h"
+#include "log.h"
+#include "shmem.h"
+
+static struct {
+	ShmemRegion *r;
+	char        *name;
+
+	bool  bot;		/* the bot plays, and the AI not */
+	u32   published;
+	u32   bot_ticks;	/* played by the bot */
+	u32   answered;		/* states answered within a tick */
+} shmem;
+
+static ShmemRegion *map(const char *name, int flags)
+{
+	ShmemRegion *r;
+	int fd;
+
+	fd = shm_open(name, flags, 0600);
+	if (fd == -1)
+		return NULL;
+
+	if ((flags & O_CREAT) && ftruncate(fd, sizeof(*r)) == -1) {
+		close(fd);
+		return NULL;
+	}
+
+	r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return r == MAP_FAILED ? NULL : r;
+}
+
+int shmem_open(const char *name)
+{
+	if (shmem.r) {
+		log_warn("shmem: already open");
+		return 1;
+	}
+
+	shmem.r = map(name, O_RDWR | O_CREAT);
+	if (!shmem.r) {
+		log_err("shmem: `%s': %s", name, strerror(errno));
+		return -1;
+	}
+
+	memset(shmem.r, 0, sizeof(*shmem.r));
+	shmem.r->pid = getpid();
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(shmem.r->magic, SHMEM_MAGIC, SHMEM_MAGIC_LEN);
+
+	shmem.name = strdup(name);
+	shmem.bot = 0;
+	shmem.published = shmem.bot_ticks = shmem.answered = 0;
+
+	log_info("shmem: sharing the game as `%s'", name);
+
+	return 0;
+}
+
+void shmem_publish(const GameState *s)
+{
+	ShmemRegion *r = shmem.r;
+	GameSnapshot snap;
+	u32 seq;
+
+	if (!r)
+		return;
+
+	game_save(s, &snap);
+
+	seq = r->seq;
+	__atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(r->state, snap.data, GAME_SNAPSHOT_LEN);
+	r->time = clock_ns();
+
+	__atomic_store_n(&r->seq, seq + 2, __ATOMIC_RELEASE);
+
+	++shmem.published;
+}
+
+void shmem_bot(GameState *s, u8 input[2])
+{
+	u64 in;
+	u32 tick;
+	bool bot;
+
+	if (!shmem.r)
+		return;
+
+	in = __atomic_load_n(&shmem.r->input, __ATOMIC_ACQUIRE);
+	tick = in >> 32;
+
+	/* the state published last is of tick s->tick */
+	bot = (in & SHMEM_INPUT_SET) && tick <= s->tick &&
+	      s->tick - tick < SHMEM_BOT_TICKS;
+
+	if (bot != shmem.bot) {
+		log_info("shmem: %s plays the right paddle", 
+			 bot ? "a bot" : "the AI");
+		shmem.bot = bot;
+	}
+
+	if (!bot) {
+		s->cpu |= 1 << 1;
+		return;
+	}
+
+	s->cpu &= ~(1 << 1);
+	input[1] = in & (GAME_INPUT_UP | GAME_INPUT_DOWN);
+
+	++shmem.bot_ticks;
+	if (tick == s->tick)
+		++shmem.answered;
+}
+
+void shmem_close(void)
+{
+	if (!shmem.r)
+		return;
+
+	munmap(shmem.r, sizeof(*shmem.r));
+	shmem.r = NULL;
+	shm_unlink(shmem.name);
+	free(shmem.name);
+
+	log_info("shmem: %u states shared; the bot played %u ticks, "
+		 "%u on the latest state", shmem.published, shmem.bot_ticks,
+		 shmem.answered);
+}
+
+ShmemRegion *shmem_attach(const char *name)
+{
+	ShmemRegion *r;
+
+	r = map(name, O_RDWR);
+	if (!r) {
+		log_err("shmem: `%s': %s", name, strerror(errno));
+		return NULL;
+	}
+
+	if (memcmp(r->magic, SHMEM_MAGIC, SHMEM_MAGIC_LEN)) {
+		log_err("shmem: `%s' is not a gnop game", name);
+		munmap(r, sizeof(*r));
+		return NULL;
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return r;
+}
@@ -0,0 +1,125 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SHMEM_H
+#define SHMEM_H
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * The game's state, shared live with other processes through a POSIX
+ * shared memory object (see shm_open(3)): overlays, stat trackers, or a
+ * bot playing the right paddle.
+ *
+ * Every tick the engine writes its state into `state' under a seqlock:
+ * `seq' is odd while the state is being written, and bumped once more
+ * when it is done. A reader copies the state between two loads of
+ * `seq', and tries again unless both are the same even number; see
+ * shmem_read().
+ *
+ * A bot plays the right paddle by storing, in one go, the keys it
+ * holds and the tick of the state it answered into `input'; see
+ * shmem_answer(). While it keeps up, within SHMEM_BOT_TICKS, its keys
+ * take the place of the AI's moves. The engine stores its own pid and
+ * SHMEM_MAGIC last, so that a region with the magic set is ready.
+ */
+
+#define SHMEM_MAGIC		"GNOPSHM1"
+#define SHMEM_MAGIC_LEN		(sizeof(SHMEM_MAGIC) - 1)
+
+#define SHMEM_BOT_TICKS		(1000 / GAME_TICK_MS)
+
+#define SHMEM_INPUT_SET		0x80	/* in `input': a bot answered */
+
+typedef struct {
+	char magic[SHMEM_MAGIC_LEN];
+	u32  pid;			/* of the engine */
+	u32  seq;			/* odd while `state' is written */
+	u64  time;			/* CLOCK_MONOTONIC ns of the tick */
+	u8   state[GAME_SNAPSHOT_LEN];	/* game_save() of the tick */
+
+	/* on a cache line of its own: written by the bot */
+	u64  input __attribute__((aligned(64)));
+					/* tick << 32 | SET | keys */
+} ShmemRegion;
+
+/*
+ * Create (or take over) the shared memory object `name', like "/gnop",
+ * to share the game through.
+ */
+int  shmem_open (const char *name);
+
+/*
+ * Write state `s' for the readers.
+ */
+void shmem_publish (const GameState *s);
+
+/*
+ * If a bot is playing, give it the right paddle of `s' and set
+ * `input[1]' to its keys; otherwise leave that paddle to the AI.
+ */
+void shmem_bot (GameState *s, u8 input[2]);
+
+/*
+ * Unlink the shared memory object, and report how much was shared.
+ */
+void shmem_close (void);
+
+/*
+ * Map the shared memory object `name' an engine created, to read the
+ * game, or play it, from another process. Return NULL on error.
+ */
+ShmemRegion *shmem_attach (const char *name);
+
+/*
+ * Copy the latest state of `r' into `s', and return its sequence
+ * number: increased by 2 with each new state.
+ */
+static inline u32 shmem_read(const ShmemRegion *r, GameState *s)
+{
+	GameSnapshot snap;
+	u32 seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(snap.data, r->state, GAME_SNAPSHOT_LEN);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+
+	game_restore(s, &snap);
+
+	return seq;
+}
+
+/*
+ * Hold `keys' (GAME_INPUT_UP or GAME_INPUT_DOWN) on the right paddle of
+ * `r', in answer to the state of `tick'.
+ */
+static inline void shmem_answer(ShmemRegion *r, u32 tick, u8 keys)
+{
+	__atomic_store_n(&r->input, (u64)tick << 32 | SHMEM_INPUT_SET | 
+			 (keys & (GAME_INPUT_UP | GAME_INPUT_DOWN)), 
+			 __ATOMIC_RELEASE);
+}
+
+#endif /* !SHMEM_H */
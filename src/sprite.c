@@ -19,13 +19,16 @@
 
 #include <errno.h>
 
+#include "mem.h"
 #include "video.h"
 #include "sprite_impl.h"
 
 INLINE_METHOD void sprite_free(Sprite *self)
 {
-	if (self && self->surface && self->surface != self->screen)
+	if (self && self->surface && self->surface != self->screen) {
+		mem_surface_track(-SURFACE_BYTES(self->surface));
 		SDL_FreeSurface(self->surface);
+	}
 }
 
 INLINE_METHOD int sprite_blit(Sprite *self)
@@ -116,6 +119,9 @@ static Sprite *_sprite_new(SDL_Surface *screen, SDL_Surface *surface)
 		self->surface = surface;
 		self->dst.w = surface->w;
 		self->dst.h = surface->h;
+
+		if (surface != screen)
+			mem_surface_track(SURFACE_BYTES(surface));
 	}
 
 	return self;
@@ -255,6 +261,7 @@ int sprite_fill_pixel(Sprite *self, s16 x, s16 y, u32 color)
 	case 3:
 		log_fixme("unsupported odd surface format "
 			  "(3 bytes per pixel): exit");
+		log_flush();
 		abort();
 		break;
 
@@ -302,3 +309,8 @@ INLINE_METHOD int sprite_set_accel(Sprite *self, u32 color)
 
 	return retv;
 }
+
+INLINE_METHOD void sprite_set_target(Sprite *self, const Sprite *target)
+{
+	self->screen = target ? target->surface : SDL_GetVideoSurface();
+}
@@ -48,6 +48,12 @@ int  sprite_set_alpha	 (Sprite *self, u8 alpha);
 int  sprite_set_colorkey (Sprite *self, u32 color);
 int  sprite_set_accel    (Sprite *self, u32 color);	
 
+/*
+ * Blit on `target' instead of the screen (NULL: on the screen again).
+ * `target' must have the screen's format.
+ */
+void sprite_set_target (Sprite *self, const Sprite *target);
+
 #define sprite_enable_colorkey(SELF) sprite_set_colorkey(SELF, SPRITE_COLORKEY)
 
 #endif /* !SPRITE_H */
@@ -28,6 +28,11 @@
 
 #define SPRITE(OBJ)	((Sprite *)(OBJ))
 
+/*
+ * Pixel memory held by an SDL surface.
+ */
+#define SURFACE_BYTES(S)	((S) ? (s64)(S)->pitch * (S)->h : 0)
+
 struct _Sprite {
 	LayerVT parent;
 
@@ -0,0 +1,553 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-sprt: tell whether a controller plays stronger than another.
+ *
+ * Matches between the candidate and the baseline (see controller.h)
+ * are played on all CPUs, two a seed with the sides swapped, until a
+ * sequential probability ratio test decides between H0, the candidate
+ * is elo0 stronger, and H1, it is elo1 stronger, at error rates alpha
+ * and beta; or until the most matches allowed are played.
+ *
+ * The two matches of a seed are far from independent, so the test is
+ * over pairs: a pair scores 0, 1/2, 1, 3/2 or 2 for the candidate (1 a
+ * win, 1/2 a draw), the pentanomial model. The log-likelihood ratio is
+ * the normal approximation of the generalized SPRT over the pairs'
+ * scores, halved to a match's:
+ *
+ *	LLR = N (s1 - s0) (2 mean - s0 - s1) / (2 var)
+ *
+ * where N counts the pairs, var is the variance of their scores, and s0
+ * and s1 are the scores expected at elo0 and elo1. H1 is accepted once
+ * it reaches log((1 - beta) / alpha), H0 once it falls to
+ * log(beta / (1 - alpha)).
+ *
+ * Pairs are counted in the order of their seeds, whatever order the
+ * threads finish them in: the test stops where it would on one thread,
+ * not sooner for pairs that happen to be quick.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "controller.h"
+#include "log.h"
+
+#define DEFAULT_ELO0		0
+#define DEFAULT_ELO1		10
+#define DEFAULT_ALPHA		0.05
+#define DEFAULT_BETA		0.05
+#define DEFAULT_MAX_MATCHES	100000
+
+#define RALLY_TICKS	5000	/* a hundred returns, or so */
+#define STALEMATES	10	/* rallies that long draw the match */
+#define REPORT_NS	(2 * NSEC_PER_SEC)
+#define REORDER_PAIRS	1024	/* played ahead of the next to count */
+
+/* exit statuses, after 1 for errors */
+#define EXIT_H1		0
+#define EXIT_H0		2
+#define EXIT_UNDECIDED	3
+
+#define USAGE_FMT	\
+	"Usage: %s [OPTION]... CANDIDATE BASELINE\n"			\
+	"Play the controller CANDIDATE against BASELINE until a\n"	\
+	"sequential test tells whether it is stronger.\n\n"		\
+	"Controllers: ai[:PRESET] (the computer player, with the\n"	\
+	"parameters in PRESET) or follow[:DEADZONE] (chases the ball).\n\n"\
+	"  -0, --elo0=ELO\t H0: CANDIDATE is ELO stronger (default: %d)\n"\
+	"  -1, --elo1=ELO\t H1: CANDIDATE is ELO stronger (default: %d)\n"\
+	"  -a, --alpha=P\t\t accept H1 wrongly with probability P\n"	\
+	"               \t\t (default: %.2f)\n"				\
+	"  -b, --beta=P\t\t accept H0 wrongly with probability P\n"	\
+	"              \t\t (default: %.2f)\n"				\
+	"  -n, --max-matches=N\t give up after N matches (default: %d)\n"\
+	"  -j, --jobs=N\t\t play on N threads (default: one per CPU)\n"	\
+	"  -s, --seed=N\t\t seed the matches\n"			\
+	LOG_LEVEL_USAGE							\
+	"  --help\t\t display this help and exit\n\n"			\
+	"Exit status: 0 if H1 is accepted, 2 if H0 is, 3 if neither\n"	\
+	"within N matches, 1 on errors.\n"
+
+#define USAGE_ARGS	DEFAULT_ELO0, DEFAULT_ELO1, DEFAULT_ALPHA, 	\
+			DEFAULT_BETA, DEFAULT_MAX_MATCHES
+
+enum {
+	OPT_LOG_LEVEL = 256,
+};
+
+static struct option long_options[] = {
+	{ "elo0", required_argument, NULL, '0' },
+	{ "elo1", required_argument, NULL, '1' },
+	{ "alpha", required_argument, NULL, 'a' },
+	{ "beta", required_argument, NULL, 'b' },
+	{ "max-matches", required_argument, NULL, 'n' },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "seed", required_argument, NULL, 's' },
+	{ "log-level", required_argument, NULL, OPT_LOG_LEVEL },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL },
+};
+
+enum {
+	UNDECIDED,
+	ACCEPT_H0,
+	ACCEPT_H1,
+};
+
+static struct {
+	/* options */
+	const char *candidate, *baseline;
+	double      elo0, elo1, alpha, beta;
+	u32         max_matches, jobs;
+	u64         seed;
+
+	double      s0, s1;		/* expected scores */
+	double      lower, upper;	/* LLR bounds */
+
+	pthread_mutex_t lock;
+	pthread_cond_t  counted;	/* `pairs' grew, or decided */
+	u32         next;		/* match to play next */
+	u32         pairs;		/* counted, in order */
+	u8          pending[REORDER_PAIRS][2];	/* half points + 1 */
+	u32         won, drawn, lost;
+	u32         penta[5];		/* pairs by half points */
+	u64         ticks;
+	double      llr;
+	int         decision;
+	u64         start, reported;
+} sprt = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.counted = PTHREAD_COND_INITIALIZER,
+};
+
+static double elo_to_score(double elo)
+{
+	return 1 / (1 + pow(10, -elo / 400));
+}
+
+static double score_to_elo(double s)
+{
+	if (s <= 0)
+		return -INFINITY;
+	if (s >= 1)
+		return INFINITY;
+
+	return -400 * log10(1 / s - 1);
+}
+
+/*
+ * The mean and variance of the pairs' scores so far, a match's worth,
+ * and their number, after `prior' pairs more of every score.
+ */
+static double pair_stats(int prior, double *mean, double *var)
+{
+	double n = 5 * prior, p, x;
+	int k;
+
+	for (k=0; k<5; ++k)
+		n += sprt.penta[k];
+
+	*mean = *var = 0;
+	for (k=0; k<5; ++k) {
+		p = (sprt.penta[k] + prior) / n;
+		x = k / 4.0;
+		*mean += p * x;
+		*var += p * x * x;
+	}
+	*var -= *mean * *mean;
+
+	return n;
+}
+
+/*
+ * A pair of every score is added as a prior, or the first pairs, all
+ * alike, would have no variance and decide at once.
+ */
+static double update_llr(void)
+{
+	double mean, var, n;
+
+	n = pair_stats(1, &mean, &var);
+
+	return n * (sprt.s1 - sprt.s0) * (2 * mean - sprt.s0 - sprt.s1) / 
+		(2 * var);
+}
+
+/*
+ * Play a match from `seed', `left' on paddle 0, and return the side
+ * that won it, or -1 for a draw. `*ticks' grows by the ticks played.
+ *
+ * Some pairs rally forever: a rally past RALLY_TICKS is played again,
+ * from a restart at the same score, and after STALEMATES of those the
+ * match is a draw.
+ */
+static int play_match(Controller *left, Controller *right, u64 seed, 
+		      u64 *ticks)
+{
+	static const u8 restart[2] = { GAME_INPUT_RESTART };
+	GameState s;
+	u32 rally = 0, stalemates = 0, ev;
+	u8 input[2], score[2];
+
+	game_init(&s, seed);
+	s.cpu = 0;
+
+	for (;;) {
+		input[0] = controller_keys(left, &s, 0);
+		input[1] = controller_keys(right, &s, 1);
+		ev = game_step(&s, input);
+		++*ticks;
+
+		if (ev & GAME_EVENT_WON)
+			return ev & GAME_EVENT_POINT_1 ? 0 : 1;
+
+		if (ev & GAME_EVENT_SERVE)
+			rally = 0;
+		else if (++rally == RALLY_TICKS) {
+			if (++stalemates == STALEMATES)
+				return -1;
+
+			memcpy(score, s.score, sizeof(score));
+			game_step(&s, restart);
+			memcpy(s.score, score, sizeof(score));
+			rally = 0;
+		}
+	}
+}
+
+static void report(const char *what)
+{
+	double mean, var;
+
+	pair_stats(0, &mean, &var);
+
+	log_info("sprt: %s: %u pairs (%u-%u-%u-%u-%u), elo %+.1f, "
+		 "llr %.2f [%.2f, %.2f]", what, sprt.pairs, sprt.penta[0], 
+		 sprt.penta[1], sprt.penta[2], sprt.penta[3], sprt.penta[4], 
+		 score_to_elo(mean), sprt.llr, sprt.lower, sprt.upper);
+}
+
+static void tally(u8 half)
+{
+	if (half == 2)
+		++sprt.won;
+	else if (half == 1)
+		++sprt.drawn;
+	else
+		++sprt.lost;
+}
+
+/*
+ * Put match `i' aside until its pair is next, and count the pairs that
+ * are then complete, in order, until the test decides. Under the lock.
+ */
+static void record(u32 i, int winner)
+{
+	u8 *pair;
+
+	sprt.pending[i / 2 % REORDER_PAIRS][i & 1] = 1 + 
+		(winner < 0 ? 1 : winner == (int)(i & 1) ? 2 : 0);
+
+	while (sprt.decision == UNDECIDED) {
+		pair = sprt.pending[sprt.pairs % REORDER_PAIRS];
+		if (!pair[0] || !pair[1])
+			break;
+
+		tally(pair[0] - 1);
+		tally(pair[1] - 1);
+		++sprt.penta[pair[0] + pair[1] - 2];
+		pair[0] = pair[1] = 0;
+		++sprt.pairs;
+
+		sprt.llr = update_llr();
+		if (sprt.llr >= sprt.upper)
+			sprt.decision = ACCEPT_H1;
+		else if (sprt.llr <= sprt.lower)
+			sprt.decision = ACCEPT_H0;
+
+		pthread_cond_broadcast(&sprt.counted);
+	}
+}
+
+static void *play_matches(void *unused)
+{
+	Controller *c, *b;
+	u64 ticks, now;
+	u32 i;
+	int winner;
+
+	c = controller_new(sprt.candidate);
+	b = controller_new(sprt.baseline);
+	if (!c || !b)
+		goto out;
+
+	pthread_mutex_lock(&sprt.lock);
+
+	for (;;) {
+		/* the pair of the next match must fit in `pending' */
+		while (sprt.decision == UNDECIDED && 
+		       sprt.next < sprt.max_matches &&
+		       sprt.next / 2 >= sprt.pairs + REORDER_PAIRS)
+			pthread_cond_wait(&sprt.counted, &sprt.lock);
+
+		if (sprt.decision != UNDECIDED || 
+		    sprt.next >= sprt.max_matches)
+			break;
+
+		i = sprt.next++;
+		pthread_mutex_unlock(&sprt.lock);
+
+		ticks = 0;
+
+		/* the candidate plays left on even matches, right on odd */
+		if (i & 1)
+			winner = play_match(b, c, sprt.seed + i / 2, &ticks);
+		else
+			winner = play_match(c, b, sprt.seed + i / 2, &ticks);
+
+		pthread_mutex_lock(&sprt.lock);
+
+		sprt.ticks += ticks;
+		record(i, winner);
+
+		now = clock_ns();
+		if (now - sprt.reported >= REPORT_NS) {
+			report("playing");
+			sprt.reported = now;
+		}
+	}
+
+	pthread_mutex_unlock(&sprt.lock);
+
+out:
+	controller_free(c);
+	controller_free(b);
+
+	return NULL;
+}
+
+/*
+ * Play until decided, and print the result. Return the exit status.
+ */
+static int run(void)
+{
+	pthread_t thread[sprt.jobs];
+	double mean, var, n, se, secs;
+	u32 i, started = 0;
+
+	sprt.s0 = elo_to_score(sprt.elo0);
+	sprt.s1 = elo_to_score(sprt.elo1);
+	sprt.lower = log(sprt.beta / (1 - sprt.alpha));
+	sprt.upper = log((1 - sprt.beta) / sprt.alpha);
+	sprt.start = sprt.reported = clock_ns();
+
+	log_info("sprt: %s against %s, elo %g vs %g, alpha %g, beta %g, "
+		 "on %u threads", sprt.candidate, sprt.baseline, sprt.elo0, 
+		 sprt.elo1, sprt.alpha, sprt.beta, sprt.jobs);
+
+	for (i=1; i<sprt.jobs; ++i)
+		if (pthread_create(&thread[started], NULL, play_matches, 
+				   NULL) == 0)
+			++started;
+
+	play_matches(NULL);
+
+	for (i=0; i<started; ++i)
+		pthread_join(thread[i], NULL);
+
+	secs = (double)(clock_ns() - sprt.start) / NSEC_PER_SEC;
+	if (!sprt.pairs)
+		return 1;
+
+	n = pair_stats(0, &mean, &var);
+	se = sqrt(var / n);
+
+	printf("matches   %u (%u won, %u drawn, %u lost), %.0f/s\n", 
+	       2 * sprt.pairs, sprt.won, sprt.drawn, sprt.lost, 
+	       2 * n / secs);
+	printf("pairs     %u (%u-%u-%u-%u-%u, from 0 to 2 points)\n", 
+	       sprt.pairs, sprt.penta[0], sprt.penta[1], sprt.penta[2], 
+	       sprt.penta[3], sprt.penta[4]);
+	printf("score     %.4f +- %.4f\n", mean, 1.96 * se);
+	printf("elo       %+.1f [%+.1f, %+.1f] (95%%)\n", 
+	       score_to_elo(mean), score_to_elo(mean - 1.96 * se), 
+	       score_to_elo(mean + 1.96 * se));
+	printf("llr       %.3f [%.3f, %.3f]\n", sprt.llr, sprt.lower, 
+	       sprt.upper);
+
+	switch (sprt.decision) {
+	case ACCEPT_H1:
+		printf("result    H1: %s is %g elo stronger or more "
+		       "(alpha %g)\n", sprt.candidate, sprt.elo1, sprt.alpha);
+		return EXIT_H1;
+
+	case ACCEPT_H0:
+		printf("result    H0: %s is %g elo stronger or less "
+		       "(beta %g)\n", sprt.candidate, sprt.elo0, sprt.beta);
+		return EXIT_H0;
+	}
+
+	printf("result    undecided after %u matches\n", 2 * sprt.pairs);
+
+	return EXIT_UNDECIDED;
+}
+
+static int parse_prob(const char *arg, double *p)
+{
+	char *end;
+
+	*p = strtod(arg, &end);
+	if (*end || *p <= 0 || *p >= 0.5) {
+		log_err("invalid error rate: %s (0-0.5)", arg);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int ac, char *av[])
+{
+	Controller *c;
+	long jobs;
+	char *p;
+	int opt, retv;
+
+	sprt.elo0 = DEFAULT_ELO0;
+	sprt.elo1 = DEFAULT_ELO1;
+	sprt.alpha = DEFAULT_ALPHA;
+	sprt.beta = DEFAULT_BETA;
+	sprt.max_matches = DEFAULT_MAX_MATCHES;
+	sprt.seed = clock_ns();
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	sprt.jobs = jobs > 0 ? jobs : 1;
+
+	for (;;) {
+		opt = getopt_long(ac, av, "0:1:a:b:n:j:s:", long_options, 
+				  NULL);
+		if (opt == -1)
+			break;
+
+		switch (opt) {
+		case '0':
+			sprt.elo0 = strtod(optarg, &p);
+			if (*p) {
+				log_err("invalid elo: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case '1':
+			sprt.elo1 = strtod(optarg, &p);
+			if (*p) {
+				log_err("invalid elo: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 'a':
+			if (parse_prob(optarg, &sprt.alpha) != 0)
+				return 1;
+			break;
+
+		case 'b':
+			if (parse_prob(optarg, &sprt.beta) != 0)
+				return 1;
+			break;
+
+		case 'n':
+			sprt.max_matches = strtoul(optarg, &p, 10);
+			if (*p || !sprt.max_matches || 
+			    sprt.max_matches == UINT32_MAX) {
+				log_err("invalid number of matches: %s", 
+					optarg);
+				return 1;
+			}
+			/* whole pairs */
+			sprt.max_matches += sprt.max_matches & 1;
+			break;
+
+		case 'j':
+			jobs = strtol(optarg, &p, 10);
+			if (*p || jobs < 1 || jobs > 1024) {
+				log_err("invalid number of jobs: %s", optarg);
+				return 1;
+			}
+			sprt.jobs = jobs;
+			break;
+
+		case 's':
+			sprt.seed = strtoull(optarg, &p, 10);
+			if (*p) {
+				log_err("invalid seed: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_LOG_LEVEL:
+			if (log_set_level_name(optarg) != 0)
+				return 1;
+			break;
+
+		case 'h':
+			printf(USAGE_FMT, *av, USAGE_ARGS);
+			return 0;
+
+		case '?':
+			printf("Try `%s --help' for more information\n", 
+			       av[0]);
+			return 1;
+		}
+	}
+
+	if (ac - optind != 2) {
+		printf(USAGE_FMT, *av, USAGE_ARGS);
+		return 1;
+	}
+
+	if (sprt.elo1 <= sprt.elo0) {
+		log_err("elo1 must be more than elo0");
+		return 1;
+	}
+
+	sprt.candidate = av[optind];
+	sprt.baseline = av[optind + 1];
+
+	/* the threads make their own: complain once, here */
+	if (!(c = controller_new(sprt.candidate)))
+		return 1;
+	controller_free(c);
+	if (!(c = controller_new(sprt.baseline)))
+		return 1;
+	controller_free(c);
+
+	log_init();
+	retv = run();
+	log_quit();
+
+	return retv;
+}
@@ -0,0 +1,466 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "bytes.h"
+#include "clock.h"
+#include "log.h"
+#include "net.h"
+#include "relay.h"
+#include "stream.h"
+
+#define OUT_MAX		4096	/* bytes queued for the relay */
+#define IN_MAX		4096
+
+#define VIEW_STATES	64	/* ticks of states kept to play out */
+#define TICK_NS		(GAME_TICK_MS * NSEC_PER_MSEC)
+#define DELAY_NS	(STREAM_DELAY_MS * NSEC_PER_MSEC)
+#define STEP_MAX_NS	(100 * NSEC_PER_MSEC)	/* played out at once */
+#define LERP_MAX	64	/* pixels: moved further, it jumped */
+#define LERP_GAP	8	/* ticks: further apart, don't */
+
+#define NO_TICK		((u32)-1)
+
+enum {
+	STREAM_NONE,
+	STREAM_PUBLISH,
+	STREAM_WATCH,
+};
+
+static struct {
+	int   fd;
+	u8    role;
+	bool  udp;
+
+	/* publishing */
+	GameState last;		/* base of the next state */
+	bool  keyed;		/* the relay has `last' */
+	u8    out[OUT_MAX];
+	u32   out_len;
+
+	/* watching */
+	u8    in[IN_MAX];
+	u32   in_len;
+	StreamDecoder dec;
+	GameState ring[VIEW_STATES];	/* by tick */
+	u32   newest;
+	bool  started;
+	bool  stalled;
+	u64   pos;		/* game time shown (ns since tick 0) */
+	u64   last_ns;
+	u64   hello_at;
+
+	u32   received;
+	u32   lost;		/* UDP states without their key */
+	u32   stalls;		/* times the newest state was shown */
+	u32   skips;		/* times playback jumped ahead */
+} st = { -1 };
+
+/*
+ * Connect a socket of `type' to `addr', which won't block afterwards.
+ */
+static int open_socket(const char *addr, int type)
+{
+	struct sockaddr_in sin;
+	int one = 1;
+
+	if (net_resolve(addr, 1, &sin) != 0)
+		return -1;
+
+	st.fd = socket(AF_INET, type, 0);
+	if (st.fd == -1)
+		goto fail;
+
+	if (connect(st.fd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		goto fail;
+
+	/* states are small, and late if held back */
+	if (type == SOCK_STREAM)
+		setsockopt(st.fd, IPPROTO_TCP, TCP_NODELAY, &one, 
+			   sizeof(one));
+
+	fcntl(st.fd, F_SETFL, fcntl(st.fd, F_GETFL) | O_NONBLOCK);
+
+	return 0;
+
+fail:
+	log_err("stream: %s: %s", addr, strerror(errno));
+	if (st.fd != -1)
+		close(st.fd);
+	st.fd = -1;
+	return -1;
+}
+
+static void send_hello(u8 type)
+{
+	u8 buf[RELAY_HELLO_LEN];
+
+	buf[0] = type;
+	memcpy(buf + 1, RELAY_MAGIC, RELAY_MAGIC_LEN);
+	send(st.fd, buf, sizeof(buf), MSG_NOSIGNAL);
+	st.hello_at = clock_ns();
+}
+
+/*
+ * Send what the relay takes of the queue. Return -1 if it is gone.
+ */
+static int flush(void)
+{
+	ssize_t n;
+
+	while (st.out_len) {
+		n = send(st.fd, st.out, st.out_len, MSG_NOSIGNAL);
+		if (n == -1 && (errno == EAGAIN || errno == EINTR))
+			break;
+		if (n == -1) {
+			log_warn("stream: relay gone: %s", strerror(errno));
+			return -1;
+		}
+
+		st.out_len -= n;
+		memmove(st.out, st.out + n, st.out_len);
+	}
+
+	return 0;
+}
+
+int stream_publish_open(const char *addr)
+{
+	if (st.role != STREAM_NONE) {
+		log_warn("stream: already open");
+		return -1;
+	}
+
+	if (open_socket(addr, SOCK_STREAM) != 0)
+		return -1;
+
+	send_hello('S');
+	st.role = STREAM_PUBLISH;
+	st.keyed = 0;
+	st.out_len = 0;
+
+	log_info("stream: publishing to %s", addr);
+
+	return 0;
+}
+
+int stream_publish(const GameState *s)
+{
+	u8 *p;
+
+	if (st.role != STREAM_PUBLISH)
+		return -1;
+
+	if (flush() != 0)
+		goto gone;
+
+	/* behind: start over from a keyframe once the queue is drained */
+	if (st.out_len + RELAY_MSG_MAX > OUT_MAX)
+		st.keyed = 0;
+	if (!st.keyed && st.out_len)
+		return 0;
+
+	p = st.out + st.out_len;
+	p[0] = st.keyed ? 'D' : 'K';
+	p[1] = delta_encode(st.keyed ? &st.last : NULL, s, p + 2);
+	st.out_len += 2 + p[1];
+
+	st.last = *s;
+	st.keyed = 1;
+
+	if (flush() != 0)
+		goto gone;
+
+	return 0;
+
+gone:
+	st.out_len = 0;
+	stream_close();
+	return -1;
+}
+
+int stream_watch_open(const char *addr, bool udp)
+{
+	u32 i;
+
+	if (st.role != STREAM_NONE) {
+		log_warn("stream: already open");
+		return -1;
+	}
+
+	if (open_socket(addr, udp ? SOCK_DGRAM : SOCK_STREAM) != 0)
+		return -1;
+
+	send_hello('V');
+	st.role = STREAM_WATCH;
+	st.udp = udp;
+	st.in_len = 0;
+	st.dec.have_base = st.started = st.stalled = 0;
+	st.newest = NO_TICK;
+	for (i=0; i<VIEW_STATES; ++i)
+		st.ring[i].tick = NO_TICK;
+	st.received = st.lost = st.stalls = st.skips = 0;
+
+	log_info("stream: watching %s over %s", addr, udp ? "UDP" : "TCP");
+
+	return 0;
+}
+
+/*
+ * Keep state `s' to be played out.
+ */
+static void keep(const GameState *s)
+{
+	u32 i;
+
+	/* a new stream, as the game started over: so does playback */
+	if (st.newest != NO_TICK && s->tick + VIEW_STATES <= st.newest) {
+		for (i=0; i<VIEW_STATES; ++i)
+			st.ring[i].tick = NO_TICK;
+		st.newest = NO_TICK;
+		st.started = 0;
+	}
+
+	st.ring[s->tick % VIEW_STATES] = *s;
+	if (st.newest == NO_TICK || s->tick > st.newest)
+		st.newest = s->tick;
+	++st.received;
+}
+
+int stream_decode(StreamDecoder *d, u8 type, const u8 *p, u32 len,
+		  GameState *s)
+{
+	const GameState *base = NULL;
+
+	switch (type) {
+	case 'B':
+		if (len < 4)
+			return -1;
+		if (!d->have_base || d->base.tick != get_le(p, 4))
+			return 0;
+		p += 4;
+		len -= 4;
+		/* FALLTHROUGH */
+	case 'D':
+		if (!d->have_base)
+			return 0;
+		base = &d->base;
+		/* FALLTHROUGH */
+	case 'K':
+		break;
+
+	default:
+		return -1;
+	}
+
+	if (delta_decode(base, p, len, s) != (int)len)
+		return -1;
+
+	if (type != 'B') {
+		d->base = *s;
+		d->have_base = 1;
+	}
+
+	return 1;
+}
+
+/*
+ * Take the state of message `type', whose `len' bytes are at `p'.
+ */
+static void take_state(u8 type, const u8 *p, u32 len)
+{
+	GameState s;
+
+	switch (stream_decode(&st.dec, type, p, len, &s)) {
+	case 1:
+		keep(&s);
+		break;
+
+	case 0:
+		++st.lost;
+		break;
+
+	default:
+		log_warn("stream: bad '%c' state", type);
+	}
+}
+
+/*
+ * Take the states received. Return -1 if the relay is gone.
+ */
+static int receive(void)
+{
+	u8 buf[RELAY_MSG_MAX];
+	u32 off;
+	ssize_t n;
+
+	if (st.udp) {
+		while ((n = recv(st.fd, buf, sizeof(buf), 0)) > 0)
+			take_state(buf[0], buf + 1, n - 1);
+		return 0;
+	}
+
+	for (;;) {
+		n = recv(st.fd, st.in + st.in_len, IN_MAX - st.in_len, 0);
+		if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+			log_info("stream: the relay closed the stream");
+			return -1;
+		}
+		if (n == -1)
+			return 0;
+		st.in_len += n;
+
+		for (off=0; st.in_len - off >= 2 && 
+			    st.in_len - off >= 2u + st.in[off + 1]; 
+		     off += 2 + st.in[off + 1])
+			take_state(st.in[off], st.in + off + 2, st.in[off + 1]);
+
+		st.in_len -= off;
+		memmove(st.in, st.in + off, st.in_len);
+	}
+}
+
+static s16 lerp(s16 a, s16 b, u64 num, u64 den)
+{
+	if (abs(b - a) > LERP_MAX)
+		return a;
+
+	return a + (s64)(b - a) * (s64)num / (s64)den;
+}
+
+/*
+ * Set `view' to the state at `st.pos', between the ticks around it.
+ */
+static bool interpolate(GameState *view)
+{
+	const GameState *a = NULL, *b = NULL, *g;
+	u32 t = st.pos / TICK_NS, i;
+	u64 num, den;
+	int p;
+
+	for (i=0; i<LERP_GAP && i<=t && !a; ++i) {
+		g = &st.ring[(t - i) % VIEW_STATES];
+		if (g->tick == t - i)
+			a = g;
+	}
+	if (!a)
+		return 0;
+
+	for (i=1; i<=LERP_GAP && !b; ++i) {
+		g = &st.ring[(t + i) % VIEW_STATES];
+		if (g->tick == t + i)
+			b = g;
+	}
+
+	*view = *a;
+
+	if (!b || b->phase != a->phase || b->match != a->match)
+		return 1;
+
+	num = st.pos - (u64)a->tick * TICK_NS;
+	den = (u64)(b->tick - a->tick) * TICK_NS;
+
+	view->ball.x = lerp(a->ball.x, b->ball.x, num, den);
+	view->ball.y = lerp(a->ball.y, b->ball.y, num, den);
+	for (p=0; p<2; ++p)
+		view->paddle[p].pos = lerp(a->paddle[p].pos, 
+					   b->paddle[p].pos, num, den);
+
+	return 1;
+}
+
+int stream_watch(GameState *view)
+{
+	u64 now, newest, elapsed;
+
+	if (st.role != STREAM_WATCH)
+		return -1;
+
+	if (receive() != 0)
+		return -1;
+
+	now = clock_ns();
+	if (st.udp && now - st.hello_at >= RELAY_HELLO_MS * NSEC_PER_MSEC)
+		send_hello('V');
+
+	if (st.newest == NO_TICK)
+		return 0;
+
+	newest = (u64)st.newest * TICK_NS;
+	if (!st.started) {
+		st.pos = newest > DELAY_NS ? newest - DELAY_NS : 0;
+		st.last_ns = now;
+		st.started = 1;
+	}
+
+	elapsed = now - st.last_ns;
+	if (elapsed > STEP_MAX_NS)
+		elapsed = STEP_MAX_NS;
+	st.last_ns = now;
+	st.pos += elapsed;
+
+	/*
+	 * Stay STREAM_DELAY_MS behind the newest state: catch up a little
+	 * faster when further behind, jump when far behind, and hold when
+	 * nothing newer came.
+	 */
+	if (st.pos + VIEW_STATES / 2 * TICK_NS < newest) {
+		st.pos = newest - DELAY_NS;
+		++st.skips;
+	} else if (st.pos + 2 * DELAY_NS < newest) {
+		st.pos += elapsed / 8;
+	}
+
+	if (st.pos >= newest) {
+		st.pos = newest;
+		if (!st.stalled)
+			++st.stalls;
+		st.stalled = 1;
+	} else {
+		st.stalled = 0;
+	}
+
+	return interpolate(view);
+}
+
+void stream_close(void)
+{
+	u8 bye = 'Q';
+
+	if (st.role == STREAM_NONE)
+		return;
+
+	if (st.role == STREAM_PUBLISH) {
+		flush();
+	} else {
+		if (st.udp)
+			send(st.fd, &bye, 1, MSG_NOSIGNAL);
+		log_info("stream: %u states received, %u lost, %u stalls, "
+			 "%u skips", st.received, st.lost, st.stalls, 
+			 st.skips);
+	}
+
+	close(st.fd);
+	st.fd = -1;
+	st.role = STREAM_NONE;
+}
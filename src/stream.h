@@ -0,0 +1,78 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "common.h"
+#include "game.h"
+
+/*
+ * This side of a spectator stream (see relay.h): publishing the game's
+ * states to a relay, or watching them from one. Only one at a time.
+ */
+
+#define STREAM_DELAY_MS		100
+
+/*
+ * A stream being decoded: what its next state may be coded against.
+ */
+typedef struct {
+	GameState base;		/* TCP: the previous state, UDP: the key */
+	bool      have_base;
+} StreamDecoder;
+
+/*
+ * Connect to the relay at `addr' (HOST:PORT) to publish states.
+ */
+int  stream_publish_open (const char *addr);
+
+/*
+ * Send state `s' to the relay, without blocking. States which do not
+ * fit while the relay is slow to read are dropped, and the stream
+ * starts over from a keyframe. Return -1 once the relay is gone.
+ */
+int  stream_publish      (const GameState *s);
+
+/*
+ * Connect to the relay at `addr' (HOST:PORT), over TCP or with `udp'
+ * set over UDP, to watch the states published there.
+ */
+int  stream_watch_open   (const char *addr, bool udp);
+
+/*
+ * Take the states received, and set `view' to the one to show now:
+ * played out STREAM_DELAY_MS behind the newest, so that late states
+ * still arrive in time, and interpolated between ticks. Return 1 if
+ * `view' was set, 0 while buffering, or -1 once the relay is gone.
+ */
+int  stream_watch        (GameState *view);
+
+/*
+ * Decode into `s' the state of message `type', whose `len' bytes are at
+ * `p'. Return 1 if it was decoded, 0 if the state it is coded against
+ * is missing, or -1 if it is not a state.
+ */
+int  stream_decode       (StreamDecoder *d, u8 type, const u8 *p, u32 len,
+			  GameState *s);
+
+/*
+ * Close the stream, and report how playback went.
+ */
+void stream_close        (void);
+
+#endif /* !STREAM_H */
@@ -0,0 +1,267 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "clock.h"
+#include "log.h"
+#include "telemetry.h"
+
+#define BATCH_RALLIES	256
+#define BATCH_HITS	(16 * TELEMETRY_HITS_MAX)
+
+typedef struct {
+	u8 player;
+	s8 vx, vy;
+} Hit;
+
+typedef struct {
+	u32 match;
+	u32 rally;
+	u32 start_tick;
+	u32 ticks;
+	u32 ms;
+	u32 hits;	/* may exceed the stored ones */
+	u32 first_hit;	/* in Batch.hit */
+	u8  scorer;
+} Rally;
+
+/*
+ * A batch of rallies, their hits in an array of their own: a rally
+ * points at its first one.
+ */
+typedef struct {
+	Rally rally[BATCH_RALLIES];
+	Hit   hit[BATCH_HITS];
+	u32   nrallies;
+	u32   nhits;
+} Batch;
+
+static struct {
+	bool   enabled;
+	FILE  *fp;
+
+	Batch  batch[2];
+	Batch *cur;		/* filled by the game */
+	Batch *full;		/* being written, or NULL */
+
+	pthread_t        thread;
+	pthread_mutex_t  lock;
+	pthread_cond_t   cond;
+	bool             stop;
+
+	/* rally in progress */
+	bool   in_rally;
+	Rally  rally;
+	u64    start_ns;
+
+	u32    nrallies;	/* rallies since telemetry_open() */
+	u64    written;
+	u64    dropped;		/* the writer fell behind */
+} tel;
+
+static void write_batch(Batch *b)
+{
+	const Rally *r;
+	const Hit *h;
+	u32 i, j, n;
+
+	for (i=0; i<b->nrallies; ++i) {
+		r = &b->rally[i];
+		fprintf(tel.fp, "%u,%u,%u,%u,%u,%u,%u,", r->match, r->rally,
+			r->start_tick, r->ticks, r->ms, r->hits, r->scorer);
+
+		n = r->hits < TELEMETRY_HITS_MAX ? r->hits : TELEMETRY_HITS_MAX;
+		for (j=0; j<n; ++j) {
+			h = &b->hit[r->first_hit + j];
+			fprintf(tel.fp, "%s%u:%d:%d", j ? " " : "", h->player,
+				h->vx, h->vy);
+		}
+
+		fputc('\n', tel.fp);
+	}
+
+	fflush(tel.fp);
+	tel.written += b->nrallies;
+
+	b->nrallies = b->nhits = 0;
+}
+
+static void *writer(void *unused)
+{
+	Batch *b;
+	bool stop;
+
+	for (;;) {
+		pthread_mutex_lock(&tel.lock);
+		while (!tel.full && !tel.stop)
+			pthread_cond_wait(&tel.cond, &tel.lock);
+		b = tel.full;
+		stop = tel.stop;
+		pthread_mutex_unlock(&tel.lock);
+
+		if (!b && stop)
+			break;
+
+		write_batch(b);
+
+		pthread_mutex_lock(&tel.lock);
+		tel.full = NULL;
+		pthread_mutex_unlock(&tel.lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Hand the current batch to the writer. If it is still busy with the
+ * other one, the current batch is dropped instead of waiting.
+ */
+static void rotate(void)
+{
+	pthread_mutex_lock(&tel.lock);
+
+	if (tel.full) {
+		tel.dropped += tel.cur->nrallies;
+		tel.cur->nrallies = tel.cur->nhits = 0;
+	}
+	else {
+		tel.full = tel.cur;
+		tel.cur = tel.cur == &tel.batch[0] ? &tel.batch[1] 
+						   : &tel.batch[0];
+		pthread_cond_signal(&tel.cond);
+	}
+
+	pthread_mutex_unlock(&tel.lock);
+}
+
+int telemetry_open(const char *path)
+{
+	if (tel.enabled) {
+		log_warn("telemetry: already open");
+		return 1;
+	}
+
+	memset(&tel, 0, sizeof(tel));
+
+	tel.fp = fopen(path, "w");
+	if (!tel.fp) {
+		log_err("telemetry: could not open `%s': %s", path, 
+			strerror(errno));
+		return -1;
+	}
+
+	fputs("match,rally,start_tick,ticks,ms,hits,scorer,vectors\n", 
+	      tel.fp);
+
+	pthread_mutex_init(&tel.lock, NULL);
+	pthread_cond_init(&tel.cond, NULL);
+
+	if (pthread_create(&tel.thread, NULL, writer, NULL) != 0) {
+		log_err("telemetry: could not start writer");
+		fclose(tel.fp);
+		return -1;
+	}
+
+	tel.cur = &tel.batch[0];
+	tel.enabled = 1;
+
+	return 0;
+}
+
+void telemetry_close(void)
+{
+	if (!tel.enabled)
+		return;
+
+	tel.enabled = 0;
+
+	pthread_mutex_lock(&tel.lock);
+	tel.stop = 1;
+	pthread_cond_signal(&tel.cond);
+	pthread_mutex_unlock(&tel.lock);
+
+	pthread_join(tel.thread, NULL);
+
+	write_batch(tel.cur);
+	fclose(tel.fp);
+
+	pthread_mutex_destroy(&tel.lock);
+	pthread_cond_destroy(&tel.cond);
+
+	log_info("telemetry: %llu rallies written, %llu dropped",
+		 (unsigned long long)tel.written, 
+		 (unsigned long long)tel.dropped);
+}
+
+void telemetry_rally_start(u32 match, u32 tick)
+{
+	if (!tel.enabled)
+		return;
+
+	/* the rally must fit in the current batch */
+	if (tel.cur->nrallies == BATCH_RALLIES ||
+	    tel.cur->nhits + TELEMETRY_HITS_MAX > BATCH_HITS)
+		rotate();
+
+	tel.in_rally = 1;
+	tel.rally.match = match;
+	tel.rally.rally = ++tel.nrallies;
+	tel.rally.start_tick = tick;
+	tel.rally.hits = 0;
+	tel.rally.first_hit = tel.cur->nhits;
+	tel.start_ns = clock_ns();
+}
+
+void telemetry_hit(u8 player, s8 vx, s8 vy)
+{
+	Hit *h;
+
+	if (!tel.in_rally)
+		return;
+
+	if (tel.rally.hits < TELEMETRY_HITS_MAX) {
+		h = &tel.cur->hit[tel.rally.first_hit + tel.rally.hits];
+		h->player = player;
+		h->vx = vx;
+		h->vy = vy;
+	}
+
+	++tel.rally.hits;
+}
+
+void telemetry_rally_end(u32 tick, u8 scorer)
+{
+	Rally *r;
+
+	if (!tel.in_rally)
+		return;
+
+	tel.in_rally = 0;
+
+	tel.rally.ticks = tick - tel.rally.start_tick;
+	tel.rally.ms = (clock_ns() - tel.start_ns) / NSEC_PER_MSEC;
+	tel.rally.scorer = scorer;
+
+	r = &tel.cur->rally[tel.cur->nrallies++];
+	*r = tel.rally;
+
+	tel.cur->nhits += r->hits < TELEMETRY_HITS_MAX ? r->hits 
+						       : TELEMETRY_HITS_MAX;
+}
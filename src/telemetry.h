@@ -0,0 +1,47 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "common.h"
+
+/*
+ * Record every rally to the CSV file `path'. Rallies are collected in a
+ * preallocated buffer and written in batches by a background thread;
+ * telemetry_close() writes what is left and stops it.
+ *
+ * Columns: match, rally, start_tick, ticks, ms, hits, scorer (1 or 2,
+ * or 0 if the match was restarted during the rally) and the ball vector
+ * after each paddle hit, as space separated "player:x:y" triples (at
+ * most TELEMETRY_HITS_MAX per rally).
+ */
+int  telemetry_open  (const char *path);
+void telemetry_close (void);
+
+#define TELEMETRY_HITS_MAX	256
+
+/*
+ * Rally events, cheap enough for the game loop. They do nothing unless
+ * telemetry is open. A rally still running at telemetry_close() is lost.
+ * Restarting the match ends it with scorer 0.
+ */
+void telemetry_rally_start (u32 match, u32 tick);
+void telemetry_hit         (u8 player, s8 vx, s8 vy);
+void telemetry_rally_end   (u32 tick, u8 scorer);
+
+#endif /* !TELEMETRY_H */
@@ -28,8 +28,10 @@
 # include <alloca.h>
 #endif
 
+#include <SDL_mutex.h>
 #include <SDL_ttf.h>
 
+#include "mem.h"
 #include "sprite_impl.h"
 #include "text.h"
 
@@ -39,14 +41,28 @@ struct _Text {
 	u32            color;
 };
 
+/*
+ * SDL_ttf is not thread-safe: calls into it are serialized.
+ */
+static SDL_mutex *ttf_lock;
+
+#define TTF_LOCKED(STMT) do {						\
+	SDL_mutexP(ttf_lock);						\
+	STMT;								\
+	SDL_mutexV(ttf_lock);						\
+} while (0)
+
 INLINE_METHOD static void text_free(Text *self)
 {
-	TTF_CloseFont(self->font);
+	TTF_LOCKED(TTF_CloseFont(self->font));
 	sprite_free(SPRITE(self));
 }
 
 int ttf_init(void)
 {
+	if (!ttf_lock)
+		ttf_lock = SDL_CreateMutex();
+
 	if (!TTF_WasInit()) {
 		if (TTF_Init() != 0) {
 			log_err("could not inizialize TTF subsystem: %s",
@@ -61,19 +77,38 @@ int ttf_init(void)
 INLINE void ttf_quit(void)
 {
 	TTF_Quit();
+
+	SDL_DestroyMutex(ttf_lock);
+	ttf_lock = NULL;
 }
 
-Text *text_new(const char *fnt, int ptsz, u32 color)
+TTF_Font *ttf_open_font(const char *path, int ptsz)
 {
-	Sprite *parent;
-	Text *self;
 	TTF_Font *font;
 
-	font = TTF_OpenFont(fnt, ptsz);
-	if (!font) {
+	TTF_LOCKED(font = TTF_OpenFont(path, ptsz));
+	if (!font)
 		log_err("could not load given font: %s", SDL_GetError());
-		return NULL;
-	}
+
+	return font;
+}
+
+TTF_Font *ttf_open_font_mem(const void *data, u32 size, int ptsz)
+{
+	TTF_Font *font;
+
+	TTF_LOCKED(font = TTF_OpenFontRW(SDL_RWFromConstMem(data, size), 1, 
+					 ptsz));
+	if (!font)
+		log_err("could not load given font: %s", SDL_GetError());
+
+	return font;
+}
+
+Text *text_new_with_font(TTF_Font *font, u32 color)
+{
+	Sprite *parent;
+	Text *self;
 
 	parent = sprite_new(0, 0);
 	self = realloc(parent, sizeof(Text));
@@ -86,6 +121,28 @@ Text *text_new(const char *fnt, int ptsz, u32 color)
 	return self;
 }
 
+Text *text_new(const char *fnt, int ptsz, u32 color)
+{
+	TTF_Font *font;
+
+	font = ttf_open_font(fnt, ptsz);
+	if (!font)
+		return NULL;
+
+	return text_new_with_font(font, color);
+}
+
+Text *text_new_from_mem(const void *data, u32 size, int ptsz, u32 color)
+{
+	TTF_Font *font;
+
+	font = ttf_open_font_mem(data, size, ptsz);
+	if (!font)
+		return NULL;
+
+	return text_new_with_font(font, color);
+}
+
 int text_set_text(Text *self, const char *fmt, ...)
 {
 	va_list ap;
@@ -111,6 +168,8 @@ int text_set_text(Text *self, const char *fmt, ...)
 	color.g = (self->color >> 8) & 0xff;
 	color.b = self->color & 0xff;
 
+	SDL_mutexP(ttf_lock);
+
 	tmp = TTF_RenderText_Blended(self->font, buf, color);
 
 #if !HAVE_ALLOCA
@@ -121,14 +180,21 @@ int text_set_text(Text *self, const char *fmt, ...)
 	SDL_FreeSurface(tmp);
 
 	if (!surface) {
+		SDL_mutexV(ttf_lock);
 		log_err("could not create surface: %s", SDL_GetError());
 		return errno ? -errno : -1;
 	}
 
-	if (SPRITE(self)->surface)
+	/* surface accounting is not atomic either */
+	if (SPRITE(self)->surface) {
+		mem_surface_track(-SURFACE_BYTES(SPRITE(self)->surface));
 		SDL_FreeSurface(SPRITE(self)->surface);
+	}
 
 	SPRITE(self)->surface = surface;
+	mem_surface_track(SURFACE_BYTES(surface));
+
+	SDL_mutexV(ttf_lock);
 
 	layer_set_width(self, surface->w);
 	layer_set_height(self, surface->h);
@@ -27,6 +27,8 @@
 #ifndef TEXT_H
 #define TEXT_H
 
+#include <SDL_ttf.h>
+
 #include "sprite.h"
 
 typedef struct _Text Text;
@@ -34,7 +36,17 @@ typedef struct _Text Text;
 int  ttf_init(void);
 void ttf_quit(void);
 
-Text *text_new (const char *font_path, int ptsz, u32 fg_color);
+/*
+ * Parse a font without creating any surface, so it can be done off the
+ * main thread; the result is handed to text_new_with_font().
+ */
+TTF_Font *ttf_open_font     (const char *path, int ptsz);
+TTF_Font *ttf_open_font_mem (const void *data, u32 size, int ptsz);
+
+Text *text_new           (const char *font_path, int ptsz, u32 fg_color);
+Text *text_new_from_mem  (const void *font_data, u32 size, int ptsz,
+			  u32 fg_color);
+Text *text_new_with_font (TTF_Font *font, u32 fg_color); /* takes `font' */
 
 CHECK_FMT2 int text_set_text  (Text *self, const char *fmt, ...);
 
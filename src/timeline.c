@@ -0,0 +1,161 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL_thread.h>
+
+#include "clock.h"
+#include "timeline.h"
+
+#define SPAN_MAX	32
+#define BAR_WIDTH	40
+
+#define MS(NS)	((double)(NS) / NSEC_PER_MSEC)
+
+typedef struct {
+	const char *what;
+	u64   start;
+	u64   end;
+	bool  main;	/* recorded by the thread which called timeline_init() */
+} Span;
+
+static struct {
+	bool   enabled;
+	u64    t0;
+	Uint32 main_thread;
+
+	Span   span[SPAN_MAX];
+	u32    nspans;
+} tl;
+
+void timeline_init(void)
+{
+	memset(&tl, 0, sizeof(tl));
+	tl.main_thread = SDL_ThreadID();
+	tl.t0 = clock_ns();
+	tl.enabled = 1;
+}
+
+int timeline_begin(const char *what)
+{
+	u32 i;
+
+	if (!tl.enabled)
+		return -1;
+
+	i = __atomic_fetch_add(&tl.nspans, 1, __ATOMIC_RELAXED);
+	if (i >= SPAN_MAX)
+		return -1;
+
+	tl.span[i].what = what;
+	tl.span[i].main = SDL_ThreadID() == tl.main_thread;
+	tl.span[i].start = clock_ns();
+	tl.span[i].end = 0;
+
+	return i;
+}
+
+void timeline_end(int span)
+{
+	if (span >= 0)
+		tl.span[span].end = clock_ns();
+}
+
+void timeline_mark(const char *what)
+{
+	timeline_end(timeline_begin(what));
+}
+
+static int cmp_span(const void *a, const void *b)
+{
+	const Span *x = a, *y = b;
+
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static void print_bar(const Span *s, u64 total)
+{
+	int from, to, i;
+
+	from = (s->start - tl.t0) * BAR_WIDTH / total;
+	to = (s->end - tl.t0) * BAR_WIDTH / total;
+
+	putchar('|');
+	for (i=0; i<BAR_WIDTH; ++i)
+		putchar(i < from || i > to ? ' ' : 
+			s->end == s->start ? '^' : s->main ? '#' : '=');
+	puts("|");
+}
+
+/*
+ * Spans are joined with the threads which recorded them before this
+ * runs, so plain reads are enough here.
+ */
+void timeline_quit(void)
+{
+	u64 last, ready, on_main, off_main;
+	u32 n, i;
+	Span *s;
+
+	if (!tl.enabled)
+		return;
+
+	tl.enabled = 0;
+
+	n = tl.nspans < SPAN_MAX ? tl.nspans : SPAN_MAX;
+	if (!n)
+		return;
+
+	qsort(tl.span, n, sizeof(*tl.span), cmp_span);
+
+	for (i=0, last=tl.t0, on_main=off_main=0; i<n; ++i) {
+		s = &tl.span[i];
+		if (!s->end)	/* never closed */
+			s->end = s->start;
+
+		if (s->end > last)
+			last = s->end;
+
+		if (s->main)
+			on_main += s->end - s->start;
+		else
+			off_main += s->end - s->start;
+	}
+
+	ready = last - tl.t0;
+
+	printf("\nstartup timeline (ms, `#' main thread, `=' background, "
+	       "`^' instant)\n");
+	printf("%-16s %8s %8s\n", "what", "start", "length");
+
+	for (i=0; i<n; ++i) {
+		s = &tl.span[i];
+		printf("%-16s %8.2f %8.2f  ", s->what, MS(s->start - tl.t0), 
+		       MS(s->end - s->start));
+		print_bar(s, ready ? ready : 1);
+	}
+
+	printf("ready after %.2f ms: %.2f ms of work on the main thread, "
+	       "%.2f ms in background\n\n", MS(ready), MS(on_main), 
+	       MS(off_main));
+}
@@ -0,0 +1,42 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include "common.h"
+
+/*
+ * Enable recording of the startup timeline; times are reported relative
+ * to this call. timeline_quit() prints the report on stdout.
+ */
+void timeline_init (void);
+void timeline_quit (void);
+
+/*
+ * Open a span named `what' (a string literal) on the calling thread and
+ * return its handle, or -1 if recording is off. Any thread may record.
+ */
+int  timeline_begin (const char *what);
+void timeline_end   (int span);
+
+/*
+ * Record an instant, e.g. the first frame shown.
+ */
+void timeline_mark  (const char *what);
+
+#endif /* !TIMELINE_H */
@@ -0,0 +1,597 @@
+/* $Id$
+ *
+ * Copyright (c) 2009 Sergio Perticone <g4ll0ws@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * gnop-tune: tune the AI's parameters (see ai.h) by self-play.
+ *
+ * Candidates play headless matches against a fixed opponent, the
+ * default AI or a preset, and are scored by their share of the points:
+ * the closer to the target share, the better. A target of 1 makes the
+ * strongest AI the search can find; lower ones make easier presets.
+ *
+ * The search is CMA-ES: each generation samples candidates from a
+ * multivariate normal distribution over the parameters, scaled to
+ * [0, 1], and moves its mean and reshapes its covariance towards the
+ * better half. Candidates are played on all CPUs at once, every one of
+ * a generation on the same seeds.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "clock.h"
+#include "log.h"
+
+#define N		AI_PARAMS_NO
+#define LAMBDA_MAX	64
+
+#define DEFAULT_GENERATIONS	30
+#define DEFAULT_POINTS		200
+#define DEFAULT_SIGMA		0.2
+
+#define RALLY_TICKS	5000	/* a hundred returns, or so */
+
+#define USAGE_FMT	\
+	"Usage: %s [OPTION]... FILE\n"					\
+	"Tune the AI by self-play, and save the preset found to FILE.\n\n"\
+	"  -g, --generations=N\t search for N generations (default: %d)\n"\
+	"  -p, --points=N\t play N points per candidate (default: %d)\n"	\
+	"  -t, --target=SHARE\t aim for SHARE of the points, 0 to 1\n"	\
+	"                    \t (default: 1, the strongest)\n"		\
+	"  -a, --against=FILE\t play against the preset FILE (default:\n"	\
+	"                    \t the default AI)\n"				\
+	"  -l, --lambda=N\t sample N candidates a generation (default:\n"	\
+	"                \t %d)\n"						\
+	"  -j, --jobs=N\t\t play on N threads (default: one per CPU)\n"	\
+	"  -s, --seed=N\t\t seed the search and the matches\n"		\
+	LOG_LEVEL_USAGE							\
+	"  --help\t\t display this help and exit\n"
+
+enum {
+	OPT_LOG_LEVEL = 256,
+};
+
+static struct option long_options[] = {
+	{ "generations", required_argument, NULL, 'g' },
+	{ "points", required_argument, NULL, 'p' },
+	{ "target", required_argument, NULL, 't' },
+	{ "against", required_argument, NULL, 'a' },
+	{ "lambda", required_argument, NULL, 'l' },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "seed", required_argument, NULL, 's' },
+	{ "log-level", required_argument, NULL, OPT_LOG_LEVEL },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL },
+};
+
+/*
+ * The range searched for each parameter, in ai_param[]'s order.
+ */
+static const s16 range[N][2] = {
+	{ 0, GAME_HEIGHT / 2 },			/* rest_top */
+	{ GAME_HEIGHT / 2, GAME_HEIGHT },	/* rest_bottom */
+	{ 0, GAME_WIDTH },			/* engage_x */
+	{ 0, GAME_WIDTH },			/* fast_x */
+	{ 0, GAME_BALL_SPEED + 1 },		/* fast_vx */
+	{ 0, GAME_PADDLE_HEIGHT / 2 },		/* deadzone */
+};
+
+typedef struct {
+	double   x[N];		/* sampled, in [0, 1] if all goes well */
+	double   y[N];		/* (x - mean) / sigma */
+	AiParams ai;
+	double   share;		/* of the points won */
+	double   fitness;	/* lower is better */
+} Candidate;
+
+static struct {
+	/* options */
+	u32      generations, points, lambda, jobs;
+	double   target;
+	u64      seed;
+	AiParams against;
+
+	/* the distribution */
+	double   mean[N], sigma;
+	double   C[N][N], B[N][N], D[N];
+	double   pc[N], ps[N];
+	double   weights[LAMBDA_MAX];
+	u32      mu;
+	double   mueff, cc, cs, c1, cmu, damps, chin;
+
+	Candidate cand[LAMBDA_MAX];
+	u32      next;		/* candidate to play next */
+	u64      match_seed;	/* of the generation */
+	u64      rng;
+} tune;
+
+/*
+ * splitmix64.
+ */
+static u64 next_rand(void)
+{
+	u64 z = (tune.rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+/*
+ * A standard normal deviate (Box-Muller).
+ */
+static double gauss(void)
+{
+	double u = ((next_rand() >> 11) + 1.0) / 9007199254740993.0;
+	double v = (next_rand() >> 11) / 9007199254740992.0;
+
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void to_params(const double x[N], AiParams *a)
+{
+	double t;
+	int i;
+
+	for (i=0; i<N; ++i) {
+		t = x[i] < 0 ? 0 : x[i] > 1 ? 1 : x[i];
+		AI_PARAM(a, i) = lround(range[i][0] + 
+					t * (range[i][1] - range[i][0]));
+	}
+}
+
+static void from_params(const AiParams *a, double x[N])
+{
+	int i;
+
+	for (i=0; i<N; ++i)
+		x[i] = (double)(AI_PARAM(a, i) - range[i][0]) / 
+		       (range[i][1] - range[i][0]);
+}
+
+/*
+ * Play `a' against the opponent for the points asked, on either side
+ * half of the time, and return the share of the points it won. Some
+ * pairs rally forever: a rally that goes on too long is a draw, worth
+ * half a point to each, and play restarts.
+ */
+static double play(const AiParams *a, u32 points, u64 seed)
+{
+	static const u8 none[2], restart[2] = { GAME_INPUT_RESTART };
+	GameState s;
+	u32 won = 0, drawn = 0, played = 0, rally = 0, ev;
+	int side;
+
+	for (side=0; side<2; ++side) {
+		if (side)
+			ai_use(&tune.against, a);
+		else
+			ai_use(a, &tune.against);
+
+		game_init(&s, seed + side);
+		s.cpu = 1 << 0 | 1 << 1;
+
+		while (played < points * (side + 1) / 2) {
+			if (++rally < RALLY_TICKS)
+				ev = game_step(&s, none);
+			else {
+				ev = game_step(&s, restart);
+				++drawn;
+				++played;
+			}
+
+			if (ev & (GAME_EVENT_SERVE | GAME_EVENT_MATCH))
+				rally = 0;
+			if (ev & (GAME_EVENT_POINT_1 << side))
+				++won;
+			if (ev & (GAME_EVENT_POINT_1 | GAME_EVENT_POINT_2))
+				++played;
+		}
+	}
+
+	return (won + drawn / 2.0) / played;
+}
+
+static void *play_candidates(void *unused)
+{
+	Candidate *c;
+	u32 i;
+
+	while ((i = __atomic_fetch_add(&tune.next, 1, __ATOMIC_RELAXED)) < 
+	       tune.lambda) {
+		c = &tune.cand[i];
+		c->share = play(&c->ai, tune.points, tune.match_seed);
+		c->fitness = fabs(c->share - tune.target);
+	}
+
+	return NULL;
+}
+
+/*
+ * Play every candidate of the generation on all threads.
+ */
+static void play_generation(void)
+{
+	pthread_t thread[tune.jobs];
+	u32 i, started = 0;
+
+	tune.next = 0;
+	tune.match_seed = next_rand();
+
+	for (i=1; i<tune.jobs; ++i)
+		if (pthread_create(&thread[started], NULL, play_candidates,
+				   NULL) == 0)
+			++started;
+
+	play_candidates(NULL);
+
+	for (i=0; i<started; ++i)
+		pthread_join(thread[i], NULL);
+}
+
+/*
+ * Set B and D to the eigenvectors and the square roots of the
+ * eigenvalues of C, with Jacobi rotations.
+ */
+static void eigen(void)
+{
+	double a[N][N], v[N][N], theta, t, c, s, x, y;
+	int i, j, k, sweep;
+
+	memcpy(a, tune.C, sizeof(a));
+	for (i=0; i<N; ++i)
+		for (j=0; j<N; ++j)
+			v[i][j] = i == j;
+
+	for (sweep=0; sweep<50; ++sweep) {
+		for (t=0, i=0; i<N; ++i)
+			for (j=i+1; j<N; ++j)
+				t += fabs(a[i][j]);
+		if (t < 1e-20)
+			break;
+
+		for (i=0; i<N; ++i)
+			for (j=i+1; j<N; ++j) {
+				if (fabs(a[i][j]) < 1e-30)
+					continue;
+
+				theta = (a[j][j] - a[i][i]) / (2 * a[i][j]);
+				t = (theta >= 0 ? 1 : -1) / 
+				    (fabs(theta) + sqrt(theta * theta + 1));
+				c = 1 / sqrt(t * t + 1);
+				s = t * c;
+
+				for (k=0; k<N; ++k) {
+					x = a[k][i];
+					y = a[k][j];
+					a[k][i] = c * x - s * y;
+					a[k][j] = s * x + c * y;
+				}
+				for (k=0; k<N; ++k) {
+					x = a[i][k];
+					y = a[j][k];
+					a[i][k] = c * x - s * y;
+					a[j][k] = s * x + c * y;
+				}
+				for (k=0; k<N; ++k) {
+					x = v[k][i];
+					y = v[k][j];
+					v[k][i] = c * x - s * y;
+					v[k][j] = s * x + c * y;
+				}
+			}
+	}
+
+	memcpy(tune.B, v, sizeof(v));
+	for (i=0; i<N; ++i)
+		tune.D[i] = sqrt(a[i][i] > 1e-20 ? a[i][i] : 1e-20);
+}
+
+/*
+ * Start the search at `start', with the usual CMA-ES constants.
+ */
+static void init_search(const double start[N])
+{
+	double sum = 0, sum2 = 0;
+	u32 i;
+
+	memcpy(tune.mean, start, sizeof(tune.mean));
+	tune.sigma = DEFAULT_SIGMA;
+	memset(tune.C, 0, sizeof(tune.C));
+	for (i=0; i<N; ++i)
+		tune.C[i][i] = 1;
+	eigen();
+
+	tune.mu = tune.lambda / 2;
+	for (i=0; i<tune.mu; ++i) {
+		tune.weights[i] = log(tune.mu + 0.5) - log(i + 1);
+		sum += tune.weights[i];
+	}
+	for (i=0; i<tune.mu; ++i) {
+		tune.weights[i] /= sum;
+		sum2 += tune.weights[i] * tune.weights[i];
+	}
+	tune.mueff = 1 / sum2;
+
+	tune.cc = (4 + tune.mueff / N) / (N + 4 + 2 * tune.mueff / N);
+	tune.cs = (tune.mueff + 2) / (N + tune.mueff + 5);
+	tune.c1 = 2 / ((N + 1.3) * (N + 1.3) + tune.mueff);
+	tune.cmu = 2 * (tune.mueff - 2 + 1 / tune.mueff) / 
+		   ((N + 2) * (N + 2) + tune.mueff);
+	if (tune.cmu > 1 - tune.c1)
+		tune.cmu = 1 - tune.c1;
+	tune.damps = 1 + tune.cs + 2 * fmax(0, sqrt((tune.mueff - 1) / 
+						    (N + 1)) - 1);
+	tune.chin = sqrt(N) * (1 - 1.0 / (4 * N) + 1.0 / (21 * N * N));
+}
+
+static void sample(void)
+{
+	double z[N];
+	Candidate *c;
+	u32 k, i, j;
+
+	for (k=0; k<tune.lambda; ++k) {
+		c = &tune.cand[k];
+
+		for (i=0; i<N; ++i)
+			z[i] = tune.D[i] * gauss();
+		for (i=0; i<N; ++i) {
+			for (c->y[i]=0, j=0; j<N; ++j)
+				c->y[i] += tune.B[i][j] * z[j];
+			c->x[i] = tune.mean[i] + tune.sigma * c->y[i];
+		}
+
+		to_params(c->x, &c->ai);
+	}
+}
+
+static int by_fitness(const void *a, const void *b)
+{
+	const Candidate *x = a, *y = b;
+
+	return x->fitness < y->fitness ? -1 : x->fitness > y->fitness;
+}
+
+/*
+ * Move the distribution towards the better half of the generation
+ * `gen'.
+ */
+static void update(u32 gen)
+{
+	double yw[N], t[N], invsqrt_yw[N], norm = 0, hsig;
+	u32 i, j, k;
+
+	qsort(tune.cand, tune.lambda, sizeof(*tune.cand), by_fitness);
+
+	for (i=0; i<N; ++i) {
+		for (yw[i]=0, k=0; k<tune.mu; ++k)
+			yw[i] += tune.weights[k] * tune.cand[k].y[i];
+		tune.mean[i] += tune.sigma * yw[i];
+	}
+
+	/* C^-1/2 yw = B D^-1 B' yw */
+	for (i=0; i<N; ++i) {
+		for (t[i]=0, j=0; j<N; ++j)
+			t[i] += tune.B[j][i] * yw[j];
+		t[i] /= tune.D[i];
+	}
+	for (i=0; i<N; ++i)
+		for (invsqrt_yw[i]=0, j=0; j<N; ++j)
+			invsqrt_yw[i] += tune.B[i][j] * t[j];
+
+	for (i=0; i<N; ++i) {
+		tune.ps[i] = (1 - tune.cs) * tune.ps[i] + 
+			     sqrt(tune.cs * (2 - tune.cs) * tune.mueff) * 
+			     invsqrt_yw[i];
+		norm += tune.ps[i] * tune.ps[i];
+	}
+	norm = sqrt(norm);
+
+	hsig = norm / sqrt(1 - pow(1 - tune.cs, 2 * (gen + 1))) / tune.chin
+	       < 1.4 + 2.0 / (N + 1);
+
+	for (i=0; i<N; ++i)
+		tune.pc[i] = (1 - tune.cc) * tune.pc[i] + hsig * 
+			     sqrt(tune.cc * (2 - tune.cc) * tune.mueff) * yw[i];
+
+	for (i=0; i<N; ++i)
+		for (j=0; j<N; ++j) {
+			double rank_mu = 0;
+
+			for (k=0; k<tune.mu; ++k)
+				rank_mu += tune.weights[k] * 
+					   tune.cand[k].y[i] * 
+					   tune.cand[k].y[j];
+
+			tune.C[i][j] = (1 - tune.c1 - tune.cmu) * tune.C[i][j]
+				+ tune.c1 * (tune.pc[i] * tune.pc[j] + 
+					     (1 - hsig) * tune.cc * 
+					     (2 - tune.cc) * tune.C[i][j])
+				+ tune.cmu * rank_mu;
+		}
+
+	tune.sigma *= exp(tune.cs / tune.damps * (norm / tune.chin - 1));
+	eigen();
+}
+
+static void print_params(const char *what, const AiParams *a)
+{
+	log_info("%s: rest %d-%d, engage at %d, or %d below speed %d, "
+		 "deadzone %d", what, a->rest_top, a->rest_bottom, 
+		 a->engage_x, a->fast_x, a->fast_vx, a->deadzone);
+}
+
+static int run(const char *path)
+{
+	double start[N], share;
+	char note[128];
+	AiParams best;
+	u32 gen;
+	u64 t;
+
+	from_params(&ai_default, start);
+	init_search(start);
+
+	log_info("tune: %u generations of %u candidates, %u points each, "
+		 "on %u threads, for a %.2f share", tune.generations, 
+		 tune.lambda, tune.points, tune.jobs, tune.target);
+
+	for (gen=0; gen<tune.generations; ++gen) {
+		t = clock_ns();
+		sample();
+		play_generation();
+		update(gen);
+
+		log_info("tune: generation %u: best share %.3f, worst %.3f, "
+			 "sigma %.3f, %.1f s", gen + 1, 
+			 tune.cand[0].share, tune.cand[tune.lambda - 1].share, 
+			 tune.sigma, (double)(clock_ns() - t) / NSEC_PER_SEC);
+	}
+
+	/* the mean is what the search settled on; score it afresh */
+	to_params(tune.mean, &best);
+	share = play(&best, tune.points * 4, next_rand());
+	print_params("tune: found", &best);
+	log_info("tune: won %.3f of %u points against the opponent", share,
+		 tune.points * 4);
+
+	snprintf(note, sizeof(note), "won %.3f of %u points, aiming for "
+		 "%.2f", share, tune.points * 4, tune.target);
+
+	return ai_save(path, &best, note);
+}
+
+int main(int ac, char *av[])
+{
+	const char *against = NULL;
+	long jobs;
+	char *p;
+	int c, retv;
+
+	tune.generations = DEFAULT_GENERATIONS;
+	tune.points = DEFAULT_POINTS;
+	tune.target = 1;
+	tune.lambda = 4 + (u32)(3 * log(N));
+	tune.seed = clock_ns();
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	tune.jobs = jobs > 0 ? jobs : 1;
+
+	for (;;) {
+		c = getopt_long(ac, av, "g:p:t:a:l:j:s:", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'g':
+			tune.generations = strtoul(optarg, &p, 10);
+			if (*p || !tune.generations) {
+				log_err("invalid generations: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 'p':
+			tune.points = strtoul(optarg, &p, 10);
+			if (*p || tune.points < 2) {
+				log_err("invalid points: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case 't':
+			tune.target = strtod(optarg, &p);
+			if (*p || tune.target < 0 || tune.target > 1) {
+				log_err("invalid target: %s (0-1)", optarg);
+				return 1;
+			}
+			break;
+
+		case 'a':
+			against = optarg;
+			break;
+
+		case 'l':
+			tune.lambda = strtoul(optarg, &p, 10);
+			if (*p || tune.lambda < 4 || tune.lambda > LAMBDA_MAX) {
+				log_err("invalid lambda: %s (4-%d)", optarg,
+					LAMBDA_MAX);
+				return 1;
+			}
+			break;
+
+		case 'j':
+			jobs = strtol(optarg, &p, 10);
+			if (*p || jobs < 1 || jobs > 1024) {
+				log_err("invalid number of jobs: %s", optarg);
+				return 1;
+			}
+			tune.jobs = jobs;
+			break;
+
+		case 's':
+			tune.seed = strtoull(optarg, &p, 10);
+			if (*p) {
+				log_err("invalid seed: %s", optarg);
+				return 1;
+			}
+			break;
+
+		case OPT_LOG_LEVEL:
+			if (log_set_level_name(optarg) != 0)
+				return 1;
+			break;
+
+		case 'h':
+			printf(USAGE_FMT, *av, DEFAULT_GENERATIONS, 
+			       DEFAULT_POINTS, 4 + (int)(3 * log(N)));
+			return 0;
+
+		case '?':
+			printf("Try `%s --help' for more information\n", 
+			       av[0]);
+			return 1;
+		}
+	}
+
+	if (ac - optind != 1) {
+		printf(USAGE_FMT, *av, DEFAULT_GENERATIONS, DEFAULT_POINTS,
+		       4 + (int)(3 * log(N)));
+		return 1;
+	}
+
+	tune.against = ai_default;
+	if (against && ai_load(against, &tune.against) != 0)
+		return 1;
+	tune.rng = tune.seed;
+
+	log_init();
+	retv = run(av[optind]);
+	log_quit();
+
+	return retv != 0;
+}
@@ -24,6 +24,7 @@
 
 static struct {
 	bool	     init;
+	bool	     event_thread;
 	int	     flags;
 	SDL_Surface *screen;
 } video;
@@ -35,7 +36,14 @@ int video_init(void)
 		return 0;
 	}
 
-	if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+	/*
+	 * Let SDL pump events on its own thread where the platform allows
+	 * it, so that input is collected while the game thread sleeps.
+	 */
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_EVENTTHREAD) == 0) {
+		video.event_thread = 1;
+	}
+	else if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
 		log_err("could not initialize video subsystem: %s",
 			  SDL_GetError());
 		
@@ -50,6 +58,9 @@ int video_init(void)
 INLINE void video_quit(void)
 {
 	SDL_QuitSubSystem(SDL_INIT_VIDEO);
+	video.init = 0;
+	video.event_thread = 0;
+	video.flags = 0;
 }
 
 int video_set_icon(const char *bmp_path)
@@ -163,6 +174,11 @@ INLINE u32 video_get_flags(void)
 	return video.flags;
 }
 
+INLINE bool video_has_event_thread(void)
+{
+	return video.event_thread;
+}
+
 INLINE u8 video_get_bpp(void)
 {
 	return video.screen->format->BitsPerPixel;
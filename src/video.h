@@ -38,6 +38,7 @@ u16  video_get_width       (void);
 u16  video_get_height      (void);
 u32  video_get_flags       (void);
 u8   video_get_bpp	   (void);
+bool video_has_event_thread (void);
 u32  video_get_pixel       (s16 x, s16 y);
 
 #endif /* !VIDEO_H */